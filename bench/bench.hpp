@@ -0,0 +1,114 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_BENCH
+#define PURINE_BENCH
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/common.hpp"
+#include "operations/tensor.hpp"
+
+using std::function;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief collects timings of benchmark cases and writes them as json,
+     * one object per case, so that runs can be diffed for regressions.
+     */
+    class Bench {
+        protected:
+            struct Result {
+                string group;
+                string name;
+                string shape;
+                int iters;
+                double min_us;
+                double median_us;
+                double mean_us;
+                double flops;
+            };
+            vector<Result> results_;
+        public:
+            // fn is called warmup times untimed, then iters times.
+            // flops (per call) is optional, gflops is reported when given.
+            void run(const string& group, const string& name,
+                    const string& shape, const function<void()>& fn,
+                    double flops = 0, int iters = 20, int warmup = 3) {
+                for (int i = 0; i < warmup; ++i) {
+                    fn();
+                }
+                vector<double> times(iters);
+                for (int i = 0; i < iters; ++i) {
+                    auto start = std::chrono::steady_clock::now();
+                    fn();
+                    times[i] = std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - start).count();
+                }
+                std::sort(times.begin(), times.end());
+                double sum = 0;
+                for (double t : times) {
+                    sum += t;
+                }
+                Result r = { group, name, shape, iters, times[0],
+                    times[iters / 2], sum / iters, flops };
+                results_.push_back(r);
+                MPI_LOG( << std::setw(12) << group << " " << std::setw(20)
+                        << name << " " << std::setw(20) << shape << " median "
+                        << std::setw(10) << r.median_us << " us"
+                        << (flops > 0 ? " " + std::to_string(
+                                flops / r.median_us / 1e3) + " GFLOPS" : "") );
+            }
+
+            void dump(const string& filename) const {
+                std::ofstream out(filename);
+                CHECK(out) << "can not open " << filename;
+                out << "[";
+                for (int i = 0; i < results_.size(); ++i) {
+                    const Result& r = results_[i];
+                    out << (i == 0 ? "\n" : ",\n") << "{\"group\":\""
+                        << r.group << "\",\"name\":\"" << r.name
+                        << "\",\"shape\":\"" << r.shape << "\",\"iters\":"
+                        << r.iters << ",\"min_us\":" << r.min_us
+                        << ",\"median_us\":" << r.median_us << ",\"mean_us\":"
+                        << r.mean_us;
+                    if (r.flops > 0) {
+                        out << ",\"gflops\":" << r.flops / r.median_us / 1e3;
+                    }
+                    out << "}";
+                }
+                out << "\n]\n";
+            }
+    };
+
+    inline string shape_string(const Size& s) {
+        std::ostringstream out;
+        out << s.num() << "x" << s.channels() << "x" << s.height() << "x"
+            << s.width();
+        return out.str();
+    }
+
+    // a cpu tensor filled with uniform random values in [lo, hi)
+    inline shared_ptr<Tensor> random_tensor(const Size& size, DTYPE lo = -1.,
+            DTYPE hi = 1.) {
+        shared_ptr<Tensor> t(new Tensor(current_rank(), -1, size));
+        DTYPE* data = t->mutable_cpu_data();
+        for (int i = 0; i < size.count(); ++i) {
+            data[i] = lo + (hi - lo) * ((*caffe_rng())() % 1000000) / 1e6;
+        }
+        return t;
+    }
+
+}
+
+#endif
@@ -0,0 +1,200 @@
+// Copyright Lin Min 2015
+// macro benchmarks of graphs: scheduling overhead, cross rank copies and a
+// full cpu network iteration.
+//   mpirun -np 2 bench_graphs [result.json]
+// the copy benchmarks are skipped when run with a single rank.
+
+#include <mpi.h>
+#include <glog/logging.h>
+
+#include "bench/bench.hpp"
+#include "composite/composite.hpp"
+#include "dispatch/blob.hpp"
+#include "dispatch/graph_template.hpp"
+#include "dispatch/op_template.hpp"
+#include "dispatch/runnable.hpp"
+#include "operations/include/eltwise.hpp"
+#include "operations/include/random.hpp"
+
+using namespace purine;
+
+typedef vector<Blob*> B;
+
+int world_size() {
+    int size;
+    MPI_CHECK(MPI_Comm_size(MPI_COMM_WORLD, &size));
+    return size;
+}
+
+// per op cost of the dispatcher: a long chain and a wide fan out of tiny ops
+void bench_scheduling(Bench* bench) {
+    for (int length : { 16, 256 }) {
+        Runnable chain;
+        Blob* blob = chain.create("b0", 0, -1, { 1, 1, 1, 1 });
+        *chain.create<Constant>("init", 0, -1, "main",
+                Constant::param_tuple(1.)) >> B{ blob };
+        for (int i = 0; i < length; ++i) {
+            Blob* next = chain.create("b" + to_string(i + 1), 0, -1,
+                    { 1, 1, 1, 1 });
+            B{ blob } >> *chain.create<Scale>("scale" + to_string(i), 0, -1,
+                    "main", Scale::param_tuple(1.)) >> B{ next };
+            blob = next;
+        }
+        bench->run("scheduling", "chain", to_string(length) + " ops",
+                [&]() { chain.run(); });
+    }
+    for (int width : { 16, 256 }) {
+        Runnable fan;
+        Blob* src = fan.create("src", 0, -1, { 1, 1, 1, 1 });
+        *fan.create<Constant>("init", 0, -1, "main",
+                Constant::param_tuple(1.)) >> B{ src };
+        for (int i = 0; i < width; ++i) {
+            B{ src } >> *fan.create<Scale>("scale" + to_string(i), 0, -1,
+                    "main", Scale::param_tuple(1.))
+                >> B{ fan.create("dst" + to_string(i), 0, -1, { 1, 1, 1, 1 }) };
+        }
+        bench->run("scheduling", "fan_out", to_string(width) + " ops",
+                [&]() { fan.run(); });
+    }
+}
+
+// Copy, Distribute and Aggregate between the cpus of the local ranks.
+// every rank builds the same graph and runs its own part of it.
+void bench_copy(Bench* bench) {
+    int ranks = world_size();
+    if (ranks < 2) {
+        MPI_LOG( << "single rank, skipping copy benchmarks" );
+        return;
+    }
+    for (int count : { 1 << 16, 1 << 22 }) {
+        Size size = { count >> 10, 1, 1, 1 << 10 };
+        string shape = shape_string(size) + " " + to_string(ranks) + " ranks";
+        {
+            Runnable g;
+            Blob* src = g.create("src", 0, -1, size);
+            Blob* dst = g.create("dst", 1, -1, size);
+            B{ src } >> *g.createAny<Copy>("copy", Copy::param_tuple(1, -1))
+                >> B{ dst };
+            bench->run("copy", "Copy", shape, [&]() {
+                    g.run();
+                    MPI_CHECK(MPI_Barrier(MPI_COMM_WORLD)); },
+                    2. * count * sizeof(DTYPE));
+        }
+        {
+            Runnable g;
+            Blob* src = g.create("src", 0, -1, size);
+            vector<pair<int, int> > dests;
+            B dst;
+            for (int r = 0; r < ranks; ++r) {
+                dests.push_back({ r, -1 });
+                dst.push_back(g.create("dst" + to_string(r), r, -1, size));
+            }
+            B{ src } >> *g.createAny<Distribute>("distribute",
+                    Distribute::param_tuple(dests)) >> dst;
+            bench->run("copy", "Distribute", shape, [&]() {
+                    g.run();
+                    MPI_CHECK(MPI_Barrier(MPI_COMM_WORLD)); });
+        }
+        {
+            Runnable g;
+            B src;
+            for (int r = 0; r < ranks; ++r) {
+                Blob* b = g.create("src" + to_string(r), r, -1, size);
+                *g.create<Constant>("init" + to_string(r), r, -1, "main",
+                        Constant::param_tuple(1.)) >> B{ b };
+                src.push_back(b);
+            }
+            Blob* dst = g.create("dst", 0, -1, size);
+            src >> *g.createAny<Aggregate>("aggregate",
+                    Aggregate::param_tuple(Aggregate::SUM, 0, -1)) >> B{ dst };
+            bench->run("copy", "Aggregate", shape, [&]() {
+                    g.run();
+                    MPI_CHECK(MPI_Barrier(MPI_COMM_WORLD)); });
+        }
+    }
+}
+
+// forward and backward of a fully connected network on the cpu
+class MLP : public Runnable {
+    protected:
+        Blob* data_;
+        Blob* label_;
+        vector<Layer*> layers_;
+    public:
+        MLP(int batch, const vector<int>& hidden) : Runnable(0, -1) {
+            data_ = create("data", { batch, hidden[0], 1, 1 });
+            Blob* data_diff = create("data_diff", { batch, hidden[0], 1, 1 });
+            label_ = create("label", { batch, 1, 1, 1 });
+            for (int i = 1; i < hidden.size(); ++i) {
+                layers_.push_back(createGraph<InnerProdLayer>("fc"
+                            + to_string(i), InnerProdLayer::param_tuple(
+                                hidden[i], "")));
+            }
+            SoftmaxLossLayer* loss = createGraph<SoftmaxLossLayer>("loss",
+                    SoftmaxLossLayer::param_tuple(1.));
+            B{ data_, data_diff } >> *layers_[0];
+            for (int i = 1; i < layers_.size(); ++i) {
+                *layers_[i - 1] >> *layers_[i];
+            }
+            loss->set_label(label_);
+            *layers_.back() >> *loss;
+        }
+
+        // random data and weights, zero biases and labels i % classes
+        void init(int classes) {
+            Runnable initializer(0, -1);
+            B data = { initializer.create("data", data_->shared_tensor()) };
+            *initializer.create<Gaussian>("init_data", "main",
+                    Gaussian::param_tuple(0., 1.)) >> data;
+            for (int i = 0; i < layers_.size(); ++i) {
+                vector<Blob*> weight = layers_[i]->weight_data();
+                B w = { initializer.create("weight",
+                        weight[0]->shared_tensor()) };
+                B b = { initializer.create("bias", weight[1]->shared_tensor()) };
+                *initializer.create<Gaussian>("init_weight", "main",
+                        Gaussian::param_tuple(0., 0.05)) >> w;
+                *initializer.create<Constant>("init_bias", "main",
+                        Constant::param_tuple(0.)) >> b;
+            }
+            initializer.run();
+            DTYPE* label = label_->tensor()->mutable_cpu_data();
+            for (int i = 0; i < label_->tensor()->size().num(); ++i) {
+                label[i] = i % classes;
+            }
+        }
+};
+
+void bench_network(Bench* bench) {
+    if (current_rank() != 0) {
+        return;
+    }
+    for (int batch : { 64, 256 }) {
+        vector<int> hidden = { 784, 1024, 1024, 10 };
+        MLP mlp(batch, hidden);
+        mlp.init(hidden.back());
+        double flops = 0;
+        for (int i = 1; i < hidden.size(); ++i) {
+            // forward, backward data and backward weight
+            flops += 3 * 2. * batch * hidden[i - 1] * hidden[i];
+        }
+        bench->run("network", "mlp", "batch " + to_string(batch) + " 784-1024-1024-10",
+                [&]() { mlp.run(); }, flops, 10, 2);
+    }
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+    int ret;
+    MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    Bench bench;
+    if (current_rank() == 0) {
+        bench_scheduling(&bench);
+    }
+    bench_copy(&bench);
+    bench_network(&bench);
+    if (current_rank() == 0) {
+        bench.dump(argc > 1 ? argv[1] : "bench_graphs.json");
+    }
+    MPI_CHECK(MPI_Finalize());
+    return 0;
+}
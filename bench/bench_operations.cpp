@@ -0,0 +1,259 @@
+// Copyright Lin Min 2015
+// micro benchmarks of Operation::compute_cpu
+//   mpirun -np 1 bench_operations [result.json]
+
+#include <mpi.h>
+#include <lmdb.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glog/logging.h>
+#include <opencv2/opencv.hpp>
+
+#include "bench/bench.hpp"
+#include "caffeine/io.hpp"
+#include "caffeine/proto/caffe.pb.h"
+#include "operations/include/conv.hpp"
+#include "operations/include/eltwise.hpp"
+#include "operations/include/image_label.hpp"
+#include "operations/include/inner.hpp"
+#include "operations/include/mem_copy.hpp"
+#include "operations/include/random.hpp"
+#include "operations/include/softmax.hpp"
+
+using namespace purine;
+using caffe::Datum;
+
+typedef vector<Tensor*> T;
+
+void bench_inner(Bench* bench) {
+    // { num, input dim, output dim }
+    vector<vector<int> > shapes = {
+        { 64, 1024, 1024 }, { 128, 4096, 1000 }, { 256, 9216, 4096 } };
+    for (const vector<int>& s : shapes) {
+        shared_ptr<Tensor> bottom = random_tensor({ s[0], s[1], 1, 1 });
+        shared_ptr<Tensor> weight = random_tensor({ s[2], s[1], 1, 1 });
+        shared_ptr<Tensor> top = random_tensor({ s[0], s[2], 1, 1 });
+        string shape = to_string(s[0]) + "x" + to_string(s[1]) + "x"
+            + to_string(s[2]);
+        double flops = 2. * s[0] * s[1] * s[2];
+        Inner up({ bottom.get(), weight.get() }, { top.get() }, tuple<>());
+        bench->run("inner", "Inner", shape, [&]() { up.compute_cpu({ false }); },
+                flops);
+        InnerDown down({ top.get(), weight.get() }, { bottom.get() }, tuple<>());
+        bench->run("inner", "InnerDown", shape,
+                [&]() { down.compute_cpu({ false }); }, flops);
+        InnerWeight w({ top.get(), bottom.get() }, { weight.get() }, tuple<>());
+        bench->run("inner", "InnerWeight", shape,
+                [&]() { w.compute_cpu({ false }); }, flops);
+    }
+}
+
+// 3x3 stride 1 convolutions of inception and nin3, each cpu algorithm
+void bench_conv(Bench* bench) {
+    // { num, channels, size, filters }
+    vector<vector<int> > shapes = {
+        { 32, 96, 28, 128 }, { 32, 192, 8, 192 }, { 32, 160, 14, 320 } };
+    vector<ConvCpu::Algo> algos = { ConvCpu::IM2COL, ConvCpu::WINOGRAD_2X2,
+        ConvCpu::WINOGRAD_4X4, ConvCpu::DIRECT };
+    for (const vector<int>& s : shapes) {
+        shared_ptr<Tensor> bottom = random_tensor({ s[0], s[1], s[2], s[2] });
+        shared_ptr<Tensor> weight = random_tensor({ s[3], s[1], 3, 3 });
+        shared_ptr<Tensor> top = random_tensor({ s[0], s[3], s[2], s[2] });
+        string shape = shape_string(bottom->size()) + "x" + to_string(s[3]);
+        double flops = 2. * s[0] * s[1] * s[2] * s[2] * s[3] * 9;
+        Conv::param_tuple args(1, 1, 1, 1);
+        for (ConvCpu::Algo algo : algos) {
+            ConvCpu::set_algo(algo);
+            Conv up({ bottom.get(), weight.get() }, { top.get() }, args);
+            bench->run("conv", "Conv_" + ConvCpu::name(algo), shape,
+                    [&]() { up.compute_cpu({ false }); }, flops, 5, 1);
+            ConvDown down({ top.get(), weight.get() }, { bottom.get() }, args);
+            bench->run("conv", "ConvDown_" + ConvCpu::name(algo), shape,
+                    [&]() { down.compute_cpu({ false }); }, flops, 5, 1);
+            ConvWeight w({ top.get(), bottom.get() }, { weight.get() }, args);
+            bench->run("conv", "ConvWeight_" + ConvCpu::name(algo), shape,
+                    [&]() { w.compute_cpu({ false }); }, flops, 5, 1);
+        }
+    }
+    ConvCpu::set_algo(ConvCpu::AUTO);
+}
+
+// 1x1 convolutions of the nin mlpconv and the inception reduce branches
+void bench_conv1x1(Bench* bench) {
+    // { num, channels, size, filters }
+    vector<vector<int> > shapes = {
+        { 32, 192, 32, 160 }, { 32, 256, 28, 64 }, { 32, 832, 7, 256 } };
+    for (const vector<int>& s : shapes) {
+        shared_ptr<Tensor> bottom = random_tensor({ s[0], s[1], s[2], s[2] });
+        shared_ptr<Tensor> weight = random_tensor({ s[3], s[1], 1, 1 });
+        shared_ptr<Tensor> top = random_tensor({ s[0], s[3], s[2], s[2] });
+        string shape = shape_string(bottom->size()) + "x" + to_string(s[3]);
+        double flops = 2. * s[0] * s[1] * s[2] * s[2] * s[3];
+        Conv::param_tuple args(0, 0, 1, 1);
+        Conv up({ bottom.get(), weight.get() }, { top.get() }, args);
+        bench->run("conv1x1", "Conv", shape,
+                [&]() { up.compute_cpu({ false }); }, flops, 5, 1);
+        ConvDown down({ top.get(), weight.get() }, { bottom.get() }, args);
+        bench->run("conv1x1", "ConvDown", shape,
+                [&]() { down.compute_cpu({ false }); }, flops, 5, 1);
+        ConvWeight w({ top.get(), bottom.get() }, { weight.get() }, args);
+        bench->run("conv1x1", "ConvWeight", shape,
+                [&]() { w.compute_cpu({ false }); }, flops, 5, 1);
+    }
+}
+
+void bench_eltwise(Bench* bench) {
+    for (int count : { 1 << 16, 1 << 20, 1 << 24 }) {
+        Size size = { count >> 10, 1, 1, 1 << 10 };
+        shared_ptr<Tensor> a = random_tensor(size);
+        shared_ptr<Tensor> b = random_tensor(size);
+        shared_ptr<Tensor> c = random_tensor(size);
+        string shape = shape_string(size);
+        Sum sum({ a.get(), b.get() }, { c.get() }, tuple<>());
+        bench->run("eltwise", "Sum", shape, [&]() { sum.compute_cpu({ false }); });
+        Mul mul({ a.get(), b.get() }, { c.get() }, tuple<>());
+        bench->run("eltwise", "Mul", shape, [&]() { mul.compute_cpu({ false }); });
+        WeightedSum wsum({ a.get(), b.get() }, { c.get() },
+                WeightedSum::param_tuple(vector<DTYPE>{ 0.9, -0.01 }));
+        bench->run("eltwise", "WeightedSum", shape,
+                [&]() { wsum.compute_cpu({ false }); });
+        Scale scale({ a.get() }, { c.get() }, Scale::param_tuple(0.5));
+        bench->run("eltwise", "Scale", shape,
+                [&]() { scale.compute_cpu({ false }); });
+    }
+}
+
+// Softmax itself has no cpu path, the cpu side of the loss layer is timed.
+void bench_softmax(Bench* bench) {
+    for (const vector<int>& s : vector<vector<int> >{ { 128, 10 },
+            { 128, 1000 }, { 256, 1000 } }) {
+        Size size = { s[0], s[1], 1, 1 };
+        shared_ptr<Tensor> prob = random_tensor(size, 0., 1.);
+        shared_ptr<Tensor> label = random_tensor({ s[0], 1, 1, 1 }, 0., 0.);
+        for (int i = 0; i < s[0]; ++i) {
+            label->mutable_cpu_data()[i] = i % s[1];
+        }
+        shared_ptr<Tensor> loss = random_tensor({ 1, 1, 1, 1 });
+        shared_ptr<Tensor> lambda = random_tensor({ 1, 1, 1, 1 }, 1., 1.);
+        shared_ptr<Tensor> diff = random_tensor(size);
+        string shape = shape_string(size);
+        SoftmaxLoss fwd({ prob.get(), label.get() }, { loss.get() }, tuple<>());
+        bench->run("softmax", "SoftmaxLoss", shape,
+                [&]() { fwd.compute_cpu({ false }); });
+        SoftmaxLossDown bwd({ prob.get(), label.get(), lambda.get() },
+                { diff.get() }, tuple<>());
+        bench->run("softmax", "SoftmaxLossDown", shape,
+                [&]() { bwd.compute_cpu({ false }); });
+    }
+}
+
+void bench_random(Bench* bench) {
+    for (int count : { 1 << 16, 1 << 20 }) {
+        Size size = { count >> 10, 1, 1, 1 << 10 };
+        shared_ptr<Tensor> t = random_tensor(size);
+        string shape = shape_string(size);
+        Gaussian gaussian({}, { t.get() }, Gaussian::param_tuple(0., 0.01));
+        bench->run("random", "Gaussian", shape,
+                [&]() { gaussian.compute_cpu({ false }); });
+        Uniform uniform({}, { t.get() }, Uniform::param_tuple(-0.1, 0.1));
+        bench->run("random", "Uniform", shape,
+                [&]() { uniform.compute_cpu({ false }); });
+        Constant constant({}, { t.get() }, Constant::param_tuple(0.));
+        bench->run("random", "Constant", shape,
+                [&]() { constant.compute_cpu({ false }); });
+        Bernoulli bernoulli({}, { t.get() }, Bernoulli::param_tuple(0.5));
+        bench->run("random", "Bernoulli", shape,
+                [&]() { bernoulli.compute_cpu({ false }); });
+    }
+}
+
+void bench_mem_copy(Bench* bench) {
+    for (int count : { 1 << 16, 1 << 20, 1 << 24 }) {
+        Size size = { count >> 10, 1, 1, 1 << 10 };
+        shared_ptr<Tensor> src = random_tensor(size);
+        shared_ptr<Tensor> dst = random_tensor(size);
+        MemCopy copy({ src.get() }, { dst.get() }, tuple<>());
+        bench->run("mem_copy", "MemCopy", shape_string(size),
+                [&]() { copy.compute_cpu({ false }); },
+                2. * count * sizeof(DTYPE));
+    }
+}
+
+// write num random 3 x size x size datums to a fresh lmdb at path
+void make_lmdb(const string& path, int num, int size, bool encoded) {
+    MDB_env* env;
+    MDB_dbi dbi;
+    MDB_txn* txn;
+    CHECK_EQ(mkdir(path.c_str(), 0744), 0) << "mkdir " << path << " failed";
+    CHECK_EQ(mdb_env_create(&env), MDB_SUCCESS);
+    CHECK_EQ(mdb_env_set_mapsize(env, 1099511627776), MDB_SUCCESS);
+    CHECK_EQ(mdb_env_open(env, path.c_str(), 0, 0664), MDB_SUCCESS);
+    CHECK_EQ(mdb_txn_begin(env, NULL, 0, &txn), MDB_SUCCESS);
+    CHECK_EQ(mdb_open(txn, NULL, 0, &dbi), MDB_SUCCESS);
+    cv::Mat img(size, size, CV_8UC3);
+    Datum datum;
+    string value;
+    for (int i = 0; i < num; ++i) {
+        cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+        caffe::CVMatToDatum(img, &datum);
+        if (encoded) {
+            vector<uchar> buf;
+            cv::imencode(".jpg", img, buf);
+            datum.set_data(string(buf.begin(), buf.end()));
+            datum.set_encoded(true);
+        }
+        datum.set_label(i % 10);
+        datum.SerializeToString(&value);
+        string key = to_string(i);
+        MDB_val mdb_key = { key.size(), &key[0] };
+        MDB_val mdb_value = { value.size(), &value[0] };
+        CHECK_EQ(mdb_put(txn, dbi, &mdb_key, &mdb_value, 0), MDB_SUCCESS);
+    }
+    CHECK_EQ(mdb_txn_commit(txn), MDB_SUCCESS);
+    mdb_close(env, dbi);
+    mdb_env_close(env);
+}
+
+void bench_image_label(Bench* bench) {
+    const int batch = 64;
+    const int crop = 224;
+    char dir[] = "/tmp/purine_bench_XXXXXX";
+    CHECK(mkdtemp(dir) != NULL);
+    string raw = string(dir) + "/raw";
+    string jpeg = string(dir) + "/jpeg";
+    make_lmdb(raw, 4 * batch, crop, false);
+    make_lmdb(jpeg, 4 * batch, crop, true);
+    shared_ptr<Tensor> image = random_tensor({ batch, 3, crop, crop });
+    shared_ptr<Tensor> label = random_tensor({ batch, 1, 1, 1 });
+    string shape = shape_string(image->size());
+    vector<std::tuple<string, string, int> > cases = {
+        std::make_tuple("ImageLabel", raw, DatasetCache::NONE),
+        std::make_tuple("ImageLabel_jpeg", jpeg, DatasetCache::NONE),
+        std::make_tuple("ImageLabel_cached", raw, DatasetCache::MEMORY) };
+    for (const auto& c : cases) {
+        ImageLabel op({}, { image.get(), label.get() },
+                ImageLabel::param_tuple(std::get<1>(c), "", true, true, true,
+                    -1, 1., 0., 0, batch, batch, crop, std::get<2>(c)));
+        bench->run("image_label", std::get<0>(c), shape,
+                [&]() { op.compute_cpu({ false, false }); }, 0, 10, 1);
+    }
+    CHECK_EQ(system(("rm -rf " + string(dir)).c_str()), 0);
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+    int ret;
+    MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    Bench bench;
+    bench_inner(&bench);
+    bench_conv(&bench);
+    bench_conv1x1(&bench);
+    bench_eltwise(&bench);
+    bench_softmax(&bench);
+    bench_random(&bench);
+    bench_mem_copy(&bench);
+    bench_image_label(&bench);
+    bench.dump(argc > 1 ? argv[1] : "bench_operations.json");
+    MPI_CHECK(MPI_Finalize());
+    return 0;
+}
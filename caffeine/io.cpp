@@ -85,6 +85,41 @@ namespace caffe {
         datum->set_data(buffer);
     }
 
+    bool DecodeDatumInPlace(Datum* datum, bool is_color, cv::Mat* buf) {
+        if (!datum->encoded()) {
+            return true;
+        }
+        const string& data = datum->data();
+        int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE);
+        cv::imdecode(cv::Mat(1, data.size(), CV_8UC1, (void*)data.data()),
+                cv_read_flag, buf);
+        if (!buf->data) {
+            LOG(ERROR) << "Could not decode datum ";
+            return false;
+        }
+        int channels = buf->channels();
+        int height = buf->rows;
+        int width = buf->cols;
+        // reuse the capacity of the data string for the decoded pixels
+        string* out = datum->mutable_data();
+        out->resize(channels * height * width);
+        for (int h = 0; h < height; ++h) {
+            const uchar* ptr = buf->ptr<uchar>(h);
+            int img_index = 0;
+            for (int w = 0; w < width; ++w) {
+                for (int c = 0; c < channels; ++c) {
+                    (*out)[(c * height + h) * width + w] =
+                        static_cast<char>(ptr[img_index++]);
+                }
+            }
+        }
+        datum->set_channels(channels);
+        datum->set_height(height);
+        datum->set_width(width);
+        datum->set_encoded(false);
+        return true;
+    }
+
     cv::Mat dtype2mat(DTYPE* in, int channels, int rows, int cols){
         if(channels == 3){
             cv::Mat out(rows, cols, CV_32FC3);
@@ -46,6 +46,10 @@ namespace caffe {
     cv::Mat DatumToCVMat(const Datum& datum, bool is_color);
     void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
 
+    // decode an encoded (jpeg/png) datum in place into raw CHW bytes.
+    // buf is scratch space for imdecode and is reused across calls.
+    bool DecodeDatumInPlace(Datum* datum, bool is_color, cv::Mat* buf);
+
     void mat2dtype(cv::Mat& in, std::vector<DTYPE>& out);
     cv::Mat dtype2mat(DTYPE* in, int channels, int rows, int cols);
 
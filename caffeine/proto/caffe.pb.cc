@@ -57,13 +57,14 @@ void protobuf_AssignDesc_caffe_2eproto() {
       ::google::protobuf::MessageFactory::generated_factory(),
       sizeof(BlobProto));
   Datum_descriptor_ = file->message_type(1);
-  static const int Datum_offsets_[6] = {
+  static const int Datum_offsets_[7] = {
     GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(Datum, channels_),
     GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(Datum, height_),
     GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(Datum, width_),
     GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(Datum, data_),
     GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(Datum, label_),
     GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(Datum, float_data_),
+    GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(Datum, encoded_),
   };
   Datum_reflection_ =
     new ::google::protobuf::internal::GeneratedMessageReflection(
@@ -113,10 +114,10 @@ void protobuf_AddDesc_caffe_2eproto() {
     "\n\013caffe.proto\022\005caffe\"y\n\tBlobProto\022\016\n\003num"
     "\030\001 \001(\005:\0010\022\023\n\010channels\030\002 \001(\005:\0010\022\021\n\006height"
     "\030\003 \001(\005:\0010\022\020\n\005width\030\004 \001(\005:\0010\022\020\n\004data\030\005 \003("
-    "\002B\002\020\001\022\020\n\004diff\030\006 \003(\002B\002\020\001\"i\n\005Datum\022\020\n\010chan"
-    "nels\030\001 \001(\005\022\016\n\006height\030\002 \001(\005\022\r\n\005width\030\003 \001("
-    "\005\022\014\n\004data\030\004 \001(\014\022\r\n\005label\030\005 \001(\005\022\022\n\nfloat_"
-    "data\030\006 \003(\002", 250);
+    "\002B\002\020\001\022\020\n\004diff\030\006 \003(\002B\002\020\001\"\201\001\n\005Datum\022\020\n\010cha"
+    "nnels\030\001 \001(\005\022\016\n\006height\030\002 \001(\005\022\r\n\005width\030\003 \001"
+    "(\005\022\014\n\004data\030\004 \001(\014\022\r\n\005label\030\005 \001(\005\022\022\n\nfloat"
+    "_data\030\006 \003(\002\022\026\n\007encoded\030\007 \001(\010:\005false", 275);
   ::google::protobuf::MessageFactory::InternalRegisterGeneratedFile(
     "caffe.proto", &protobuf_RegisterTypes);
   BlobProto::default_instance_ = new BlobProto();
@@ -596,6 +597,7 @@ const int Datum::kWidthFieldNumber;
 const int Datum::kDataFieldNumber;
 const int Datum::kLabelFieldNumber;
 const int Datum::kFloatDataFieldNumber;
+const int Datum::kEncodedFieldNumber;
 #endif  // !_MSC_VER
 
 Datum::Datum()
@@ -619,6 +621,7 @@ void Datum::SharedCtor() {
   width_ = 0;
   data_ = const_cast< ::std::string*>(&::google::protobuf::internal::kEmptyString);
   label_ = 0;
+  encoded_ = false;
   ::memset(_has_bits_, 0, sizeof(_has_bits_));
 }
 
@@ -666,6 +669,7 @@ void Datum::Clear() {
       }
     }
     label_ = 0;
+    encoded_ = false;
   }
   float_data_.Clear();
   ::memset(_has_bits_, 0, sizeof(_has_bits_));
@@ -773,6 +777,22 @@ bool Datum::MergePartialFromCodedStream(
           goto handle_uninterpreted;
         }
         if (input->ExpectTag(53)) goto parse_float_data;
+        if (input->ExpectTag(56)) goto parse_encoded;
+        break;
+      }
+
+      // optional bool encoded = 7 [default = false];
+      case 7: {
+        if (::google::protobuf::internal::WireFormatLite::GetTagWireType(tag) ==
+            ::google::protobuf::internal::WireFormatLite::WIRETYPE_VARINT) {
+         parse_encoded:
+          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
+                   bool, ::google::protobuf::internal::WireFormatLite::TYPE_BOOL>(
+                 input, &encoded_)));
+          set_has_encoded();
+        } else {
+          goto handle_uninterpreted;
+        }
         if (input->ExpectAtEnd()) return true;
         break;
       }
@@ -827,6 +847,11 @@ void Datum::SerializeWithCachedSizes(
       6, this->float_data(i), output);
   }
 
+  // optional bool encoded = 7 [default = false];
+  if (has_encoded()) {
+    ::google::protobuf::internal::WireFormatLite::WriteBool(7, this->encoded(), output);
+  }
+
   if (!unknown_fields().empty()) {
     ::google::protobuf::internal::WireFormat::SerializeUnknownFields(
         unknown_fields(), output);
@@ -868,6 +893,11 @@ void Datum::SerializeWithCachedSizes(
       WriteFloatToArray(6, this->float_data(i), target);
   }
 
+  // optional bool encoded = 7 [default = false];
+  if (has_encoded()) {
+    target = ::google::protobuf::internal::WireFormatLite::WriteBoolToArray(7, this->encoded(), target);
+  }
+
   if (!unknown_fields().empty()) {
     target = ::google::protobuf::internal::WireFormat::SerializeUnknownFieldsToArray(
         unknown_fields(), target);
@@ -914,6 +944,11 @@ int Datum::ByteSize() const {
           this->label());
     }
 
+    // optional bool encoded = 7 [default = false];
+    if (has_encoded()) {
+      total_size += 1 + 1;
+    }
+
   }
   // repeated float float_data = 6;
   {
@@ -964,6 +999,9 @@ void Datum::MergeFrom(const Datum& from) {
     if (from.has_label()) {
       set_label(from.label());
     }
+    if (from.has_encoded()) {
+      set_encoded(from.encoded());
+    }
   }
   mutable_unknown_fields()->MergeFrom(from.unknown_fields());
 }
@@ -993,6 +1031,7 @@ void Datum::Swap(Datum* other) {
     std::swap(data_, other->data_);
     std::swap(label_, other->label_);
     float_data_.Swap(&other->float_data_);
+    std::swap(encoded_, other->encoded_);
     std::swap(_has_bits_[0], other->_has_bits_[0]);
     _unknown_fields_.Swap(&other->_unknown_fields_);
     std::swap(_cached_size_, other->_cached_size_);
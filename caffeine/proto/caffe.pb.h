@@ -284,6 +284,13 @@ class Datum : public ::google::protobuf::Message {
   inline ::google::protobuf::RepeatedField< float >*
       mutable_float_data();
 
+  // optional bool encoded = 7 [default = false];
+  inline bool has_encoded() const;
+  inline void clear_encoded();
+  static const int kEncodedFieldNumber = 7;
+  inline bool encoded() const;
+  inline void set_encoded(bool value);
+
   // @@protoc_insertion_point(class_scope:caffe.Datum)
  private:
   inline void set_has_channels();
@@ -296,6 +303,8 @@ class Datum : public ::google::protobuf::Message {
   inline void clear_has_data();
   inline void set_has_label();
   inline void clear_has_label();
+  inline void set_has_encoded();
+  inline void clear_has_encoded();
 
   ::google::protobuf::UnknownFieldSet _unknown_fields_;
 
@@ -305,9 +314,10 @@ class Datum : public ::google::protobuf::Message {
   ::google::protobuf::int32 width_;
   ::google::protobuf::int32 label_;
   ::google::protobuf::RepeatedField< float > float_data_;
+  bool encoded_;
 
   mutable int _cached_size_;
-  ::google::protobuf::uint32 _has_bits_[(6 + 31) / 32];
+  ::google::protobuf::uint32 _has_bits_[(7 + 31) / 32];
 
   friend void  protobuf_AddDesc_caffe_2eproto();
   friend void protobuf_AssignDesc_caffe_2eproto();
@@ -648,6 +658,28 @@ Datum::mutable_float_data() {
   return &float_data_;
 }
 
+// optional bool encoded = 7 [default = false];
+inline bool Datum::has_encoded() const {
+  return (_has_bits_[0] & 0x00000040u) != 0;
+}
+inline void Datum::set_has_encoded() {
+  _has_bits_[0] |= 0x00000040u;
+}
+inline void Datum::clear_has_encoded() {
+  _has_bits_[0] &= ~0x00000040u;
+}
+inline void Datum::clear_encoded() {
+  encoded_ = false;
+  clear_has_encoded();
+}
+inline bool Datum::encoded() const {
+  return encoded_;
+}
+inline void Datum::set_encoded(bool value) {
+  set_has_encoded();
+  encoded_ = value;
+}
+
 
 // @@protoc_insertion_point(namespace_scope)
 
@@ -23,6 +23,13 @@ namespace purine {
             Update::param_tuple args_;
             Update* updator = NULL;
             DTYPE learning_rate_scale_;
+            // weight of the diff of each minion, summed if empty
+            vector<DTYPE> diff_weights_;
+            // quorum of the minions the update waits for, 0 for all
+            int quorum_ = 0;
+            int deadline_ = 0;
+            bool defer_ = false;
+            Aggregate* agg_ = NULL;
         public:
             typedef Update::param_tuple param_tuple;
             explicit AllReduce(int rank, int device, const param_tuple& args)
@@ -36,6 +43,26 @@ namespace purine {
             inline void set_learning_rate_scale(DTYPE scale){
                 learning_rate_scale_ = scale;
             }
+            // to be called before the weight_diffs are connected
+            inline void set_diff_weights(const vector<DTYPE>& weights) {
+                diff_weights_ = weights;
+            }
+            /**
+             * @brief update once quorum diffs arrived or deadline (us) passed
+             *        since the first one, late diffs are dropped or deferred
+             *        to the next update. to be called before the weight_diffs
+             *        are connected.
+             */
+            inline void set_quorum(int quorum, int deadline = 0,
+                    bool defer = false) {
+                quorum_ = quorum;
+                deadline_ = deadline;
+                defer_ = defer;
+            }
+            // counters of the late diffs, NULL without quorum
+            inline Op<QuorumSum>* quorum() {
+                return agg_ == NULL ? NULL : agg_->quorum();
+            }
             shared_ptr<Tensor> weight() { return weight_->shared_tensor(); }
             shared_ptr<Tensor> weight_diff() { return weight_diff_->shared_tensor(); }
             shared_ptr<Tensor> history() { return history_->shared_tensor(); }
@@ -54,8 +81,21 @@ namespace purine {
                 // agg bottom
                 /*weight_diff就是本次迭代产生的，如果是异步随机梯度下降，我们需要算出很多个weight_diff,然后累加起来*/
                 weight_diff_ = create("[weight_diff]", bottom_size);
-                Aggregate* agg = createAny<Aggregate>("agg_diff",
-                        Aggregate::param_tuple(Aggregate::SUM, rank_, device_));
+                Aggregate* agg;
+                if (quorum_ > 0) {
+                    agg = createAny<Aggregate>("agg_diff",
+                            Aggregate::param_tuple(Aggregate::QUORUM_SUM, rank_,
+                                device_), QuorumSum::param_tuple(quorum_, deadline_,
+                                    defer_, diff_weights_));
+                } else if (diff_weights_.size() == 0) {
+                    agg = createAny<Aggregate>("agg_diff",
+                            Aggregate::param_tuple(Aggregate::SUM, rank_, device_));
+                } else {
+                    agg = createAny<Aggregate>("agg_diff",
+                            Aggregate::param_tuple(Aggregate::WEIGHTED_SUM, rank_,
+                                device_), diff_weights_);
+                }
+                agg_ = agg;
 
                 bottom_ >> *agg >> vector<Blob*>{ weight_diff_ };
                 // create history, weight
@@ -28,7 +28,7 @@ namespace purine {
             public:
                 AsgdDataParallel(const vector<vector<int> >& locations);
                 virtual ~AsgdDataParallel() override {};
-                virtual void run_async() override;
+                virtual Iteration run_async() override;
                 virtual void run() override;
                 virtual void sync() override;
                 inline int fetch_count(){return fetch_count_->shared_tensor()->cpu_data()[0];}
@@ -301,7 +301,7 @@ namespace purine {
         }
 
     template <typename Net, typename PS>
-        void AsgdDataParallel<Net, PS>::run_async(){
+        Runnable::Iteration AsgdDataParallel<Net, PS>::run_async(){
             std::vector<std::thread>threads;
             for(auto& net : nets_){
                 if(net->is_empty() == false){
@@ -312,7 +312,7 @@ namespace purine {
                 }
             }
             for(auto& t : threads)t.join();
-            Runnable::run_async();
+            return Runnable::run_async();
         }
 
     template<typename Net, typename PS>
@@ -41,7 +41,7 @@ namespace purine {
             void clear_weight_diff();
             inline std::vector<Blob*>& get_weight_diff(){return weight_diff_sum_;}
             virtual void sync() override;
-            virtual void run_async() override;
+            virtual Iteration run_async() override;
             inline void set_period(double p){ 
                 period = p;
             }
@@ -129,10 +129,11 @@ namespace purine {
         }
 
     template<typename Net>
-        void asgd_net<Net>::run_async(){
+        Runnable::Iteration asgd_net<Net>::run_async(){
             feed();
-            Runnable::run_async();
+            Iteration iteration = Runnable::run_async();
             net_->fetch()->run_async();
+            return iteration;
         }
 
     template<typename Net>
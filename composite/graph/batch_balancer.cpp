@@ -0,0 +1,124 @@
+// Copyright Lin Min 2015
+#include <mpi.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <utility>
+
+#include "common/common.hpp"
+#include "composite/graph/batch_balancer.hpp"
+#include "dispatch/trace.hpp"
+
+namespace purine {
+
+    BatchBalancer::BatchBalancer(const vector<vector<int> >& locations,
+            int interval, int samples, double tolerance)
+        : locations_(locations), interval_(interval), samples_(samples),
+        tolerance_(tolerance) {
+            CHECK_GT(locations.size(), 0);
+            CHECK_GT(samples, 0);
+            CHECK_GE(interval, samples);
+            for (const vector<int>& loc : locations) {
+                CHECK_EQ(loc.size(), 3);
+                CHECK_GT(loc[2], 0);
+            }
+        }
+
+    int BatchBalancer::phase(int iter) const {
+        return (iter - 1) % interval_ + 1;
+    }
+
+    void BatchBalancer::begin(int iter) {
+        if (phase(iter) == interval_ - samples_ + 1) {
+            Tracer::clear();
+            Tracer::enable();
+        }
+    }
+
+    bool BatchBalancer::end(int iter) {
+        if (phase(iter) != interval_) {
+            return false;
+        }
+        Tracer::enable(false);
+        // compute time of the local replicas
+        vector<double> compute(locations_.size(), 0.);
+        for (const Tracer::Event& e : Tracer::events()) {
+            if (e.category != Tracer::COMPUTE) {
+                continue;
+            }
+            const string& name = Tracer::name(e.name);
+            if (name.compare(0, 7, "replica") != 0) {
+                continue;
+            }
+            int index = atoi(name.c_str() + 7);
+            if (index < locations_.size()
+                    && locations_[index][0] == current_rank()) {
+                compute[index] += double(e.end - e.begin) / samples_;
+            }
+        }
+        Tracer::clear();
+        compute_ = vector<double>(compute.size());
+        MPI_CHECK(MPI_Allreduce(&compute[0], &compute_[0], compute.size(),
+                    MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD));
+        double slowest = *std::max_element(compute_.begin(), compute_.end());
+        double fastest = *std::min_element(compute_.begin(), compute_.end());
+        if (fastest <= 0. || slowest <= fastest * (1. + tolerance_)) {
+            return false;
+        }
+        // samples per us of each replica
+        int total = 0;
+        vector<double> rates(locations_.size());
+        for (int i = 0; i < locations_.size(); ++i) {
+            total += locations_[i][2];
+            rates[i] = locations_[i][2] / compute_[i];
+        }
+        vector<int> batch = split(total, rates);
+        bool changed = false;
+        for (int i = 0; i < locations_.size(); ++i) {
+            changed = changed || batch[i] != locations_[i][2];
+            locations_[i][2] = batch[i];
+        }
+        return changed;
+    }
+
+    vector<int> BatchBalancer::split(int total, const vector<double>& rates) {
+        CHECK_GE(total, rates.size());
+        double sum = std::accumulate(rates.begin(), rates.end(), 0.);
+        CHECK_GT(sum, 0.);
+        // one sample each, the rest proportionally
+        int rest = total - rates.size();
+        vector<int> parts(rates.size());
+        vector<std::pair<double, int> > remainders(rates.size());
+        int assigned = 0;
+        for (int i = 0; i < rates.size(); ++i) {
+            double share = rest * rates[i] / sum;
+            parts[i] = 1 + int(share);
+            assigned += int(share);
+            remainders[i] = { share - int(share), i };
+        }
+        std::sort(remainders.rbegin(), remainders.rend());
+        for (int i = 0; i < rest - assigned; ++i) {
+            ++parts[remainders[i].second];
+        }
+        return parts;
+    }
+
+    string BatchBalancer::report() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        for (int i = 0; i < locations_.size(); ++i) {
+            out << "  replica" << i << " [" << locations_[i][0] << "]["
+                << (locations_[i][1] < 0 ? string("CPU") : "GPU"
+                        + std::to_string(locations_[i][1])) << "] batch "
+                << locations_[i][2];
+            if (i < compute_.size()) {
+                out << ", compute " << compute_[i] / 1000. << " ms";
+            }
+            out << std::endl;
+        }
+        return out.str();
+    }
+
+}
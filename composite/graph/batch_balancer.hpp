@@ -0,0 +1,77 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_BATCH_BALANCER
+#define PURINE_BATCH_BALANCER
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief rebalance the batch sizes of the replicas of DataParallel.
+     *
+     * With a fixed parallel_config the slowest replica sets the pace of
+     * every synchronous iteration. Every interval iterations, the balancer
+     * traces the last few iterations and measures the compute time of each
+     * replica (sum of the COMPUTE spans of the ops named "replica<i>::...",
+     * all the ranks are gathered with MPI). The global batch size is then
+     * split proportionally to the measured throughput of the replicas, so
+     * that they finish at the same time.
+     *
+     * The batch sizes are baked into the graphs, when end() returns true the
+     * caller rebuilds FetchImage and DataParallel from locations() and moves
+     * the weights with DataParallel::load_from. DataParallel weights the
+     * diffs of the replicas by their batch sizes.
+     *
+     *   balancer.begin(iter);
+     *   ... run_async, sync ...
+     *   if (balancer.end(iter)) { rebuild with balancer.locations() }
+     *
+     * Iterations are counted from 1, the balancer clears the Tracer before
+     * and after each measurement.
+     */
+    class BatchBalancer {
+        protected:
+            vector<vector<int> > locations_;
+            int interval_;
+            int samples_;
+            double tolerance_;
+            vector<double> compute_;
+        public:
+            /**
+             * @param locations { rank, device, batch_size } of the replicas
+             * @param interval iterations between two rebalancing
+             * @param samples iterations measured before rebalancing
+             * @param tolerance relative spread of the compute times below
+             *        which the batch sizes are kept
+             */
+            explicit BatchBalancer(const vector<vector<int> >& locations,
+                    int interval = 500, int samples = 5, double tolerance = 0.05);
+            // enables the tracing in the measured iterations
+            void begin(int iter);
+            // true if the batch sizes changed at this iteration
+            bool end(int iter);
+            inline const vector<vector<int> >& locations() const {
+                return locations_;
+            }
+            // us per iteration of each replica in the last measurement
+            inline const vector<double>& compute_time() const {
+                return compute_;
+            }
+            string report() const;
+            /**
+             * @brief split total into parts proportional to the rates, each
+             *        at least 1, rounded by largest remainder.
+             */
+            static vector<int> split(int total, const vector<double>& rates);
+        protected:
+            // 1 to interval
+            int phase(int iter) const;
+    };
+
+}
+
+#endif
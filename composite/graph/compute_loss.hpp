@@ -6,6 +6,7 @@
 #include <fstream>
 #include <set>
 #include "composite/composite.hpp"
+#include "dispatch/inference.hpp"
 
 using namespace std;
 
@@ -18,10 +19,16 @@ namespace purine {
                 vector<Blob*> labels_;
                 vector<Blob*> loss_;
                 vector<Blob*> weights_;
+                shared_ptr<Inference> inference_;
             public:
                 explicit ComputeLoss(int rank, int device, int batch_size);
                 virtual ~ComputeLoss() override {}
 
+                /**
+                 * @brief compile the graph for evaluation (see Inference),
+                 *        call before load and before the first run.
+                 */
+                void optimize();
                 void load(const string& filename);
                 void print_loss();
                 vector<DTYPE> get_loss();
@@ -100,6 +107,17 @@ namespace purine {
                 return ret;
             }
         }
+    template <typename Net>
+        void ComputeLoss<Net>::optimize() {
+            vector<Blob*> inputs = data_;
+            inputs.insert(inputs.end(), labels_.begin(), labels_.end());
+            vector<Blob*> outputs = loss_;
+            const vector<Blob*>& probs = net_->get_probs();
+            outputs.insert(outputs.end(), probs.begin(), probs.end());
+            inference_ = make_shared<Inference>(this, inputs, outputs);
+            MPI_LOG( << "Inference: " << inference_->report() );
+        }
+
     template <typename Net>
         void ComputeLoss<Net>::load(const string& filename) {
             Runnable loader(0, -1);
@@ -137,6 +155,9 @@ namespace purine {
                 }
             }
             loader.run();
+            if (inference_) {
+                inference_->fold();
+            }
             MPI_LOG( << "Snapshot loaded" );
         }
 
@@ -146,19 +146,42 @@ namespace purine {
             };
         }
 
+        if (agg_type_ == Aggregate::QUORUM_SUM) {
+            auto copy = createAny<Vectorize<Copy> >("agg_to_dest",
+                    vector<Copy::param_tuple>(bottom_.size(),
+                        Copy::param_tuple(top_[0]->rank(), top_[0]->device())));
+            vector<vector<Blob*> >{ bottom_ } >> *copy;
+            quorum_ = create<QuorumSum>("quorum_sum", top_[0]->rank(),
+                    top_[0]->device(), "main", quorum_args_);
+            copy->top()[0] >> *quorum_ >> top_;
+            return;
+        }
+        bool weighted = agg_type_ == Aggregate::WEIGHTED_SUM;
+        if (weighted) {
+            CHECK_EQ(weights_.size(), bottom_.size());
+        }
         map<int, Aggregate*> local_aggs;
         map<int, vector<Blob*> > local_blobs;
         vector<Blob*> dest_blobs;
+        vector<DTYPE> dest_weights;
         for (int i = 0; i < bottom_.size(); ++i) {
             if (bottom_[i]->rank() != top_[0]->rank() &&
                     local_aggs.count(bottom_[i]->rank()) == 0) {
                 local_aggs[bottom_[i]->rank()] = createAny<Aggregate>("local_agg",
-                        param_tuple(Type::SUM, bottom_[i]->rank(), -1));
+                        param_tuple(weighted ? Type::WEIGHTED_SUM : Type::SUM,
+                            bottom_[i]->rank(), -1));
                 local_blobs[bottom_[i]->rank()] = { bottom_[i] };
             } else if (bottom_[i]->rank() != top_[0]->rank()) {
                 local_blobs[bottom_[i]->rank()].push_back(bottom_[i]);
             } else {
                 dest_blobs.push_back(bottom_[i]);
+                if (weighted) {
+                    dest_weights.push_back(weights_[i]);
+                }
+                continue;
+            }
+            if (weighted) {
+                local_aggs[bottom_[i]->rank()]->weights_.push_back(weights_[i]);
             }
         }
 
@@ -178,7 +201,19 @@ namespace purine {
         vector<vector<Blob*> >{ dest_blobs } >> *copy;
         vector<Blob*> copied = copy->top()[0];
 
-        if (agg_type_ == Aggregate::SUM || bottom_.size() == 1) {
+        if (weighted) {
+            // the local aggs are weighted already
+            dest_weights.resize(copied.size(), 1.);
+            if (copied.size() > 1) {
+                copied >> *create<WeightedSum>("weighted_sum", top_[0]->rank(),
+                        top_[0]->device(), "main",
+                        WeightedSum::param_tuple(dest_weights)) >> top_;
+            } else {
+                top_[0]->share_from(copied[0]);
+                copied >> *create<Scale>("scale", top_[0]->rank(), top_[0]->device(),
+                        "main", Scale::param_tuple(dest_weights[0])) >> top_;
+            }
+        } else if (agg_type_ == Aggregate::SUM || bottom_.size() == 1) {
             if (copied.size() > 1){
                 copied >> *create<Sum>("sum", top_[0]->rank(), top_[0]->device(),
                         "main", Sum::param_tuple()) >> top_;
@@ -5,6 +5,7 @@
 
 #include <utility>
 #include "dispatch/graph_template.hpp"
+#include "dispatch/op.hpp"
 #include "composite/connectable.hpp"
 
 using std::pair;
@@ -56,21 +57,44 @@ namespace purine {
     /**
      * { blob1, blob2, ... } >> agg >> { dest }
      * rank and device are not required.
+     * WEIGHTED_SUM takes one weight per bottom, the blobs of a remote rank
+     * are weighted and summed on that rank before being sent.
+     * QUORUM_SUM does not wait for the stragglers, see Op<QuorumSum>. the
+     * bottoms are sent one by one (there is no local sum, which would wait
+     * for all the bottoms of a rank) and the late ones are counted by
+     * quorum().
      */
     class Aggregate : public Connectable {
         public:
             enum Type {
                 SUM,
-                AVERAGE
+                AVERAGE,
+                WEIGHTED_SUM,
+                QUORUM_SUM
             };
         protected:
             Type agg_type_;
+            vector<DTYPE> weights_;
+            QuorumSum::param_tuple quorum_args_;
+            Op<QuorumSum>* quorum_ = NULL;
             virtual void setup() override;
         public:
             typedef tuple<Type, int, int> param_tuple;
             Aggregate(const param_tuple& args) {
                 std::tie(agg_type_, rank_, device_) = args;
             }
+            Aggregate(const param_tuple& args, const vector<DTYPE>& weights)
+                : weights_(weights) {
+                std::tie(agg_type_, rank_, device_) = args;
+            }
+            Aggregate(const param_tuple& args,
+                    const QuorumSum::param_tuple& quorum_args)
+                : quorum_args_(quorum_args) {
+                std::tie(agg_type_, rank_, device_) = args;
+                CHECK_EQ(agg_type_, QUORUM_SUM);
+            }
+            // the op summing the bottoms, for its counters of late bottoms
+            inline Op<QuorumSum>* quorum() { return quorum_; }
             virtual ~Aggregate() override {}
     };
 
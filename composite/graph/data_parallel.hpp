@@ -14,6 +14,7 @@ namespace purine {
     template <typename Net, typename PS>
         class DataParallel : public Runnable {
             protected:
+                vector<vector<int> > locations_;
                 vector<Net*> nets_;
                 Vectorize<PS>* param_server_ = NULL;
                 vector<Blob*> data_;
@@ -21,6 +22,18 @@ namespace purine {
                 vector<Blob*> loss_;
                 vector<vector<Blob*> > new_weights_;
                 vector<vector<Blob*> > weights_;
+                int quorum_ = 0;
+                int deadline_ = 0;
+                bool defer_ = false;
+                // micro batches per update, the param server is in update_
+                // when more than one.
+                int accumulation_ = 1;
+                int micro_batch_ = 0;
+                shared_ptr<Runnable> update_;
+                // losses of the replicas, aggregated by setup_param_server
+                vector<vector<Blob*> > losses_;
+                void setup_loss();
+                void wait_replicas();
             public:
                 DataParallel(const vector<vector<int> >& locations);
                 virtual ~DataParallel() override {};
@@ -39,22 +52,104 @@ namespace purine {
                  */
                 void save(const string& filename);
 
+                /**
+                 * @brief take the weights and history of the param server of
+                 *        other (e.g. built with other batch sizes) and
+                 *        distribute the weights to the replicas.
+                 */
+                void load_from(DataParallel<Net, PS>* other);
+
+                /**
+                 * @brief weight of the diff of each replica, batch size
+                 *        relative to the mean batch size. empty when all the
+                 *        replicas have the same batch size.
+                 */
+                vector<DTYPE> replica_weights() const;
+
                 vector<DTYPE> loss();
                 void print_weight_info();
+
+                /**
+                 * @brief do not wait for the stragglers, the param server
+                 *        updates once quorum replicas sent their diffs (see
+                 *        AllReduce::set_quorum) and the loss is the mean
+                 *        over the replicas which arrived. the iteration of
+                 *        a rank still waits for the replicas of that rank,
+                 *        so the ranks of the fast replicas do not wait for
+                 *        a straggler of another rank. the new weights sent
+                 *        to the straggler keep it at most one generation
+                 *        behind. call before setup_param_server.
+                 */
+                inline void set_quorum(int quorum, int deadline = 0,
+                        bool defer = false) {
+                    quorum_ = quorum;
+                    deadline_ = deadline;
+                    defer_ = defer;
+                }
+                // late diffs of each replica, summed over the weights
+                void print_straggler_info();
+
+                /**
+                 * @brief accumulate the weight diffs of the replicas over
+                 *        micro_batches runs (feed, run_async, sync) before
+                 *        the param server updates the weights, at the end of
+                 *        the last sync. the effective batch is micro_batches
+                 *        times the batch of the replicas, the activations
+                 *        are those of one batch. call before
+                 *        setup_param_server.
+                 */
+                inline void set_accumulation(int micro_batches) {
+                    CHECK_GT(micro_batches, 0);
+                    CHECK(param_server_ == NULL);
+                    accumulation_ = micro_batches;
+                }
                 void feed(const vector<Blob*>& data, const vector<Blob*>& labels);
+                virtual Iteration run_async() override;
                 virtual void sync() override;
                 PS* param_server(int index) {
                     return param_server_->element(index);
                 }
                 template <typename... Args>
                     void setup_param_server(const Args&... args) {
+                        setup_loss();
+                        if (quorum_ > 0) {
+                            wait_replicas();
+                        }
                         vector<vector<Blob*> > weight_diff(nets_.size());
                         for (int i = 0; i < nets_.size(); ++i) {
                             weight_diff[i] = nets_[i]->weight_diff();
                         }
+                        vector<DTYPE> weights = replica_weights();
+                        Runnable* graph = this;
+                        if (accumulation_ > 1) {
+                            // the update runs once every accumulation_ runs,
+                            // on the accumulated weight diffs.
+                            update_ = make_shared<Runnable>();
+                            graph = update_.get();
+                            for (int i = 0; i < nets_.size(); ++i) {
+                                for (Blob*& diff : weight_diff[i]) {
+                                    diff = update_->create("weight_diff",
+                                            diff->shared_tensor());
+                                }
+                            }
+                            weights.resize(nets_.size(), 1.);
+                            for (DTYPE& w : weights) {
+                                w /= accumulation_;
+                            }
+                        }
                         //PS->AllReduce
                         //...Args == vector<int>(18, 0), vector<int>(18, -1), param = {0.9, learning_rate, global_decay}
-                        param_server_ = createAny<Vectorize<PS> >("param_server", args...);
+                        param_server_ = graph->createAny<Vectorize<PS> >(
+                                "param_server", args...);
+                        for (int i = 0; i < param_server_->size(); ++i) {
+                            if (weights.size() != 0) {
+                                param_server_->element(i)->set_diff_weights(weights);
+                            }
+                            if (quorum_ > 0) {
+                                param_server_->element(i)->set_quorum(quorum_,
+                                        deadline_, defer_);
+                            }
+                        }
                         weight_diff >> *param_server_;
                         new_weights_ = param_server_->top();
                     }
@@ -105,6 +200,39 @@ namespace purine {
             }
         }
 
+    template <typename Net, typename PS>
+        void DataParallel<Net, PS>::print_straggler_info() {
+            if (quorum_ == 0) {
+                return;
+            }
+            vector<int> late(nets_.size(), 0);
+            int dropped = 0;
+            int deferred = 0;
+            for (int i = 0; i < param_server_->size(); ++i) {
+                Op<QuorumSum>* quorum = param_server_->element(i)->quorum();
+                if (quorum->rank() != current_rank()) {
+                    continue;
+                }
+                vector<int> l = quorum->late();
+                for (int j = 0; j < l.size(); ++j) {
+                    late[j] += l[j];
+                }
+                dropped += quorum->dropped();
+                deferred += quorum->deferred();
+            }
+            if (dropped + deferred == 0) {
+                return;
+            }
+            for (int j = 0; j < nets_.size(); ++j) {
+                if (late[j] != 0) {
+                    LOG(INFO) << "replica" << j << " [" << nets_[j]->rank() << "]["
+                        << nets_[j]->device() << "] late " << late[j];
+                }
+            }
+            LOG(INFO) << "late diffs: " << dropped << " dropped, " << deferred
+                << " deferred";
+        }
+
     template <typename Net, typename PS>
         template <typename Random>
         void DataParallel<Net, PS>::init(vector<int> index,
@@ -219,9 +347,64 @@ namespace purine {
             }
         }
 
+    template <typename Net, typename PS>
+        void DataParallel<Net, PS>::load_from(DataParallel<Net, PS>* other) {
+            CHECK_EQ(param_server_->size(), other->param_server_->size());
+            for (int i = 0; i < param_server_->size(); ++i) {
+                PS* ps = param_server_->element(i);
+                PS* old = other->param_server_->element(i);
+                CHECK_EQ(ps->rank(), old->rank());
+                CHECK_EQ(ps->device(), old->device());
+                if (current_rank() == ps->rank()) {
+                    ps->weight()->swap_memory(old->weight().get());
+                    ps->history()->swap_memory(old->history().get());
+                }
+            }
+            Runnable distributor(0, -1);
+            int param_num = param_server_->size();
+            vector<Blob*> weight_ps(param_num);
+            vector<vector<Blob*> > weights(nets_.size());
+            for (int j = 0; j < param_num; ++j) {
+                weight_ps[j] = distributor.create("weight_ps",
+                        param_server_->element(j)->weight());
+            }
+            for (int i = 0; i < nets_.size(); ++i) {
+                weights[i] = vector<Blob*>(param_num);
+                for (int j = 0; j < param_num; ++j) {
+                    weights[i][j] = distributor.create("weight",
+                            nets_[i]->weight_data()[j]->shared_tensor());
+                }
+            }
+            vector<vector<Blob*> >{ weight_ps }
+            >> *distributor.createAny<Vectorize<Distribute> >("distribute",
+                    vector<Distribute::param_tuple>(param_num,
+                        Distribute::param_tuple()))
+                >> weights;
+            distributor.run();
+        }
+
+    template <typename Net, typename PS>
+        vector<DTYPE> DataParallel<Net, PS>::replica_weights() const {
+            int total = 0;
+            bool equal = true;
+            for (const vector<int>& loc : locations_) {
+                total += loc[2];
+                equal = equal && loc[2] == locations_[0][2];
+            }
+            if (equal) {
+                return {};
+            }
+            // the loss of a replica is averaged over its batch
+            vector<DTYPE> weights(locations_.size());
+            for (int i = 0; i < locations_.size(); ++i) {
+                weights[i] = DTYPE(locations_[i][2]) * locations_.size() / total;
+            }
+            return weights;
+        }
+
     template <typename Net, typename PS>
         DataParallel<Net, PS>::DataParallel(const vector<vector<int> >& locations)
-        : Runnable() {
+        : Runnable(), locations_(locations) {
             // create replica
             vector<vector<Blob*> > losses;
             nets_ = vector<Net*>(locations.size());
@@ -244,12 +427,70 @@ namespace purine {
                 losses.push_back(nets_[i]->loss());
                 weights_[i] = nets_[i]->weight_data();
             }
+            losses_ = losses;
+        }
+
+    template <typename Net, typename PS>
+        void DataParallel<Net, PS>::setup_loss() {
             // agg loss to rank 0 device -1.
-            Vectorize<Aggregate>* agg = createAny<Vectorize<Aggregate> >("agg_loss",
-                    vector<Aggregate::param_tuple>(losses[0].size(),
-                        Aggregate::param_tuple(Aggregate::AVERAGE, 0, -1)));
-            losses >> *agg;
-            loss_ = agg->top()[0];
+            vector<DTYPE> weights = replica_weights();
+            if (weights.size() == 0 && quorum_ == 0) {
+                Vectorize<Aggregate>* agg = createAny<Vectorize<Aggregate> >(
+                        "agg_loss", vector<Aggregate::param_tuple>(losses_[0].size(),
+                            Aggregate::param_tuple(Aggregate::AVERAGE, 0, -1)));
+                losses_ >> *agg;
+                loss_ = agg->top()[0];
+                return;
+            }
+            // mean over the samples of all the replicas
+            weights.resize(losses_.size(), 1.);
+            for (DTYPE& w : weights) {
+                w /= losses_.size();
+            }
+            for (int j = 0; j < losses_[0].size(); ++j) {
+                vector<Blob*> loss(losses_.size());
+                for (int i = 0; i < losses_.size(); ++i) {
+                    loss[i] = losses_[i][j];
+                }
+                Aggregate* agg;
+                if (quorum_ > 0) {
+                    // rescaled to the mean over the replicas taken
+                    agg = createAny<Aggregate>("agg_loss_" + to_string(j),
+                            Aggregate::param_tuple(Aggregate::QUORUM_SUM, 0, -1),
+                            QuorumSum::param_tuple(quorum_, deadline_, false,
+                                weights));
+                } else {
+                    agg = createAny<Aggregate>("agg_loss_" + to_string(j),
+                            Aggregate::param_tuple(Aggregate::WEIGHTED_SUM, 0, -1),
+                            weights);
+                }
+                loss >> *agg;
+                loss_.push_back(agg->top()[0]);
+            }
+        }
+
+    /**
+     * the quorum sums are the only readers of the diffs and losses, a
+     * straggler sharing the rank of the param server would be left running
+     * when sync returns and swaps its weights. a token written once all its
+     * diffs are done keeps it among the sinks of its rank.
+     */
+    template <typename Net, typename PS>
+        void DataParallel<Net, PS>::wait_replicas() {
+            for (int i = 0; i < nets_.size(); ++i) {
+                int rank = nets_[i]->rank();
+                int device = nets_[i]->device();
+                Op<Constant>* done = create<Constant>("replica_done", rank,
+                        device, "main", Constant::param_tuple(0.));
+                Blob* token = create("replica_done", rank, device, { 1, 1, 1, 1 });
+                *done >> vector<Blob*>{ token };
+                for (Blob* diff : nets_[i]->weight_diff()) {
+                    done->add_control(diff);
+                }
+                for (Blob* loss : nets_[i]->loss()) {
+                    done->add_control(loss);
+                }
+            }
         }
 
     template <typename Net, typename PS>
@@ -269,9 +510,31 @@ namespace purine {
             }
         }
 
+    template <typename Net, typename PS>
+        Runnable::Iteration DataParallel<Net, PS>::run_async() {
+            if (accumulation_ > 1) {
+                // the first micro batch overwrites the diffs
+                bool accumulate = micro_batch_ % accumulation_ != 0;
+                for (int i = 0; i < nets_.size(); ++i) {
+                    if (nets_[i]->rank() == current_rank()) {
+                        for (Blob* diff : nets_[i]->weight_diff()) {
+                            diff->set_accumulate(accumulate);
+                        }
+                    }
+                }
+            }
+            return Runnable::run_async();
+        }
+
     template <typename Net, typename PS>
         void DataParallel<Net, PS>::sync() {
             Runnable::sync();
+            if (accumulation_ > 1) {
+                if (++micro_batch_ % accumulation_ != 0) {
+                    return;
+                }
+                update_->run();
+            }
             // update the weights
             for (int i = 0; i < nets_.size(); ++i) {
                 if (nets_[i]->rank() == current_rank()) {
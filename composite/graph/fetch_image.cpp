@@ -15,7 +15,7 @@ namespace purine {
 
     FetchImage::FetchImage(const string& source, const string& mean, bool mirror,
             bool random, bool color, float scale, int crop_size, float angle, 
-            const vector<vector<int> >& location) 
+            const vector<vector<int> >& location, DatasetCache::Mode cache)
     {
         map<int, vector<Blob*> > images;
         map<int, vector<Blob*> > labels;
@@ -74,7 +74,7 @@ namespace purine {
             Blob* label = create("LABELS", kv.first, -1, {size, 1, 1, 1});
             Op<ImageLabel>* image_label = create<ImageLabel>("FETCH", kv.first, -1,
                     "fetch", ImageLabel::param_tuple(source, mean, mirror, random, color, -1, scale, angle, 
-                        offset, interval, size, crop_size));
+                        offset, interval, size, crop_size, cache));
             *image_label >> vector<Blob*>{ image, label };
 
             master_cpu_labels = label;
@@ -106,7 +106,7 @@ namespace purine {
     FetchImage::FetchImage(const string& source, const string& mean, 
             bool color, int multi_view_id, float scale, float angle,
             int crop_size,
-            const vector<vector<int> >& location) 
+            const vector<vector<int> >& location, DatasetCache::Mode cache)
     {
         map<int, vector<Blob*> > images;
         map<int, vector<Blob*> > labels;
@@ -163,7 +163,7 @@ namespace purine {
             Blob* label = create("LABELS", kv.first, -1, {size, 1, 1, 1});
             Op<ImageLabel>* image_label = create<ImageLabel>("FETCH", kv.first, -1,
                     "fetch", ImageLabel::param_tuple(source, mean, false, false, color, multi_view_id, scale, angle,
-                        offset, interval, size, crop_size));
+                        offset, interval, size, crop_size, cache));
             *image_label >> vector<Blob*>{ image, label };
 
             master_cpu_labels = label;
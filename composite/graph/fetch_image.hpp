@@ -27,7 +27,8 @@ namespace purine {
              */
             FetchImage(const string& source, const string& mean,
                     bool mirror, bool random, bool color, float scale, int crop_size, float angle, 
-                    const vector<vector<int> >& location);
+                    const vector<vector<int> >& location,
+                    DatasetCache::Mode cache = DatasetCache::NONE);
 
             /* @bref
              * for testing
@@ -37,7 +38,8 @@ namespace purine {
             FetchImage(const string& source, const string& mean,
                     bool color, int multi_view_id, float scale, float angle,
                     int crop_size,
-                    const vector<vector<int> >& location);
+                    const vector<vector<int> >& location,
+                    DatasetCache::Mode cache = DatasetCache::NONE);
 
             virtual ~FetchImage() override {}
             const vector<Blob*>& images() { return images_; }
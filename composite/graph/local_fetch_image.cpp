@@ -16,7 +16,7 @@ namespace purine {
     LocalFetchImage::LocalFetchImage(const string& source, const string& mean,
             bool mirror, bool random, bool color, float scale, float angle,
             int crop_size,
-            const vector<int> & location)
+            const vector<int> & location, DatasetCache::Mode cache)
     {
         rank_ = location[0];
         device_ = location[1];
@@ -50,7 +50,7 @@ namespace purine {
         Op<ImageLabel>* image_label = create<ImageLabel>("FETCH", location[0], -1,
                 "fetch", ImageLabel::param_tuple(source, mean, mirror, random, color, -1, scale, 
                     angle, 
-                    offset, batch_size, batch_size, crop_size));
+                    offset, batch_size, batch_size, crop_size, cache));
         *image_label >> vector<Blob*>{ image, label };
 
         master_cpu_labels = label;
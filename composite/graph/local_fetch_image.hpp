@@ -29,7 +29,8 @@ namespace purine {
                     bool mirror, bool random, bool color, float scale, 
                     float angle,
                     int crop_size,
-                    const vector<int> & location);
+                    const vector<int> & location,
+                    DatasetCache::Mode cache = DatasetCache::NONE);
 
             virtual ~LocalFetchImage() override {}
             const vector<Blob*>& images() { return images_; }
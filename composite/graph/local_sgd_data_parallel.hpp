@@ -0,0 +1,282 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_LOCAL_SGD_DATA_PARALLEL
+#define PURINE_LOCAL_SGD_DATA_PARALLEL
+
+#include <fstream>
+#include "composite/composite.hpp"
+
+using namespace std;
+
+namespace purine {
+
+    /**
+     * @brief data parallelism with periodic model averaging (local SGD).
+     *
+     * Unlike DataParallel, there is no param server in the iteration: each
+     * replica applies its own momentum Update to its weights, with its own
+     * history, and nothing leaves the replica. Every period iterations
+     * (after sync) the weights of the replicas are averaged on rank 0 with
+     * Aggregate and sent back with Distribute, so the network carries the
+     * weights once per period instead of the diffs and the weights every
+     * iteration. The histories stay local.
+     *
+     * During the first warmup iterations the weights are averaged every
+     * iteration, which keeps the replicas together while the weights change
+     * fast.
+     */
+    template <typename Net>
+        class LocalSgdDataParallel : public Runnable {
+            protected:
+                vector<Net*> nets_;
+                vector<Blob*> data_;
+                vector<Blob*> labels_;
+                vector<Blob*> loss_;
+                vector<vector<Blob*> > weights_;
+                vector<vector<Blob*> > new_weights_;
+                vector<vector<Update*> > updates_;
+                shared_ptr<Runnable> averager_;
+                int period_ = 1;
+                int warmup_ = 0;
+                int iteration_ = 0;
+                int averaged_ = 0;
+            public:
+                LocalSgdDataParallel(const vector<vector<int> >& locations);
+                virtual ~LocalSgdDataParallel() override {}
+
+                /**
+                 * @brief create the local update of each weight of each
+                 *        replica, param is { momentum, learning_rate,
+                 *        weight_decay } of each weight.
+                 */
+                void setup_update(const vector<Update::param_tuple>& param);
+                // set { momentum, learning_rate, weight_decay } of a weight
+                void set_param(int index, const WeightedSum::param_tuple& param);
+                inline void set_period(int period, int warmup = 0) {
+                    CHECK_GT(period, 0);
+                    period_ = period;
+                    warmup_ = warmup;
+                }
+                // number of times the weights were averaged
+                inline int averaged() const { return averaged_; }
+
+                // init weight using random number.
+                template <typename Random>
+                    void init(vector<int> index,
+                            const typename Random::param_tuple& args);
+
+                /**
+                 * @brief save the weights of the first replica, call average()
+                 *        before to save the averaged weights.
+                 */
+                void save(const string& filename);
+
+                vector<DTYPE> loss();
+                void feed(const vector<Blob*>& data, const vector<Blob*>& labels);
+                // average the weights of the replicas now
+                void average();
+                virtual void sync() override;
+        };
+
+    template <typename Net>
+        LocalSgdDataParallel<Net>::LocalSgdDataParallel(
+                const vector<vector<int> >& locations) : Runnable() {
+            vector<vector<Blob*> > losses;
+            nets_ = vector<Net*>(locations.size());
+            weights_ = vector<vector<Blob*> >(locations.size());
+            for (int i = 0; i < locations.size(); ++i) {
+                nets_[i] = createGraph<Net>("replica" + to_string(i),
+                        locations[i][0], locations[i][1], locations[i][2]);
+                const vector<Blob*>& data_diff = nets_[i]->data_diff();
+                vector<Node*> to_prune(data_diff.size());
+                transform(data_diff.begin(), data_diff.end(), to_prune.begin(),
+                        [](Blob* b)->Node* {
+                        return dynamic_cast<Node*>(b);
+                        });
+                nets_[i]->prune(to_prune);
+                const vector<Blob*>& dt = nets_[i]->data();
+                const vector<Blob*>& lb = nets_[i]->label();
+                data_.insert(data_.end(), dt.begin(), dt.end());
+                labels_.insert(labels_.end(), lb.begin(), lb.end());
+                losses.push_back(nets_[i]->loss());
+                weights_[i] = nets_[i]->weight_data();
+            }
+            // agg loss to rank 0 device -1.
+            Vectorize<Aggregate>* agg = createAny<Vectorize<Aggregate> >("agg_loss",
+                    vector<Aggregate::param_tuple>(losses[0].size(),
+                        Aggregate::param_tuple(Aggregate::AVERAGE, 0, -1)));
+            losses >> *agg;
+            loss_ = agg->top()[0];
+            // { weights of the replicas } >> average >> distribute >> { weights }
+            averager_ = make_shared<Runnable>(0, -1);
+            for (int j = 0; j < weights_[0].size(); ++j) {
+                vector<Blob*> replicas(nets_.size());
+                vector<Blob*> averaged(nets_.size());
+                for (int i = 0; i < nets_.size(); ++i) {
+                    replicas[i] = averager_->create("weight",
+                            weights_[i][j]->shared_tensor());
+                    averaged[i] = averager_->create("averaged",
+                            weights_[i][j]->shared_tensor());
+                }
+                replicas >> *averager_->createAny<Aggregate>("average",
+                        Aggregate::param_tuple(Aggregate::AVERAGE, 0, -1))
+                    >> *averager_->createAny<Distribute>("distribute",
+                            Distribute::param_tuple()) >> averaged;
+            }
+        }
+
+    template <typename Net>
+        void LocalSgdDataParallel<Net>::setup_update(
+                const vector<Update::param_tuple>& param) {
+            CHECK_EQ(param.size(), weights_[0].size());
+            Runnable fill_history(0, -1);
+            updates_ = vector<vector<Update*> >(nets_.size());
+            new_weights_ = vector<vector<Blob*> >(nets_.size());
+            for (int i = 0; i < nets_.size(); ++i) {
+                const vector<Blob*>& weight_diff = nets_[i]->weight_diff();
+                int rank = nets_[i]->rank();
+                int device = nets_[i]->device();
+                vector<Blob*> to_fill;
+                for (int j = 0; j < param.size(); ++j) {
+                    Size size = weights_[i][j]->tensor()->size();
+                    // suffixed, the cached names key the traces and reports
+                    string index = to_string(j);
+                    Blob* history = create("history" + index, rank, device,
+                            size);
+                    Blob* new_history = create("new_history" + index,
+                            history->shared_tensor());
+                    Blob* new_weight = create("new_weight" + index, rank,
+                            device, size);
+                    Update* update = createGraph<Update>("update" + index,
+                            rank, device, param[j]);
+                    vector<Blob*>{ weights_[i][j], weight_diff[j], history }
+                    >> *update >> vector<Blob*>{ new_weight, new_history };
+                    updates_[i].push_back(update);
+                    new_weights_[i].push_back(new_weight);
+                    to_fill.push_back(fill_history.create("history" + index,
+                                history->shared_tensor()));
+                }
+                *fill_history.create<Constant>("filler", rank, device, "main",
+                        Constant::param_tuple(0.)) >> to_fill;
+            }
+            fill_history.run();
+        }
+
+    template <typename Net>
+        void LocalSgdDataParallel<Net>::set_param(int index,
+                const WeightedSum::param_tuple& param) {
+            for (int i = 0; i < nets_.size(); ++i) {
+                if (nets_[i]->rank() == current_rank()) {
+                    updates_[i][index]->set_param(param);
+                }
+            }
+        }
+
+    template <typename Net>
+        template <typename Random>
+        void LocalSgdDataParallel<Net>::init(vector<int> index,
+                const typename Random::param_tuple& args) {
+            Runnable initializer(0, -1);
+            Op<Random>* rnd = initializer.create<Random>("init", "main", args);
+            vector<Blob*> tmp(index.size());
+            vector<vector<Blob*> > weights(nets_.size(),
+                    vector<Blob*>(index.size()));
+            for (int i = 0; i < index.size(); ++i) {
+                tmp[i] = initializer.create("tmp",
+                        weights_[0][index[i]]->tensor()->size());
+                for (int j = 0; j < nets_.size(); ++j) {
+                    weights[j][i] = initializer.create("weight",
+                            weights_[j][index[i]]->shared_tensor());
+                }
+            }
+            *rnd >> tmp;
+            vector<vector<Blob*> >{ tmp }
+            >> *initializer.createAny<Vectorize<Distribute> >("init_distribute",
+                    vector<Distribute::param_tuple>(index.size(),
+                        Distribute::param_tuple()))
+                >> weights;
+            initializer.run();
+        }
+
+    template <typename Net>
+        void LocalSgdDataParallel<Net>::save(const string& filename) {
+            Runnable saver;
+            int param_num = weights_[0].size();
+            vector<Blob*> param(param_num);
+            for (int i = 0; i < param_num; ++i) {
+                param[i] = saver.create("param", weights_[0][i]->shared_tensor());
+            }
+            auto copier = saver.createAny<Vectorize<Copy> >("copy_here",
+                    vector<Copy::param_tuple>(param_num, Copy::param_tuple(0, -1)));
+            vector<vector<Blob*> >{ param } >> *copier;
+            vector<Blob*> copied = copier->top()[0];
+            saver.run();
+
+            if (current_rank() == 0) {
+                ofstream out(filename);
+                for (int i = 0; i < param_num; ++i) {
+                    const char* data = reinterpret_cast<const char*>(
+                            copied[i]->tensor()->cpu_data());
+                    int len = copied[i]->tensor()->size().count() * sizeof(DTYPE);
+                    out.write(data, len);
+                }
+                LOG(INFO) << "Saving snapshot " << filename;
+            }
+        }
+
+    template <typename Net>
+        vector<DTYPE> LocalSgdDataParallel<Net>::loss() {
+            CHECK_EQ(current_rank(), 0);
+            vector<DTYPE> ret(loss_.size());
+            transform(loss_.begin(), loss_.end(), ret.begin(), [](Blob* b)->DTYPE {
+                    return b->tensor()->cpu_data()[0];
+                    });
+            return ret;
+        }
+
+    template <typename Net>
+        void LocalSgdDataParallel<Net>::feed(const vector<Blob*>& data,
+                const vector<Blob*>& labels) {
+            CHECK_EQ(data.size(), data_.size());
+            CHECK_EQ(labels.size(), labels_.size());
+            for (int i = 0; i < data.size(); ++i) {
+                if (current_rank() == data_[i]->rank()) {
+                    data_[i]->tensor()->swap_memory(data[i]->tensor());
+                }
+            }
+            for (int i = 0; i < labels.size(); ++i) {
+                if (current_rank() == labels_[i]->rank()) {
+                    labels_[i]->tensor()->swap_memory(labels[i]->tensor());
+                }
+            }
+        }
+
+    template <typename Net>
+        void LocalSgdDataParallel<Net>::average() {
+            if (nets_.size() > 1) {
+                averager_->run();
+                ++averaged_;
+            }
+        }
+
+    template <typename Net>
+        void LocalSgdDataParallel<Net>::sync() {
+            Runnable::sync();
+            CHECK_EQ(new_weights_.size(), nets_.size()) << "setup_update first";
+            for (int i = 0; i < nets_.size(); ++i) {
+                if (nets_[i]->rank() == current_rank()) {
+                    for (int j = 0; j < weights_[i].size(); ++j) {
+                        new_weights_[i][j]->tensor()->swap_memory(
+                                weights_[i][j]->tensor());
+                    }
+                }
+            }
+            ++iteration_;
+            int period = iteration_ <= warmup_ ? 1 : period_;
+            if (iteration_ % period == 0) {
+                average();
+            }
+        }
+
+}
+
+#endif
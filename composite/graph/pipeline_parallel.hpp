@@ -0,0 +1,252 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_PIPELINE_PARALLEL
+#define PURINE_PIPELINE_PARALLEL
+
+#include <iomanip>
+#include <sstream>
+#include "composite/composite.hpp"
+#include "dispatch/trace.hpp"
+
+using namespace std;
+
+namespace purine {
+
+    /**
+     * @brief pipeline parallelism. The layers of Net are split into stages
+     * located on different (rank, device), the batch into micro batches.
+     *
+     * Net is constructed as Net(rank, device, micro_batch_size, stages), with
+     * (rank, device) being the first stage, and places its layers on the
+     * stages in order (stages may also hold one location per layer, as
+     * given by Placement). Layer::set_bottom inserts the Copy between two
+     * stages. data() and label() of Net are on the first stage, the rest of
+     * the interface is the one DataParallel uses.
+     *
+     * A replica of Net is created per micro batch, all of them share the
+     * weight tensors of the first one. There is no dependency between the
+     * micro batches except the weights, so while micro batch m is on stage
+     * s, micro batch m + 1 is already on stage s - 1 and the stages overlap
+     * (GPipe: forward of the micro batches fills the pipeline, backward
+     * drains it). The weight diffs of the micro batches are summed by the
+     * param server, like the diffs of the replicas in DataParallel.
+     */
+    template <typename Net, typename PS>
+        class PipelineParallel : public Runnable {
+            protected:
+                vector<pair<int, int> > stages_;
+                int micro_batch_size_;
+                vector<Net*> micro_batches_;
+                Vectorize<PS>* param_server_ = NULL;
+                vector<Blob*> data_;
+                vector<Blob*> labels_;
+                vector<Blob*> loss_;
+                vector<vector<Blob*> > new_weights_;
+                vector<Blob*> weights_;
+                // wall time of the last iteration, for stage_report
+                int64_t iteration_begin_ = 0;
+                int64_t iteration_end_ = 0;
+            public:
+                PipelineParallel(const vector<pair<int, int> >& stages,
+                        int micro_batch_size, int num_micro_batches);
+                virtual ~PipelineParallel() override {}
+
+                // init weight using random number.
+                template <typename Random>
+                    void init(vector<int> index,
+                            const typename Random::param_tuple& args);
+
+                vector<DTYPE> loss();
+                // weights of the first micro batch, each on its stage
+                inline const vector<Blob*>& weight_data() { return weights_; }
+                void feed(const vector<Blob*>& data, const vector<Blob*>& labels);
+                virtual Iteration run_async() override;
+                virtual void sync() override;
+                /**
+                 * @brief busy time and throughput of the stages on this
+                 *        rank during the last iteration. needs Tracer to be
+                 *        enabled during that iteration.
+                 */
+                string stage_report() const;
+                PS* param_server(int index) {
+                    return param_server_->element(index);
+                }
+                template <typename... Args>
+                    void setup_param_server(const Args&... args) {
+                        vector<vector<Blob*> > weight_diff(micro_batches_.size());
+                        for (int i = 0; i < micro_batches_.size(); ++i) {
+                            weight_diff[i] = micro_batches_[i]->weight_diff();
+                        }
+                        param_server_ = createAny<Vectorize<PS> >("param_server",
+                                args...);
+                        weight_diff >> *param_server_;
+                        new_weights_ = param_server_->top();
+                    }
+        };
+
+    template <typename Net, typename PS>
+        PipelineParallel<Net, PS>::PipelineParallel(
+                const vector<pair<int, int> >& stages, int micro_batch_size,
+                int num_micro_batches) : Runnable(),
+        micro_batch_size_(micro_batch_size) {
+            CHECK_GT(stages.size(), 0);
+            CHECK_GT(num_micro_batches, 0);
+            for (const pair<int, int>& stage : stages) {
+                if (stages_.size() == 0 || stages_.back() != stage) {
+                    stages_.push_back(stage);
+                }
+            }
+            vector<vector<Blob*> > losses;
+            micro_batches_ = vector<Net*>(num_micro_batches);
+            for (int i = 0; i < num_micro_batches; ++i) {
+                micro_batches_[i] = createGraph<Net>("micro_batch" + to_string(i),
+                        stages[0].first, stages[0].second, micro_batch_size,
+                        stages);
+                const vector<Blob*>& data_diff = micro_batches_[i]->data_diff();
+                vector<Node*> to_prune(data_diff.size());
+                transform(data_diff.begin(), data_diff.end(), to_prune.begin(),
+                        [](Blob* b)->Node* {
+                        return dynamic_cast<Node*>(b);
+                        });
+                micro_batches_[i]->prune(to_prune);
+                const vector<Blob*>& dt = micro_batches_[i]->data();
+                const vector<Blob*>& lb = micro_batches_[i]->label();
+                data_.insert(data_.end(), dt.begin(), dt.end());
+                labels_.insert(labels_.end(), lb.begin(), lb.end());
+                losses.push_back(micro_batches_[i]->loss());
+            }
+            // the ops are setup lazily on first run, sharing the tensor now
+            // makes all the micro batches use the weights of the first one.
+            weights_ = micro_batches_[0]->weight_data();
+            for (int i = 1; i < num_micro_batches; ++i) {
+                const vector<Blob*>& w = micro_batches_[i]->weight_data();
+                CHECK_EQ(w.size(), weights_.size());
+                for (int j = 0; j < w.size(); ++j) {
+                    w[j]->share_from(weights_[j]);
+                }
+            }
+            // agg loss to rank 0 device -1.
+            Vectorize<Aggregate>* agg = createAny<Vectorize<Aggregate> >("agg_loss",
+                    vector<Aggregate::param_tuple>(losses[0].size(),
+                        Aggregate::param_tuple(Aggregate::AVERAGE, 0, -1)));
+            losses >> *agg;
+            loss_ = agg->top()[0];
+        }
+
+    template <typename Net, typename PS>
+        template <typename Random>
+        void PipelineParallel<Net, PS>::init(vector<int> index,
+                const typename Random::param_tuple& args) {
+            Runnable initializer(0, -1);
+            Op<Random>* rnd = initializer.create<Random>("init", "main", args);
+            vector<Blob*> tmp(index.size());
+            vector<vector<Blob*> > weights(2, vector<Blob*>(index.size()));
+            for (int i = 0; i < index.size(); ++i) {
+                tmp[i] = initializer.create("tmp",
+                        param_server_->element(index[i])->weight()->size());
+                weights[0][i] = initializer.create("weight",
+                        weights_[index[i]]->shared_tensor());
+                weights[1][i] = initializer.create("weight_ps",
+                        param_server_->element(index[i])->weight());
+            }
+            *rnd >> tmp;
+            vector<vector<Blob*> >{ tmp }
+            >> *initializer.createAny<Vectorize<Distribute> >("init_distribute",
+                    vector<Distribute::param_tuple>(index.size(),
+                        Distribute::param_tuple()))
+                >> weights;
+            initializer.run();
+        }
+
+    template <typename Net, typename PS>
+        vector<DTYPE> PipelineParallel<Net, PS>::loss() {
+            CHECK_EQ(current_rank(), 0);
+            vector<DTYPE> ret(loss_.size());
+            transform(loss_.begin(), loss_.end(), ret.begin(), [](Blob* b)->DTYPE {
+                    return b->tensor()->cpu_data()[0];
+                    });
+            return ret;
+        }
+
+    template <typename Net, typename PS>
+        void PipelineParallel<Net, PS>::feed(const vector<Blob*>& data,
+                const vector<Blob*>& labels) {
+            CHECK_EQ(data.size(), data_.size());
+            CHECK_EQ(labels.size(), labels_.size());
+            for (int i = 0; i < data.size(); ++i) {
+                if (current_rank() == data_[i]->rank()) {
+                    data_[i]->tensor()->swap_memory(data[i]->tensor());
+                }
+            }
+            for (int i = 0; i < labels.size(); ++i) {
+                if (current_rank() == labels_[i]->rank()) {
+                    labels_[i]->tensor()->swap_memory(labels[i]->tensor());
+                }
+            }
+        }
+
+    template <typename Net, typename PS>
+        Runnable::Iteration PipelineParallel<Net, PS>::run_async() {
+            iteration_begin_ = Tracer::now();
+            return Runnable::run_async();
+        }
+
+    template <typename Net, typename PS>
+        void PipelineParallel<Net, PS>::sync() {
+            Runnable::sync();
+            iteration_end_ = Tracer::now();
+            // the micro batches share the weights of the first one
+            for (int j = 0; j < weights_.size(); ++j) {
+                if (weights_[j]->rank() == current_rank()) {
+                    CHECK_EQ(new_weights_[0][j]->tensor()->size(),
+                            weights_[j]->tensor()->size());
+                    CHECK_EQ(new_weights_[0][j]->device(), weights_[j]->device());
+                    new_weights_[0][j]->tensor()->swap_memory(weights_[j]->tensor());
+                }
+            }
+        }
+
+    template <typename Net, typename PS>
+        string PipelineParallel<Net, PS>::stage_report() const {
+            std::ostringstream out;
+            int64_t total = std::max<int64_t>(iteration_end_ - iteration_begin_, 1);
+            int samples = micro_batch_size_ * micro_batches_.size();
+            vector<Tracer::Event> events = Tracer::events();
+            out << "pipeline: " << stages_.size() << " stages, "
+                << micro_batches_.size() << " micro batches of "
+                << micro_batch_size_ << ", iteration " << std::fixed
+                << std::setprecision(3) << total / 1000. << " ms, "
+                << samples * 1e6 / total << " samples/s" << std::endl;
+            for (int i = 0; i < stages_.size(); ++i) {
+                if (stages_[i].first != current_rank()) {
+                    continue;
+                }
+                // merge the compute spans of the stage's device
+                vector<pair<int64_t, int64_t> > spans;
+                for (const Tracer::Event& e : events) {
+                    if (e.device == stages_[i].second
+                            && e.category == Tracer::COMPUTE
+                            && e.begin >= iteration_begin_
+                            && e.end <= iteration_end_) {
+                        spans.push_back({ e.begin, e.end });
+                    }
+                }
+                std::sort(spans.begin(), spans.end());
+                int64_t busy = 0;
+                int64_t last = iteration_begin_;
+                for (const pair<int64_t, int64_t>& s : spans) {
+                    busy += std::max<int64_t>(0, s.second - std::max(s.first, last));
+                    last = std::max(last, s.second);
+                }
+                out << "  stage " << i << " [" << stages_[i].first << "]["
+                    << (stages_[i].second < 0 ? string("CPU") : "GPU"
+                            + to_string(stages_[i].second)) << "] busy "
+                    << busy / 1000. << " ms (" << 100. * busy / total
+                    << "%), " << samples * 1e6 / std::max<int64_t>(busy, 1)
+                    << " samples/s if never idle" << std::endl;
+            }
+            return out.str();
+        }
+
+}
+
+#endif
@@ -20,6 +20,8 @@ namespace purine {
             int kernel_w;
             int num_output;
             string activation;
+            // bytes of columns this layer holds of the budget
+            size_t columns_bytes_ = 0;
         public:
             typedef vector<Blob*> B;
             typedef tuple<int, int, int, int, int, int, int, string> param_tuple;
@@ -28,9 +30,30 @@ namespace purine {
                 std::tie(pad_h, pad_w, stride_h, stride_w, kernel_h,
                         kernel_w, num_output, activation) = args;
             }
-            virtual ~ConvLayer() override {}
+            virtual ~ConvLayer() override {
+                columns_kept()[rank_] -= columns_bytes_;
+            }
+            /**
+             * @brief bytes of im2col columns the cpu conv layers of a rank
+             *        keep from conv_up for conv_weight, which then skips its
+             *        own im2col. 0 (none) by default. Layers set up once the
+             *        budget is used up run im2col twice as before. A layer
+             *        gives its bytes back when it is destroyed.
+             */
+            inline static void set_column_budget(size_t bytes) {
+                column_budget() = bytes;
+            }
 
         protected:
+            static size_t& column_budget() {
+                static size_t bytes = 0;
+                return bytes;
+            }
+            // bytes of columns kept on each rank
+            static map<int, size_t>& columns_kept() {
+                static map<int, size_t> kept;
+                return kept;
+            }
             virtual void setup() override {
                 CHECK(bottom_setup_);
                 CHECK_EQ(bottom_.size(), 2);
@@ -71,6 +94,26 @@ namespace purine {
                     };
                 }
 
+                // keep the columns of forward for conv_weight, the same on
+                // all the ranks so that the graphs match
+                B columns;
+                size_t bytes = size_t(bottom_size.num()) * bottom_size.channels()
+                    * kernel_h * kernel_w * out_h * out_w * sizeof(DTYPE);
+                bool pointwise = kernel_h == 1 && kernel_w == 1 && pad_h == 0
+                    && pad_w == 0 && stride_h == 1 && stride_w == 1;
+                if (device_ < 0 && !pointwise
+                        && columns_kept()[rank_] + bytes <= column_budget()) {
+                    columns_kept()[rank_] += bytes;
+                    columns_bytes_ = bytes;
+                    columns = { create("columns", { bottom_size.num(),
+                            bottom_size.channels() * kernel_h * kernel_w,
+                            out_h, out_w }) };
+                }
+                auto with_columns = [&columns](B blobs)->B {
+                    blobs.insert(blobs.end(), columns.begin(), columns.end());
+                    return blobs;
+                };
+
                 // create ops
                 Conv::param_tuple params = make_tuple(pad_h, pad_w, stride_h, stride_w);
                 Op<Conv>* conv_up = create<Conv>("conv_up", "main", params);
@@ -82,21 +125,25 @@ namespace purine {
 
                 if (activation == "") {
                     // forward
-                    B{ bottom_[0], weight_[0] } >> *conv_up >> B{ top_[0] };
+                    B{ bottom_[0], weight_[0] } >> *conv_up
+                        >> with_columns({ top_[0] });
                     B{ weight_[1] } >> *bias_up >> B{ top_[0] };
                     // backward
                     B{ top_[1], weight_[0] } >> *conv_down >> B{ bottom_[1] };
-                    B{ top_[1], bottom_[0] } >> *conv_weight >> B{ weight_[2] };
+                    with_columns({ top_[1], bottom_[0] }) >> *conv_weight
+                        >> B{ weight_[2] };
                     B{ top_[1] } >> *bias_down >> B{ weight_[3] };
                 } else {
                     // inplace
                     Blob* tmp_data = create("before_act", top_[0]->shared_tensor());
                     Blob* tmp_diff = create("before_act_diff", top_[1]->shared_tensor());
-                    B{ bottom_[0], weight_[0] } >> *conv_up >> B{ tmp_data };
+                    B{ bottom_[0], weight_[0] } >> *conv_up
+                        >> with_columns({ tmp_data });
                     B{ weight_[1] } >> *bias_up >> B{ tmp_data };
                     // backward
                     B{ tmp_diff, weight_[0] } >> *conv_down >> B{ bottom_[1] };
-                    B{ tmp_diff, bottom_[0] } >> *conv_weight >> B{ weight_[2] };
+                    with_columns({ tmp_diff, bottom_[0] }) >> *conv_weight
+                        >> B{ weight_[2] };
                     B{ tmp_diff } >> *bias_down >> B{ weight_[3] };
                     ActivationLayer* act = createGraph<ActivationLayer>("act",
                             ActivationLayer::param_tuple(activation, true));
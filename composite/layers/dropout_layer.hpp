@@ -3,6 +3,7 @@
 #define PURINE_DROPOUT_LAYER
 
 #include "composite/layer.hpp"
+#include "operations/include/dropout.hpp"
 #include "operations/include/eltwise.hpp"
 #include "operations/include/random.hpp"
 
@@ -46,7 +47,14 @@ namespace purine {
                         };
                     }
                 }
-                if (!test) {
+                if (!test && device_ < 0) {
+                    // on the cpu the mask has one bit per element
+                    Blob* mask = create("mask", Dropout::mask_size(bottom_size));
+                    B{ bottom_[0] } >> *create<Dropout>("dropout", "main",
+                            Dropout::param_tuple(ratio)) >> B{ top_[0], mask };
+                    B{ top_[1], mask } >> *create<DropoutDown>("dropout_down",
+                            "main", DropoutDown::param_tuple()) >> B{ bottom_[1] };
+                } else if (!test) {
                     // create ops
                     Op<Bernoulli>* mask_generator = create<Bernoulli>("mask_gen", "main",
                             make_tuple(1. - ratio)); // the thread can be other than main
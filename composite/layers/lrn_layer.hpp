@@ -43,11 +43,20 @@ namespace purine {
                 Blob* scale = create("scale", bottom_size);
                 Op<LRNScale>* lrn_scale = create<LRNScale>("lrnscale", "main",
                         param_tuple(alpha, beta, size));
-                Op<LRN>* lrn = create<LRN>("lrn", "main", param_tuple(alpha, beta, size));
                 Op<LRNDown>* lrn_down = create<LRNDown>("lrndown", "main",
                         param_tuple(alpha, beta, size));
-                vector<Blob*>{ bottom_[0] } >> *lrn_scale >> vector<Blob*>{ scale };
-                vector<Blob*>{ bottom_[0], scale } >> *lrn >> vector<Blob*>{ top_[0] };
+                if (device_ < 0) {
+                    // on the cpu, the scale and the top in one pass
+                    vector<Blob*>{ bottom_[0] } >> *lrn_scale
+                        >> vector<Blob*>{ scale, top_[0] };
+                } else {
+                    Op<LRN>* lrn = create<LRN>("lrn", "main",
+                            param_tuple(alpha, beta, size));
+                    vector<Blob*>{ bottom_[0] } >> *lrn_scale
+                        >> vector<Blob*>{ scale };
+                    vector<Blob*>{ bottom_[0], scale } >> *lrn
+                        >> vector<Blob*>{ top_[0] };
+                }
                 vector<Blob*>{ bottom_[0], top_[1], scale, top_[0] } >>
                     *lrn_down >> vector<Blob*>{ bottom_[1] };
             }
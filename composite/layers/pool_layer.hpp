@@ -52,6 +52,16 @@ namespace purine {
                 Op<Pool>* pool_up = create<Pool>("pool_up", "main", args_);
                 Op<PoolDown>* pool_down = create<PoolDown>("pool_down", "main", args_);
 
+                // on the cpu, max pooling keeps where the max of each window
+                // is, for backward
+                if (device_ < 0 && method == "max"
+                        && kernel_h * kernel_w < Pool::NO_MAX) {
+                    Blob* mask = create("mask", Pool::mask_size(expect_top_size));
+                    B{ bottom_[0] } >> *pool_up >> B{ top_[0], mask };
+                    B{ top_[1], top_[0], bottom_[0], mask } >> *pool_down
+                        >> B{ bottom_[1] };
+                    return;
+                }
                 // forward
                 B{ bottom_[0] } >> *pool_up >> B{ top_[0] };
                 // backward
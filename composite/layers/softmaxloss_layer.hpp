@@ -40,6 +40,18 @@ namespace purine {
                     loss_[1]->tensor()->mutable_cpu_data()[0] = loss_scale;
                 }
 
+                // on the cpu, one op for softmax, loss and diff
+                if (device_ < 0) {
+                    Blob* label_cpu = (B{ label_ } >> *createAny<Copy>(
+                                "label_cpu", Copy::param_tuple(rank_, -1))).top()[0];
+                    probs_ = create("softmaxed", bottom_[0]->tensor()->size());
+                    B{ bottom_[0], label_cpu, loss_[1] }
+                    >> *create<SoftmaxCrossEntropy>("softmax_xent", "main",
+                            SoftmaxCrossEntropy::param_tuple())
+                        >> B{ probs_, loss_[0], bottom_[1] };
+                    return;
+                }
+
                 // create ops
                 Op<Softmax>* softmax = create<Softmax>("softmax", "main",
                         make_tuple("channel"));
@@ -22,7 +22,7 @@ namespace purine {
     }
 
     // this is always called from in_thread
-    void Blob::compute() {
+    void Blob::compute(int generation) {
         if (!inputs_.empty()) {
             // record cudaevent if outputs are in different thread as in input.
             // and inputs are executed in GPU.
@@ -49,10 +49,10 @@ namespace purine {
                 CUDA_CHECK(cudaEventSynchronize(cuda_event_));
             }
             // after syncing, update conditional variable.
-            ++(dynamic_cast<Runnable*>(cached_root_)->sink_counter());
+            dynamic_cast<Runnable*>(cached_root_)->sink_done(generation);
         }
         for (Node* out : outputs_) {
-            out->inc_in();
+            out->inc_in(generation, this);
         }
     }
 
@@ -18,6 +18,8 @@ namespace purine {
         protected:
         shared_ptr<Tensor> tensor_;
         cudaEvent_t cuda_event_ = NULL;
+        // writers add to the tensor instead of overwriting it
+        bool accumulate_ = false;
         public:
         explicit Blob(int rank, int device, const Size& size);
         explicit Blob(shared_ptr<Tensor> tensor);
@@ -29,8 +31,11 @@ namespace purine {
             return tensor_.get();
         }
         inline shared_ptr<Tensor> shared_tensor() { return tensor_; }
+        // set between iterations, e.g. to accumulate gradients over runs
+        inline void set_accumulate(bool accumulate) { accumulate_ = accumulate; }
+        inline bool accumulate() const { return accumulate_; }
         void share_from(Blob* other);
-        virtual void compute() override;
+        virtual void compute(int generation) override;
     };
 }
 
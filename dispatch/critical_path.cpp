@@ -0,0 +1,224 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include "dispatch/blob.hpp"
+#include "dispatch/critical_path.hpp"
+
+using std::set;
+
+namespace purine {
+
+    CriticalPath::CriticalPath(Runnable* graph,
+            const vector<Tracer::Event>& events) {
+        // the most recent execution of each op
+        map<string, Timing> by_name;
+        for (const Tracer::Event& e : events) {
+            string name = Tracer::name(e.name);
+            if (by_name.count(name) == 0 || by_name[name].begin < e.begin) {
+                by_name[name] = { e.begin, e.end, e.device, e.category,
+                    Tracer::name(e.loop) };
+            }
+        }
+        for (Node* node : graph->nodes()) {
+            Op_* op = dynamic_cast<Op_*>(node);
+            if (op == NULL || by_name.count(op->cached_name()) == 0) {
+                continue;
+            }
+            ops_.push_back(op);
+            timing_[op] = by_name[op->cached_name()];
+        }
+        CHECK_GT(ops_.size(), 0) << "no traced op in the graph, "
+            << "run it with Tracer::enable() first";
+        // op -> blob -> op
+        for (Op_* op : ops_) {
+            set<Op_*> preds;
+            for (Node* blob : op->inputs()) {
+                for (Node* node : blob->inputs()) {
+                    Op_* pred = dynamic_cast<Op_*>(node);
+                    if (pred != NULL && timing_.count(pred) != 0) {
+                        preds.insert(pred);
+                    }
+                }
+            }
+            predecessors_[op] = vector<Op_*>(preds.begin(), preds.end());
+        }
+        Op_* last = ops_[0];
+        begin_ = timing_[ops_[0]].begin;
+        for (Op_* op : ops_) {
+            const Timing& t = timing_[op];
+            begin_ = std::min(begin_, t.begin);
+            if (t.end > timing_[last].end) {
+                last = op;
+            }
+            busy_[t.loop].push_back({ t.begin, t.end });
+        }
+        end_ = timing_[last].end;
+        // walk back through the input which arrived last
+        for (Op_* op = last; op != NULL; ) {
+            path_.push_back(op);
+            Op_* gate = NULL;
+            for (Op_* pred : predecessors_[op]) {
+                if (gate == NULL || timing_[pred].end > timing_[gate].end) {
+                    gate = pred;
+                }
+            }
+            op = gate;
+        }
+        std::reverse(path_.begin(), path_.end());
+        // merge the busy intervals of each loop, ops of a thread pool overlap
+        for (auto& kv : busy_) {
+            vector<pair<int64_t, int64_t> >& intervals = kv.second;
+            std::sort(intervals.begin(), intervals.end());
+            vector<pair<int64_t, int64_t> > merged;
+            for (const pair<int64_t, int64_t>& i : intervals) {
+                if (merged.size() != 0 && i.first <= merged.back().second) {
+                    merged.back().second = std::max(merged.back().second,
+                            i.second);
+                } else {
+                    merged.push_back(i);
+                }
+            }
+            intervals = merged;
+        }
+    }
+
+    static string ms(int64_t us) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3) << us / 1000. << " ms";
+        return out.str();
+    }
+
+    string CriticalPath::report() const {
+        std::ostringstream out;
+        int64_t total = length();
+        // gpu, cpu, mpi, wait
+        int64_t spent[4] = { 0, 0, 0, 0 };
+        static const char* kinds[] = { "gpu compute", "cpu compute", "mpi",
+            "wait" };
+        int64_t ready = begin_;
+        for (Op_* op : path_) {
+            const Timing& t = timing_.at(op);
+            spent[3] += std::max<int64_t>(0, t.begin - ready);
+            int kind = t.category != Tracer::COMPUTE ? 2 : t.device < 0 ? 1 : 0;
+            spent[kind] += t.end - t.begin;
+            ready = t.end;
+        }
+        int bound = std::max_element(spent, spent + 4) - spent;
+        out << "critical path: " << path_.size() << " of " << ops_.size()
+            << " ops, " << ms(total) << std::endl;
+        for (int i = 0; i < 4; ++i) {
+            out << "  " << std::setw(12) << kinds[i] << " " << ms(spent[i])
+                << " (" << 100. * spent[i] / std::max<int64_t>(total, 1)
+                << "%)" << std::endl;
+        }
+        out << "  bound by " << kinds[bound] << std::endl;
+
+        out << "loop utilization:" << std::endl;
+        for (const auto& kv : busy_) {
+            int64_t busy = 0;
+            vector<pair<int64_t, int64_t> > gaps;  // (length, start)
+            int64_t last = begin_;
+            for (const pair<int64_t, int64_t>& i : kv.second) {
+                busy += i.second - i.first;
+                if (i.first > last) {
+                    gaps.push_back({ i.first - last, last });
+                }
+                last = i.second;
+            }
+            if (end_ > last) {
+                gaps.push_back({ end_ - last, last });
+            }
+            std::sort(gaps.rbegin(), gaps.rend());
+            out << "  " << kv.first << " busy " << ms(busy) << " ("
+                << 100. * busy / std::max<int64_t>(total, 1) << "%)";
+            if (gaps.size() != 0) {
+                out << ", largest idle gaps:";
+                for (int i = 0; i < std::min<int>(3, gaps.size()); ++i) {
+                    out << " " << ms(gaps[i].first) << " at +"
+                        << ms(gaps[i].second - begin_);
+                }
+            }
+            out << std::endl;
+        }
+
+        out << "critical ops:" << std::endl;
+        ready = begin_;
+        for (Op_* op : path_) {
+            const Timing& t = timing_.at(op);
+            out << "  +" << ms(t.begin - begin_) << " " << op->cached_name()
+                << " [" << t.loop << "] " << ms(t.end - t.begin);
+            if (t.begin > ready) {
+                out << " after waiting " << ms(t.begin - ready);
+            }
+            out << std::endl;
+            ready = t.end;
+        }
+        return out.str();
+    }
+
+    static string escape(const string& s) {
+        string ret;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                ret += '\\';
+            }
+            ret += c;
+        }
+        return ret;
+    }
+
+    void CriticalPath::dump_dot(const string& filename) const {
+        set<Op_*> critical(path_.begin(), path_.end());
+        map<Node*, int> ids;
+        auto id = [&](Node* n)->string {
+            if (ids.count(n) == 0) {
+                int size = ids.size();
+                ids[n] = size;
+            }
+            return "n" + to_string(ids[n]);
+        };
+        std::ofstream out(filename);
+        CHECK(out) << "can not open " << filename;
+        out << "digraph purine {" << std::endl;
+        out << "  rankdir=LR;" << std::endl;
+        set<Node*> blobs;
+        for (Op_* op : ops_) {
+            const Timing& t = timing_.at(op);
+            out << "  " << id(op) << " [shape=box,label=\""
+                << escape(op->cached_name()) << "\\n" << escape(t.loop)
+                << "\\n" << ms(t.end - t.begin) << "\"";
+            if (critical.count(op) != 0) {
+                out << ",color=red,penwidth=2";
+            }
+            out << "];" << std::endl;
+            blobs.insert(op->inputs().begin(), op->inputs().end());
+            blobs.insert(op->outputs().begin(), op->outputs().end());
+        }
+        for (Node* blob : blobs) {
+            out << "  " << id(blob) << " [shape=ellipse,fontsize=8,label=\""
+                << escape(blob->cached_name()) << "\"];" << std::endl;
+        }
+        for (Op_* op : ops_) {
+            for (Node* blob : op->inputs()) {
+                out << "  " << id(blob) << " -> " << id(op);
+                bool hot = false;
+                for (Node* pred : blob->inputs()) {
+                    hot |= critical.count(static_cast<Op_*>(pred)) != 0;
+                }
+                out << (hot && critical.count(op) != 0 ?
+                        " [color=red,penwidth=2]" : "") << ";" << std::endl;
+            }
+            for (Node* blob : op->outputs()) {
+                out << "  " << id(op) << " -> " << id(blob)
+                    << (critical.count(op) != 0 ? " [color=red]" : "")
+                    << ";" << std::endl;
+            }
+        }
+        out << "}" << std::endl;
+    }
+
+}
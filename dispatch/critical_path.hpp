@@ -0,0 +1,57 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_CRITICAL_PATH
+#define PURINE_CRITICAL_PATH
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dispatch/op.hpp"
+#include "dispatch/runnable.hpp"
+#include "dispatch/trace.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief analyze an executed graph with the timings recorded by Tracer.
+     *
+     * The DAG of the local ops of the runnable is rebuilt (op -> blob -> op)
+     * and the most recent traced execution of every op is attached to it.
+     * The critical path is found by walking back from the op which finished
+     * last, always through the input which arrived last. Time on the path
+     * is split into gpu compute, cpu compute (which includes the parameter
+     * server), mpi and waiting (the op was ready but not started yet).
+     */
+    class CriticalPath {
+        public:
+            struct Timing {
+                int64_t begin;
+                int64_t end;
+                int device;
+                int category;
+                string loop;
+            };
+            explicit CriticalPath(Runnable* graph,
+                    const vector<Tracer::Event>& events = Tracer::events());
+            inline const vector<Op_*>& path() const { return path_; }
+            inline int64_t length() const { return end_ - begin_; }
+            string report() const;
+            void dump_dot(const string& filename) const;
+        protected:
+            vector<Op_*> ops_;
+            map<Op_*, vector<Op_*> > predecessors_;
+            map<Op_*, Timing> timing_;
+            vector<Op_*> path_;
+            // loop name -> busy intervals of the analyzed iteration
+            map<string, vector<pair<int64_t, int64_t> > > busy_;
+            int64_t begin_ = 0;
+            int64_t end_ = 0;
+    };
+
+}
+
+#endif
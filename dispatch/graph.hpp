@@ -39,7 +39,9 @@ namespace purine {
     class Runnable;
 
     class Graph {
+        friend class Inference;
         friend class Runnable;
+        friend class SiblingFusion;
         protected:
         string cached_name_;
         Graph* cached_root_;
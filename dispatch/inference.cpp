@@ -0,0 +1,430 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <sstream>
+
+#include "dispatch/blob.hpp"
+#include "dispatch/graph_template.hpp"
+#include "dispatch/inference.hpp"
+#include "operations/include/activation.hpp"
+#include "operations/include/bias.hpp"
+#include "operations/include/conv.hpp"
+#include "operations/include/dummy.hpp"
+#include "operations/include/eltwise.hpp"
+#include "operations/include/fused.hpp"
+#include "operations/include/inner.hpp"
+
+using std::deque;
+
+namespace purine {
+
+    // nodes ordered so that a node comes after all its inputs
+    static vector<Node*> topological(const vector<Node*>& nodes) {
+        map<Node*, int> in;
+        deque<Node*> que;
+        for (Node* node : nodes) {
+            in[node] = node->inputs().size();
+            if (node->is_source()) {
+                que.push_back(node);
+            }
+        }
+        vector<Node*> order;
+        while (que.size() != 0) {
+            Node* node = que.front();
+            que.pop_front();
+            order.push_back(node);
+            for (Node* output : node->outputs()) {
+                if (--in[output] == 0) {
+                    que.push_back(output);
+                }
+            }
+        }
+        return order;
+    }
+
+    Inference::Inference(Runnable* graph, const vector<Blob*>& inputs,
+            const vector<Blob*>& outputs) : graph_(graph),
+        inputs_(inputs.begin(), inputs.end()),
+        outputs_(outputs.begin(), outputs.end()) {
+        CHECK(!graph->prepared_) << "the graph is rewritten before it is run";
+        strip();
+        Graph* into = graph->createAny<Graph>("inference");
+        fold_scales(into);
+        fuse(into);
+        fold_constants();
+        plan();
+    }
+
+    void Inference::remove(Node* node) {
+        static_cast<Graph*>(node)->parent_->delete_subgraph(node);
+    }
+
+    void Inference::strip() {
+        set<Node*> needed;
+        deque<Node*> que(outputs_.begin(), outputs_.end());
+        while (que.size() != 0) {
+            Node* node = que.front();
+            que.pop_front();
+            if (needed.insert(node).second) {
+                que.insert(que.end(), node->inputs().begin(),
+                        node->inputs().end());
+                // an op keeps all its outputs, even those nobody reads
+                if (dynamic_cast<Op_*>(node) != NULL) {
+                    que.insert(que.end(), node->outputs().begin(),
+                            node->outputs().end());
+                }
+            }
+        }
+        for (Node* node : graph_->Graph::nodes()) {
+            if (needed.count(node) == 0) {
+                remove(node);
+                ++stripped_;
+            }
+        }
+    }
+
+    void Inference::fold_scales(Graph* into) {
+        vector<Node*> nodes = graph_->Graph::nodes();
+        map<Tensor*, vector<Blob*> > tensors;
+        vector<Op<Scale>*> scales;
+        for (Node* node : nodes) {
+            if (Blob* blob = dynamic_cast<Blob*>(node)) {
+                tensors[blob->tensor()].push_back(blob);
+            } else if (Op<Scale>* scale = dynamic_cast<Op<Scale>*>(node)) {
+                scales.push_back(scale);
+            }
+        }
+        for (Op<Scale>* scale : scales) {
+            if (scale->inputs().size() != 1 || scale->outputs().size() != 1) {
+                continue;
+            }
+            Blob* x = static_cast<Blob*>(scale->inputs()[0]);
+            Blob* y = static_cast<Blob*>(scale->outputs()[0]);
+            if (outputs_.count(y) || y->inputs().size() != 1
+                    || y->outputs().size() == 0) {
+                continue;
+            }
+            // y is only read as the bottom of conv or inner, and does not
+            // share its tensor but with x (inplace dropout)
+            bool foldable = true;
+            for (Blob* blob : tensors[y->tensor()]) {
+                foldable &= blob == x || blob == y;
+            }
+            for (Node* reader : y->outputs()) {
+                foldable &= (dynamic_cast<Op<Conv>*>(reader) != NULL
+                        || dynamic_cast<Op<Inner>*>(reader) != NULL)
+                    && reader->inputs()[0] == y && reader->inputs()[1] != y;
+            }
+            if (!foldable) {
+                continue;
+            }
+            vector<Node*> readers = y->outputs();
+            for (Node* reader : readers) {
+                Op_* op = static_cast<Op_*>(reader);
+                Blob* weight = static_cast<Blob*>(op->inputs()[1]);
+                Blob* scaled = into->create("scaled_weight", weight->rank(),
+                        weight->device(), weight->tensor()->size());
+                vector<Blob*>{ weight } >> *into->create<Scale>("scale_weight",
+                        weight->rank(), weight->device(), "main", scale->param())
+                    >> vector<Blob*>{ scaled };
+                op->replace_input(y, x);
+                op->replace_input(weight, scaled);
+            }
+            remove(scale);
+            remove(y);
+            ++scales_;
+        }
+    }
+
+    void Inference::fuse(Graph* into) {
+        vector<Op_*> candidates;
+        for (Node* node : graph_->Graph::nodes()) {
+            if (dynamic_cast<Op<Conv>*>(node) != NULL
+                    || dynamic_cast<Op<Inner>*>(node) != NULL) {
+                candidates.push_back(static_cast<Op_*>(node));
+            }
+        }
+        auto same_place = [](Op_* a, Op_* b)->bool {
+            return a->rank() == b->rank() && a->device() == b->device();
+        };
+        for (Op_* op : candidates) {
+            if (op->inputs().size() != 2 || op->outputs().size() != 1) {
+                continue;
+            }
+            Blob* top = static_cast<Blob*>(op->outputs()[0]);
+            // the only other writer of top is a Bias
+            Op_* bias = NULL;
+            bool fusable = top->inputs().size() <= 2;
+            for (Node* writer : top->inputs()) {
+                if (writer != op) {
+                    bias = static_cast<Op_*>(writer);
+                    fusable &= dynamic_cast<Op<Bias>*>(writer) != NULL
+                        && writer->inputs().size() == 1 && same_place(op, bias);
+                }
+            }
+            if (!fusable) {
+                continue;
+            }
+            // and an activation is its only reader
+            Op<Activation>* activation = NULL;
+            if (outputs_.count(top) == 0 && top->outputs().size() == 1) {
+                activation = dynamic_cast<Op<Activation>*>(top->outputs()[0]);
+                if (activation != NULL && (activation->inputs().size() != 1
+                            || activation->outputs().size() != 1
+                            || activation->outputs()[0]->inputs().size() != 1
+                            || !same_place(op, activation))) {
+                    activation = NULL;
+                }
+            }
+            if (bias == NULL && activation == NULL) {
+                continue;
+            }
+            Blob* out = activation != NULL
+                ? static_cast<Blob*>(activation->outputs()[0]) : top;
+            string mode = activation != NULL ? std::get<0>(activation->param())
+                : "";
+            vector<Blob*> inputs = { static_cast<Blob*>(op->inputs()[0]),
+                static_cast<Blob*>(op->inputs()[1]) };
+            if (bias != NULL) {
+                inputs.push_back(static_cast<Blob*>(bias->inputs()[0]));
+            }
+            Op_* fused;
+            if (Op<Conv>* conv = dynamic_cast<Op<Conv>*>(op)) {
+                int pad_h, pad_w, stride_h, stride_w;
+                std::tie(pad_h, pad_w, stride_h, stride_w) = conv->param();
+                fused = into->create<ConvBiasAct>(op->name(), op->rank(),
+                        op->device(), op->thread(), ConvBiasAct::param_tuple(
+                            pad_h, pad_w, stride_h, stride_w, mode));
+            } else {
+                fused = into->create<InnerBiasAct>(op->name(), op->rank(),
+                        op->device(), op->thread(),
+                        InnerBiasAct::param_tuple(mode));
+            }
+            remove(op);
+            if (bias != NULL) {
+                remove(bias);
+            }
+            if (activation != NULL) {
+                remove(activation);
+                remove(top);
+            }
+            inputs >> *fused >> vector<Blob*>{ out };
+            ++fused_;
+        }
+    }
+
+    void Inference::fold_constants() {
+        vector<Node*> order = topological(graph_->Graph::nodes());
+        // constant: blobs which are not fed and only constant ops write, ops
+        // reading only constant blobs (ops without inputs may be random)
+        set<Node*> constant;
+        for (Node* node : order) {
+            bool is_constant;
+            if (dynamic_cast<Blob*>(node) != NULL) {
+                is_constant = inputs_.count(node) == 0
+                    && outputs_.count(node) == 0;
+            } else {
+                is_constant = !node->is_source();
+            }
+            for (Node* input : node->inputs()) {
+                is_constant &= constant.count(input) != 0;
+            }
+            if (is_constant) {
+                constant.insert(node);
+            }
+        }
+        vector<Op_*> ops;
+        vector<Node*> blobs;
+        for (Node* node : order) {
+            if (constant.count(node) == 0) {
+                continue;
+            }
+            if (dynamic_cast<Blob*>(node) == NULL) {
+                ops.push_back(static_cast<Op_*>(node));
+                continue;
+            }
+            // the intermediate results, read only by the folded ops
+            bool intermediate = !node->is_source();
+            for (Node* reader : node->outputs()) {
+                intermediate &= constant.count(reader) != 0;
+            }
+            if (intermediate) {
+                blobs.push_back(node);
+            }
+        }
+        if (ops.size() == 0) {
+            return;
+        }
+        constants_ = make_shared<Runnable>();
+        map<Node*, Blob*> copies;
+        auto copy = [&](Node* node)->Blob* {
+            if (copies.count(node) == 0) {
+                copies[node] = constants_->create("constant",
+                        static_cast<Blob*>(node)->shared_tensor());
+            }
+            return copies[node];
+        };
+        for (Op_* op : ops) {
+            vector<Blob*> inputs(op->inputs().size());
+            vector<Blob*> outputs(op->outputs().size());
+            transform(op->inputs().begin(), op->inputs().end(), inputs.begin(),
+                    copy);
+            transform(op->outputs().begin(), op->outputs().end(),
+                    outputs.begin(), copy);
+            inputs >> *op->clone(constants_.get(), "fold") >> outputs;
+        }
+        for (Op_* op : ops) {
+            remove(op);
+        }
+        for (Node* blob : blobs) {
+            remove(blob);
+        }
+        folded_ = ops.size();
+    }
+
+    void Inference::plan() {
+        vector<Node*> order = topological(graph_->Graph::nodes());
+        map<Node*, int> index;
+        vector<Op_*> ops;
+        for (Node* node : order) {
+            if (Op_* op = dynamic_cast<Op_*>(node)) {
+                index[op] = ops.size();
+                ops.push_back(op);
+            }
+        }
+        // ancestors[i][j]: ops[j] is done before ops[i] starts
+        vector<vector<bool> > ancestors(ops.size(),
+                vector<bool>(ops.size(), false));
+        for (int i = 0; i < ops.size(); ++i) {
+            for (Node* input : ops[i]->inputs()) {
+                for (Node* writer : input->inputs()) {
+                    int j = index[writer];
+                    ancestors[i][j] = true;
+                    for (int k = 0; k < j; ++k) {
+                        if (ancestors[j][k]) {
+                            ancestors[i][k] = true;
+                        }
+                    }
+                }
+            }
+        }
+        // tensors in the order they are first written
+        vector<Tensor*> tensors;
+        map<Tensor*, vector<Blob*> > blobs;
+        for (Node* node : order) {
+            if (Blob* blob = dynamic_cast<Blob*>(node)) {
+                if (blobs.count(blob->tensor()) == 0) {
+                    tensors.push_back(blob->tensor());
+                }
+                blobs[blob->tensor()].push_back(blob);
+            }
+        }
+        struct Buffer {
+            int rank;
+            int device;
+            int count;
+            vector<Tensor*> tensors;
+            set<int> users;  // the ops reading or writing the tensors
+        };
+        vector<Buffer> buffers;
+        auto is_dummy = [](Node* node)->bool {
+            return dynamic_cast<Op<Dummy>*>(node) != NULL;
+        };
+        for (Tensor* tensor : tensors) {
+            // not fed, read after the run, weights or slices
+            bool pooled = tensor->is_contiguous();
+            set<int> writers;
+            set<int> users;
+            for (Blob* blob : blobs[tensor]) {
+                pooled &= inputs_.count(blob) == 0 && outputs_.count(blob) == 0
+                    && !blob->is_source();
+                for (Node* writer : blob->inputs()) {
+                    pooled &= !is_dummy(writer);
+                    writers.insert(index[writer]);
+                    users.insert(index[writer]);
+                }
+                for (Node* reader : blob->outputs()) {
+                    pooled &= !is_dummy(reader);
+                    users.insert(index[reader]);
+                }
+            }
+            if (!pooled) {
+                continue;
+            }
+            int count = tensor->size().count();
+            bytes_before_ += count * sizeof(DTYPE);
+            // the free buffer it fits best, the largest if none is enough
+            int best = -1;
+            for (int b = 0; b < buffers.size(); ++b) {
+                const Buffer& buffer = buffers[b];
+                if (buffer.rank != tensor->rank()
+                        || buffer.device != tensor->device()) {
+                    continue;
+                }
+                bool free = true;
+                for (int user : buffer.users) {
+                    for (int writer : writers) {
+                        free &= ancestors[writer][user];
+                    }
+                }
+                if (!free) {
+                    continue;
+                }
+                if (best < 0) {
+                    best = b;
+                    continue;
+                }
+                bool fits = buffer.count >= count;
+                bool best_fits = buffers[best].count >= count;
+                if (fits != best_fits ? fits : (fits
+                            ? buffer.count < buffers[best].count
+                            : buffer.count > buffers[best].count)) {
+                    best = b;
+                }
+            }
+            if (best < 0) {
+                best = buffers.size();
+                buffers.push_back({ tensor->rank(), tensor->device(), 0, {},
+                        {} });
+            }
+            Buffer& buffer = buffers[best];
+            buffer.count = std::max(buffer.count, count);
+            buffer.tensors.push_back(tensor);
+            buffer.users.insert(users.begin(), users.end());
+        }
+        planned_ = buffers.size();
+        for (const Buffer& buffer : buffers) {
+            bytes_after_ += buffer.count * sizeof(DTYPE);
+            if (buffer.rank != current_rank()) {
+                continue;
+            }
+            shared_ptr<Tensor> memory(new Tensor(buffer.rank, buffer.device,
+                        Size(1, 1, 1, buffer.count)));
+            memory->mutable_data();
+            for (Tensor* tensor : buffer.tensors) {
+                tensor->alias(memory.get());
+            }
+            buffers_.push_back(memory);
+        }
+    }
+
+    void Inference::fold() {
+        if (constants_) {
+            constants_->run();
+        }
+    }
+
+    string Inference::report() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "removed " << stripped_ << " nodes, moved " << scales_
+            << " dropout scales onto weights, fused " << fused_ << " ops, "
+            << folded_ << " ops folded into constants" << std::endl;
+        out << "  activations " << bytes_before_ / (1 << 20) << " MB, in "
+            << planned_ << " buffers of " << bytes_after_ / (1 << 20) << " MB"
+            << std::endl;
+        return out.str();
+    }
+
+}
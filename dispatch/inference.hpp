@@ -0,0 +1,73 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_INFERENCE
+#define PURINE_INFERENCE
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "dispatch/op.hpp"
+#include "dispatch/runnable.hpp"
+
+using std::set;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief compiles a graph for evaluation.
+     *
+     * inputs are the blobs fed between runs (data, labels), outputs the
+     * blobs read after them (loss, probs). The constructor rewrites the
+     * graph before it is first run:
+     * - nodes the outputs do not depend on are removed, all of backward.
+     *   The ops kept keep all their outputs (the mask of Pool, the diff of
+     *   SoftmaxCrossEntropy);
+     * - the Scale of a test-time dropout read only by conv or inner ops is
+     *   moved onto their weights, conv(s * x, W) = conv(x, s * W);
+     * - conv/inner, its Bias and an activation reading only its top become
+     *   one ConvBiasAct or InnerBiasAct, the inplace blobs go away;
+     * - ops which only read weights (the scaled weights) are moved out of
+     *   the graph, fold() runs them once the weights are loaded;
+     * - the intermediate tensors share buffers. A tensor reuses a buffer
+     *   once all the readers of the tensors in it are ancestors of its
+     *   writers, so the buffer is free whatever order the ops run in.
+     *
+     * The weight blobs stay in the graph, the owner may keep pointers to
+     * them.
+     */
+    class Inference {
+        public:
+            explicit Inference(Runnable* graph, const vector<Blob*>& inputs,
+                    const vector<Blob*>& outputs);
+            // compute the folded constants, again whenever the weights change
+            void fold();
+            // nodes removed, ops fused and folded, memory of the activations
+            string report() const;
+        protected:
+            Runnable* graph_;
+            shared_ptr<Runnable> constants_;
+            vector<shared_ptr<Tensor> > buffers_;
+            set<Node*> inputs_;
+            set<Node*> outputs_;
+            int stripped_ = 0;
+            int scales_ = 0;
+            int fused_ = 0;
+            int folded_ = 0;
+            int planned_ = 0;  // buffers, on all the ranks
+            double bytes_before_ = 0.;
+            double bytes_after_ = 0.;
+            void remove(Node* node);
+            void strip();
+            void fold_scales(Graph* into);
+            void fuse(Graph* into);
+            void fold_constants();
+            void plan();
+    };
+
+}
+
+#endif
@@ -3,9 +3,11 @@
 
 namespace purine {
 
-    Node::Node(int rank, int device)
-        : Graph(rank, device), in_(0), out_(0) {
+    Node::Node(int rank, int device) : Graph(rank, device) {
+        for (std::atomic<int>& in : in_) {
+            in = 0;
         }
+    }
 
     Node::~Node() {
         // disconnect from the graph
@@ -19,48 +21,27 @@ namespace purine {
         }
     }
 
-    void Node::compute() {
+    void Node::compute(int generation) {
         LOG(FATAL) << "Not Implemented";
     }
 
-    int Node::in() const {
-        return in_;
-    }
-
-    int Node::out() const {
-        return out_;
+    int Node::in(int generation) const {
+        return in_[generation % MAX_IN_FLIGHT];
     }
 
     void Node::setup() {
     }
 
-    void Node::inc_in() {
-        int in = in_.fetch_add(1);
+    void Node::inc_in(int generation, Node* input) {
+        int in = in_[generation % MAX_IN_FLIGHT].fetch_add(1);
         if (in + 1 == (int)inputs_.size()) {
-            compute();
-            for (Node* node : inputs_) {
-                node->inc_out();
-            }
-            clear_in();
-            // for (Node* node : outputs_) {
-            //   node->inc_in();
-            // }
-        }
-    }
-
-    void Node::inc_out() {
-        int out = out_.fetch_add(1);
-        if (out + 1 >= (int)outputs_.size()) {
-            clear_out();
+            compute(generation);
+            clear_in(generation);
         }
     }
 
-    void Node::clear_in() {
-        in_ = 0;
-    }
-
-    void Node::clear_out() {
-        out_ = 0;
+    void Node::clear_in(int generation) {
+        in_[generation % MAX_IN_FLIGHT] = 0;
     }
 
 }
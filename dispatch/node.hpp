@@ -14,16 +14,26 @@ namespace purine {
     using std::atomic;
     using std::vector;
 
+    /**
+     * @brief node of the dispatch graph.
+     *
+     * Every iteration of the runnable is tagged with a generation number.
+     * The number of finished inputs is counted per generation, in a ring of
+     * MAX_IN_FLIGHT counters, so that nodes can receive inputs of the next
+     * iteration while the current one is still running.
+     */
     class Node : public Graph {
+        public:
+            // maximum number of overlapping iterations of a runnable
+            static const int MAX_IN_FLIGHT = 4;
         protected:
-            std::atomic<int> in_;
-            std::atomic<int> out_;
+            std::atomic<int> in_[MAX_IN_FLIGHT];
             vector<Node*> inputs_;
             vector<Node*> outputs_;
         public:
             explicit Node(int rank = 0, int device = 0);
             virtual ~Node() override;
-            virtual void compute();
+            virtual void compute(int generation);
             virtual void setup() override;
 
             inline bool is_source() const { return inputs_.size() == 0; }
@@ -33,12 +43,10 @@ namespace purine {
             inline void add_input(Node* b) { inputs_.push_back(b); }
             inline void add_output(Node* b) { outputs_.push_back(b); }
 
-            int in() const;
-            int out() const;
-            void inc_in();
-            void inc_out();
-            void clear_in();
-            void clear_out();
+            int in(int generation) const;
+            // input is the node which finished, NULL if not known
+            virtual void inc_in(int generation, Node* input = NULL);
+            void clear_in(int generation);
     };
 
 }
@@ -1,5 +1,6 @@
 // Copyright Lin Min 2015
 #include <deque>
+#include "caffeine/math_functions.hpp"
 #include "dispatch/op.hpp"
 #include "dispatch/blob.hpp"
 #include "dispatch/runnable.hpp"
@@ -9,10 +10,14 @@ using std::deque;
 namespace purine {
 
     Op_::Op_(int rank, int device, const string& thread)
-        : Node(rank, device), thread_(thread) {
+        : Node(rank, device), thread_(thread), done_(0) {
+            std::fill(ready_, ready_ + MAX_IN_FLIGHT, false);
         }
 
     Op_::~Op_() {
+        if (done_event_) {
+            CUDA_CHECK(cudaEventDestroy(done_event_));
+        }
     }
 
     // find the loop from looper.
@@ -26,15 +31,92 @@ namespace purine {
         return *loop_;
     }
 
-    void Op_::compute() {
-        loop().post([this](){
+    void Op_::trace(Tracer::Category category, int64_t begin) {
+        if (trace_name_ < 0) {
+            trace_name_ = Tracer::intern(cached_name_);
+            trace_loop_ = Tracer::intern((device_ < 0 ? string("cpu")
+                        : "gpu" + to_string(device_)) + ":" + thread_);
+        }
+        Tracer::record(trace_name_, trace_loop_, device_, category, begin,
+                Tracer::now());
+    }
+
+    void Op_::compute(int generation) {
+        generation_mutex_.lock();
+        ready_[generation % MAX_IN_FLIGHT] = true;
+        generation_mutex_.unlock();
+        try_launch();
+    }
+
+    bool Op_::outputs_free(int generation) {
+        for (Node* output : outputs_) {
+            for (Node* reader : output->outputs()) {
+                if (reader->rank() == rank_
+                        && static_cast<Op_*>(reader)->done_ < generation) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void Op_::try_launch() {
+        generation_mutex_.lock();
+        int generation = done_;
+        if (running_ || !ready_[generation % MAX_IN_FLIGHT]
+                || !outputs_free(generation)) {
+            generation_mutex_.unlock();
+            return;
+        }
+        ready_[generation % MAX_IN_FLIGHT] = false;
+        running_ = true;
+        generation_mutex_.unlock();
+        launch(generation);
+    }
+
+    void Op_::finish(int generation) {
+        generation_mutex_.lock();
+        done_ = generation + 1;
+        running_ = false;
+        generation_mutex_.unlock();
+        try_launch();
+        // the writers of the inputs might be waiting for this op
+        for (Node* input : inputs_) {
+            for (Node* writer : input->inputs()) {
+                if (writer->rank() == rank_) {
+                    static_cast<Op_*>(writer)->try_launch();
+                }
+            }
+        }
+    }
+
+    void Op_::launch(int generation) {
+        loop().post([this, generation](){
                 // put setup code inside..
                 if (!this->o_) {
                     this->setup();/*size inputs and outputs*/
                 }
+                int64_t begin = Tracer::enabled() ? Tracer::now() : 0;
+                bool overlap = dynamic_cast<Runnable*>(cached_root_)
+                    ->max_in_flight() > 1;
                 vector<bool> add(outputs_.size());
                 transform(outputs_.begin(), outputs_.end(), add.begin(),
-                    [] (Node* b) -> bool { return b->in() > 0; });
+                    [generation] (Node* b) -> bool {
+                    return b->in(generation) > 0
+                        || static_cast<Blob*>(b)->accumulate(); });
+                // readers of the previous generation on other loops
+                vector<cudaEvent_t> readers;
+                if (overlap) {
+                    for (Node* output : outputs_) {
+                        for (Node* node : output->outputs()) {
+                            Op_* reader = static_cast<Op_*>(node);
+                            if (reader->rank() == rank_ && reader->done_event_
+                                    && &reader->loop() != &loop()) {
+                                readers.push_back(reader->done_event_);
+                            }
+                        }
+                    }
+                }
                 if (device_ < 0) {
                     for (Node* node : inputs_) {
                         Blob* b = static_cast<Blob*>(node);
@@ -43,6 +125,9 @@ namespace purine {
                         }
                         CUDA_CHECK(cudaEventSynchronize(b->cuda_event()));
                     }
+                    for (cudaEvent_t event : readers) {
+                        CUDA_CHECK(cudaEventSynchronize(event));
+                    }
                 // #ifndef NDEBUG
                 //           LOG(INFO) << "start " << cached_name_;
                 // #endif
@@ -55,6 +140,9 @@ namespace purine {
                         }
                         CUDA_CHECK(cudaStreamWaitEvent(stream(), b->cuda_event(), 0));
                     }
+                    for (cudaEvent_t event : readers) {
+                        CUDA_CHECK(cudaStreamWaitEvent(stream(), event, 0));
+                    }
                     // #ifndef NDEBUG
                     //           LOG(INFO) << "start " << cached_name_;
                     // #endif
@@ -62,19 +150,35 @@ namespace purine {
                     // #ifndef NDEBUG
                     //           CUDA_CHECK(cudaStreamSynchronize(stream()));
                     // #endif
+                    // kernels are async, wait for them to get a real span
+                    if (begin != 0) {
+                        CUDA_CHECK(cudaStreamSynchronize(stream()));
+                    }
+                    if (overlap) {
+                        if (done_event_ == NULL) {
+                            CUDA_CHECK(cudaEventCreate(&done_event_,
+                                        cudaEventBlockingSync|cudaEventDisableTiming));
+                        }
+                        CUDA_CHECK(cudaEventRecord(done_event_, stream()));
+                    }
+                }
+                if (begin != 0) {
+                    trace(Tracer::COMPUTE, begin);
                 }
                 for (Node* output : outputs_) {
-                    output->inc_in();
+                    output->inc_in(generation);
                 }
-                // ++sink_counter if is sink
+                // sink_done if is sink
                 if (outputs_.size() == 0) {
-                    loop().post([this]()->void{
+                    loop().post([this, generation]()->void{
                             if (device_ >= 0) {
                             CUDA_CHECK(cudaStreamSynchronize(stream()));
                             }
-                            ++(dynamic_cast<Runnable*>(cached_root_)->sink_counter());
+                            dynamic_cast<Runnable*>(cached_root_)
+                            ->sink_done(generation);
                             });
                 }
+                finish(generation);
         });
     }
 
@@ -110,6 +214,30 @@ namespace purine {
         }
     }
 
+    void Op_::add_control(Blob* blob) {
+        blob->outputs_.push_back(this);
+        inputs_.push_back(blob);
+        ++controls_;
+    }
+
+    void Op_::replace_input(Blob* from, Blob* to) {
+        CHECK(!o_) << "can not rewire " << name() << " after setup";
+        CHECK(find(inputs_.begin(), inputs_.end(), from) != inputs_.end());
+        for (Node*& input : inputs_) {
+            if (input == from) {
+                input = to;
+                to->outputs_.push_back(this);
+            }
+        }
+        from->outputs_.erase(remove(from->outputs_.begin(), from->outputs_.end(),
+                    this), from->outputs_.end());
+    }
+
+    Op_* Op_::clone(Graph* graph, const string& name) {
+        LOG(FATAL) << "can not clone " << this->name();
+        return NULL;
+    }
+
     Op_& operator >> (const vector<Blob*>& inputs, Op_& op) {
         op.check_inputs(inputs);
         op.set_inputs(inputs);
@@ -130,13 +258,18 @@ namespace purine {
                 int flag;
                 MPI_CHECK(MPI_Test(request, &flag, MPI_STATUS_IGNORE));
                 if (flag) {
+                    if (trace_begin_ != 0) {
+                        trace(Tracer::MPI_RECV, trace_begin_);
+                    }
                     for (Node* output : outputs_) {
-                        output->inc_in();
+                        output->inc_in(mpi_generation_);
                     }
-                    // ++sink_counter if is sink
+                    // sink_done if is sink
                     if (outputs_.size() == 0) {
-                        ++(dynamic_cast<Runnable*>(cached_root_)->sink_counter());
+                        dynamic_cast<Runnable*>(cached_root_)
+                            ->sink_done(mpi_generation_);
                     }
+                    finish(mpi_generation_);
                 } else {
                     loop().post(mpi_test_);
                 }
@@ -154,15 +287,18 @@ namespace purine {
         this->o_.reset(new Irecv(input_tensors, output_tensors, this->args_));
     }
 
-    void Op<Irecv>::compute() {
+    void Op<Irecv>::launch(int generation) {
         if (!o_) {
             setup();
         }
-        loop().post([this]() {
+        loop().post([this, generation]() {
+                mpi_generation_ = generation;
                 vector<bool> add(outputs_.size());
                 transform(outputs_.begin(), outputs_.end(), add.begin(),
-                    [] (Node* b) -> bool { return b->in() > 0; });
+                    [generation] (Node* b) -> bool {
+                    return b->in(generation) > 0; });
                 if (device_ < 0) {
+                trace_begin_ = Tracer::enabled() ? Tracer::now() : 0;
                 o_->compute_cpu(add);
                 loop().post(mpi_test_);
                 } else {
@@ -180,7 +316,12 @@ namespace purine {
                 int flag;
                 MPI_CHECK(MPI_Test(request, &flag, MPI_STATUS_IGNORE));
                 if (flag) {
-                    ++(dynamic_cast<Runnable*>(cached_root_)->sink_counter());
+                    if (trace_begin_ != 0) {
+                        trace(Tracer::MPI_SEND, trace_begin_);
+                    }
+                    dynamic_cast<Runnable*>(cached_root_)
+                        ->sink_done(mpi_generation_);
+                    finish(mpi_generation_);
                 } else {
                     loop().post(mpi_test_);
                 }
@@ -198,13 +339,15 @@ namespace purine {
         this->o_.reset(new Isend(input_tensors, output_tensors, this->args_));
     }
 
-    void Op<Isend>::compute() {
+    void Op<Isend>::launch(int generation) {
         if (!o_) {
             setup();
         }
-        loop().post([this]() {
+        loop().post([this, generation]() {
+                mpi_generation_ = generation;
                 // there is not output for Isend
                 if (device_ < 0) {
+                trace_begin_ = Tracer::enabled() ? Tracer::now() : 0;
                 o_->compute_cpu({});
                 loop().post(mpi_test_);
                 } else {
@@ -250,4 +393,151 @@ namespace purine {
         }
     }
 
+    Op<QuorumSum>::Op(int rank, int device, const string& thread,
+            const typename QuorumSum::param_tuple& args)
+        : Op_(rank, device, thread), args_(args) {
+            int deadline;
+            std::tie(quorum_, deadline, defer_, weights_) = args;
+            deadline_ = deadline;
+        }
+
+    void Op<QuorumSum>::setup() {
+        // the inputs, then the deferred copies of the two last generations
+        vector<Tensor*> input_tensors;
+        for (Node* node : inputs_) {
+            input_tensors.push_back(static_cast<Blob*>(node)->tensor());
+        }
+        for (int parity : { 0, 1 }) {
+            for (const shared_ptr<Tensor>& t : deferred_[parity]) {
+                input_tensors.push_back(t.get());
+            }
+        }
+        this->o_.reset(new QuorumSum(input_tensors,
+                    { static_cast<Blob*>(outputs_[0])->tensor() }, args_));
+    }
+
+    vector<int> Op<QuorumSum>::late() {
+        std::lock_guard<std::mutex> lock(quorum_mutex_);
+        return late_;
+    }
+
+    void Op<QuorumSum>::inc_in(int generation, Node* input) {
+        int num = inputs_.size();
+        int index = find(inputs_.begin(), inputs_.end(), input) - inputs_.begin();
+        CHECK_LT(index, num);
+        std::unique_lock<std::mutex> lock(quorum_mutex_);
+        if (weights_.size() == 0) {
+            weights_ = vector<DTYPE>(num, 1.);
+        }
+        CHECK_EQ(weights_.size(), num);
+        if (late_.size() == 0) {
+            late_ = vector<int>(num, 0);
+            if (defer_) {
+                for (int parity : { 0, 1 }) {
+                    for (int i = 0; i < num; ++i) {
+                        deferred_[parity].push_back(shared_ptr<Tensor>(
+                                    new Tensor(rank_, device_,
+                                        static_cast<Blob*>(input)->tensor()->size())));
+                    }
+                }
+            }
+        }
+        if (generation < next_) {
+            ++late_[index];
+            if (!defer_ || generation != next_ - 1) {
+                ++dropped_;
+                return;
+            }
+            // copy now, the writer does not write again until this returns
+            ++deferred_count_;
+            pending_.push_back(index);
+            Blob* blob = static_cast<Blob*>(input);
+            if (blob->cuda_event() != NULL) {
+                CUDA_CHECK(cudaEventSynchronize(blob->cuda_event()));
+            }
+            Tensor* dest = deferred_[generation % 2][index].get();
+            caffe::caffe_gpu_memcpy(dest->size().count() * sizeof(DTYPE),
+                    device_ < 0 ? blob->tensor()->cpu_data()
+                    : blob->tensor()->gpu_data(),
+                    device_ < 0 ? dest->mutable_cpu_data()
+                    : dest->mutable_gpu_data());
+            return;
+        }
+        Arrival& arrival = arrivals_[generation % MAX_IN_FLIGHT];
+        if (arrival.generation != generation) {
+            arrival.generation = generation;
+            arrival.count = 0;
+            arrival.first = Tracer::now();
+            arrival.arrived = vector<bool>(num, false);
+            if (deadline_ > 0 && num > 1) {
+                watch(generation);
+            }
+        }
+        arrival.arrived[index] = true;
+        ++arrival.count;
+        lock.unlock();
+        try_fire();
+    }
+
+    void Op<QuorumSum>::try_fire() {
+        int num = inputs_.size();
+        vector<int> fired;
+        quorum_mutex_.lock();
+        while (true) {
+            Arrival& arrival = arrivals_[next_ % MAX_IN_FLIGHT];
+            if (arrival.generation != next_ || !(arrival.count == num
+                        || arrival.count >= quorum_ || (deadline_ > 0
+                            && Tracer::now() - arrival.first >= deadline_))) {
+                break;
+            }
+            vector<DTYPE>& terms = terms_[next_ % MAX_IN_FLIGHT];
+            terms = vector<DTYPE>(defer_ ? 3 * num : num, 0.);
+            DTYPE total = 0.;
+            DTYPE taken = 0.;
+            for (int i = 0; i < num; ++i) {
+                total += weights_[i];
+                if (arrival.arrived[i]) {
+                    terms[i] = weights_[i];
+                    taken += weights_[i];
+                }
+            }
+            for (int i : pending_) {
+                terms[num * (1 + (next_ - 1) % 2) + i] = weights_[i];
+                taken += weights_[i];
+            }
+            pending_.clear();
+            for (DTYPE& t : terms) {
+                t *= total / taken;
+            }
+            fired.push_back(next_++);
+        }
+        quorum_mutex_.unlock();
+        for (int generation : fired) {
+            compute(generation);
+        }
+    }
+
+    void Op<QuorumSum>::watch(int generation) {
+        loop().post([this, generation]() {
+                try_fire();
+                quorum_mutex_.lock();
+                bool waiting = next_ <= generation;
+                quorum_mutex_.unlock();
+                if (waiting) {
+                    watch(generation);
+                }
+                });
+    }
+
+    void Op<QuorumSum>::launch(int generation) {
+        if (!o_) {
+            setup();
+        }
+        quorum_mutex_.lock();
+        static_cast<QuorumSum*>(o_.get())->set_weights(
+                terms_[generation % MAX_IN_FLIGHT]);
+        quorum_mutex_.unlock();
+        Op_::launch(generation);
+    }
+
 }
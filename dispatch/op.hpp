@@ -7,12 +7,15 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 #include "common/loop.hpp"
 #include "dispatch/blob.hpp"
 #include "dispatch/node.hpp"
+#include "dispatch/trace.hpp"
 #include "operations/operation.hpp"
 #include "operations/tensor.hpp"
+#include "operations/include/eltwise.hpp"
 #include "operations/include/mpi.hpp"
 #include "operations/include/mem_copy.hpp"
 
@@ -36,18 +39,47 @@ namespace purine {
         protected:
         string thread_; // name of thread
         shared_ptr<Operation> o_;
+        // trailing inputs which only order the op, not given to the operation
+        int controls_ = 0;
         bool input_setup_ = false;
         bool output_setup_ = false;
+        // interned names for the tracer, -1 until first traced
+        int trace_name_ = -1;
+        int trace_loop_ = -1;
+        int64_t trace_begin_ = 0;
+        void trace(Tracer::Category category, int64_t begin);
+        // generations are run in order, one at a time. gen is launched when
+        // its inputs are ready (ready_) and the ops reading the outputs are
+        // done with gen - 1, whose outputs would be overwritten otherwise.
+        std::mutex generation_mutex_;
+        std::atomic<int> done_;  // number of finished generations
+        bool running_ = false;
+        bool ready_[MAX_IN_FLIGHT];
+        // recorded after each launch when iterations overlap, so that the
+        // writers of the inputs on other loops wait for the kernels.
+        cudaEvent_t done_event_ = NULL;
+        bool outputs_free(int generation);
+        void try_launch();
+        void finish(int generation);
+        // post the operation of this generation to the loop,
+        // finish(generation) is called when it is done.
+        virtual void launch(int generation);
         public:
         explicit Op_(int rank, int device, const string& thread);
         virtual ~Op_() override;
-        virtual void compute() override;
+        virtual void compute(int generation) override;
         inline string thread() const { return thread_; }
         LoopInterface& loop();
         virtual void set_inputs(const vector<Blob*>& inputs);
         virtual void set_outputs(const vector<Blob*>& outputs);
         virtual void check_inputs(const vector<Blob*>& inputs);
         virtual void check_outputs(const vector<Blob*>& outputs);
+        // launch after blob is ready too, without reading it.
+        void add_control(Blob* blob);
+        // read to instead of from, only before the op is setup.
+        void replace_input(Blob* from, Blob* to);
+        // an op of the same operation and param in graph, not connected.
+        virtual Op_* clone(Graph* graph, const string& name);
     };
 
     template <typename O>
@@ -63,6 +95,7 @@ namespace purine {
                     setup();
                 }
                 inline const typename O::param_tuple& param() { return args_; }
+                virtual Op_* clone(Graph* graph, const string& name) override;
         };
 
     template <>
@@ -72,10 +105,12 @@ namespace purine {
                 virtual void setup() override;
                 // this function tests whether the underlying async mpi operation is done yet
                 function<void()> mpi_test_;
+                int mpi_generation_ = 0;
+                virtual void launch(int generation) override;
             public:
                 explicit Op(int rank, int device, const string& thread,
                         const typename Irecv::param_tuple& args);
-                virtual void compute() override;
+                inline const typename Irecv::param_tuple& param() { return args_; }
         };
 
     template <>
@@ -84,10 +119,66 @@ namespace purine {
                 typename Isend::param_tuple args_;
                 virtual void setup() override;
                 function<void()> mpi_test_;
+                int mpi_generation_ = 0;
+                virtual void launch(int generation) override;
             public:
                 explicit Op(int rank, int device, const string& thread,
                         const typename Isend::param_tuple& args);
-                virtual void compute() override;
+                inline const typename Isend::param_tuple& param() { return args_; }
+        };
+
+    /**
+     * @brief sum of the inputs which arrived in time.
+     *
+     * The generation is launched once quorum of the inputs arrived, or the
+     * deadline passed since the first of them arrived, or all of them
+     * arrived. The sum is rescaled by (sum of all the weights) / (sum of the
+     * weights of the inputs taken), so it has the scale of the full sum.
+     * An input arriving after its generation was launched is late: it is
+     * dropped, or with defer its data is copied when it arrives and added
+     * to the next generation (only one generation late, older ones are
+     * dropped since their writer may be overwriting them already).
+     * Generations are launched in order.
+     */
+    template <>
+        class Op<QuorumSum> : public Op_ {
+            protected:
+                typename QuorumSum::param_tuple args_;
+                int quorum_;
+                int64_t deadline_;
+                bool defer_;
+                vector<DTYPE> weights_;
+                struct Arrival {
+                    int generation = -1;
+                    int count = 0;
+                    int64_t first = 0;
+                    vector<bool> arrived;
+                };
+                std::mutex quorum_mutex_;
+                Arrival arrivals_[MAX_IN_FLIGHT];
+                // weights given to QuorumSum for each generation
+                vector<DTYPE> terms_[MAX_IN_FLIGHT];
+                int next_ = 0;  // next generation to launch
+                // late inputs of generation next_ - 1, copied into
+                // deferred_[(next_ - 1) % 2]
+                vector<int> pending_;
+                vector<shared_ptr<Tensor> > deferred_[2];
+                vector<int> late_;
+                int dropped_ = 0;
+                int deferred_count_ = 0;
+                virtual void setup() override;
+                virtual void launch(int generation) override;
+                void try_fire();
+                void watch(int generation);
+            public:
+                explicit Op(int rank, int device, const string& thread,
+                        const typename QuorumSum::param_tuple& args);
+                virtual void inc_in(int generation, Node* input = NULL) override;
+                inline const typename QuorumSum::param_tuple& param() { return args_; }
+                // number of times each input was late
+                vector<int> late();
+                inline int dropped() const { return dropped_; }
+                inline int deferred() const { return deferred_count_; }
         };
 
     template <>
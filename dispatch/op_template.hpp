@@ -9,6 +9,7 @@
 
 #include "dispatch/op.hpp"
 #include "dispatch/blob.hpp"
+#include "dispatch/graph_template.hpp"
 
 using std::function;
 using std::string;
@@ -26,9 +27,10 @@ namespace purine {
 
     template <typename O>
         void Op<O>::setup() {
-            vector<Tensor*> input_tensors(this->inputs_.size());
+            vector<Tensor*> input_tensors(this->inputs_.size() - this->controls_);
             vector<Tensor*> output_tensors(this->outputs_.size());
-            transform(this->inputs_.begin(), this->inputs_.end(), input_tensors.begin(),
+            transform(this->inputs_.begin(), this->inputs_.end() - this->controls_,
+                    input_tensors.begin(),
                     [] (Node* b) -> Tensor* { return static_cast<Blob*>(b)->tensor(); });
             transform(this->outputs_.begin(), this->outputs_.end(),
                     output_tensors.begin(), [] (Node* b) -> Tensor*
@@ -36,6 +38,11 @@ namespace purine {
             this->o_.reset(new O(input_tensors, output_tensors, this->args_));
         }
 
+    template <typename O>
+        Op_* Op<O>::clone(Graph* graph, const string& name) {
+            return graph->create<O>(name, rank_, device_, thread_, args_);
+        }
+
 }
 
 #endif
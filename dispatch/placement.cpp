@@ -0,0 +1,168 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+
+#include "dispatch/blob.hpp"
+#include "dispatch/op.hpp"
+#include "dispatch/placement.hpp"
+
+using std::map;
+
+namespace purine {
+
+    Placement::Placement(Runnable* graph, const vector<string>& layers,
+            const vector<Tracer::Event>& events) : layers_(layers) {
+        CHECK_GT(layers.size(), 0);
+        // average span of each op
+        map<string, pair<int64_t, int> > spans;
+        for (const Tracer::Event& e : events) {
+            if (e.category == Tracer::COMPUTE) {
+                pair<int64_t, int>& s = spans[Tracer::name(e.name)];
+                s.first += e.end - e.begin;
+                ++s.second;
+            }
+        }
+        // layer of each op, -1 for the ops between layers (copies)
+        map<Node*, int> layer_of;
+        cost_ = vector<double>(layers.size(), 0.);
+        for (Node* node : graph->nodes()) {
+            Op_* op = dynamic_cast<Op_*>(node);
+            if (op == NULL) {
+                continue;
+            }
+            int index = -1;
+            for (int i = 0; i < layers.size(); ++i) {
+                if (op->cached_name().find("::" + layers[i] + "::")
+                        != string::npos) {
+                    index = i;
+                    break;
+                }
+            }
+            layer_of[op] = index;
+            auto it = spans.find(op->cached_name());
+            if (index >= 0 && it != spans.end()) {
+                cost_[index] += double(it->second.first) / it->second.second;
+            }
+        }
+        // a blob moves between its producer and all its consumers
+        cut_ = vector<double>(layers.size() - 1, 0.);
+        for (Node* node : graph->nodes()) {
+            Blob* blob = dynamic_cast<Blob*>(node);
+            if (blob == NULL || blob->inputs().size() == 0) {
+                continue;
+            }
+            int lo = std::numeric_limits<int>::max();
+            int hi = -1;
+            for (const vector<Node*>* ops : { &blob->inputs(), &blob->outputs() }) {
+                for (Node* op : *ops) {
+                    int index = layer_of.count(op) ? layer_of[op] : -1;
+                    if (index >= 0) {
+                        lo = std::min(lo, index);
+                        hi = std::max(hi, index);
+                    }
+                }
+            }
+            for (int k = lo; k < hi; ++k) {
+                cut_[k] += blob->tensor()->size().count() * sizeof(DTYPE);
+            }
+        }
+    }
+
+    void Placement::set_links(const Link& intra_rank, const Link& inter_rank) {
+        intra_rank_ = intra_rank;
+        inter_rank_ = inter_rank;
+    }
+
+    double Placement::transfer(double bytes, const pair<int, int>& from,
+            const pair<int, int>& to) const {
+        if (from == to || bytes == 0) {
+            return 0.;
+        }
+        const Link& link = from.first == to.first ? intra_rank_ : inter_rank_;
+        return link.latency + bytes / link.bandwidth;
+    }
+
+    vector<pair<int, int> > Placement::solve(
+            const vector<pair<int, int> >& locations, int micro_batches) {
+        CHECK_GT(locations.size(), 0);
+        CHECK_GT(micro_batches, 0);
+        int L = layers_.size();
+        vector<double> prefix(L + 1, 0.);
+        for (int i = 0; i < L; ++i) {
+            prefix[i + 1] = prefix[i] + cost_[i];
+        }
+        const double inf = std::numeric_limits<double>::infinity();
+        predicted_ = inf;
+        locations_ = locations;
+        for (int S = 1; S <= std::min<int>(locations.size(), L); ++S) {
+            // cost of layers [i, j] as group s of S
+            auto group = [&](int i, int j, int s)->double {
+                double t = prefix[j + 1] - prefix[i];
+                if (s > 0) {
+                    t += transfer(cut_[i - 1], locations[s - 1], locations[s]);
+                }
+                if (s < S - 1) {
+                    t += transfer(cut_[j], locations[s], locations[s + 1]);
+                }
+                return t;
+            };
+            // best[s][j]: slowest group when layers [0, j] are in groups [0, s]
+            vector<vector<double> > best(S, vector<double>(L, inf));
+            vector<vector<int> > first(S, vector<int>(L, 0));
+            for (int j = 0; j < L; ++j) {
+                best[0][j] = group(0, j, 0);
+            }
+            for (int s = 1; s < S; ++s) {
+                for (int j = s; j < L; ++j) {
+                    for (int i = s; i <= j; ++i) {
+                        double t = std::max(best[s - 1][i - 1], group(i, j, s));
+                        if (t < best[s][j]) {
+                            best[s][j] = t;
+                            first[s][j] = i;
+                        }
+                    }
+                }
+            }
+            double iteration = (micro_batches + S - 1) * best[S - 1][L - 1];
+            if (iteration < predicted_) {
+                predicted_ = iteration;
+                placement_ = vector<pair<int, int> >(L);
+                for (int s = S - 1, j = L - 1; s >= 0; --s) {
+                    int i = s == 0 ? 0 : first[s][j];
+                    for (int k = i; k <= j; ++k) {
+                        placement_[k] = locations[s];
+                    }
+                    j = i - 1;
+                }
+            }
+        }
+        return placement_;
+    }
+
+    string Placement::report() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        for (int i = 0; i < layers_.size(); ++i) {
+            out << "  " << std::setw(16) << layers_[i] << " "
+                << cost_[i] / 1000. << " ms";
+            if (placement_.size() != 0) {
+                out << " [" << placement_[i].first << "]["
+                    << (placement_[i].second < 0 ? string("CPU") : "GPU"
+                            + std::to_string(placement_[i].second)) << "]";
+            }
+            if (i < cut_.size()) {
+                out << ", cut " << cut_[i] / (1 << 20) << " MB";
+            }
+            out << std::endl;
+        }
+        if (placement_.size() != 0) {
+            out << "  predicted iteration " << predicted_ / 1000. << " ms"
+                << std::endl;
+        }
+        return out.str();
+    }
+
+}
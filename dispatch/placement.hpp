@@ -0,0 +1,68 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_PLACEMENT
+#define PURINE_PLACEMENT
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dispatch/runnable.hpp"
+#include "dispatch/trace.hpp"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief choose where the layers of a network run from measured costs.
+     *
+     * The costs are taken from a profiling run of the network on a single
+     * location with Tracer enabled: the compute time of a layer is the sum
+     * of the average spans of its ops (ops whose cached name contains
+     * "::layer::"), the size of the cut after layer k is the bytes of the
+     * blobs passed between layers <= k and layers > k, forward and backward.
+     *
+     * solve() splits the layers, in order, into contiguous groups on the
+     * first s of the given locations, for every s, with a dynamic program
+     * minimizing the slowest group (its compute plus the Copy of the cuts at
+     * its both ends over the link between the locations). With m micro
+     * batches a pipeline of s groups takes (m + s - 1) times the slowest
+     * group, the s with the shortest predicted iteration is kept.
+     * The result is the location of each layer, to be passed to the
+     * constructor of the network (see GoogLeNet) before it is run.
+     */
+    class Placement {
+        public:
+            struct Link {
+                double latency;  // us
+                double bandwidth;  // bytes per us
+            };
+            explicit Placement(Runnable* graph, const vector<string>& layers,
+                    const vector<Tracer::Event>& events = Tracer::events());
+            // links between devices of a rank and between ranks
+            void set_links(const Link& intra_rank, const Link& inter_rank);
+            vector<pair<int, int> > solve(const vector<pair<int, int> >& locations,
+                    int micro_batches = 1);
+            inline const vector<double>& layer_cost() const { return cost_; }
+            inline const vector<double>& cut_bytes() const { return cut_; }
+            // predicted iteration time of the last solve, in us
+            inline double predicted() const { return predicted_; }
+            string report() const;
+        protected:
+            double transfer(double bytes, const pair<int, int>& from,
+                    const pair<int, int>& to) const;
+            vector<string> layers_;
+            vector<double> cost_;  // us per layer
+            vector<double> cut_;  // bytes between layer k and k + 1
+            Link intra_rank_ = { 10., 5e3 };  // PCIe
+            Link inter_rank_ = { 50., 1e3 };  // 10GbE
+            vector<pair<int, int> > placement_;
+            vector<pair<int, int> > locations_;
+            double predicted_ = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,396 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include "dispatch/blob.hpp"
+#include "dispatch/graph_template.hpp"
+#include "dispatch/recompute.hpp"
+#include "operations/include/dropout.hpp"
+#include "operations/include/dummy.hpp"
+#include "operations/include/release.hpp"
+
+using std::deque;
+using std::set;
+
+namespace purine {
+
+    Recompute::Recompute(Runnable* graph,
+            const vector<vector<string> >& segments) : graph_(graph) {
+        CHECK(!graph->prepared_) << "the graph is rewritten before it is run";
+        vector<Node*> nodes = graph->Graph::nodes();
+        for (Node* node : nodes) {
+            if (Blob* blob = dynamic_cast<Blob*>(node)) {
+                tensors_[blob->tensor()].push_back(blob);
+            }
+        }
+        // ops of each segment in each net, the net is the name before the layer
+        map<pair<int, string>, vector<Op_*> > groups;
+        for (Node* node : nodes) {
+            Op_* op = dynamic_cast<Op_*>(node);
+            if (op == NULL) {
+                continue;
+            }
+            string name = "::" + op->name();
+            bool found = false;
+            for (int s = 0; s < segments.size() && !found; ++s) {
+                for (const string& layer : segments[s]) {
+                    size_t pos = name.find("::" + layer + "::");
+                    if (pos != string::npos) {
+                        groups[{ s, pos == 0 ? "" : name.substr(2, pos - 2) }]
+                            .push_back(op);
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        }
+        for (const auto& kv : groups) {
+            const vector<string>& layers = segments[kv.first.first];
+            Segment segment;
+            segment.name = (kv.first.second == "" ? "" : kv.first.second + "::")
+                + layers.front() + (layers.size() > 1 ? ".." + layers.back() : "");
+            segment.bytes = 0.;
+            Graph* into = graph->createAny<Graph>("recompute"
+                    + to_string(segments_.size()));
+            rewrite(&segment, kv.second, into);
+            segments_.push_back(segment);
+        }
+    }
+
+    void Recompute::rewrite(Segment* segment, const vector<Op_*>& ops,
+            Graph* into) {
+        set<Node*> group(ops.begin(), ops.end());
+        // walk down from the outputs of the segment, the nodes reached
+        // through an op which is not in the segment are late.
+        set<Node*> early;
+        set<Node*> late;
+        deque<pair<Node*, bool> > que;
+        for (Op_* op : ops) {
+            for (Node* output : op->outputs()) {
+                que.push_back({ output, false });
+            }
+        }
+        while (que.size() != 0) {
+            Node* node = que.front().first;
+            bool after = que.front().second;
+            que.pop_front();
+            if ((after ? late : early).insert(node).second == false) {
+                continue;
+            }
+            bool blob = dynamic_cast<Blob*>(node) != NULL;
+            for (Node* next : node->outputs()) {
+                que.push_back({ next, after || (blob && group.count(next) == 0) });
+            }
+        }
+        vector<Op_*> forward;
+        vector<Op_*> backward;
+        for (Op_* op : ops) {
+            if (late.count(op)) {
+                backward.push_back(op);
+            } else if (!op->is_source()) {
+                forward.push_back(op);
+            }
+        }
+        set<Node*> is_forward(forward.begin(), forward.end());
+        // backward starts with the diffs written after the segment
+        vector<Blob*> gate;
+        for (Op_* op : backward) {
+            for (Node* input : op->inputs()) {
+                if (late.count(input) && none_of(input->inputs().begin(),
+                            input->inputs().end(), [&](Node* writer)->bool {
+                            return group.count(writer) != 0;
+                            }) && find(gate.begin(), gate.end(), input)
+                        == gate.end()) {
+                    gate.push_back(static_cast<Blob*>(input));
+                }
+            }
+        }
+
+        // blobs only forward writes and only the segment reads
+        auto is_dummy = [](Node* op)->bool {
+            return dynamic_cast<Op<Dummy>*>(op) != NULL;
+        };
+        // dropout would draw another mask
+        auto is_random = [](Node* op)->bool {
+            return dynamic_cast<Op<Dropout>*>(op) != NULL;
+        };
+        set<Node*> released;
+        for (Op_* op : forward) {
+            for (Node* output : op->outputs()) {
+                const vector<Node*>& writers = output->inputs();
+                const vector<Node*>& readers = output->outputs();
+                if (readers.size() != 0 && all_of(writers.begin(), writers.end(),
+                            [&](Node* w)->bool {
+                            return is_forward.count(w) && !is_dummy(w)
+                                && !is_random(w);
+                            }) && all_of(readers.begin(), readers.end(),
+                                [&](Node* r)->bool {
+                                return group.count(r) && !is_dummy(r);
+                                })) {
+                    released.insert(output);
+                }
+            }
+        }
+        // a tensor is released with all its blobs, an op is recomputed with
+        // all its outputs and only from inputs nothing else overwrites.
+        auto overwritten = [&](Node* input)->bool {
+            for (Blob* other : tensors_[static_cast<Blob*>(input)->tensor()]) {
+                if (other != input && other->inputs().size() != 0
+                        && other->inputs() != input->inputs()) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (Node* blob : vector<Node*>(released.begin(), released.end())) {
+                const vector<Blob*>& sharing =
+                    tensors_[static_cast<Blob*>(blob)->tensor()];
+                if (any_of(sharing.begin(), sharing.end(), [&](Blob* b)->bool {
+                            return released.count(b) == 0; })) {
+                    released.erase(blob);
+                    changed = true;
+                }
+            }
+            for (Op_* op : forward) {
+                const vector<Node*>& inputs = op->inputs();
+                const vector<Node*>& outputs = op->outputs();
+                if (all_of(outputs.begin(), outputs.end(), [&](Node* b)->bool {
+                            return released.count(b) != 0; })
+                        && none_of(inputs.begin(), inputs.end(),
+                            [&](Node* b)->bool {
+                            return released.count(b) == 0 && overwritten(b);
+                            })) {
+                    continue;
+                }
+                for (Node* output : outputs) {
+                    changed = released.erase(output) != 0 || changed;
+                }
+            }
+        }
+
+        // the forward ops writing what backward reads, and what they read
+        set<Node*> recompute;
+        set<Node*> needed;
+        deque<Node*> todo;
+        for (Op_* op : backward) {
+            for (Node* input : op->inputs()) {
+                if (released.count(input)) {
+                    todo.push_back(input);
+                }
+            }
+        }
+        while (todo.size() != 0) {
+            Node* blob = todo.front();
+            todo.pop_front();
+            if (needed.insert(blob).second == false) {
+                continue;
+            }
+            for (Node* writer : blob->inputs()) {
+                if (recompute.insert(writer).second) {
+                    for (Node* input : writer->inputs()) {
+                        if (released.count(input)) {
+                            todo.push_back(input);
+                        }
+                    }
+                }
+            }
+        }
+        if (recompute.size() != 0) {
+            CHECK_NE(gate.size(), 0) << "no diff comes back to "
+                << segment->name;
+        }
+
+        // clone the ops, writing blobs which share the released tensors
+        map<Node*, Blob*> clone;
+        vector<Op_*> roots;
+        for (Op_* op : forward) {
+            if (recompute.count(op) == 0) {
+                continue;
+            }
+            for (Node* output : op->outputs()) {
+                if (clone.count(output) == 0) {
+                    clone[output] = into->create(output->name(),
+                            static_cast<Blob*>(output)->shared_tensor());
+                }
+            }
+        }
+        for (Op_* op : forward) {
+            if (recompute.count(op) == 0) {
+                continue;
+            }
+            Op_* copy = op->clone(into, op->name());
+            vector<Blob*> inputs;
+            vector<Blob*> outputs;
+            bool root = true;
+            for (Node* input : op->inputs()) {
+                if (clone.count(input)) {
+                    inputs.push_back(clone[input]);
+                    root = false;
+                } else {
+                    inputs.push_back(static_cast<Blob*>(input));
+                }
+            }
+            for (Node* output : op->outputs()) {
+                outputs.push_back(clone[output]);
+            }
+            inputs >> *copy >> outputs;
+            if (root) {
+                roots.push_back(copy);
+            }
+            segment->recomputed.push_back(op);
+        }
+        for (Op_* op : backward) {
+            vector<Node*> inputs = op->inputs();
+            for (Node* input : inputs) {
+                if (clone.count(input) && find(op->inputs().begin(),
+                            op->inputs().end(), input) != op->inputs().end()) {
+                    op->replace_input(static_cast<Blob*>(input), clone[input]);
+                }
+            }
+        }
+
+        // free a tensor once the readers of all its blobs are done. returns
+        // the blob written after the memory is freed, NULL if a reader has
+        // no output to wait for.
+        auto release = [&](const vector<Blob*>& blobs)->Blob* {
+            vector<Blob*> controls;
+            for (Blob* blob : blobs) {
+                for (Node* reader : blob->outputs()) {
+                    if (reader->outputs().size() == 0) {
+                        return NULL;
+                    }
+                    for (Node* output : reader->outputs()) {
+                        Blob* b = static_cast<Blob*>(output);
+                        if (find(blobs.begin(), blobs.end(), b) == blobs.end()
+                                && find(controls.begin(), controls.end(), b)
+                                == controls.end()) {
+                            controls.push_back(b);
+                        }
+                    }
+                }
+            }
+            Blob* first = blobs[0];
+            Op<Release>* op = into->create<Release>("release", first->rank(),
+                    first->device(), "main", Release::param_tuple());
+            Blob* token = into->create("released", first->rank(),
+                    first->device(), { 1, 1, 1, 1 });
+            blobs >> *op >> vector<Blob*>{ token };
+            for (Blob* control : controls) {
+                op->add_control(control);
+            }
+            return token;
+        };
+        vector<Tensor*> order;
+        map<Tensor*, vector<Blob*> > by_tensor;
+        for (Op_* op : forward) {
+            for (Node* output : op->outputs()) {
+                Blob* blob = static_cast<Blob*>(output);
+                vector<Blob*>& blobs = by_tensor[blob->tensor()];
+                if (released.count(output) == 0 || find(blobs.begin(),
+                            blobs.end(), blob) != blobs.end()) {
+                    continue;
+                }
+                if (blobs.size() == 0) {
+                    order.push_back(blob->tensor());
+                }
+                blobs.push_back(blob);
+            }
+        }
+        // after forward, the recompute waits for the memory to be freed
+        vector<Blob*> tokens;
+        for (Tensor* tensor : order) {
+            Blob* token = release(by_tensor[tensor]);
+            if (token != NULL) {
+                tokens.push_back(token);
+                segment->bytes += tensor->size().count() * sizeof(DTYPE);
+            }
+        }
+        for (Op_* root : roots) {
+            for (Blob* control : gate) {
+                root->add_control(control);
+            }
+            for (Blob* control : tokens) {
+                root->add_control(control);
+            }
+        }
+        // after backward
+        for (Tensor* tensor : order) {
+            vector<Blob*> clones;
+            for (Blob* blob : by_tensor[tensor]) {
+                if (clone.count(blob)) {
+                    clones.push_back(clone[blob]);
+                }
+            }
+            if (clones.size() != 0) {
+                release(clones);
+            }
+        }
+    }
+
+    vector<vector<string> > Recompute::split(const vector<string>& layers,
+            int length) {
+        int num = layers.size() - 1;
+        if (length <= 0) {
+            length = std::max(1, int(std::ceil(std::sqrt(double(num)))));
+        }
+        vector<vector<string> > ret;
+        for (int i = 0; i < num; i += length) {
+            ret.push_back(vector<string>(layers.begin() + i,
+                        layers.begin() + std::min(i + length, num)));
+        }
+        return ret;
+    }
+
+    double Recompute::released() const {
+        double ret = 0.;
+        for (const Segment& segment : segments_) {
+            ret += segment.bytes;
+        }
+        return ret;
+    }
+
+    string Recompute::report(const Simulator::Profile* profile) const {
+        if (profile != NULL) {
+            // costs are looked up by cached name
+            graph_->prepare_once();
+        }
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        double largest = 0.;
+        double time = 0.;
+        int recomputed = 0;
+        for (const Segment& segment : segments_) {
+            out << "  " << std::setw(32) << segment.name << " frees "
+                << segment.bytes / (1 << 20) << " MB, recomputes "
+                << segment.recomputed.size() << " ops";
+            if (profile != NULL) {
+                double t = 0.;
+                for (Op_* op : segment.recomputed) {
+                    t += std::max(profile->cost(op), 0.);
+                }
+                out << " in " << t / 1000. << " ms";
+                time += t;
+            }
+            out << std::endl;
+            largest = std::max(largest, segment.bytes);
+            recomputed += segment.recomputed.size();
+        }
+        out << "  " << released() / (1 << 20) << " MB freed between forward "
+            << "and backward, the largest segment takes back "
+            << largest / (1 << 20) << " MB, " << recomputed
+            << " forward ops run twice";
+        if (profile != NULL) {
+            out << " (" << time / 1000. << " ms per iteration)";
+        }
+        out << std::endl;
+        return out.str();
+    }
+
+}
@@ -0,0 +1,80 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_RECOMPUTE
+#define PURINE_RECOMPUTE
+
+#include <string>
+#include <vector>
+
+#include "dispatch/op.hpp"
+#include "dispatch/runnable.hpp"
+#include "dispatch/simulator.hpp"
+
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief activation recomputation (gradient checkpointing).
+     *
+     * A segment is a run of consecutive layers, named like in Placement (the
+     * ops whose name contains "::layer::"). It is rewritten separately in
+     * every net of the graph, e.g. in every replica of a DataParallel. The
+     * backward ops of a segment are the ones reached from the outputs of the
+     * segment through an op after the segment (the top diff comes back
+     * through the loss), the other ops reading something are forward.
+     *
+     * Blobs written only by forward ops and read only inside the segment are
+     * released after forward: a Release op frees their memory once their
+     * forward readers are done. The forward ops writing the blobs backward
+     * reads are cloned into recompute ops, which start when the top diff of
+     * the segment arrives and write the same tensors again, the backward ops
+     * read them from there and another Release frees them afterwards. So
+     * only the inputs of the segments (the checkpoints) stay allocated
+     * between forward and backward, at the cost of running the forward of
+     * the segments twice.
+     *
+     * Kept in memory, and not recomputed: blobs sharing their tensor with
+     * a blob read outside of the segment (inplace layers), slices of Split
+     * and Concat, outputs of ops without inputs and of Dropout (the masks
+     * of dropout are random) and whatever only they can compute.
+     *
+     * The graph is rewritten by the constructor, before it is first run.
+     * Like tensors shared with share_from, the released tensors are not
+     * tracked across iterations, the graph should keep max_in_flight 1.
+     */
+    class Recompute {
+        public:
+            explicit Recompute(Runnable* graph,
+                    const vector<vector<string> >& segments);
+            /**
+             * @brief consecutive segments of length layers, sqrt of the
+             *        number of layers by default. The last layer (the loss)
+             *        is in no segment.
+             */
+            static vector<vector<string> > split(const vector<string>& layers,
+                    int length = 0);
+            // bytes freed after forward, in all the segments
+            double released() const;
+            /**
+             * @brief memory freed and forward ops recomputed per segment.
+             *        with profile, the recompute time too.
+             */
+            string report(const Simulator::Profile* profile = NULL) const;
+        protected:
+            struct Segment {
+                string name;
+                vector<Op_*> recomputed;  // the forward ops which are cloned
+                double bytes;
+            };
+            Runnable* graph_;
+            vector<Segment> segments_;
+            void rewrite(Segment* segment, const vector<Op_*>& ops,
+                    Graph* into);
+            // tensor -> blobs, of the whole graph
+            map<Tensor*, vector<Blob*> > tensors_;
+    };
+
+}
+
+#endif
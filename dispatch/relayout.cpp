@@ -0,0 +1,120 @@
+// Copyright Lin Min 2015
+#include <sstream>
+
+#include "dispatch/blob.hpp"
+#include "dispatch/graph_template.hpp"
+#include "dispatch/relayout.hpp"
+#include "operations/include/activation.hpp"
+#include "operations/include/bias.hpp"
+#include "operations/include/conv.hpp"
+#include "operations/include/dummy.hpp"
+#include "operations/include/fused.hpp"
+#include "operations/include/lrn.hpp"
+#include "operations/include/pool.hpp"
+#include "operations/include/reorder.hpp"
+
+namespace purine {
+
+    bool Relayout::agnostic(Node* node) {
+        Op_* op = static_cast<Op_*>(node);
+        if (op->device() >= 0) {
+            return false;
+        }
+        // not the convs sharing their columns
+        return (dynamic_cast<Op<Conv>*>(op) != NULL
+                && op->outputs().size() == 1)
+            || (dynamic_cast<Op<ConvWeight>*>(op) != NULL
+                    && op->inputs().size() == 2)
+            || dynamic_cast<Op<ConvDown>*>(op) != NULL
+            || dynamic_cast<Op<Bias>*>(op) != NULL
+            || dynamic_cast<Op<BiasDown>*>(op) != NULL
+            || dynamic_cast<Op<Activation>*>(op) != NULL
+            || dynamic_cast<Op<ActivationDown>*>(op) != NULL
+            || dynamic_cast<Op<LRN>*>(op) != NULL
+            || dynamic_cast<Op<LRNScale>*>(op) != NULL
+            || dynamic_cast<Op<LRNDown>*>(op) != NULL
+            || dynamic_cast<Op<Pool>*>(op) != NULL
+            || dynamic_cast<Op<PoolDown>*>(op) != NULL
+            || (dynamic_cast<Op<ConvBiasAct>*>(op) != NULL
+                    && op->outputs().size() == 1);
+    }
+
+    Relayout::Relayout(Runnable* graph, Layout layout) : graph_(graph) {
+        CHECK(!graph->prepared_) << "the graph is rewritten before it is run";
+        vector<Node*> nodes = graph->Graph::nodes();
+        map<Tensor*, vector<Blob*> > tensors;
+        vector<Tensor*> order;
+        for (Node* node : nodes) {
+            if (Blob* blob = dynamic_cast<Blob*>(node)) {
+                if (tensors.count(blob->tensor()) == 0) {
+                    order.push_back(blob->tensor());
+                }
+                tensors[blob->tensor()].push_back(blob);
+            }
+        }
+        auto is_dummy = [](Node* node)->bool {
+            return dynamic_cast<Op<Dummy>*>(node) != NULL;
+        };
+        // the weight diffs are packed NCHW like the weights
+        auto weight_diff = [](Node* node)->bool {
+            return dynamic_cast<Op<ConvWeight>*>(node) != NULL
+                || dynamic_cast<Op<BiasDown>*>(node) != NULL;
+        };
+        Graph* into = NULL;
+        for (Tensor* tensor : order) {
+            const vector<Blob*>& blobs = tensors[tensor];
+            bool change = tensor->device() < 0
+                && tensor->stride() == Stride(tensor->size())
+                && tensor->layout() != layout;
+            for (Blob* blob : blobs) {
+                change &= !blob->inputs().empty();
+                for (Node* writer : blob->inputs()) {
+                    change &= agnostic(writer) && !weight_diff(writer);
+                }
+                // sliced by Split or Concat, the memory is already there
+                for (Node* reader : blob->outputs()) {
+                    change &= !is_dummy(reader);
+                }
+            }
+            if (!change) {
+                continue;
+            }
+            tensor->set_layout(layout);
+            ++changed_;
+            for (Blob* blob : blobs) {
+                vector<Node*> readers;
+                for (Node* reader : blob->outputs()) {
+                    if (!agnostic(reader)) {
+                        readers.push_back(reader);
+                    }
+                }
+                if (readers.empty()) {
+                    continue;
+                }
+                // { blob } >> reorder >> { copy } >> readers
+                if (into == NULL) {
+                    into = graph->createAny<Graph>("relayout");
+                }
+                // on the thread of the writer, the readers may be elsewhere
+                Op_* writer = static_cast<Op_*>(blob->inputs()[0]);
+                Blob* copy = into->create(blob->name(), tensor->rank(),
+                        tensor->device(), tensor->size());
+                vector<Blob*>{ blob } >> *into->create<Reorder>("reorder",
+                        writer->rank(), writer->device(), writer->thread(),
+                        Reorder::param_tuple()) >> vector<Blob*>{ copy };
+                for (Node* node : readers) {
+                    static_cast<Op_*>(node)->replace_input(blob, copy);
+                }
+                ++reordered_;
+            }
+        }
+    }
+
+    string Relayout::report() const {
+        std::ostringstream out;
+        out << "changed the layout of " << changed_ << " tensors, "
+            << reordered_ << " reorders";
+        return out.str();
+    }
+
+}
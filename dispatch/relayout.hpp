@@ -0,0 +1,47 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_RELAYOUT
+#define PURINE_RELAYOUT
+
+#include <string>
+#include <vector>
+
+#include "dispatch/op.hpp"
+#include "dispatch/runnable.hpp"
+
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief changes the layout of the cpu tensors between layout agnostic
+     *        ops.
+     *
+     * A tensor is changed to layout when it is on the cpu, packed NCHW and
+     * all the writers of its blobs are ops whose cpu kernels follow the
+     * strides (conv, bias, activation, lrn and pool, forward and
+     * backward). Readers which do not are given an NCHW copy of the blob,
+     * made by a Reorder.
+     * Sources (data, weights), the weight diffs, Split and Concat (the
+     * sliced tensors and their slices) keep their layout, so do the convs
+     * keeping their columns, which need packed NCHW images.
+     *
+     * The graph is rewritten by the constructor, before it is first run.
+     */
+    class Relayout {
+        public:
+            explicit Relayout(Runnable* graph, Layout layout = NHWC);
+            // number of tensors changed, and of Reorder added
+            inline int changed() const { return changed_; }
+            inline int reordered() const { return reordered_; }
+            string report() const;
+        protected:
+            Runnable* graph_;
+            int changed_ = 0;
+            int reordered_ = 0;
+            static bool agnostic(Node* node);
+    };
+
+}
+
+#endif
@@ -147,20 +147,35 @@ namespace purine {
         sync();
     }
 
-    void Runnable::run_async() {
+    Runnable::Iteration Runnable::run_async() {
         prepare_once();
+        int generation = generation_++;
+        if (generation >= max_in_flight_) {
+            iterations_[(generation - max_in_flight_) % Node::MAX_IN_FLIGHT]
+                .wait();
+        }
+        Iteration& iteration = iterations_[generation % Node::MAX_IN_FLIGHT];
+        iteration = Iteration(generation, cached_sinks_.size());
         for (Node* source : cached_sources_) {
             // #ifndef NDEBUG
             //     LOG(INFO) << "source: " << source->cached_name();
             // #endif
-            source->compute();
+            source->compute(generation);
         }
+        return iteration;
     }
 
     void Runnable::sync() {
-        if (sink_counter_ == cached_sinks_.size()) {
-            return;
+        for (Iteration& iteration : iterations_) {
+            iteration.wait();
         }
     }
 
+    void Runnable::set_max_in_flight(int k) {
+        CHECK_GE(k, 1);
+        CHECK_LE(k, Node::MAX_IN_FLIGHT);
+        sync();
+        max_in_flight_ = k;
+    }
+
 }
@@ -17,29 +17,57 @@ using std::condition_variable;
 namespace purine {
 
     class Runnable : public Graph {
+        friend class Inference;
+        friend class Recompute;
+        friend class Relayout;
+        friend class SiblingFusion;
+        friend class Simulator;
         public:
 
-            class SinkCounter {
+            /**
+             * @brief handle of one iteration started by run_async.
+             *        copies share the same state. wait() blocks until all
+             *        the sinks of the iteration are done.
+             */
+            class Iteration {
                 private:
-                    shared_ptr<condition_variable> cv_;
-                    shared_ptr<mutex> mtx_;
-                    shared_ptr<int> count_;
+                    struct State {
+                        int generation;
+                        int sinks;
+                        int done = 0;
+                        mutex mtx;
+                        condition_variable cv;
+                    };
+                    shared_ptr<State> state_;
                 public:
-                    SinkCounter() {
-                        cv_.reset(new condition_variable);
-                        mtx_.reset(new mutex);
-                        count_.reset(new int(0));
+                    Iteration() {}
+                    Iteration(int generation, int sinks) {
+                        state_.reset(new State);
+                        state_->generation = generation;
+                        state_->sinks = sinks;
                     }
-                    int operator++ () {
-                        std::unique_lock<std::mutex> lck(*mtx_);
-                        ++(*count_);
-                        cv_->notify_all();
+                    inline int generation() const {
+                        return state_ ? state_->generation : -1;
                     }
-                    bool operator== (int num) {
-                        std::unique_lock<std::mutex> lck(*mtx_);
-                        cv_->wait(lck, [this, num]()->bool { return *count_ == num; });
-                        *count_ = 0;
-                        return true;
+                    bool ready() const {
+                        if (!state_) {
+                            return true;
+                        }
+                        std::unique_lock<std::mutex> lck(state_->mtx);
+                        return state_->done == state_->sinks;
+                    }
+                    void wait() const {
+                        if (!state_) {
+                            return;
+                        }
+                        std::unique_lock<std::mutex> lck(state_->mtx);
+                        state_->cv.wait(lck, [this]()->bool {
+                                return state_->done == state_->sinks; });
+                    }
+                    void operator++ () {
+                        std::unique_lock<std::mutex> lck(state_->mtx);
+                        ++state_->done;
+                        state_->cv.notify_all();
                     }
             };
 
@@ -48,14 +76,31 @@ namespace purine {
             vector<Node*> cached_sinks_;
             bool prepared_ = false;
             void prepare_once();
-            SinkCounter sink_counter_;
+            // iterations in flight, indexed by generation % MAX_IN_FLIGHT
+            Iteration iterations_[Node::MAX_IN_FLIGHT];
+            int generation_ = 0;
+            int max_in_flight_ = 1;
             mutex mutex_;
             map<tuple<int, string>, shared_ptr<LoopInterface> > loops_;
         public:
             explicit Runnable(int rank = 0, int device = 0);
             virtual ~Runnable();
 
-            inline SinkCounter& sink_counter() { return sink_counter_; }
+            // called by the sinks when they are done with the iteration.
+            inline void sink_done(int generation) {
+                ++iterations_[generation % Node::MAX_IN_FLIGHT];
+            }
+            inline int max_in_flight() const { return max_in_flight_; }
+            /**
+             * @brief allow up to k iterations to run at the same time.
+             *        ops of a later iteration start as soon as their inputs
+             *        are ready, the op itself is done with the previous
+             *        iteration and the ops reading its outputs are done with
+             *        it too. Tensors shared between blobs (share_from) and
+             *        tensors swapped by the caller between iterations are not
+             *        tracked, graphs relying on them should keep k = 1.
+             */
+            void set_max_in_flight(int k);
 
             virtual vector<Node*> nodes() override;
             LoopInterface& task_loop(int device, const string& thread);
@@ -64,7 +109,10 @@ namespace purine {
                 if(nodes().size() == 0){return true;}
                 else{return false;}
             }
-            virtual void run_async();
+            // start an iteration, blocks while max_in_flight iterations are
+            // still running.
+            virtual Iteration run_async();
+            // wait for all the iterations in flight.
             virtual void sync();
             vector<vector<string> > print();
     };
@@ -0,0 +1,236 @@
+// Copyright Lin Min 2015
+#include <sstream>
+
+#include "dispatch/blob.hpp"
+#include "dispatch/graph_template.hpp"
+#include "dispatch/sibling_fusion.hpp"
+#include "operations/include/bias.hpp"
+#include "operations/include/conv.hpp"
+#include "operations/include/dummy.hpp"
+#include "operations/include/fused.hpp"
+
+namespace purine {
+
+    SiblingFusion::SiblingFusion(Runnable* graph) : graph_(graph) {
+        CHECK(!graph->prepared_) << "the graph is rewritten before it is run";
+        vector<Node*> nodes = graph->Graph::nodes();
+        map<Tensor*, vector<Blob*> > tensors;
+        for (Node* node : nodes) {
+            if (Blob* blob = dynamic_cast<Blob*>(node)) {
+                tensors[blob->tensor()].push_back(blob);
+            }
+        }
+        auto is_dummy = [](Node* node)->bool {
+            return dynamic_cast<Op<Dummy>*>(node) != NULL;
+        };
+        // a slice of Split or Concat, or sharing its tensor with one
+        auto sliced = [&](Node* node)->bool {
+            Tensor* tensor = static_cast<Blob*>(node)->tensor();
+            bool sliced = !tensor->is_contiguous();
+            for (Blob* blob : tensors[tensor]) {
+                for (Node* writer : blob->inputs()) {
+                    sliced |= is_dummy(writer);
+                }
+                for (Node* reader : blob->outputs()) {
+                    sliced |= is_dummy(reader);
+                }
+            }
+            return sliced;
+        };
+        auto same_place = [](Op_* a, Op_* b)->bool {
+            return a->rank() == b->rank() && a->device() == b->device()
+                && a->thread() == b->thread();
+        };
+
+        vector<Sibling> candidates;
+        for (Node* node : nodes) {
+            Op<Conv>* conv = dynamic_cast<Op<Conv>*>(node);
+            if (conv == NULL || conv->inputs().size() != 2
+                    || conv->outputs().size() != 1) {
+                continue;
+            }
+            Node* bottom = conv->inputs()[0];
+            Node* weight = conv->inputs()[1];
+            Node* top = conv->outputs()[0];
+            Sibling sibling = { conv, NULL, NULL, NULL };
+            // the only other writer of top is a Bias
+            bool mergeable = top->inputs().size() <= 2 && !sliced(top);
+            for (Node* writer : top->inputs()) {
+                if (writer != conv) {
+                    sibling.bias = static_cast<Op_*>(writer);
+                    mergeable &= dynamic_cast<Op<Bias>*>(writer) != NULL
+                        && writer->inputs().size() == 1
+                        && same_place(conv, sibling.bias);
+                }
+            }
+            // conv_down reads the weight, conv_weight its top diff
+            for (Node* reader : weight->outputs()) {
+                if (dynamic_cast<Op<ConvDown>*>(reader) != NULL
+                        && reader->inputs().size() == 2
+                        && reader->inputs()[1] == weight) {
+                    sibling.down = static_cast<Op_*>(reader);
+                }
+            }
+            if (sibling.down != NULL) {
+                Node* top_diff = sibling.down->inputs()[0];
+                for (Node* reader : top_diff->outputs()) {
+                    if (dynamic_cast<Op<ConvWeight>*>(reader) != NULL
+                            && reader->inputs().size() == 2
+                            && reader->inputs()[1] == bottom) {
+                        sibling.weight = static_cast<Op_*>(reader);
+                    }
+                }
+                mergeable &= sibling.weight != NULL && !sliced(top_diff)
+                    && sibling.down->outputs().size() == 1
+                    && sibling.weight->outputs().size() == 1
+                    && same_place(conv, sibling.down)
+                    && same_place(conv, sibling.weight);
+            }
+            if (mergeable) {
+                candidates.push_back(sibling);
+            }
+        }
+
+        auto same = [&](const Sibling& a, const Sibling& b)->bool {
+            Op<Conv>* x = static_cast<Op<Conv>*>(a.conv);
+            Op<Conv>* y = static_cast<Op<Conv>*>(b.conv);
+            Size kx = static_cast<Blob*>(x->inputs()[1])->tensor()->size();
+            Size ky = static_cast<Blob*>(y->inputs()[1])->tensor()->size();
+            return x->inputs()[0] == y->inputs()[0] && x->param() == y->param()
+                && kx.height() == ky.height() && kx.width() == ky.width()
+                && same_place(x, y) && (a.bias == NULL) == (b.bias == NULL)
+                && (a.down == NULL) == (b.down == NULL)
+                && (a.down == NULL
+                        || a.down->outputs()[0] == b.down->outputs()[0]);
+        };
+        vector<vector<Sibling> > groups;
+        for (const Sibling& sibling : candidates) {
+            bool found = false;
+            for (vector<Sibling>& group : groups) {
+                if (same(group[0], sibling)) {
+                    group.push_back(sibling);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                groups.push_back({ sibling });
+            }
+        }
+        Graph* into = NULL;
+        for (const vector<Sibling>& group : groups) {
+            if (group.size() < 2) {
+                continue;
+            }
+            if (into == NULL) {
+                into = graph->createAny<Graph>("siblings");
+            }
+            merge(group, into);
+            ++groups_;
+            merged_ += group.size();
+        }
+    }
+
+    void SiblingFusion::remove(Node* node) {
+        static_cast<Graph*>(node)->parent_->delete_subgraph(node);
+    }
+
+    // the blobs become slices of a new blob, along the channels
+    static Blob* stack(const vector<Blob*>& blobs, const string& name,
+            Graph* into) {
+        Tensor* first = blobs[0]->tensor();
+        int channels = 0;
+        for (Blob* blob : blobs) {
+            channels += blob->tensor()->size().channels();
+        }
+        Size size = { first->size().num(), channels, first->size().height(),
+            first->size().width() };
+        Blob* stacked = into->create(name, first->rank(), first->device(), size);
+        if (current_rank() == first->rank()) {
+            stacked->tensor()->mutable_data();
+            int off = 0;
+            for (Blob* blob : blobs) {
+                Size slice = blob->tensor()->size();
+                blob->tensor()->slice_from(stacked->tensor(), { 0, off, 0, 0 },
+                        slice);
+                off += slice.channels();
+            }
+        }
+        return stacked;
+    }
+
+    void SiblingFusion::merge(const vector<Sibling>& siblings, Graph* into) {
+        Op<Conv>* first = static_cast<Op<Conv>*>(siblings[0].conv);
+        int rank = first->rank();
+        int device = first->device();
+        string thread = first->thread();
+        int pad_h, pad_w, stride_h, stride_w;
+        std::tie(pad_h, pad_w, stride_h, stride_w) = first->param();
+        Blob* bottom = static_cast<Blob*>(first->inputs()[0]);
+        vector<Blob*> weights;
+        vector<Blob*> biases;
+        vector<Blob*> tops;
+        for (const Sibling& sibling : siblings) {
+            weights.push_back(static_cast<Blob*>(sibling.conv->inputs()[1]));
+            tops.push_back(static_cast<Blob*>(sibling.conv->outputs()[0]));
+            if (sibling.bias != NULL) {
+                biases.push_back(static_cast<Blob*>(sibling.bias->inputs()[0]));
+            }
+        }
+        bool backward = siblings[0].down != NULL;
+        vector<Blob*> top_diffs;
+        vector<Blob*> weight_diffs;
+        Blob* bottom_diff = NULL;
+        if (backward) {
+            bottom_diff = static_cast<Blob*>(siblings[0].down->outputs()[0]);
+            for (const Sibling& sibling : siblings) {
+                top_diffs.push_back(
+                        static_cast<Blob*>(sibling.down->inputs()[0]));
+                weight_diffs.push_back(
+                        static_cast<Blob*>(sibling.weight->outputs()[0]));
+            }
+        }
+        for (const Sibling& sibling : siblings) {
+            for (Op_* op : { sibling.conv, sibling.bias, sibling.down,
+                        sibling.weight }) {
+                if (op != NULL) {
+                    remove(op);
+                }
+            }
+        }
+
+        // { bottom, weights, biases } >> conv_up >> { top } >> slice >> tops
+        vector<Blob*> inputs = { bottom };
+        inputs.insert(inputs.end(), weights.begin(), weights.end());
+        inputs.insert(inputs.end(), biases.begin(), biases.end());
+        Blob* top = stack(tops, "top", into);
+        inputs >> *into->create<SiblingConv>("conv_up", rank, device, thread,
+                SiblingConv::param_tuple(pad_h, pad_w, stride_h, stride_w,
+                    siblings.size())) >> vector<Blob*>{ top };
+        vector<Blob*>{ top } >> *into->create<Dummy>("slice", rank, device,
+                thread, Dummy::param_tuple()) >> tops;
+        if (!backward) {
+            return;
+        }
+        // top_diffs >> concat >> { top_diff }, which conv_down and
+        // conv_weight read
+        Blob* top_diff = stack(top_diffs, "top_diff", into);
+        top_diffs >> *into->create<Dummy>("concat", rank, device, thread,
+                Dummy::param_tuple()) >> vector<Blob*>{ top_diff };
+        inputs = { top_diff };
+        inputs.insert(inputs.end(), weights.begin(), weights.end());
+        Conv::param_tuple params(pad_h, pad_w, stride_h, stride_w);
+        inputs >> *into->create<SiblingConvDown>("conv_down", rank, device,
+                thread, params) >> vector<Blob*>{ bottom_diff };
+        vector<Blob*>{ top_diff, bottom } >> *into->create<SiblingConvWeight>(
+                "conv_weight", rank, device, thread, params) >> weight_diffs;
+    }
+
+    string SiblingFusion::report() const {
+        std::ostringstream out;
+        out << "merged " << merged_ << " convs into " << groups_
+            << " sibling convs";
+        return out.str();
+    }
+
+}
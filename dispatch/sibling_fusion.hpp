@@ -0,0 +1,61 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_SIBLING_FUSION
+#define PURINE_SIBLING_FUSION
+
+#include <string>
+#include <vector>
+
+#include "dispatch/op.hpp"
+#include "dispatch/runnable.hpp"
+
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief horizontal fusion of the convolutions reading the same bottom.
+     *
+     * Convolutions of the same bottom with the same kernel size, pad and
+     * stride (the 1x1 reductions of an inception) are merged into one
+     * SiblingConv, a single wider gemm whose top has the channels of all
+     * their tops. The original tops become slices of it (slice_from, as in
+     * Split), so their readers are not touched. The bias of each conv goes
+     * into the SiblingConv.
+     *
+     * In backward, the top diffs become slices of one diff, which the
+     * writers fill in place like the bottoms of Concat, and SiblingConvDown
+     * and SiblingConvWeight replace the conv_down and conv_weight of the
+     * merged convs. Their bottom diff must be the same blob.
+     *
+     * Skipped: convs whose top or top diff is already a slice (the top of
+     * a branch going into the Concat of an inception), or shares its tensor
+     * with a slice.
+     *
+     * The graph is rewritten by the constructor, before it is first run.
+     */
+    class SiblingFusion {
+        public:
+            explicit SiblingFusion(Runnable* graph);
+            // number of SiblingConv, and of convs merged into them
+            inline int groups() const { return groups_; }
+            inline int merged() const { return merged_; }
+            string report() const;
+        protected:
+            // a conv with its bias and backward, NULL if there are none
+            struct Sibling {
+                Op_* conv;
+                Op_* bias;
+                Op_* down;
+                Op_* weight;
+            };
+            Runnable* graph_;
+            int groups_ = 0;
+            int merged_ = 0;
+            void remove(Node* node);
+            void merge(const vector<Sibling>& siblings, Graph* into);
+    };
+
+}
+
+#endif
@@ -0,0 +1,274 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <queue>
+#include <sstream>
+
+#include "dispatch/blob.hpp"
+#include "dispatch/simulator.hpp"
+
+using std::deque;
+
+namespace purine {
+
+    Simulator::Profile::Profile(Runnable* graph,
+            const vector<Tracer::Event>& events) {
+        map<string, pair<int64_t, int> > spans;
+        for (const Tracer::Event& e : events) {
+            if (e.category == Tracer::COMPUTE) {
+                pair<int64_t, int>& s = spans[Tracer::name(e.name)];
+                s.first += e.end - e.begin;
+                ++s.second;
+            }
+        }
+        for (Node* node : graph->nodes()) {
+            Op_* op = dynamic_cast<Op_*>(node);
+            if (op == NULL || spans.count(op->cached_name()) == 0) {
+                continue;
+            }
+            const pair<int64_t, int>& s = spans[op->cached_name()];
+            costs_[key(op->cached_name())] = { double(s.first) / s.second,
+                batch(op) };
+        }
+    }
+
+    void Simulator::Profile::save(const string& filename) const {
+        std::ofstream out(filename);
+        CHECK(out) << "can not open " << filename;
+        for (const auto& kv : costs_) {
+            out << kv.second.num << " " << kv.second.us << " " << kv.first
+                << std::endl;
+        }
+    }
+
+    void Simulator::Profile::load(const string& filename) {
+        std::ifstream in(filename);
+        CHECK(in) << "can not open " << filename;
+        Cost cost;
+        string name;
+        while (in >> cost.num >> cost.us && std::getline(in, name)) {
+            costs_[name.substr(1)] = cost;
+        }
+    }
+
+    string Simulator::Profile::key(const string& cached_name) {
+        size_t pos = cached_name.find("::");
+        return pos == string::npos ? cached_name : cached_name.substr(pos + 2);
+    }
+
+    int Simulator::Profile::batch(Op_* op) {
+        int num = 0;
+        for (const vector<Node*>* blobs : { &op->inputs(), &op->outputs() }) {
+            for (Node* node : *blobs) {
+                num = std::max(num,
+                        static_cast<Blob*>(node)->tensor()->size().num());
+            }
+        }
+        return num;
+    }
+
+    double Simulator::Profile::cost(Op_* op) const {
+        auto it = costs_.find(key(op->cached_name()));
+        if (it == costs_.end()) {
+            return -1.;
+        }
+        return it->second.us * batch(op) / std::max(it->second.num, 1);
+    }
+
+    Simulator::Simulator(Runnable* graph, const Profile& profile)
+        : graph_(graph), profile_(profile) {
+        }
+
+    void Simulator::set_links(const Placement::Link& intra_rank,
+            const Placement::Link& inter_rank) {
+        intra_rank_ = intra_rank;
+        inter_rank_ = inter_rank;
+    }
+
+    static double bytes(Node* blob) {
+        return static_cast<Blob*>(blob)->tensor()->size().count()
+            * sizeof(DTYPE);
+    }
+
+    Simulator::Result Simulator::run() {
+        graph_->prepare_once();
+        // all the ranks, not only the local nodes
+        vector<Node*> nodes = graph_->Graph::nodes();
+        Result result = { 0., {}, 0., 0., 0 };
+
+        struct LoopState {
+            string name;
+            deque<Op_*> queue;
+            int running;
+            int capacity;
+        };
+        map<string, LoopState> loops;
+        map<Op_*, LoopState*> loop_of;
+        map<int, Op_*> irecv_of_tag;
+        for (Node* node : nodes) {
+            Op_* op = dynamic_cast<Op_*>(node);
+            if (op == NULL) {
+                continue;
+            }
+            string name = "[" + to_string(op->rank()) + "]" + (op->device() < 0
+                    ? string("cpu") : "gpu" + to_string(op->device()) + ":"
+                    + op->thread());
+            if (loops.count(name) == 0) {
+                loops[name] = { name, {}, 0, op->device() < 0 ? cpu_threads_ : 1 };
+            }
+            loop_of[op] = &loops[name];
+            if (Op<Irecv>* irecv = dynamic_cast<Op<Irecv>*>(op)) {
+                irecv_of_tag[std::get<0>(irecv->param())] = op;
+            }
+        }
+
+        // (time, sequence, op, completes), sequence keeps the order stable
+        typedef std::tuple<double, int, Op_*, bool> Event;
+        std::priority_queue<Event, vector<Event>, std::greater<Event> > events;
+        int sequence = 0;
+        map<Node*, int> in;
+        map<int, double> nic_out;
+        map<int, double> nic_in;
+        // irecvs which were posted, or whose data arrived first
+        map<Op_*, double> posted;
+        map<Op_*, double> arrived;
+
+        auto duration = [&](Op_* op)->double {
+            if (dynamic_cast<Op<Irecv>*>(op) || dynamic_cast<Op<Isend>*>(op)) {
+                return 0.;
+            }
+            double cost = profile_.cost(op);
+            if (cost < 0) {
+                if (op->inputs().size() == 1 && op->outputs().size() == 1
+                        && op->inputs()[0]->device() != op->outputs()[0]->device()) {
+                    // an unprofiled MemCopy between host and device
+                    cost = intra_rank_.latency
+                        + bytes(op->inputs()[0]) / intra_rank_.bandwidth;
+                } else {
+                    ++result.unknown;
+                    cost = 0.;
+                }
+            }
+            return cost;
+        };
+        auto dispatch = [&](LoopState* loop, double t) {
+            while (loop->running < loop->capacity && loop->queue.size() != 0) {
+                Op_* op = loop->queue.front();
+                loop->queue.pop_front();
+                ++loop->running;
+                double cost = duration(op);
+                result.busy[loop->name] += cost;
+                if (op->cached_name().find("param_server") != string::npos) {
+                    result.ps_busy += cost;
+                }
+                events.push(Event(t + cost, sequence++, op, false));
+            }
+        };
+        auto ready = [&](Node* node, double t) {
+            Op_* op = static_cast<Op_*>(node);
+            loop_of[op]->queue.push_back(op);
+            dispatch(loop_of[op], t);
+        };
+        std::function<void(Node*, double)> complete = [&](Node* node, double t) {
+            result.iteration = std::max(result.iteration, t);
+            for (Node* output : node->outputs()) {
+                if (++in[output] == output->inputs().size()) {
+                    if (dynamic_cast<Blob*>(output) != NULL) {
+                        complete(output, t);
+                    } else {
+                        ready(output, t);
+                    }
+                }
+            }
+        };
+
+        for (Node* node : nodes) {
+            if (node->is_source()) {
+                if (dynamic_cast<Blob*>(node) != NULL) {
+                    complete(node, 0.);
+                } else {
+                    ready(node, 0.);
+                }
+            }
+        }
+        while (events.size() != 0) {
+            double t;
+            Op_* op;
+            bool completes;
+            std::tie(t, std::ignore, op, completes) = events.top();
+            events.pop();
+            if (completes) {
+                complete(op, t);
+                continue;
+            }
+            // the op leaves its loop
+            --loop_of[op]->running;
+            dispatch(loop_of[op], t);
+            if (Op<Isend>* isend = dynamic_cast<Op<Isend>*>(op)) {
+                int src = op->rank();
+                int dest = std::get<1>(isend->param());
+                double size = bytes(op->inputs()[0]);
+                const Placement::Link& link = src == dest ? intra_rank_
+                    : inter_rank_;
+                double start = std::max(t, std::max(nic_out[src], nic_in[dest]));
+                double end = start + link.latency + size / link.bandwidth;
+                nic_out[src] = end;
+                nic_in[dest] = end;
+                events.push(Event(end, sequence++, op, true));
+                auto it = irecv_of_tag.find(std::get<0>(isend->param()));
+                if (it == irecv_of_tag.end()) {
+                    continue;
+                }
+                Op_* irecv = it->second;
+                if (irecv->cached_name().find("param_server") != string::npos) {
+                    result.ps_bytes += size;
+                }
+                if (posted.count(irecv)) {
+                    events.push(Event(std::max(end, posted[irecv]), sequence++,
+                                irecv, true));
+                    posted.erase(irecv);
+                } else {
+                    arrived[irecv] = end;
+                }
+            } else if (dynamic_cast<Op<Irecv>*>(op) != NULL) {
+                if (arrived.count(op)) {
+                    events.push(Event(std::max(t, arrived[op]), sequence++, op,
+                                true));
+                    arrived.erase(op);
+                } else {
+                    posted[op] = t;
+                }
+            } else {
+                complete(op, t);
+            }
+        }
+        // an irecv whose isend is not in the graph never completes
+        for (const auto& kv : posted) {
+            LOG(WARNING) << "nothing sent to " << kv.first->cached_name();
+        }
+        return result;
+    }
+
+    string Simulator::report(const Result& result) {
+        std::ostringstream out;
+        double total = std::max(result.iteration, 1.);
+        out << std::fixed << std::setprecision(3);
+        out << "predicted iteration " << result.iteration / 1000. << " ms"
+            << std::endl;
+        for (const auto& kv : result.busy) {
+            out << "  " << std::setw(24) << kv.first << " busy "
+                << kv.second / 1000. << " ms (" << 100. * kv.second / total
+                << "%)" << std::endl;
+        }
+        out << "  param server busy " << result.ps_busy / 1000. << " ms, "
+            << "received " << result.ps_bytes / (1 << 20) << " MB" << std::endl;
+        if (result.unknown != 0) {
+            out << "  " << result.unknown << " ops without profile counted as free"
+                << std::endl;
+        }
+        return out.str();
+    }
+
+}
@@ -0,0 +1,84 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_SIMULATOR
+#define PURINE_SIMULATOR
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dispatch/op.hpp"
+#include "dispatch/placement.hpp"
+#include "dispatch/runnable.hpp"
+#include "dispatch/trace.hpp"
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief predict the iteration time of a graph without running it.
+     *
+     * The graph of all the ranks is replayed with the semantics of
+     * Node::inc_in: a node fires once all its inputs fired, an op waits in
+     * the FIFO of its loop (one per gpu thread, a pool of cpu_threads per
+     * rank for the cpu) and holds it for its profiled cost. An Isend moves
+     * the bytes to its Irecv (matched by tag) through the NICs of both
+     * ranks, one transfer at a time per direction, which is where the
+     * incast of a parameter server shows up.
+     *
+     * The costs come from a Profile measured on a real run, so candidate
+     * configurations (e.g. a DataParallel built from another
+     * parallel_config) can be compared offline.
+     */
+    class Simulator {
+        public:
+            /**
+             * @brief average traced span of each op, keyed by the cached name
+             *        without its first component (the replica), together with
+             *        the batch size it ran at. costs are scaled linearly with
+             *        the batch size when looked up.
+             */
+            class Profile {
+                public:
+                    struct Cost {
+                        double us;
+                        int num;
+                    };
+                    Profile() {}
+                    explicit Profile(Runnable* graph,
+                            const vector<Tracer::Event>& events = Tracer::events());
+                    void load(const string& filename);
+                    void save(const string& filename) const;
+                    // -1 if the op was not profiled
+                    double cost(Op_* op) const;
+                    static string key(const string& cached_name);
+                    static int batch(Op_* op);
+                protected:
+                    map<string, Cost> costs_;
+            };
+            struct Result {
+                double iteration;  // us
+                map<string, double> busy;  // loop -> us
+                double ps_busy;  // us of the param server ops
+                double ps_bytes;  // received by the param server
+                int unknown;  // ops without profile, counted as free
+            };
+            explicit Simulator(Runnable* graph, const Profile& profile);
+            void set_links(const Placement::Link& intra_rank,
+                    const Placement::Link& inter_rank);
+            inline void set_cpu_threads(int threads) { cpu_threads_ = threads; }
+            Result run();
+            static string report(const Result& result);
+        protected:
+            Runnable* graph_;
+            const Profile& profile_;
+            Placement::Link intra_rank_ = { 10., 5e3 };
+            Placement::Link inter_rank_ = { 50., 1e3 };
+            int cpu_threads_ = 4;  // libuv default pool size
+    };
+
+}
+
+#endif
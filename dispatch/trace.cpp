@@ -0,0 +1,132 @@
+// Copyright Lin Min 2015
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "common/common.hpp"
+#include "dispatch/trace.hpp"
+
+namespace purine {
+
+    const int Tracer::RingBuffer::capacity;
+    atomic<bool> Tracer::enabled_(false);
+    std::mutex Tracer::mutex_;
+    vector<Tracer::RingBuffer*> Tracer::buffers_;
+    map<string, int> Tracer::ids_;
+    vector<string> Tracer::names_;
+
+    vector<Tracer::Event> Tracer::RingBuffer::events() const {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t begin = head > capacity ? head - capacity : 0;
+        vector<Event> ret;
+        ret.reserve(head - begin);
+        for (uint64_t i = begin; i < head; ++i) {
+            ret.push_back(events_[i % capacity]);
+        }
+        return ret;
+    }
+
+    void Tracer::enable(bool on) {
+        enabled_.store(on);
+    }
+
+    int64_t Tracer::now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    int Tracer::intern(const string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        map<string, int>::iterator it = ids_.find(name);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+        int id = names_.size();
+        names_.push_back(name);
+        ids_[name] = id;
+        return id;
+    }
+
+    string Tracer::name(int id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return names_[id];
+    }
+
+    // buffers are never freed, threads of the loops live as long as the
+    // process and the events should survive them anyway.
+    Tracer::RingBuffer* Tracer::buffer() {
+        static thread_local RingBuffer* buffer_ = NULL;
+        if (buffer_ == NULL) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            buffer_ = new RingBuffer(buffers_.size());
+            buffers_.push_back(buffer_);
+        }
+        return buffer_;
+    }
+
+    vector<Tracer::Event> Tracer::events() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        vector<Event> ret;
+        for (RingBuffer* buffer : buffers_) {
+            vector<Event> events = buffer->events();
+            ret.insert(ret.end(), events.begin(), events.end());
+        }
+        return ret;
+    }
+
+    void Tracer::clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (RingBuffer* buffer : buffers_) {
+            buffer->clear();
+        }
+    }
+
+    static string escape(const string& s) {
+        string ret;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                ret += '\\';
+            }
+            ret += c;
+        }
+        return ret;
+    }
+
+    void Tracer::dump(const string& filename) {
+        static const char* categories[] = { "compute", "mpi_send", "mpi_recv" };
+        int rank = current_rank();
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ostringstream out;
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (RingBuffer* buffer : buffers_) {
+            vector<Event> events = buffer->events();
+            if (events.size() == 0) {
+                continue;
+            }
+            // name the thread after the loop it ran
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\","
+                << "\"ph\":\"M\",\"pid\":" << rank << ",\"tid\":"
+                << buffer->tid() << ",\"args\":{\"name\":\""
+                << escape(names_[events[0].loop]) << "\"}}";
+            first = false;
+            for (const Event& e : events) {
+                out << ",\n{\"name\":\"" << escape(names_[e.name])
+                    << "\",\"cat\":\"" << categories[e.category]
+                    << "\",\"ph\":\"X\",\"ts\":" << e.begin
+                    << ",\"dur\":" << e.end - e.begin
+                    << ",\"pid\":" << rank << ",\"tid\":" << buffer->tid()
+                    << ",\"args\":{\"loop\":\"" << escape(names_[e.loop])
+                    << "\",\"device\":" << e.device << "}}";
+            }
+        }
+        out << "\n]}\n";
+        std::ostringstream path;
+        path << filename << ".rank" << rank << ".json";
+        std::ofstream file(path.str());
+        CHECK(file) << "can not open " << path.str();
+        file << out.str();
+        LOG(INFO) << "trace written to " << path.str();
+    }
+
+}
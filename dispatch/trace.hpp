@@ -0,0 +1,92 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_TRACE
+#define PURINE_TRACE
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::atomic;
+using std::map;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+    /**
+     * @brief per op execution tracing.
+     *
+     * Every thread which records an event owns a ring buffer, so recording
+     * takes no lock: the writer fills a slot and then publishes it by bumping
+     * the head. Names (cached_name_ of ops, loop names) are interned once per
+     * op into integer ids, events only carry the ids.
+     *
+     * Tracing is off by default and toggled at runtime with enable(). dump()
+     * writes the events of the current rank as chrome trace_event json
+     * (load it in chrome://tracing), and should be called while the graph is
+     * idle, e.g. after sync().
+     */
+    class Tracer {
+        public:
+            enum Category {
+                COMPUTE = 0,
+                MPI_SEND = 1,
+                MPI_RECV = 2
+            };
+            struct Event {
+                int name;
+                int loop;
+                int device;
+                int category;
+                int64_t begin;  // us
+                int64_t end;  // us
+            };
+            class RingBuffer {
+                public:
+                    static const int capacity = 1 << 16;
+                    explicit RingBuffer(int tid) : tid_(tid), head_(0) {
+                        events_.resize(capacity);
+                    }
+                    inline void push(const Event& e) {
+                        uint64_t head = head_.load(std::memory_order_relaxed);
+                        events_[head % capacity] = e;
+                        head_.store(head + 1, std::memory_order_release);
+                    }
+                    vector<Event> events() const;
+                    inline int tid() const { return tid_; }
+                    inline void clear() { head_.store(0); }
+                private:
+                    int tid_;
+                    atomic<uint64_t> head_;
+                    vector<Event> events_;
+            };
+
+            static inline bool enabled() {
+                return enabled_.load(std::memory_order_relaxed);
+            }
+            static void enable(bool on = true);
+            static int64_t now();
+            static int intern(const string& name);
+            static inline void record(int name, int loop, int device,
+                    Category category, int64_t begin, int64_t end) {
+                buffer()->push({ name, loop, device, category, begin, end });
+            }
+            static vector<Event> events();
+            static string name(int id);
+            static void clear();
+            static void dump(const string& filename);
+        private:
+            static RingBuffer* buffer();
+            static atomic<bool> enabled_;
+            static std::mutex mutex_;
+            static vector<RingBuffer*> buffers_;
+            static map<string, int> ids_;
+            static vector<string> names_;
+    };
+
+}
+
+#endif
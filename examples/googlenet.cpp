@@ -4,6 +4,7 @@
 #include <glog/logging.h>
 #include "examples/googlenet.hpp"
 #include "composite/graph/all_reduce.hpp"
+#include "composite/graph/batch_balancer.hpp"
 
 int batch_size = 64;
 string source = "/temp/imagenet-train-lmdb";
@@ -70,7 +71,7 @@ int main(int argc, char** argv) {
     for (int rank : {0, 1, 2, 3}) {
         for (int device : {0, 1, 2}) {
             for(int batch_size: {128, 128, 128}){
-                parallels.push_back({rank, device});
+                parallels.push_back({rank, device, batch_size});
             }
         }
     }
@@ -88,8 +89,11 @@ int main(int argc, char** argv) {
         = make_shared<DataParallel<GoogLeNet<false>, AllReduce> >(parallels);
     setup_param_server(parallel_googlenet.get(), 0.1);
     initialize(parallel_googlenet.get(), "");
+    // equalize the compute time of the replicas every 500 iterations
+    BatchBalancer balancer(parallels);
     // iteration
     for (int iter = 1; iter <= 100000; ++iter) {
+        balancer.begin(iter);
         // set learning rate
         if (current_rank() == 0) {
             for (int i = 0; i < 116; ++i) {
@@ -115,6 +119,23 @@ int main(int argc, char** argv) {
                 << parallel_googlenet->loss()[1]);
         if (iter % 100 == 0) {
             parallel_googlenet->print_weight_info();
+            parallel_googlenet->print_straggler_info();
+        }
+        if (balancer.end(iter)) {
+            MPI_LOG( << "rebalance batch sizes\n"
+                    << balancer.report() );
+            shared_ptr<DataParallel<GoogLeNet<false>, AllReduce> > rebalanced
+                = make_shared<DataParallel<GoogLeNet<false>, AllReduce> >(
+                        balancer.locations());
+            setup_param_server(rebalanced.get(), 0.1);
+            rebalanced->load_from(parallel_googlenet.get());
+            parallel_googlenet = rebalanced;
+            fetch.reset();
+            fetch = make_shared<FetchImage>(source, mean_file,
+                    true, true, true, 1.1, 224,
+                    10.0,
+                    balancer.locations());
+            fetch->run();
         }
         if (iter % 100000 == 0) {
             parallel_googlenet->save("./googlenet_no_aux_dump_iter_"
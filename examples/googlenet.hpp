@@ -23,7 +23,19 @@ class GoogLeNet : public Graph {
         vector<Blob*> probs_;
         int batch_size;
     public:
-        explicit GoogLeNet(int rank, int device, int bs);
+        // layers are spread evenly over the stages in order, all on
+        // (rank, device) if there is no stage. with one stage per layer
+        // (e.g. from Placement::solve) layer i is put on stages[i].
+        explicit GoogLeNet(int rank, int device, int bs,
+                const vector<pair<int, int> >& stages = {});
+        // names of the layers, in the order they are placed
+        static vector<string> layers() {
+            return { "conv1", "max_pool1", "conv2_reduce", "conv2", "max_pool2",
+                "inception3a", "inception3b", "max_pool3", "inception4a",
+                "inception4b", "inception4c", "inception4d", "inception4e",
+                "max_pool4", "inception5a", "inception5b", "global_avg",
+                "dropout", "inner", "softmaxloss" };
+        }
         virtual ~GoogLeNet() override {}
         inline const vector<Blob*>& weight_data() { return weight_data_; }
         inline const vector<Blob*>& weight_diff() { return weight_diff_; }
@@ -35,57 +47,88 @@ class GoogLeNet : public Graph {
 };
 
 template <bool test>
-GoogLeNet<test>::GoogLeNet(int rank, int device, int bs) : Graph(rank, device) {
+GoogLeNet<test>::GoogLeNet(int rank, int device, int bs,
+        const vector<pair<int, int> >& stages) : Graph(rank, device) {
     int batch_size = bs;
+    const int num_layers = layers().size();
+    vector<pair<int, int> > at(num_layers, { rank, device });
+    if (stages.size() == num_layers) {
+        at = stages;
+    } else {
+        for (int i = 0; i < num_layers && stages.size() != 0; ++i) {
+            at[i] = stages[i * stages.size() / num_layers];
+        }
+    }
     data_ = create("data", { batch_size, 3, 224, 224 });
     data_diff_ = create("data_diff", { batch_size, 3, 224, 224 });
     label_ = create("label", { batch_size, 1, 1, 1 });
     // creating layers
     ConvLayer* conv1 = createGraph<ConvLayer>("conv1",
+            at[0].first, at[0].second,
             ConvLayer::param_tuple(3, 3, 2, 2, 7, 7, 64, "relu"));
     PoolLayer* pool1 = createGraph<PoolLayer>("max_pool1",
+            at[1].first, at[1].second,
             PoolLayer::param_tuple("max", 3, 3, 2, 2, 0, 0));
     // LRNLayer* norm1 = createGraph<LRNLayer>("norm1",
     //     LRNLayer::param_tuple(0.0001, 0.75, 5));
     ConvLayer* conv2_reduce = createGraph<ConvLayer>("conv2_reduce",
+            at[2].first, at[2].second,
             ConvLayer::param_tuple(0, 0, 1, 1, 1, 1, 64, "relu"));
     ConvLayer* conv2 = createGraph<ConvLayer>("conv2",
+            at[3].first, at[3].second,
             ConvLayer::param_tuple(1, 1, 1, 1, 3, 3, 192, "relu"));
     // LRNLayer* norm2 = createGraph<LRNLayer>("norm2",
     //     LRNLayer::param_tuple(0.0001, 0.75, 5));
     PoolLayer* pool2 = createGraph<PoolLayer>("max_pool2",
+            at[4].first, at[4].second,
             PoolLayer::param_tuple("max", 3, 3, 2, 2, 0, 0));
     InceptionLayer* inception3a = createGraph<InceptionLayer>("inception3a",
+            at[5].first, at[5].second,
             InceptionLayer::param_tuple(64, 128, 32, 96, 16, 32));
     InceptionLayer* inception3b = createGraph<InceptionLayer>("inception3b",
+            at[6].first, at[6].second,
             InceptionLayer::param_tuple(128, 192, 96, 128, 32, 64));
     PoolLayer* pool3 = createGraph<PoolLayer>("max_pool3",
+            at[7].first, at[7].second,
             PoolLayer::param_tuple("max", 3, 3, 2, 2, 0, 0));
     InceptionLayer* inception4a = createGraph<InceptionLayer>("inception4a",
+            at[8].first, at[8].second,
             InceptionLayer::param_tuple(192, 208, 48, 96, 16, 64));
     InceptionLayer* inception4b = createGraph<InceptionLayer>("inception4b",
+            at[9].first, at[9].second,
             InceptionLayer::param_tuple(160, 224, 64, 112, 24, 64));
     InceptionLayer* inception4c = createGraph<InceptionLayer>("inception4c",
+            at[10].first, at[10].second,
             InceptionLayer::param_tuple(128, 256, 64, 128, 24, 64));
     InceptionLayer* inception4d = createGraph<InceptionLayer>("inception4d",
+            at[11].first, at[11].second,
             InceptionLayer::param_tuple(112, 288, 64, 144, 32, 64));
     InceptionLayer* inception4e = createGraph<InceptionLayer>("inception4e",
+            at[12].first, at[12].second,
             InceptionLayer::param_tuple(256, 320, 128, 160, 32, 128));
     PoolLayer* pool4 = createGraph<PoolLayer>("max_pool4",
+            at[13].first, at[13].second,
             PoolLayer::param_tuple("max", 3, 3, 2, 2, 0, 0));
     InceptionLayer* inception5a = createGraph<InceptionLayer>("inception5a",
+            at[14].first, at[14].second,
             InceptionLayer::param_tuple(256, 320, 128, 160, 32, 128));
     InceptionLayer* inception5b = createGraph<InceptionLayer>("inception5b",
+            at[15].first, at[15].second,
             InceptionLayer::param_tuple(384, 384, 128, 192, 48, 128));
     GlobalAverageLayer* global_ave = createGraph<GlobalAverageLayer>("global_avg",
+            at[16].first, at[16].second,
             GlobalAverageLayer::param_tuple());
     DropoutLayer* dropout = createGraph<DropoutLayer>("dropout",
+            at[17].first, at[17].second,
             DropoutLayer::param_tuple(0.4, test, false));
     InnerProdLayer* inner = createGraph<InnerProdLayer>("inner",
+            at[18].first, at[18].second,
             InnerProdLayer::param_tuple(1000, ""));
     SoftmaxLossLayer* softmaxloss = createGraph<SoftmaxLossLayer>("softmaxloss",
+            at[19].first, at[19].second,
             SoftmaxLossLayer::param_tuple(1.));
-    Acc* acc = createGraph<Acc>("acc", rank_, -1, Acc::param_tuple(5));
+    Acc* acc = createGraph<Acc>("acc", at[num_layers - 1].first, -1,
+            Acc::param_tuple(5));
     // connecting layers
     B{ data_,  data_diff_ } >> *conv1 >> *pool1 >> *conv2_reduce
         >> *conv2 >> *pool2 >> *inception3a >> *inception3b >> *pool3
@@ -0,0 +1,136 @@
+// Copyright Lin Min 2015
+// GoogLeNet split into 4 pipeline stages, one per rank,
+// the batch of 128 is run as 4 micro batches of 32.
+//   mpirun -np 4 googlenet_pipeline [place]
+// with "place", the network is first profiled on the first stage and the
+// layers are placed by Placement instead of evenly.
+
+#include <mpi.h>
+#include <glog/logging.h>
+#include "examples/googlenet.hpp"
+#include "composite/graph/all_reduce.hpp"
+#include "composite/graph/pipeline_parallel.hpp"
+#include "dispatch/placement.hpp"
+
+int batch_size = 32;
+string source = "/temp/imagenet-train-lmdb";
+string mean_file = "/temp/imagenet-train-mean";
+
+using namespace purine;
+
+typedef PipelineParallel<GoogLeNet<false>, AllReduce> Pipeline;
+
+void setup_param_server(Pipeline* pipeline, DTYPE global_learning_rate) {
+    DTYPE global_decay = 0.0001;
+    vector<AllReduce::param_tuple> param(116);
+    vector<int> ranks(116);
+    for (int i = 0; i < 116; ++i) {
+        DTYPE learning_rate = global_learning_rate * (i % 2 ? 2. : 1.);
+        param[i] = AllReduce::param_tuple(0.9, learning_rate,
+                learning_rate * global_decay * (i % 2 ? 0. : 1.));
+        // update each weight on the cpu of its stage
+        ranks[i] = pipeline->weight_data()[i]->rank();
+    }
+    pipeline->setup_param_server(ranks, vector<int>(116, -1), param);
+}
+
+void initialize(Pipeline* pipeline) {
+    vector<int> weight_indice(58);
+    vector<int> bias_indice(58);
+    for (int i = 0; i < 58; ++i) {
+        weight_indice[i] = i * 2;
+        bias_indice[i] = i * 2 + 1;
+    }
+    pipeline->init<Constant>(bias_indice, Constant::param_tuple(0.2));
+    pipeline->init<Gaussian>(weight_indice, Gaussian::param_tuple(0., 0.05));
+    pipeline->init<Gaussian>({0, 2, 12, 14, 24, 26, 36, 38, 48, 50, 60, 62,
+            72, 74, 84, 86, 96, 98, 108, 110, 114},
+            Gaussian::param_tuple(0., 0.01));
+}
+
+// run a few iterations on the first stage with tracing on, then place the
+// layers from the measured costs. solved on the first stage's rank and
+// broadcast, so that all the ranks build the same graph.
+vector<pair<int, int> > place(const vector<pair<int, int> >& stages,
+        int micro_batches) {
+    vector<string> layers = GoogLeNet<false>::layers();
+    vector<int> flat(2 * layers.size());
+    {
+        FetchImage fetch(source, mean_file, true, true, true, 1.1, 224, 10.0,
+                { { stages[0].first, stages[0].second, batch_size } });
+        fetch.run();
+        Pipeline profile({ stages[0] }, batch_size, 1);
+        setup_param_server(&profile, 0.);
+        initialize(&profile);
+        for (int iter = 0; iter < 10; ++iter) {
+            Tracer::enable(iter >= 5);
+            profile.feed(fetch.images(), fetch.labels());
+            profile.run_async();
+            fetch.run_async();
+            fetch.sync();
+            profile.sync();
+        }
+        Tracer::enable(false);
+        if (current_rank() == stages[0].first) {
+            Placement placement(&profile, layers);
+            vector<pair<int, int> > p = placement.solve(stages, micro_batches);
+            LOG(INFO) << "placement:\n" << placement.report();
+            for (int i = 0; i < p.size(); ++i) {
+                flat[2 * i] = p[i].first;
+                flat[2 * i + 1] = p[i].second;
+            }
+        }
+        Tracer::clear();
+    }
+    MPI_CHECK(MPI_Bcast(&flat[0], flat.size(), MPI_INT, stages[0].first,
+                MPI_COMM_WORLD));
+    vector<pair<int, int> > ret(layers.size());
+    for (int i = 0; i < ret.size(); ++i) {
+        ret[i] = { flat[2 * i], flat[2 * i + 1] };
+    }
+    return ret;
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+    // initilize MPI
+    int ret;
+    MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    const int micro_batches = 4;
+    vector<pair<int, int> > stages = { {0, 0}, {1, 0}, {2, 0}, {3, 0} };
+    // images of all the micro batches are fetched to the first stage
+    vector<vector<int> > locations(micro_batches,
+            { stages[0].first, stages[0].second, batch_size });
+    shared_ptr<FetchImage> fetch = make_shared<FetchImage>(source, mean_file,
+            true, true, true, 1.1, 224, 10.0, locations);
+    fetch->run();
+    if (argc > 1 && string(argv[1]) == "place") {
+        stages = place(stages, micro_batches);
+    }
+    shared_ptr<Pipeline> pipeline = make_shared<Pipeline>(stages, batch_size,
+            micro_batches);
+    setup_param_server(pipeline.get(), 0.01);
+    initialize(pipeline.get());
+    for (int iter = 1; iter <= 100000; ++iter) {
+        // trace every 100th iteration for the stage report
+        Tracer::enable(iter % 100 == 0);
+        pipeline->feed(fetch->images(), fetch->labels());
+        pipeline->run_async();
+        fetch->run_async();
+        fetch->sync();
+        pipeline->sync();
+        MPI_LOG( << "iteration: " << iter << ", loss: "
+                << pipeline->loss()[0] << " " << pipeline->loss()[1]);
+        if (iter % 100 == 0) {
+            Tracer::enable(false);
+            LOG(INFO) << "rank " << current_rank() << "\n"
+                << pipeline->stage_report();
+            Tracer::clear();
+        }
+    }
+    fetch.reset();
+    pipeline.reset();
+    // Finalize MPI
+    MPI_CHECK(MPI_Finalize());
+    return 0;
+}
@@ -2,9 +2,14 @@
 
 #include <mpi.h>
 #include <chrono>
+#include <cstdlib>
 #include <glog/logging.h>
 #include "examples/googlenet.hpp"
 #include "composite/graph/all_reduce.hpp"
+#include "dispatch/critical_path.hpp"
+#include "dispatch/recompute.hpp"
+#include "dispatch/sibling_fusion.hpp"
+#include "dispatch/simulator.hpp"
 
 int batch_size = 128;
 string source = "/temp/imagenet-train-256xN-lmdb";
@@ -83,12 +88,30 @@ void time(int bs) {
         = make_shared<DataParallel<GoogLeNet<false>, AllReduce> >(parallels);
     setup_param_server(parallel_googlenet.get(), 0.1);
     initialize(parallel_googlenet.get(), "");
+    // PURINE_SIBLINGS merges the 1x1 convs of each inception reading the
+    // same bottom into one wider conv
+    if (getenv("PURINE_SIBLINGS")) {
+        SiblingFusion siblings(parallel_googlenet.get());
+        MPI_LOG( << "siblings: " << siblings.report() );
+    }
+    // PURINE_RECOMPUTE frees the activations of segments of sqrt(layers)
+    // layers after forward and recomputes them for backward
+    shared_ptr<Recompute> recompute;
+    if (getenv("PURINE_RECOMPUTE")) {
+        recompute = make_shared<Recompute>(parallel_googlenet.get(),
+                Recompute::split(GoogLeNet<false>::layers()));
+        MPI_LOG( << "recompute:\n" << recompute->report() );
+    }
 
     auto start = std::chrono::system_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>
         (std::chrono::system_clock::now() - start);
+    // PURINE_TRACE=prefix traces 10 more iterations after the timed ones
+    const char* trace = getenv("PURINE_TRACE");
+    int iterations = trace ? 210 : 200;
     // iteration
-    for (int iter = 1; iter <= 200; ++iter) {
+    for (int iter = 1; iter <= iterations; ++iter) {
+        Tracer::enable(iter > 200);
         // feed prefetched data to googlenet
         parallel_googlenet->feed(fetch->images(), fetch->labels());
         // start googlenet and next fetch
@@ -108,6 +131,24 @@ void time(int bs) {
                     " Time Elapsed: " << duration.count());
         }
     }
+    if (trace) {
+        Tracer::enable(false);
+        string prefix = string(trace) + "_" + to_string(batch_size);
+        Tracer::dump(prefix);
+        CriticalPath critical(parallel_googlenet.get());
+        LOG(INFO) << "rank " << current_rank() << "\n" << critical.report();
+        critical.dump_dot(prefix + ".rank" + to_string(current_rank())
+                + ".dot");
+        // op costs for plan_parallel
+        Simulator::Profile profile(parallel_googlenet.get());
+        profile.save(prefix + ".rank" + to_string(current_rank())
+                + ".profile");
+        if (recompute) {
+            LOG(INFO) << "rank " << current_rank() << " recompute\n"
+                << recompute->report(&profile);
+        }
+        Tracer::clear();
+    }
     // delete
     fetch.reset();
     parallel_googlenet.reset();
@@ -118,6 +159,10 @@ int main(int argc, char** argv) {
     // initilize MPI
     int ret;
     MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    // PURINE_CONV_CACHE=file keeps the tuned cpu conv algorithms across runs
+    if (const char* conv_cache = getenv("PURINE_CONV_CACHE")) {
+        ConvCpu::set_cache(conv_cache);
+    }
     time(40);
     time(48);
     time(56);
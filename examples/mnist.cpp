@@ -58,15 +58,20 @@ int main(int argc, char** argv) {
     // initilize MPI
     int ret;
     MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    // PURINE_CONV_CACHE=file keeps the tuned cpu conv algorithms across runs
+    if (const char* conv_cache = getenv("PURINE_CONV_CACHE")) {
+        ConvCpu::set_cache(conv_cache);
+    }
     // parallels
     vector<vector<int> > parallels;
     read_parallel_config(parallels);  
     // parameter server
     // fetch image
+    // PURINE_DATASET_CACHE=memory or shared keeps the dataset in memory
     shared_ptr<FetchImage> fetch = make_shared<FetchImage>(source, mean_file,
             false, true, false, 1.0, 28, 
             5.0f,
-            parallels);
+            parallels, DatasetCache::mode(getenv("PURINE_DATASET_CACHE")));
     fetch->run();
     // create data parallelism of Nin_Cifar;
     shared_ptr<DataParallel<Mnist<false>, AllReduce> > parallel_mnist
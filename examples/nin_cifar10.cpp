@@ -59,19 +59,28 @@ int main(int argc, char** argv) {
     // initilize MPI
     int ret;
     MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    // PURINE_CONV_CACHE=file keeps the tuned cpu conv algorithms across runs
+    if (const char* conv_cache = getenv("PURINE_CONV_CACHE")) {
+        ConvCpu::set_cache(conv_cache);
+    }
     // parallels
     vector<vector<int> > parallels;
     read_parallel_config(parallels);  
     // parameter server
     // fetch image
+    // PURINE_DATASET_CACHE=memory or shared keeps the dataset in memory
     shared_ptr<FetchImage> fetch = make_shared<FetchImage>(source, mean_file,
             true, true, true, 1.1, 32,
             10.0,
-            parallels);
+            parallels, DatasetCache::mode(getenv("PURINE_DATASET_CACHE")));
     fetch->run();
     // create data parallelism of Nin_Cifar;
     shared_ptr<DataParallel<NIN_Cifar10<false>, AllReduce> > parallel_nin_cifar
         = make_shared<DataParallel<NIN_Cifar10<false>, AllReduce> >(parallels);
+    // micro batches accumulated per update, the batch size in
+    // parallel_config is the one of a micro batch, iter counts micro batches
+    int accumulation = argc > 1 ? atoi(argv[1]) : 1;
+    parallel_nin_cifar->set_accumulation(accumulation);
     // set learning rate etc
     DTYPE global_learning_rate = 0.05;
     DTYPE global_decay = 0.0001;
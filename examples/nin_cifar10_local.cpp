@@ -0,0 +1,129 @@
+// Copyright Lin Min 2015
+// nin_cifar10 trained with local SGD: the replicas update their own
+// weights and average them every period iterations.
+//   mpirun ... nin_cifar10_local [period] [warmup]
+// compare the loss and accuracy with the log of nin_cifar10.
+
+#include <mpi.h>
+#include <glog/logging.h>
+#include "examples/nin_cifar10.hpp"
+#include "composite/graph/local_sgd_data_parallel.hpp"
+
+string data_path = "/home/zhxfl/purine2/data/cifar-10/";
+
+string source =    data_path + "cifar-10-train-lmdb";
+string mean_file = data_path + "mean.binaryproto";
+
+using namespace purine;
+
+typedef LocalSgdDataParallel<NIN_Cifar10<false> > LocalNIN;
+
+WeightedSum::param_tuple update_param(int i, DTYPE global_learning_rate,
+        DTYPE global_decay) {
+    DTYPE learning_rate = global_learning_rate * (i % 2 ? 2. : 1.);
+    if (i == 16 || i == 17) {
+        learning_rate /= 10.;
+    }
+    DTYPE weight_decay = learning_rate * global_decay * (i % 2 ? 0. : 1.);
+    return make_tuple<vector<DTYPE> >({0.9, learning_rate, weight_decay});
+}
+
+void setup_update(LocalNIN* parallel_nin_cifar, DTYPE global_learning_rate,
+        DTYPE global_decay) {
+    vector<Update::param_tuple> param(18);
+    for (int i = 0; i < 18; ++i) {
+        vector<DTYPE> p = std::get<0>(update_param(i, global_learning_rate,
+                    global_decay));
+        param[i] = Update::param_tuple(p[0], p[1], p[2]);
+    }
+    parallel_nin_cifar->setup_update(param);
+}
+
+void read_parallel_config(vector<vector<int>>& parallels){
+    FILE* file = fopen("parallel_config", "r+");
+    int rank, device, batch_size;
+    while(fscanf(file, "%d %d %d", &rank, &device, &batch_size) != EOF){
+        parallels.push_back({rank, device, batch_size});
+        MPI_LOG(<<"rank " << rank << " device " << device << " batch_size " << batch_size);
+    }
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+    // initilize MPI
+    int ret;
+    MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    // PURINE_CONV_CACHE=file keeps the tuned cpu conv algorithms across runs
+    if (const char* conv_cache = getenv("PURINE_CONV_CACHE")) {
+        ConvCpu::set_cache(conv_cache);
+    }
+    int period = argc > 1 ? atoi(argv[1]) : 8;
+    int warmup = argc > 2 ? atoi(argv[2]) : 1000;
+    // parallels
+    vector<vector<int> > parallels;
+    read_parallel_config(parallels);
+    // fetch image
+    // PURINE_DATASET_CACHE=memory or shared keeps the dataset in memory
+    shared_ptr<FetchImage> fetch = make_shared<FetchImage>(source, mean_file,
+            true, true, true, 1.1, 32,
+            10.0,
+            parallels, DatasetCache::mode(getenv("PURINE_DATASET_CACHE")));
+    fetch->run();
+    shared_ptr<LocalNIN> parallel_nin_cifar = make_shared<LocalNIN>(parallels);
+    // nin_cifar10 sums the diffs of the replicas, each replica here steps
+    // on the mean diff of its own batch, scale to keep the same step size.
+    DTYPE global_learning_rate = 0.05 * parallels.size();
+    DTYPE global_decay = 0.0001;
+    setup_update(parallel_nin_cifar.get(), global_learning_rate, global_decay);
+    parallel_nin_cifar->set_period(period, warmup);
+
+    vector<int> indice(9);
+    iota(indice.begin(), indice.end(), 0);
+    vector<int> weight_indice(9);
+    vector<int> bias_indice(9);
+    transform(indice.begin(), indice.end(), weight_indice.begin(),
+            [](int i)->int {
+            return i * 2;
+            });
+    transform(indice.begin(), indice.end(), bias_indice.begin(),
+            [](int i)->int {
+            return i * 2 + 1;
+            });
+    parallel_nin_cifar->init<Constant>(bias_indice, Constant::param_tuple(0.));
+    parallel_nin_cifar->init<Gaussian>(weight_indice,
+            Gaussian::param_tuple(0., 0.05));
+    // iteration
+    for (int iter = 1; iter <= 50000; ++iter) {
+        if(iter == 40000 || iter == 45000){
+            global_learning_rate /= 10.;
+            for (int i = 0; i < 18; ++i) {
+                parallel_nin_cifar->set_param(i, update_param(i,
+                            global_learning_rate, global_decay));
+            }
+        }
+        parallel_nin_cifar->feed(fetch->images(), fetch->labels());
+        parallel_nin_cifar->run_async();
+        fetch->run_async();
+        parallel_nin_cifar->sync();
+        fetch->sync();
+        // the loss is averaged over the replicas, which differ between two
+        // averagings
+        if(iter % 10 == 0 && current_rank() == 0)
+        {
+            MPI_LOG(<<"iter " << iter << " loss " << parallel_nin_cifar->loss()[0]
+                    << " accuracy " << parallel_nin_cifar->loss()[1]
+                    << " averaged " << parallel_nin_cifar->averaged());
+        }
+        if (iter % 5000 == 0) {
+            parallel_nin_cifar->average();
+            parallel_nin_cifar->save("./nin_cifar_local_dump_iter_"
+                    + to_string(iter) + ".snapshot");
+        }
+    }
+    // delete
+    fetch.reset();
+    parallel_nin_cifar.reset();
+    // Finalize MPI
+    MPI_CHECK(MPI_Finalize());
+    return 0;
+}
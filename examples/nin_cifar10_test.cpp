@@ -21,7 +21,8 @@ int main(int argc, char** argv) {
     // create data parallelism of Nin_Cifar;
     shared_ptr<ComputeLoss<NIN_Cifar10<true> > > nin_cifar_test
         = make_shared<ComputeLoss<NIN_Cifar10<true> > >(0, 0, batch_size);
-    // do the initialization
+    // strip and fuse the graph for evaluation, then load the weights
+    nin_cifar_test->optimize();
     nin_cifar_test->load("./nin_cifar_dump_iter_50000.snapshot");
 
     // iteration
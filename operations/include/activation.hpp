@@ -23,6 +23,7 @@ namespace purine {
             explicit Activation(const vector<Tensor*>& inputs,
                     const vector<Tensor*>& outputs, const param_tuple& args);
             virtual ~Activation();
+            virtual void compute_cpu(const vector<bool>& add);
             virtual void compute_gpu(const vector<bool>& add);
     };
 
@@ -39,6 +40,7 @@ namespace purine {
             explicit ActivationDown(const vector<Tensor*>& inputs,
                     const vector<Tensor*>& outputs, const param_tuple& args);
             virtual ~ActivationDown();
+            virtual void compute_cpu(const vector<bool>& add);
             virtual void compute_gpu(const vector<bool>& add);
     };
 
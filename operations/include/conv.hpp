@@ -3,14 +3,23 @@
 #ifndef PURINE_CONV
 #define PURINE_CONV
 
+#include <memory>
+#include <vector>
+
 #include "operations/operation.hpp"
 #include "operations/cudnn.hpp"
 #include "operations/tensor.hpp"
+#include "operations/include/conv_cpu.hpp"
+
+using std::shared_ptr;
+using std::vector;
 
 namespace purine {
 
 /**
  * { bottom, weight } >> op >> { top }
+ * On the gpu, cudnn. On the cpu, see ConvCpu.
+ * On the cpu, { top, columns } keeps the im2col columns for ConvWeight.
  */
 class Conv : public Operation {
  protected:
@@ -22,11 +31,13 @@ class Conv : public Operation {
   cudnnConvolutionFwdAlgo_t algo_ = (cudnnConvolutionFwdAlgo_t)NULL;
   size_t workspace_size_ = 0;
   shared_ptr<Tensor> workspace_;
+  shared_ptr<ConvCpu> cpu_;
  public:
   typedef tuple<int, int, int, int> param_tuple;
   explicit Conv(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
       const param_tuple& args);
   virtual ~Conv();
+  virtual void compute_cpu(const vector<bool>& add);
   virtual void compute_gpu(const vector<bool>& add);
 };
 
@@ -40,17 +51,21 @@ class ConvDown : public Operation {
   cudnnTensorDescriptor_t top_desc_ = NULL;
   cudnnFilterDescriptor_t filter_desc_ = NULL;
   cudnnConvolutionDescriptor_t conv_desc_ = NULL;
+  shared_ptr<ConvCpu> cpu_;
  public:
   typedef tuple<int, int, int, int> param_tuple;
   explicit ConvDown(const vector<Tensor*>& inputs,
       const vector<Tensor*>& outputs,
       const param_tuple& args);
   virtual ~ConvDown();
+  virtual void compute_cpu(const vector<bool>& add);
   virtual void compute_gpu(const vector<bool>& add);
 };
 
 /**
  * { top_diff, bottom } >> op >> { weight_diff }
+ * On the cpu, { top_diff, bottom, columns } reads the columns which Conv
+ * kept instead of running im2col.
  */
 class ConvWeight : public Operation {
  protected:
@@ -59,12 +74,14 @@ class ConvWeight : public Operation {
   cudnnTensorDescriptor_t top_desc_ = NULL;
   cudnnFilterDescriptor_t filter_desc_ = NULL;
   cudnnConvolutionDescriptor_t conv_desc_ = NULL;
+  shared_ptr<ConvCpu> cpu_;
  public:
   typedef tuple<int, int, int, int> param_tuple;
   explicit ConvWeight(const vector<Tensor*>& inputs,
       const vector<Tensor*>& outputs,
       const param_tuple& args);
   virtual ~ConvWeight();
+  virtual void compute_cpu(const vector<bool>& add);
   virtual void compute_gpu(const vector<bool>& add);
 };
 
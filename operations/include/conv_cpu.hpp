@@ -0,0 +1,112 @@
+// Copyright Lin Min 2015
+
+#ifndef PURINE_CONV_CPU
+#define PURINE_CONV_CPU
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "operations/tensor.hpp"
+#include "operations/include/winograd.hpp"
+
+using std::map;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+/**
+ * @brief the cpu algorithms of Conv, ConvDown and ConvWeight for one shape.
+ *
+ * - IM2COL: im2col and gemm, the gemm reads the image directly for 1x1
+ *   kernels with stride 1 and no pad. Needs packed images, or NHWC
+ *   tensors for such 1x1 kernels, which are one gemm for the whole batch.
+ * - WINOGRAD_2X2, WINOGRAD_4X4: Winograd, 3x3 kernels with stride 1.
+ * - DIRECT: loops over the taps, axpy along the rows. No workspace.
+ *
+ * With AUTO the algorithm is tuned on the first compute: every algorithm
+ * which applies to the shape and whose workspace is within the limit is
+ * run once to warm up, then timed a few times on the actual inputs (into a
+ * scratch output). The one with the fastest best run is kept for all the
+ * ops of the same key (pass, sizes, pad, stride). The
+ * decisions are written to the cache file when one is set, and read back
+ * from it by later runs, which then skip the timing.
+ *
+ * FORWARD and BACKWARD_FILTER of the same bottom can share a column
+ * buffer (set_columns): forward keeps the im2col result of every image in
+ * it and the filter pass reads it instead of running im2col again.
+ */
+class ConvCpu {
+ public:
+  enum Algo { AUTO, IM2COL, WINOGRAD_2X2, WINOGRAD_4X4, DIRECT };
+  enum Pass { FORWARD, BACKWARD_DATA, BACKWARD_FILTER };
+ protected:
+  Pass pass_;
+  Size bottom_size_;
+  Size top_size_;
+  Size kernel_size_;
+  int pad_h_, pad_w_, stride_h_, stride_w_;
+  bool packed_;
+  bool nhwc_;
+  Algo algo_;
+  shared_ptr<Winograd> winograd_;
+  vector<DTYPE> col_;
+  Tensor* columns_ = NULL;
+
+  static Algo default_algo_;
+  static size_t workspace_limit_;
+  static string cache_file_;
+  static map<string, Algo> decisions_;
+  static std::mutex mutex_;
+
+  Algo tune(const vector<Tensor*>& inputs, Tensor* output);
+  void im2col(const vector<Tensor*>& inputs, Tensor* output, bool add);
+  void pointwise_nhwc(const vector<Tensor*>& inputs, Tensor* output,
+      bool add);
+  bool pointwise() const;
+  void direct(const vector<Tensor*>& inputs, Tensor* output, bool add);
+ public:
+  /**
+   * packed: whether the images of the bottom and top tensors are packed
+   * (strides of an unsliced tensor, except between images).
+   * nhwc: whether the bottom and top tensors are packed NHWC.
+   */
+  explicit ConvCpu(Pass pass, const Size& bottom, const Size& top,
+      const Size& kernel, int pad_h, int pad_w, int stride_h, int stride_w,
+      bool packed, bool nhwc = false);
+  // the algorithms which apply to the shape
+  vector<Algo> algos() const;
+  // bytes of the buffers of algo
+  size_t workspace(Algo algo) const;
+  string key() const;
+  inline Algo algo() const { return algo_; }
+  /**
+   * columns of all the images, { num, channels * kernel, top height,
+   * top width }. Pins the algorithm to IM2COL, the filter pass must run
+   * after the forward which wrote them.
+   */
+  void set_columns(Tensor* columns);
+  // inputs and output as in the op
+  void run(Algo algo, const vector<Tensor*>& inputs, Tensor* output,
+      bool add);
+  // run with the algorithm of the op, tuned on the first call
+  void compute(const vector<Tensor*>& inputs, Tensor* output, bool add);
+
+  static string name(Algo algo);
+  static Algo algo(const string& name);
+  // algorithm of the ops created afterwards, AUTO by default
+  inline static void set_algo(Algo algo) { default_algo_ = algo; }
+  inline static void set_workspace_limit(size_t bytes) {
+    workspace_limit_ = bytes;
+  }
+  // load the decisions in filename (if it exists), save new ones there
+  static void set_cache(const string& filename);
+};
+
+}
+
+#endif
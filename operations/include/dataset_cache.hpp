@@ -0,0 +1,104 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_DATASET_CACHE
+#define PURINE_DATASET_CACHE
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+using std::shared_ptr;
+using std::weak_ptr;
+
+namespace purine {
+
+    /**
+     * A whole lmdb dataset loaded once into a contiguous uint8 arena.
+     * Every record is stored as decoded CHW pixels, encoded datums are
+     * decoded at load time.
+     *
+     * MEMORY keeps the arena in the process and shares it between the
+     * ImageLabel ops of the process which read the same source.
+     * SHARED puts the arena in POSIX shared memory, so that ranks on the
+     * same machine load the dataset only once. The first rank to create the
+     * segment fills it, the others map it and wait until it is ready.
+     * The header keeps the pid of that rank and the size and mtime of the
+     * source: a segment left behind by a dead rank, one of another version
+     * of the source, or one not ready within timeout_seconds() is unlinked
+     * and made again.
+     */
+    class DatasetCache {
+        public:
+            enum Mode {
+                NONE = 0,
+                MEMORY = 1,
+                SHARED = 2
+            };
+            struct Record {
+                uint64_t offset;
+                int channels;
+                int height;
+                int width;
+                int label;
+            };
+            static shared_ptr<DatasetCache> get(const string& source,
+                    bool color, Mode mode);
+            // "none" (or NULL), "memory" or "shared"
+            static Mode mode(const char* name);
+            static int& timeout_seconds();
+
+            DatasetCache(const string& source, bool color, Mode mode);
+            ~DatasetCache();
+            int size() const { return count_; }
+            const Record& record(int i) const { return records_[i]; }
+            const uint8_t* data(int i) const {
+                return arena_ + records_[i].offset;
+            }
+        protected:
+            struct Header {
+                volatile int ready;
+                int owner;
+                int64_t source_size;
+                int64_t source_mtime;
+                int count;
+                uint64_t bytes;
+            };
+            void load(vector<Record>* records, vector<uint8_t>* arena);
+            void attach_shared();
+            void create_shared(int fd);
+            // maps a segment another rank made, false if it is stale
+            bool open_shared(int fd);
+            // unlinks shm_name_ if it is still the segment of fd
+            void unlink_shared(int fd);
+
+            string source_;
+            bool color_;
+            Mode mode_;
+            int count_ = 0;
+            const Record* records_ = NULL;
+            const uint8_t* arena_ = NULL;
+            // MEMORY
+            vector<Record> local_records_;
+            vector<uint8_t> local_arena_;
+            // SHARED
+            string shm_name_;
+            bool shm_owner_ = false;
+            ino_t shm_inode_ = 0;
+            int64_t source_size_ = 0;
+            int64_t source_mtime_ = 0;
+            void* shm_ = NULL;
+            size_t shm_size_ = 0;
+
+            static std::mutex registry_mutex_;
+            static map<string, weak_ptr<DatasetCache> > registry_;
+    };
+
+}
+
+#endif
@@ -0,0 +1,51 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_DROPOUT
+#define PURINE_DROPOUT
+
+#include <cstdint>
+
+#include "operations/operation.hpp"
+
+namespace purine {
+
+/**
+ * { bottom } >> op >> { top, mask }
+ * drops each element with probability ratio. mask keeps one bit per
+ * element (in the order of n, c, h, w), 32 of them in the memory of each
+ * DTYPE, its size is mask_size(bottom size). The bits are drawn from
+ * Philox4x32-10, a counter based generator: the bits of a word depend
+ * only on the seed, the word and the number of the run, so they can be
+ * drawn in any order, by any number of threads. On the cpu only.
+ */
+class Dropout : public Operation {
+ protected:
+  DTYPE ratio;
+  uint64_t seed_;
+  uint64_t run_ = 0;
+ public:
+  typedef tuple<DTYPE> param_tuple;
+  explicit Dropout(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+  static Size mask_size(const Size& size);
+  // ten rounds of Philox4x32 on counter, in place
+  static void philox(uint32_t counter[4], uint32_t key0, uint32_t key1);
+  // the mask words [begin, end) of the run with ratio
+  static void draw(uint64_t seed, uint64_t run, DTYPE ratio, int begin,
+      int end, uint32_t* words);
+};
+
+/**
+ * { top_diff, mask } >> op >> { bottom_diff }
+ */
+class DropoutDown : public Operation {
+ public:
+  typedef tuple<> param_tuple;
+  explicit DropoutDown(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+};
+
+}
+
+#endif
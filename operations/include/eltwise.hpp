@@ -46,6 +46,26 @@ namespace purine {
             inline vector<DTYPE> weights() { return weights_; }
     };
 
+    /**
+     * { ... } >> op >> { top }
+     * weighted sum of the inputs whose weight is not zero. the weights are
+     * set before each run by Op<QuorumSum>, which decides from the arrival
+     * of the inputs which of them take part (see dispatch/op.hpp).
+     * param: quorum, deadline in us (0 for none), whether late inputs are
+     * deferred to the next run, weight of each input (all 1 if empty).
+     */
+    class QuorumSum : public Operation {
+        protected:
+            vector<DTYPE> weights_;
+        public:
+            typedef tuple<int, int, bool, vector<DTYPE> > param_tuple;
+            explicit QuorumSum(const vector<Tensor*>& inputs,
+                    const vector<Tensor*>& outputs, const param_tuple& args);
+            virtual void compute_cpu(const vector<bool>& add);
+            virtual void compute_gpu(const vector<bool>& add);
+            inline void set_weights(const vector<DTYPE>& w) { weights_ = w; }
+    };
+
     /**
      * { ... } >> op >> { top }
      */
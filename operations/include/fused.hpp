@@ -0,0 +1,121 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_FUSED
+#define PURINE_FUSED
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "operations/operation.hpp"
+#include "operations/include/activation.hpp"
+#include "operations/include/bias.hpp"
+#include "operations/include/conv.hpp"
+#include "operations/include/inner.hpp"
+
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace purine {
+
+/**
+ * { bottom, weight, bias } >> op >> { top }
+ * Conv, Bias and Activation (mode "" for none) in a single op, bias is
+ * optional. Used by Inference in place of conv_up, bias_up and
+ * activation_up.
+ */
+class ConvBiasAct : public Operation {
+ protected:
+  shared_ptr<Conv> conv_;
+  shared_ptr<Bias> bias_;
+  shared_ptr<Activation> activation_;
+ public:
+  typedef tuple<int, int, int, int, string> param_tuple;
+  explicit ConvBiasAct(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+  virtual void compute_gpu(const vector<bool>& add);
+};
+
+/**
+ * { bottom, weight, bias } >> op >> { top }
+ * Inner, Bias and Activation (mode "" for none) in a single op.
+ */
+class InnerBiasAct : public Operation {
+ protected:
+  shared_ptr<Inner> inner_;
+  shared_ptr<Bias> bias_;
+  shared_ptr<Activation> activation_;
+ public:
+  typedef tuple<string> param_tuple;
+  explicit InnerBiasAct(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+  virtual void compute_gpu(const vector<bool>& add);
+};
+
+/**
+ * { bottom, weight_1, ..., weight_n, bias_1, ..., bias_n } >> op >> { top }
+ * n convolutions of the same bottom, with the same kernel, pad and stride,
+ * as one Conv whose weights are the n weights one after the other (the
+ * biases are optional). top has the channels of the n tops, which are its
+ * slices. The weights are copied into the stacked ones when they change.
+ * Used by SiblingFusion.
+ */
+class SiblingConv : public Operation {
+ protected:
+  vector<Tensor*> weights_;
+  vector<Tensor*> biases_;
+  vector<int64_t> weight_versions_;
+  vector<int64_t> bias_versions_;
+  shared_ptr<Tensor> weight_;
+  shared_ptr<Tensor> bias_;
+  shared_ptr<ConvBiasAct> conv_;
+ public:
+  // pad_h, pad_w, stride_h, stride_w, n
+  typedef tuple<int, int, int, int, int> param_tuple;
+  explicit SiblingConv(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+  virtual void compute_gpu(const vector<bool>& add);
+};
+
+/**
+ * { top_diff, weight_1, ..., weight_n } >> op >> { bottom_diff }
+ * backward of SiblingConv to its bottom, top_diff has the channels of the
+ * n top diffs.
+ */
+class SiblingConvDown : public Operation {
+ protected:
+  vector<Tensor*> weights_;
+  vector<int64_t> weight_versions_;
+  shared_ptr<Tensor> weight_;
+  shared_ptr<ConvDown> conv_down_;
+ public:
+  typedef tuple<int, int, int, int> param_tuple;
+  explicit SiblingConvDown(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+  virtual void compute_gpu(const vector<bool>& add);
+};
+
+/**
+ * { top_diff, bottom } >> op >> { weight_diff_1, ..., weight_diff_n }
+ * backward of SiblingConv to its weights, in one ConvWeight whose result
+ * is copied out to the n weight diffs.
+ */
+class SiblingConvWeight : public Operation {
+ protected:
+  shared_ptr<Tensor> weight_diff_;
+  shared_ptr<ConvWeight> conv_weight_;
+ public:
+  typedef tuple<int, int, int, int> param_tuple;
+  explicit SiblingConvWeight(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+  virtual void compute_gpu(const vector<bool>& add);
+};
+
+}
+
+#endif
@@ -4,14 +4,28 @@
 
 #include <lmdb.h>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <opencv2/core/core.hpp>
 
 #include "operations/operation.hpp"
 #include "caffeine/math_functions.hpp"
+#include "caffeine/proto/caffe.pb.h"
+#include "operations/include/dataset_cache.hpp"
 
 namespace purine {
 
     /*
      * {} >> op >> { image, label }
+     *
+     * Datums with encoded = true hold jpeg/png bytes. They are decoded by a
+     * dedicated pool of decoder threads (started on first use) into buffers
+     * which are reused from batch to batch.
+     *
+     * cache is a DatasetCache::Mode. Unless it is NONE the whole source is
+     * loaded once and batches are served from memory instead of lmdb.
      */
     class ImageLabel : public Operation {
         protected:
@@ -27,6 +41,7 @@ namespace purine {
             int offset;
             int batch_size;
             int crop_size;
+            int cache;
 
             shared_ptr<Tensor> mean_;
             MDB_env* mdb_env_;
@@ -34,16 +49,42 @@ namespace purine {
             MDB_txn* mdb_txn_;
             MDB_cursor* mdb_cursor_;
             MDB_val mdb_key_, mdb_value_;
+            shared_ptr<DatasetCache> cache_;
+            int cursor_ = 0;
 
+            // per item datums and imdecode buffers, reused across batches.
+            vector<caffe::Datum> datums_;
+            vector<cv::Mat> decode_bufs_;
+            // decoder pool, thread i decodes items i, i + n, i + 2n, ...
+            vector<shared_ptr<std::thread> > decoders_;
+            std::mutex decode_mutex_;
+            std::condition_variable decode_cv_;
+            std::condition_variable done_cv_;
+            int decode_round_ = 0;
+            int decode_running_ = 0;
+            bool decode_stop_ = false;
+            // decode throughput counters
+            std::atomic<long> decoded_images_;
+            std::atomic<long> decoded_bytes_;
+            double decode_seconds_ = 0.;
+            int decode_batches_ = 0;
+
+            void start_decoders();
+            void decode_worker(int id);
+            void decode_batch();
         public:
             typedef tuple<string, string, bool, bool, bool, int, float, float,
-                    int, int, int, int> param_tuple;
+                    int, int, int, int, int> param_tuple;
 
             explicit ImageLabel(const vector<Tensor*>& inputs,
                     const vector<Tensor*>& outputs, const param_tuple& args);
             
             ~ImageLabel();
             virtual void compute_cpu(const vector<bool>& add);
+
+            long decoded_images() const { return decoded_images_; }
+            long decoded_bytes() const { return decoded_bytes_; }
+            double decode_seconds() const { return decode_seconds_; }
     };
 }
 
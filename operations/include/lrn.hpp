@@ -26,11 +26,14 @@ namespace purine {
             typedef tuple<DTYPE, DTYPE, int> param_tuple;
             explicit LRN(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
                     const param_tuple& args);
+            virtual void compute_cpu(const vector<bool>& add);
             virtual void compute_gpu(const vector<bool>& add);
     };
 
     /**
-     * { bottom } >> op >> { top }
+     * { bottom } >> op >> { scale }
+     * On the cpu also { bottom } >> op >> { scale, top }, which writes the
+     * top of LRN in the same pass.
      */
     class LRNScale : public Operation {
         protected:
@@ -41,6 +44,7 @@ namespace purine {
             typedef tuple<DTYPE, DTYPE, int> param_tuple;
             explicit LRNScale(const vector<Tensor*>& inputs,
                     const vector<Tensor*>& outputs, const param_tuple& args);
+            virtual void compute_cpu(const vector<bool>& add);
             virtual void compute_gpu(const vector<bool>& add);
     };
 
@@ -56,6 +60,7 @@ namespace purine {
             typedef tuple<DTYPE, DTYPE, int> param_tuple;
             explicit LRNDown(const vector<Tensor*>& inputs,
                     const vector<Tensor*>& outputs, const param_tuple& args);
+            virtual void compute_cpu(const vector<bool>& add);
             virtual void compute_gpu(const vector<bool>& add);
     };
 
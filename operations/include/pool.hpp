@@ -2,13 +2,20 @@
 #ifndef PURINE_POOL
 #define PURINE_POOL
 
+#include <cstdint>
+
 #include "operations/cudnn.hpp"
 #include "operations/operation.hpp"
 
 namespace purine {
 
 /**
- * { bottom } >> op >> { top }
+ * { bottom } >> op >> { top, [mask] }
+ * mask: on the cpu, for max pooling, the offset of the max in its window
+ * (h * kernel_w + w, NO_MAX for a window out of the bottom), so that
+ * PoolDown does not search the windows again. One byte per element of top
+ * (in the order of n, c, h, w), 4 of them in the memory of each DTYPE, its
+ * size is mask_size(top size). Windows of up to 254 elements.
  */
 class Pool : public Operation {
  protected:
@@ -22,11 +29,14 @@ class Pool : public Operation {
   explicit Pool(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
       const param_tuple& args);
   virtual ~Pool();
+  virtual void compute_cpu(const vector<bool>& add);
   virtual void compute_gpu(const vector<bool>& add);
+  static const uint8_t NO_MAX = 255;
+  static Size mask_size(const Size& top);
 };
 
 /**
- * { top_diff, top, bottom } >> op >> { bottom_diff }
+ * { top_diff, top, bottom, [mask] } >> op >> { bottom_diff }
  */
 class PoolDown : public Operation {
  protected:
@@ -40,6 +50,7 @@ class PoolDown : public Operation {
   explicit PoolDown(const vector<Tensor*>& inputs,
       const vector<Tensor*>& outputs, const param_tuple& args);
   virtual ~PoolDown();
+  virtual void compute_cpu(const vector<bool>& add);
   virtual void compute_gpu(const vector<bool>& add);
 };
 
@@ -0,0 +1,26 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_RELEASE
+#define PURINE_RELEASE
+
+#include "operations/operation.hpp"
+
+namespace purine {
+
+    /**
+     * { bottom, ... } >> op >> { released }
+     * frees the memory of the bottom tensors (see Tensor::release), the
+     * next writer allocates it again. released is never written, it only
+     * tells the ops which write the bottoms again that the memory was freed.
+     */
+    class Release : public Operation {
+        public:
+            typedef tuple<> param_tuple;
+            explicit Release(const vector<Tensor*>& inputs,
+                    const vector<Tensor*>& outputs, const param_tuple& args);
+            virtual void compute_cpu(const vector<bool>& add);
+            virtual void compute_gpu(const vector<bool>& add);
+    };
+
+}
+
+#endif
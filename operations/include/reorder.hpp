@@ -0,0 +1,30 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_REORDER
+#define PURINE_REORDER
+
+#include "operations/cudnn.hpp"
+#include "operations/operation.hpp"
+
+namespace purine {
+
+/**
+ * { bottom } >> op >> { top }
+ * copies bottom into top of the same size and another layout (or any
+ * other strides).
+ */
+class Reorder : public Operation {
+ protected:
+  cudnnTensorDescriptor_t bottom_desc_ = NULL;
+  cudnnTensorDescriptor_t top_desc_ = NULL;
+ public:
+  typedef tuple<> param_tuple;
+  explicit Reorder(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual ~Reorder();
+  virtual void compute_cpu(const vector<bool>& add);
+  virtual void compute_gpu(const vector<bool>& add);
+};
+
+}
+
+#endif
@@ -63,6 +63,19 @@ class SoftmaxLossDown : public Operation {
   virtual void compute_cpu(const vector<bool>& add);
 };
 
+/**
+ * { bottom, label, lambda } >> op >> { softmax, loss, bottom_diff }
+ * Softmax over the channels, SoftmaxLoss and SoftmaxLossDown in one op,
+ * which reads each position of bottom once for all three. On the cpu only.
+ */
+class SoftmaxCrossEntropy : public Operation {
+ public:
+  typedef tuple<> param_tuple;
+  explicit SoftmaxCrossEntropy(const vector<Tensor*>& inputs,
+      const vector<Tensor*>& outputs, const param_tuple& args);
+  virtual void compute_cpu(const vector<bool>& add);
+};
+
 }
 
 #endif
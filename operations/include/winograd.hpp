@@ -0,0 +1,67 @@
+// Copyright Lin Min 2015
+
+#ifndef PURINE_WINOGRAD
+#define PURINE_WINOGRAD
+
+#include <vector>
+
+#include "operations/tensor.hpp"
+
+using std::vector;
+
+namespace purine {
+
+/**
+ * @brief cpu convolution F(m x m, 3 x 3) of Lavin and Gray, for 3x3
+ * kernels with stride 1, m is 2 or 4.
+ *
+ * The padded bottom is cut into overlapping (m + 2) x (m + 2) tiles,
+ * V = B' d B, the filter is transformed to U = G g G', and for each of the
+ * (m + 2)^2 points of the tile a gemm reduces the channels, M = U V. The
+ * top tiles are Y = A' M A. The backward passes are the transposes of the
+ * same bilinear form, with Z = A dy A': the bottom diff is B (U' Z) B'
+ * added to the overlapping tiles, the weight diff is G' (Z V') G.
+ *
+ * U is kept between calls and only transformed again when the weight
+ * tensor changed (Tensor::version). One image is transformed at a time to
+ * bound the memory.
+ */
+class Winograd {
+ protected:
+  int m_;
+  int alpha_;
+  int pad_h_, pad_w_;
+  Size bottom_size_;
+  Size top_size_;
+  int tiles_h_, tiles_w_;
+  // the transforms and their transposes
+  vector<DTYPE> BT_, B_, G_, GT_, AT_, A_;
+  const DTYPE* filter_data_ = NULL;
+  int64_t filter_version_ = -1;
+  vector<DTYPE> U_;  // alpha^2 x K x C
+  vector<DTYPE> V_;  // alpha^2 x C x tiles
+  vector<DTYPE> M_;  // alpha^2 x K x tiles
+  vector<DTYPE> dU_;  // alpha^2 x K x C, the weight diff before G' . G
+  void transform_filter(Tensor* weight);
+  void transform_bottom(Tensor* bottom, int n);
+  void transform_top_diff(Tensor* top_diff, int n);
+ public:
+  explicit Winograd(int m, const Size& bottom, const Size& top,
+      int pad_h, int pad_w);
+  static bool supported(const Size& kernel, int stride_h, int stride_w);
+  inline int m() const { return m_; }
+  // transform the filter again on the next call, as if the weight changed
+  inline void invalidate_filter() { filter_version_ = -1; }
+  // { bottom, weight } >> top
+  void forward(Tensor* bottom, Tensor* weight, Tensor* top, bool add);
+  // { top_diff, weight } >> bottom_diff
+  void backward_data(Tensor* top_diff, Tensor* weight, Tensor* bottom_diff,
+      bool add);
+  // { top_diff, bottom } >> weight_diff
+  void backward_filter(Tensor* top_diff, Tensor* bottom, Tensor* weight_diff,
+      bool add);
+};
+
+}
+
+#endif
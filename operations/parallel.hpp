@@ -0,0 +1,39 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_PARALLEL
+#define PURINE_PARALLEL
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace purine {
+
+/**
+ * f(begin, end) on slices of [0, count), in up to hardware_concurrency
+ * threads of at least grain items each. The calling thread runs the first
+ * slice and returns when all of them are done, so f may keep its buffers
+ * on the stack.
+ */
+template <typename F>
+void parallel_for(int count, int grain, const F& f) {
+  int threads = std::min<int>(std::max(1u, std::thread::hardware_concurrency()),
+      count / std::max(grain, 1));
+  if (threads <= 1) {
+    f(0, count);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int i = 1; i < threads; ++i) {
+    workers.push_back(std::thread([&f, count, threads, i]() {
+            f(count * i / threads, count * (i + 1) / threads);
+          }));
+  }
+  f(0, count / threads);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+}
+
+#endif
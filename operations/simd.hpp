@@ -0,0 +1,139 @@
+// Copyright Lin Min 2015
+#ifndef PURINE_SIMD
+#define PURINE_SIMD
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "common/common.hpp"
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Helpers of the cpu kernels. The vector versions are compiled when the
+ * tree is built for a cpu with AVX2 or AVX-512 (CPU_NATIVE in
+ * CMakeLists.txt), the kernels keep a scalar loop for the tails and for
+ * other cpus.
+ */
+namespace purine {
+namespace simd {
+
+/**
+ * e^x for x <= 0, as 2^k * e^r with |r| <= ln2 / 2 and e^r a degree 6
+ * polynomial (relative error about 1e-7).
+ */
+inline float exp_approx(float x) {
+  x = std::max(x, -87.f);
+  float k = std::floor(x * 1.44269504f + 0.5f);
+  float r = x - k * 0.693145752f - k * 1.42860677e-6f;
+  float p = 1.f + r * (1.f + r * (0.5f + r * (0.166666667f
+          + r * (0.0416666667f + r * (0.00833333333f
+              + r * 0.00138888889f)))));
+  int32_t bits = (static_cast<int32_t>(k) + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+#ifdef __AVX2__
+static_assert(sizeof(DTYPE) == sizeof(float), "the vector kernels are float");
+
+// exp_approx of 8 floats, the same steps as the scalar one
+inline __m256 exp_approx(__m256 x) {
+  x = _mm256_max_ps(x, _mm256_set1_ps(-87.f));
+  __m256 k = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(x,
+          _mm256_set1_ps(1.44269504f)), _mm256_set1_ps(0.5f)));
+  __m256 r = _mm256_sub_ps(_mm256_sub_ps(x, _mm256_mul_ps(k,
+          _mm256_set1_ps(0.693145752f))), _mm256_mul_ps(k,
+          _mm256_set1_ps(1.42860677e-6f)));
+  __m256 p = _mm256_set1_ps(0.00138888889f);
+  for (float c : { 0.00833333333f, 0.0416666667f, 0.166666667f, 0.5f, 1.f,
+          1.f }) {
+    p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(c));
+  }
+  __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(k),
+          _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+
+// sum of the 8 floats
+inline float sum(__m256 x) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(x),
+      _mm256_extractf128_ps(x, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+// max of the 8 floats
+inline float max(__m256 x) {
+  __m128 s = _mm_max_ps(_mm256_castps256_ps128(x),
+      _mm256_extractf128_ps(x, 1));
+  s = _mm_max_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_max_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+#endif
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#define PURINE_VECTOR
+static_assert(sizeof(DTYPE) == sizeof(float), "the vector kernels are float");
+
+// the widest float vector of the cpu, for the kernels that only need
+// arithmetic
+struct floats {
+#ifdef __AVX512F__
+  typedef __m512 type;
+  static const int size = 16;
+#else
+  typedef __m256 type;
+  static const int size = 8;
+#endif
+  type v;
+};
+
+#ifdef __AVX512F__
+inline floats load(const float* p) { return { _mm512_loadu_ps(p) }; }
+inline void store(float* p, floats x) { _mm512_storeu_ps(p, x.v); }
+inline floats set1(float x) { return { _mm512_set1_ps(x) }; }
+inline floats sqrt(floats x) { return { _mm512_sqrt_ps(x.v) }; }
+inline floats operator+(floats a, floats b) {
+  return { _mm512_add_ps(a.v, b.v) };
+}
+inline floats operator-(floats a, floats b) {
+  return { _mm512_sub_ps(a.v, b.v) };
+}
+inline floats operator*(floats a, floats b) {
+  return { _mm512_mul_ps(a.v, b.v) };
+}
+inline floats operator/(floats a, floats b) {
+  return { _mm512_div_ps(a.v, b.v) };
+}
+#else
+inline floats load(const float* p) { return { _mm256_loadu_ps(p) }; }
+inline void store(float* p, floats x) { _mm256_storeu_ps(p, x.v); }
+inline floats set1(float x) { return { _mm256_set1_ps(x) }; }
+inline floats sqrt(floats x) { return { _mm256_sqrt_ps(x.v) }; }
+inline floats operator+(floats a, floats b) {
+  return { _mm256_add_ps(a.v, b.v) };
+}
+inline floats operator-(floats a, floats b) {
+  return { _mm256_sub_ps(a.v, b.v) };
+}
+inline floats operator*(floats a, floats b) {
+  return { _mm256_mul_ps(a.v, b.v) };
+}
+inline floats operator/(floats a, floats b) {
+  return { _mm256_div_ps(a.v, b.v) };
+}
+#endif
+#endif
+
+}
+}
+
+#endif
@@ -107,6 +107,15 @@ inline Size operator + (Size size, const Size& add) {
   return size;
 }
 
+/**
+ * @brief order of the dimensions in the memory of a packed tensor. NHWC
+ *        keeps the channels of a pixel next to each other.
+ */
+enum Layout {
+  NCHW = 0,
+  NHWC = 1
+};
+
 class Stride {
  public:
   explicit Stride() {
@@ -121,6 +130,13 @@ class Stride {
     cstride_ = size.width() * size.height();
     nstride_ = size.width() * size.height() * size.channels();
   }
+  explicit Stride(const Size& size, Layout layout) : Stride(size) {
+    if (layout == NHWC) {
+      cstride_ = 1;
+      wstride_ = size.channels();
+      hstride_ = size.width() * size.channels();
+    }
+  }
   explicit Stride(const int n, const int c, const int h, const int w) {
     nstride_ = n;
     cstride_ = c;
@@ -1,7 +1,4 @@
 // Copyright Lin Min 2015
-#include <algorithm>
-#include <cfloat>
-#include <cmath>
 #include "operations/include/accuracy.hpp"
 
 namespace purine {
@@ -14,6 +11,8 @@ namespace purine {
             CHECK_EQ(inputs_[1]->size(), Size(inputs_[0]->size().num(), 1, 1, 1));
         }
 
+    // the label is in the top n when less than n classes rank before it,
+    // with the order of partial_sort on (score, class) pairs
     void Accuracy::compute_cpu(const vector<bool>& add) {
         DTYPE accuracy = 0;
         const DTYPE* bottom_data = inputs_[0]->cpu_data();
@@ -21,23 +20,18 @@ namespace purine {
         Size size = inputs_[0]->size();
         int num = size.num();
         int dim = size.count() / size.num();
-        vector<DTYPE> maxval(topN + 1);
-        vector<int> max_id(topN + 1);
         for (int i = 0; i < num; ++i) {
-            std::vector<std::pair<DTYPE, int> > bottom_data_vector;
-            for (int j = 0; j < dim; ++j) {
-                bottom_data_vector.push_back(
-                        std::make_pair(bottom_data[i * dim + j], j));
+            const DTYPE* row = bottom_data + i * dim;
+            int label = static_cast<int>(bottom_label[i]);
+            CHECK_GE(label, 0) << "label " << bottom_label[i] << " of " << i;
+            CHECK_LT(label, dim) << "label " << bottom_label[i] << " of " << i;
+            DTYPE score = row[label];
+            int before = 0;
+            for (int j = 0; j < dim && before < topN; ++j) {
+                before += row[j] > score || (row[j] == score && j > label);
             }
-            std::partial_sort(
-                    bottom_data_vector.begin(), bottom_data_vector.begin() + topN,
-                    bottom_data_vector.end(), std::greater<std::pair<DTYPE, int> >());
-            // check if true label is in top k predictions
-            for (int k = 0; k < topN; k++) {
-                if (bottom_data_vector[k].second == static_cast<int>(bottom_label[i])) {
-                    ++accuracy;
-                    break;
-                }
+            if (before < topN) {
+                ++accuracy;
             }
         }
         outputs_[0]->mutable_cpu_data()[0] = accuracy / num;
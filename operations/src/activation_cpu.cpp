@@ -0,0 +1,100 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <cmath>
+
+#include "operations/include/activation.hpp"
+
+namespace purine {
+
+    enum ActivationFn { RELU, LRELU, SIGMOID, TANH };
+
+    static ActivationFn mode_of(const string& mode) {
+        return mode == "relu" ? RELU : mode == "lrelu" ? LRELU
+            : mode == "sigmoid" ? SIGMOID : TANH;
+    }
+
+    /**
+     * f(offsets) for every element, offsets[i] of the element in tensors[i].
+     * Tensors of the same packed layout (NCHW or NHWC) are a flat loop.
+     */
+    template <typename F>
+    static void elementwise(const vector<Tensor*>& tensors, const F& f) {
+        int offsets[4];
+        int count = tensors.size();
+        CHECK_LE(count, 4);
+        bool flat = true;
+        for (Tensor* t : tensors) {
+            flat &= t->is_contiguous() && t->stride() == tensors[0]->stride();
+        }
+        Size s = tensors[0]->size();
+        if (flat) {
+            for (int i = 0; i < s.count(); ++i) {
+                std::fill(offsets, offsets + count, i);
+                f(offsets);
+            }
+            return;
+        }
+        for (int n = 0; n < s.num(); ++n) {
+            for (int c = 0; c < s.channels(); ++c) {
+                for (int h = 0; h < s.height(); ++h) {
+                    for (int w = 0; w < s.width(); ++w) {
+                        for (int i = 0; i < count; ++i) {
+                            Stride st = tensors[i]->stride();
+                            offsets[i] = n * st.nstride() + c * st.cstride()
+                                + h * st.hstride() + w * st.wstride();
+                        }
+                        f(offsets);
+                    }
+                }
+            }
+        }
+    }
+
+    void Activation::compute_cpu(const vector<bool>& add) {
+        const DTYPE* bottom = inputs_[0]->cpu_data();
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* top = outputs_[0]->mutable_cpu_data();
+        bool accumulate = add[0];
+        ActivationFn mode = mode_of(mode_);
+        elementwise({ inputs_[0], outputs_[0] }, [&](const int* off) {
+                DTYPE x = bottom[off[0]];
+                DTYPE y;
+                if (mode == RELU) {
+                    y = x > 0 ? x : 0;
+                } else if (mode == LRELU) {
+                    y = x > 0 ? x : x * DTYPE(0.01);
+                } else if (mode == SIGMOID) {
+                    y = 1. / (1. + std::exp(-x));
+                } else {
+                    y = std::tanh(x);
+                }
+                top[off[1]] = (accumulate ? top[off[1]] : 0) + y;
+                });
+    }
+
+    void ActivationDown::compute_cpu(const vector<bool>& add) {
+        const DTYPE* top_diff = inputs_[0]->cpu_data();
+        const DTYPE* top = inputs_[1]->cpu_data();
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* bottom_diff = outputs_[0]->mutable_cpu_data();
+        bool accumulate = add[0];
+        ActivationFn mode = mode_of(mode_);
+        elementwise({ inputs_[0], inputs_[1], outputs_[0] },
+                [&](const int* off) {
+                DTYPE y = top[off[1]];
+                DTYPE grad;
+                if (mode == RELU) {
+                    grad = y > 0 ? 1 : 0;
+                } else if (mode == LRELU) {
+                    grad = y > 0 ? 1 : DTYPE(0.01);
+                } else if (mode == SIGMOID) {
+                    grad = y * (1 - y);
+                } else {
+                    grad = 1 - y * y;
+                }
+                DTYPE& dx = bottom_diff[off[2]];
+                dx = (accumulate ? dx : 0) + top_diff[off[0]] * grad;
+                });
+    }
+
+}
@@ -23,7 +23,23 @@ namespace purine {
     }
 
     void Bias::compute_cpu(const vector<bool>& add) {
-
+        Size s = outputs_[0]->size();
+        Stride st = outputs_[0]->stride();
+        const DTYPE* bias = inputs_[0]->cpu_data();
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* top = outputs_[0]->mutable_cpu_data();
+        for (int n = 0; n < s.num(); ++n) {
+            for (int c = 0; c < s.channels(); ++c) {
+                for (int h = 0; h < s.height(); ++h) {
+                    DTYPE* row = top + n * st.nstride() + c * st.cstride()
+                        + h * st.hstride();
+                    for (int w = 0; w < s.width(); ++w) {
+                        row[w * st.wstride()] = (add[0] ? row[w * st.wstride()]
+                                : 0) + bias[c];
+                    }
+                }
+            }
+        }
     }
 
     void Bias::compute_gpu(const vector<bool>& add) {
@@ -57,7 +73,26 @@ namespace purine {
     }
 
     void BiasDown::compute_cpu(const vector<bool>& add) {
-
+        Size s = inputs_[0]->size();
+        Stride st = inputs_[0]->stride();
+        const DTYPE* top_diff = inputs_[0]->cpu_data();
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* bias_diff = outputs_[0]->mutable_cpu_data();
+        int cstride = outputs_[0]->stride().cstride();
+        for (int c = 0; c < s.channels(); ++c) {
+            DTYPE sum = 0;
+            for (int n = 0; n < s.num(); ++n) {
+                for (int h = 0; h < s.height(); ++h) {
+                    const DTYPE* row = top_diff + n * st.nstride()
+                        + c * st.cstride() + h * st.hstride();
+                    for (int w = 0; w < s.width(); ++w) {
+                        sum += row[w * st.wstride()];
+                    }
+                }
+            }
+            DTYPE& b = bias_diff[c * cstride];
+            b = (add[0] ? b : 0) + sum;
+        }
     }
 
     void BiasDown::compute_gpu(const vector<bool>& add) {
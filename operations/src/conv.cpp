@@ -3,12 +3,24 @@
 
 namespace purine {
 
+    // the images (but not the batch) of the tensor are not sliced
+    static bool packed(Tensor* tensor) {
+        Size s = tensor->size();
+        Stride st = tensor->stride();
+        return st.wstride() == 1 && st.hstride() == s.width()
+            && st.cstride() == s.height() * s.width();
+    }
+
+    static bool nhwc(Tensor* tensor) {
+        return tensor->is_contiguous() && tensor->layout() == NHWC;
+    }
+
     // Update cudnn R2
     Conv::Conv(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
             const param_tuple& args) : Operation(inputs, outputs) {
         std::tie(pad_h, pad_w, stride_h, stride_w) = args;
         CHECK_EQ(inputs_.size(), 2);
-        CHECK_EQ(outputs_.size(), 1);
+        CHECK(outputs_.size() == 1 || outputs_.size() == 2);
         Size bottom_size = inputs_[0]->size();
         Stride bottom_stride = inputs_[0]->stride();
         Size top_size = outputs_[0]->size();
@@ -22,6 +34,17 @@ namespace purine {
                 / stride_h + 1, top_size.height());
         CHECK_EQ((bottom_size.width() + 2 * pad_w - kernel_size.width())
                 / stride_w + 1, top_size.width());
+        if (inputs_[0]->device() < 0) {
+            cpu_.reset(new ConvCpu(ConvCpu::FORWARD, bottom_size, top_size,
+                        kernel_size, pad_h, pad_w, stride_h, stride_w,
+                        packed(inputs_[0]) && packed(outputs_[0]),
+                        nhwc(inputs_[0]) && nhwc(outputs_[0])));
+            if (outputs_.size() == 2) {
+                cpu_->set_columns(outputs_[1]);
+            }
+            return;
+        }
+        CHECK_EQ(outputs_.size(), 1) << "the columns are kept on the cpu only";
         cudnn::createTensor4dDesc<DTYPE>(&bottom_desc_, bottom_size, bottom_stride);
         cudnn::createTensor4dDesc<DTYPE>(&top_desc_, top_size, top_stride);
         cudnn::createFilterDesc<DTYPE>(&filter_desc_, kernel_size);
@@ -36,12 +59,20 @@ namespace purine {
     }
 
     Conv::~Conv() {
+        if (conv_desc_ == NULL) {
+            return;
+        }
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(bottom_desc_));
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(top_desc_));
         CUDNN_CHECK(cudnnDestroyFilterDescriptor(filter_desc_));
         CUDNN_CHECK(cudnnDestroyConvolutionDescriptor(conv_desc_));
     }
 
+    void Conv::compute_cpu(const vector<bool>& add) {
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        cpu_->compute(inputs_, outputs_[0], add[0]);
+    }
+
     void Conv::compute_gpu(const vector<bool>& add) {
         if (!workspace_ && workspace_size_ != 0) {
             int device;
@@ -74,6 +105,13 @@ namespace purine {
                 / stride_h + 1, top_size.height());
         CHECK_EQ((bottom_size.width() + 2 * pad_w - kernel_size.width())
                 / stride_w + 1, top_size.width());
+        if (inputs_[0]->device() < 0) {
+            cpu_.reset(new ConvCpu(ConvCpu::BACKWARD_DATA, bottom_size, top_size,
+                        kernel_size, pad_h, pad_w, stride_h, stride_w,
+                        packed(outputs_[0]) && packed(inputs_[0]),
+                        nhwc(outputs_[0]) && nhwc(inputs_[0])));
+            return;
+        }
         cudnn::createTensor4dDesc<DTYPE>(&bottom_desc_, bottom_size, bottom_stride);
         cudnn::createTensor4dDesc<DTYPE>(&top_desc_, top_size, top_stride);
         cudnn::createFilterDesc<DTYPE>(&filter_desc_, kernel_size);
@@ -82,12 +120,20 @@ namespace purine {
     }
 
     ConvDown::~ConvDown() {
+        if (conv_desc_ == NULL) {
+            return;
+        }
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(bottom_desc_));
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(top_desc_));
         CUDNN_CHECK(cudnnDestroyFilterDescriptor(filter_desc_));
         CUDNN_CHECK(cudnnDestroyConvolutionDescriptor(conv_desc_));
     }
 
+    void ConvDown::compute_cpu(const vector<bool>& add) {
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        cpu_->compute(inputs_, outputs_[0], add[0]);
+    }
+
     void ConvDown::compute_gpu(const vector<bool>& add) {
         const DTYPE* weight_data = inputs_[1]->gpu_data();
         const DTYPE* top_diff = inputs_[0]->gpu_data();
@@ -104,6 +150,7 @@ namespace purine {
             const vector<Tensor*>& outputs,
             const param_tuple& args) : Operation(inputs, outputs) {
         std::tie(pad_h, pad_w, stride_h, stride_w) = args;
+        CHECK(inputs_.size() == 2 || inputs_.size() == 3);
         Size bottom_size = inputs_[1]->size();
         Size top_size = inputs_[0]->size();
         Size kernel_size = outputs_[0]->size();
@@ -116,6 +163,17 @@ namespace purine {
                 / stride_h + 1, top_size.height());
         CHECK_EQ((bottom_size.width() + 2 * pad_w - kernel_size.width())
                 / stride_w + 1, top_size.width());
+        if (inputs_[0]->device() < 0) {
+            cpu_.reset(new ConvCpu(ConvCpu::BACKWARD_FILTER, bottom_size, top_size,
+                        kernel_size, pad_h, pad_w, stride_h, stride_w,
+                        packed(inputs_[1]) && packed(inputs_[0]),
+                        nhwc(inputs_[1]) && nhwc(inputs_[0])));
+            if (inputs_.size() == 3) {
+                cpu_->set_columns(inputs_[2]);
+            }
+            return;
+        }
+        CHECK_EQ(inputs_.size(), 2) << "the columns are kept on the cpu only";
         cudnn::createTensor4dDesc<DTYPE>(&bottom_desc_, bottom_size, bottom_stride);
         cudnn::createTensor4dDesc<DTYPE>(&top_desc_, top_size, top_stride);
         cudnn::createFilterDesc<DTYPE>(&filter_desc_, kernel_size);
@@ -124,12 +182,20 @@ namespace purine {
     }
 
     ConvWeight::~ConvWeight() {
+        if (conv_desc_ == NULL) {
+            return;
+        }
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(bottom_desc_));
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(top_desc_));
         CUDNN_CHECK(cudnnDestroyFilterDescriptor(filter_desc_));
         CUDNN_CHECK(cudnnDestroyConvolutionDescriptor(conv_desc_));
     }
 
+    void ConvWeight::compute_cpu(const vector<bool>& add) {
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        cpu_->compute(inputs_, outputs_[0], add[0]);
+    }
+
     void ConvWeight::compute_gpu(const vector<bool>& add) {
         const DTYPE* top_diff = inputs_[0]->gpu_data();
         const DTYPE* bottom_data = inputs_[1]->gpu_data();
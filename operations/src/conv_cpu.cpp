@@ -0,0 +1,476 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "caffeine/im2col.hpp"
+#include "caffeine/math_functions.hpp"
+#include "operations/include/conv_cpu.hpp"
+
+namespace purine {
+
+    ConvCpu::Algo ConvCpu::default_algo_ = ConvCpu::AUTO;
+    size_t ConvCpu::workspace_limit_ = size_t(256) << 20;
+    string ConvCpu::cache_file_;
+    map<string, ConvCpu::Algo> ConvCpu::decisions_;
+    std::mutex ConvCpu::mutex_;
+
+    static const char* ALGO_NAMES[] = { "auto", "im2col", "winograd2x2",
+        "winograd4x4", "direct" };
+    // timed runs of each candidate after the warm-up, the best one counts
+    static const int TUNE_RUNS = 3;
+
+    ConvCpu::ConvCpu(Pass pass, const Size& bottom, const Size& top,
+            const Size& kernel, int pad_h, int pad_w, int stride_h, int stride_w,
+            bool packed, bool nhwc) : pass_(pass), bottom_size_(bottom),
+        top_size_(top), kernel_size_(kernel), pad_h_(pad_h), pad_w_(pad_w),
+        stride_h_(stride_h), stride_w_(stride_w), packed_(packed), nhwc_(nhwc),
+        algo_(default_algo_) {
+        if (algo_ != AUTO) {
+            vector<Algo> candidates = algos();
+            if (std::find(candidates.begin(), candidates.end(), algo_)
+                    == candidates.end()) {
+                // e.g. winograd for a 5x5 kernel
+                algo_ = packed_ || (nhwc_ && pointwise()) ? IM2COL : DIRECT;
+            }
+        }
+    }
+
+    vector<ConvCpu::Algo> ConvCpu::algos() const {
+        vector<Algo> ret;
+        if (packed_ || (nhwc_ && pointwise())) {
+            ret.push_back(IM2COL);
+        }
+        if (Winograd::supported(kernel_size_, stride_h_, stride_w_)
+                && pad_h_ <= 2 && pad_w_ <= 2) {
+            ret.push_back(WINOGRAD_2X2);
+            ret.push_back(WINOGRAD_4X4);
+        }
+        ret.push_back(DIRECT);
+        return ret;
+    }
+
+    bool ConvCpu::pointwise() const {
+        return kernel_size_.height() == 1 && kernel_size_.width() == 1
+            && pad_h_ == 0 && pad_w_ == 0 && stride_h_ == 1 && stride_w_ == 1;
+    }
+
+    size_t ConvCpu::workspace(Algo algo) const {
+        size_t K = top_size_.channels();
+        size_t C = bottom_size_.channels();
+        size_t spatial = top_size_.height() * top_size_.width();
+        switch (algo) {
+            case IM2COL:
+                if (pointwise()) {
+                    return 0;
+                }
+                return C * kernel_size_.height() * kernel_size_.width() * spatial
+                    * sizeof(DTYPE);
+            case WINOGRAD_2X2:
+            case WINOGRAD_4X4: {
+                size_t m = algo == WINOGRAD_2X2 ? 2 : 4;
+                size_t points = (m + 2) * (m + 2);
+                size_t tiles = ((top_size_.height() + m - 1) / m)
+                    * ((top_size_.width() + m - 1) / m);
+                size_t count = points * (K * C + C * tiles + K * tiles);
+                if (pass_ == BACKWARD_FILTER) {
+                    count += points * K * C;
+                }
+                return count * sizeof(DTYPE);
+            }
+            default:
+                return 0;
+        }
+    }
+
+    void ConvCpu::set_columns(Tensor* columns) {
+        CHECK(pass_ == FORWARD || pass_ == BACKWARD_FILTER);
+        CHECK(packed_) << "im2col needs packed images";
+        CHECK(columns->is_contiguous());
+        CHECK_EQ(columns->size(), Size(bottom_size_.num(),
+                    kernel_size_.count() / kernel_size_.num(),
+                    top_size_.height(), top_size_.width()));
+        columns_ = columns;
+        algo_ = IM2COL;
+    }
+
+    string ConvCpu::key() const {
+        static const char* PASS_NAMES[] = { "Conv", "ConvDown", "ConvWeight" };
+        std::ostringstream os;
+        os << PASS_NAMES[pass_] << " " << bottom_size_ << " " << kernel_size_
+            << " pad " << pad_h_ << " " << pad_w_ << " stride " << stride_h_
+            << " " << stride_w_ << (packed_ ? "" : nhwc_ ? " nhwc" : " strided");
+        return os.str();
+    }
+
+    string ConvCpu::name(Algo algo) {
+        return ALGO_NAMES[algo];
+    }
+
+    ConvCpu::Algo ConvCpu::algo(const string& name) {
+        for (int i = 0; i <= DIRECT; ++i) {
+            if (name == ALGO_NAMES[i]) {
+                return Algo(i);
+            }
+        }
+        LOG(FATAL) << "unknown conv algorithm " << name;
+        return AUTO;
+    }
+
+    void ConvCpu::set_cache(const string& filename) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_file_ = filename;
+        std::ifstream in(filename);
+        string name;
+        string key;
+        while (in >> name && std::getline(in, key)) {
+            decisions_[key.substr(1)] = algo(name);
+        }
+    }
+
+    void ConvCpu::compute(const vector<Tensor*>& inputs, Tensor* output,
+            bool add) {
+        if (algo_ == AUTO) {
+            algo_ = tune(inputs, output);
+            // the buffers of the algorithms which lost
+            if (algo_ != WINOGRAD_2X2 && algo_ != WINOGRAD_4X4) {
+                winograd_.reset();
+            }
+            if (algo_ != IM2COL) {
+                vector<DTYPE>().swap(col_);
+            }
+        }
+        run(algo_, inputs, output, add);
+    }
+
+    ConvCpu::Algo ConvCpu::tune(const vector<Tensor*>& inputs, Tensor* output) {
+        string key = this->key();
+        vector<Algo> candidates = algos();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = decisions_.find(key);
+            if (it != decisions_.end() && std::find(candidates.begin(),
+                        candidates.end(), it->second) != candidates.end()) {
+                return it->second;
+            }
+        }
+        // a warm-up run, then the best of a few, the filter transform of
+        // winograd included as the weights change every iteration in
+        // training: the tuning runs do not write the weights, so its cached
+        // transform is dropped before each of them
+        shared_ptr<Tensor> scratch(new Tensor(output->rank(), -1,
+                    output->size()));
+        Algo best = DIRECT;
+        double best_us = std::numeric_limits<double>::max();
+        std::ostringstream timings;
+        for (Algo algo : candidates) {
+            if (workspace(algo) > workspace_limit_) {
+                continue;
+            }
+            run(algo, inputs, scratch.get(), false);
+            double us = std::numeric_limits<double>::max();
+            for (int i = 0; i < TUNE_RUNS; ++i) {
+                if (winograd_) {
+                    winograd_->invalidate_filter();
+                }
+                auto start = std::chrono::steady_clock::now();
+                run(algo, inputs, scratch.get(), false);
+                us = std::min(us, std::chrono::duration<double, std::micro>(
+                            std::chrono::steady_clock::now() - start).count());
+            }
+            timings << " " << name(algo) << " " << us << " us";
+            if (us < best_us) {
+                best = algo;
+                best_us = us;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        decisions_[key] = best;
+        LOG(INFO) << key << ": " << name(best) << " (" << timings.str() << " )";
+        if (cache_file_ != "" && current_rank() == 0) {
+            std::ofstream out(cache_file_);
+            for (const auto& kv : decisions_) {
+                out << name(kv.second) << " " << kv.first << "\n";
+            }
+        }
+        return best;
+    }
+
+    void ConvCpu::run(Algo algo, const vector<Tensor*>& inputs, Tensor* output,
+            bool add) {
+        switch (algo) {
+            case IM2COL:
+                if (packed_) {
+                    im2col(inputs, output, add);
+                } else {
+                    pointwise_nhwc(inputs, output, add);
+                }
+                break;
+            case WINOGRAD_2X2:
+            case WINOGRAD_4X4: {
+                int m = algo == WINOGRAD_2X2 ? 2 : 4;
+                if (!winograd_ || winograd_->m() != m) {
+                    winograd_.reset(new Winograd(m, bottom_size_, top_size_,
+                                pad_h_, pad_w_));
+                }
+                if (pass_ == FORWARD) {
+                    winograd_->forward(inputs[0], inputs[1], output, add);
+                } else if (pass_ == BACKWARD_DATA) {
+                    winograd_->backward_data(inputs[0], inputs[1], output, add);
+                } else {
+                    winograd_->backward_filter(inputs[0], inputs[1], output, add);
+                }
+                break;
+            }
+            case DIRECT:
+                direct(inputs, output, add);
+                break;
+            default:
+                LOG(FATAL) << "no conv algorithm chosen";
+        }
+    }
+
+    void ConvCpu::im2col(const vector<Tensor*>& inputs, Tensor* output,
+            bool add) {
+        // the column buffer of a 1x1 kernel with stride 1 and no pad is the
+        // image itself, the gemm reads the tensor directly
+        bool pointwise = this->pointwise();
+        int K = kernel_size_.num();
+        int patch = kernel_size_.count() / K;
+        int spatial = top_size_.height() * top_size_.width();
+        if (!pointwise && columns_ == NULL) {
+            col_.resize(patch * spatial);
+        }
+        auto to_col = [&](const DTYPE* image, int n)->const DTYPE* {
+            if (pointwise) {
+                return image;
+            }
+            if (columns_ != NULL && pass_ == BACKWARD_FILTER) {
+                // written by the forward of the same bottom
+                return columns_->cpu_data() + n * patch * spatial;
+            }
+            DTYPE* col = columns_ != NULL
+                ? columns_->mutable_cpu_data() + n * patch * spatial : &col_[0];
+            caffe::im2col_cpu(image, bottom_size_.channels(),
+                    bottom_size_.height(), bottom_size_.width(),
+                    kernel_size_.height(), kernel_size_.width(), pad_h_, pad_w_,
+                    stride_h_, stride_w_, col);
+            return col;
+        };
+        if (pass_ == FORWARD) {
+            const DTYPE* bottom = inputs[0]->cpu_data();
+            const DTYPE* weight = inputs[1]->cpu_data();
+            DTYPE* top = output->mutable_cpu_data();
+            for (int n = 0; n < bottom_size_.num(); ++n) {
+                caffe::caffe_cpu_gemm<DTYPE>(CblasNoTrans, CblasNoTrans, K,
+                        spatial, patch, (DTYPE)1., weight,
+                        to_col(bottom + n * inputs[0]->stride().nstride(), n),
+                        (DTYPE)(add ? 1. : 0.),
+                        top + n * output->stride().nstride());
+            }
+        } else if (pass_ == BACKWARD_DATA) {
+            const DTYPE* top_diff = inputs[0]->cpu_data();
+            const DTYPE* weight = inputs[1]->cpu_data();
+            DTYPE* bottom_diff = output->mutable_cpu_data();
+            for (int n = 0; n < bottom_size_.num(); ++n) {
+                DTYPE* image = bottom_diff + n * output->stride().nstride();
+                caffe::caffe_cpu_gemm<DTYPE>(CblasTrans, CblasNoTrans, patch,
+                        spatial, K, (DTYPE)1., weight,
+                        top_diff + n * inputs[0]->stride().nstride(),
+                        (DTYPE)(pointwise && add ? 1. : 0.),
+                        pointwise ? image : &col_[0]);
+                if (!pointwise) {
+                    caffe::col2im_cpu(&col_[0], bottom_size_.channels(),
+                            bottom_size_.height(), bottom_size_.width(),
+                            kernel_size_.height(), kernel_size_.width(), pad_h_,
+                            pad_w_, stride_h_, stride_w_, image, add);
+                }
+            }
+        } else {
+            const DTYPE* top_diff = inputs[0]->cpu_data();
+            const DTYPE* bottom = inputs[1]->cpu_data();
+            DTYPE* weight_diff = output->mutable_cpu_data();
+            for (int n = 0; n < bottom_size_.num(); ++n) {
+                caffe::caffe_cpu_gemm<DTYPE>(CblasNoTrans, CblasTrans, K, patch,
+                        spatial, (DTYPE)1.,
+                        top_diff + n * inputs[0]->stride().nstride(),
+                        to_col(bottom + n * inputs[1]->stride().nstride(), n),
+                        (DTYPE)(add || n > 0 ? 1. : 0.), weight_diff);
+            }
+        }
+    }
+
+    void ConvCpu::pointwise_nhwc(const vector<Tensor*>& inputs,
+            Tensor* output, bool add) {
+        // the batch is a [pixels, channels] matrix, weight is [K, C]
+        int pixels = bottom_size_.num() * bottom_size_.height()
+            * bottom_size_.width();
+        int K = top_size_.channels();
+        int C = bottom_size_.channels();
+        DTYPE beta = add ? 1. : 0.;
+        if (pass_ == FORWARD) {
+            caffe::caffe_cpu_gemm<DTYPE>(CblasNoTrans, CblasTrans, pixels, K, C,
+                    (DTYPE)1., inputs[0]->cpu_data(), inputs[1]->cpu_data(), beta,
+                    output->mutable_cpu_data());
+        } else if (pass_ == BACKWARD_DATA) {
+            caffe::caffe_cpu_gemm<DTYPE>(CblasNoTrans, CblasNoTrans, pixels, C,
+                    K, (DTYPE)1., inputs[0]->cpu_data(), inputs[1]->cpu_data(),
+                    beta, output->mutable_cpu_data());
+        } else {
+            caffe::caffe_cpu_gemm<DTYPE>(CblasTrans, CblasNoTrans, K, C, pixels,
+                    (DTYPE)1., inputs[0]->cpu_data(), inputs[1]->cpu_data(), beta,
+                    output->mutable_cpu_data());
+        }
+    }
+
+    void ConvCpu::direct(const vector<Tensor*>& inputs, Tensor* output,
+            bool add) {
+        Tensor* bottom = pass_ == FORWARD ? inputs[0]
+            : (pass_ == BACKWARD_DATA ? output : inputs[1]);
+        Tensor* top = pass_ == FORWARD ? output : inputs[0];
+        Tensor* weight = pass_ == BACKWARD_FILTER ? output : inputs[1];
+        Stride bs = bottom->stride();
+        Stride ts = top->stride();
+        Stride ws = weight->stride();
+        int step = stride_w_ * bs.wstride();
+        int H = bottom_size_.height();
+        int W = bottom_size_.width();
+        int top_h = top_size_.height();
+        int top_w = top_size_.width();
+        // the columns x of the top row reading a pixel of the bottom row
+        // through tap j
+        auto columns = [&](int j, int* begin, int* end) {
+            int lo = pad_w_ - j;
+            int hi = W - 1 + pad_w_ - j;
+            *begin = lo <= 0 ? 0 : (lo + stride_w_ - 1) / stride_w_;
+            *end = hi < 0 ? 0 : std::min(top_w, hi / stride_w_ + 1);
+        };
+        auto clear = [&](DTYPE* data, int h, int w, const Stride& s) {
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    data[y * s.hstride() + x * s.wstride()] = 0;
+                }
+            }
+        };
+        int N = bottom_size_.num();
+        int C = bottom_size_.channels();
+        int K = top_size_.channels();
+        if (pass_ == BACKWARD_FILTER) {
+            const DTYPE* top_data = top->cpu_data();
+            const DTYPE* bottom_data = bottom->cpu_data();
+            DTYPE* weight_data = weight->mutable_cpu_data();
+            for (int k = 0; k < K; ++k) {
+                for (int c = 0; c < C; ++c) {
+                    for (int i = 0; i < kernel_size_.height(); ++i) {
+                        for (int j = 0; j < kernel_size_.width(); ++j) {
+                            int begin, end;
+                            columns(j, &begin, &end);
+                            int offset = (j - pad_w_) * bs.wstride();
+                            DTYPE sum = 0;
+                            for (int n = 0; n < N; ++n) {
+                                for (int y = 0; y < top_h; ++y) {
+                                    int iy = y * stride_h_ - pad_h_ + i;
+                                    if (iy < 0 || iy >= H) {
+                                        continue;
+                                    }
+                                    const DTYPE* t = top_data + n * ts.nstride()
+                                        + k * ts.cstride() + y * ts.hstride();
+                                    const DTYPE* b = bottom_data + n * bs.nstride()
+                                        + c * bs.cstride() + iy * bs.hstride();
+                                    for (int x = begin; x < end; ++x) {
+                                        sum += t[x * ts.wstride()]
+                                            * b[x * step + offset];
+                                    }
+                                }
+                            }
+                            DTYPE& w = weight_data[k * ws.nstride()
+                                + c * ws.cstride() + i * ws.hstride()
+                                + j * ws.wstride()];
+                            w = (add ? w : 0) + sum;
+                        }
+                    }
+                }
+            }
+            return;
+        }
+        const DTYPE* weight_data = weight->cpu_data();
+        if (pass_ == FORWARD) {
+            const DTYPE* bottom_data = bottom->cpu_data();
+            DTYPE* top_data = top->mutable_cpu_data();
+            for (int n = 0; n < N; ++n) {
+                for (int k = 0; k < K; ++k) {
+                    DTYPE* plane = top_data + n * ts.nstride() + k * ts.cstride();
+                    if (!add) {
+                        clear(plane, top_h, top_w, ts);
+                    }
+                    for (int c = 0; c < C; ++c) {
+                        const DTYPE* image = bottom_data + n * bs.nstride()
+                            + c * bs.cstride();
+                        for (int i = 0; i < kernel_size_.height(); ++i) {
+                            for (int j = 0; j < kernel_size_.width(); ++j) {
+                                DTYPE w = weight_data[k * ws.nstride()
+                                    + c * ws.cstride() + i * ws.hstride()
+                                    + j * ws.wstride()];
+                                int begin, end;
+                                columns(j, &begin, &end);
+                                int offset = (j - pad_w_) * bs.wstride();
+                                for (int y = 0; y < top_h; ++y) {
+                                    int iy = y * stride_h_ - pad_h_ + i;
+                                    if (iy < 0 || iy >= H) {
+                                        continue;
+                                    }
+                                    DTYPE* t = plane + y * ts.hstride();
+                                    const DTYPE* b = image + iy * bs.hstride();
+                                    for (int x = begin; x < end; ++x) {
+                                        t[x * ts.wstride()]
+                                            += w * b[x * step + offset];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        } else {
+            const DTYPE* top_data = top->cpu_data();
+            DTYPE* bottom_data = bottom->mutable_cpu_data();
+            for (int n = 0; n < N; ++n) {
+                for (int c = 0; c < C; ++c) {
+                    DTYPE* image = bottom_data + n * bs.nstride() + c * bs.cstride();
+                    if (!add) {
+                        clear(image, H, W, bs);
+                    }
+                    for (int k = 0; k < K; ++k) {
+                        const DTYPE* plane = top_data + n * ts.nstride()
+                            + k * ts.cstride();
+                        for (int i = 0; i < kernel_size_.height(); ++i) {
+                            for (int j = 0; j < kernel_size_.width(); ++j) {
+                                DTYPE w = weight_data[k * ws.nstride()
+                                    + c * ws.cstride() + i * ws.hstride()
+                                    + j * ws.wstride()];
+                                int begin, end;
+                                columns(j, &begin, &end);
+                                int offset = (j - pad_w_) * bs.wstride();
+                                for (int y = 0; y < top_h; ++y) {
+                                    int iy = y * stride_h_ - pad_h_ + i;
+                                    if (iy < 0 || iy >= H) {
+                                        continue;
+                                    }
+                                    const DTYPE* t = plane + y * ts.hstride();
+                                    DTYPE* b = image + iy * bs.hstride();
+                                    for (int x = begin; x < end; ++x) {
+                                        b[x * step + offset]
+                                            += w * t[x * ts.wstride()];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,269 @@
+// Copyright Lin Min 2015
+#include <fcntl.h>
+#include <signal.h>
+#include <lmdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include "caffeine/io.hpp"
+#include "caffeine/proto/caffe.pb.h"
+#include "operations/include/dataset_cache.hpp"
+#include "common/common.hpp"
+using caffe::Datum;
+
+namespace purine {
+
+    std::mutex DatasetCache::registry_mutex_;
+    map<string, weak_ptr<DatasetCache> > DatasetCache::registry_;
+
+    shared_ptr<DatasetCache> DatasetCache::get(const string& source,
+            bool color, Mode mode) {
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        string key = source + (color ? ":color" : ":gray")
+            + (mode == SHARED ? ":shared" : ":memory");
+        shared_ptr<DatasetCache> cache = registry_[key].lock();
+        if (!cache) {
+            cache.reset(new DatasetCache(source, color, mode));
+            registry_[key] = cache;
+        }
+        return cache;
+    }
+
+    DatasetCache::Mode DatasetCache::mode(const char* name) {
+        string mode = name == NULL ? "none" : name;
+        if (mode == "none" || mode == "") {
+            return NONE;
+        } else if (mode == "memory") {
+            return MEMORY;
+        } else if (mode == "shared") {
+            return SHARED;
+        }
+        LOG(FATAL) << "unknown dataset cache mode " << mode;
+        return NONE;
+    }
+
+    int& DatasetCache::timeout_seconds() {
+        static int timeout = 600;
+        return timeout;
+    }
+
+    DatasetCache::DatasetCache(const string& source, bool color, Mode mode)
+        : source_(source), color_(color), mode_(mode) {
+            CHECK_NE(mode_, NONE);
+            if (mode_ == MEMORY) {
+                load(&local_records_, &local_arena_);
+                count_ = local_records_.size();
+                records_ = local_records_.data();
+                arena_ = local_arena_.data();
+            } else {
+                attach_shared();
+            }
+            LOG(INFO) << "Cached " << count_ << " records of " << source_;
+        }
+
+    void DatasetCache::load(vector<Record>* records, vector<uint8_t>* arena) {
+        MDB_env* mdb_env;
+        MDB_dbi mdb_dbi;
+        MDB_txn* mdb_txn;
+        MDB_cursor* mdb_cursor;
+        MDB_val mdb_key, mdb_value;
+        MDB_stat mdb_stat;
+        CHECK_EQ(mdb_env_create(&mdb_env), MDB_SUCCESS)
+            << "mdb_env_create failed";
+        CHECK_EQ(mdb_env_set_mapsize(mdb_env, 1099511627776), MDB_SUCCESS);
+        CHECK_EQ(mdb_env_open(mdb_env, source_.c_str(), MDB_RDONLY|MDB_NOTLS,
+                    0664), MDB_SUCCESS) << "mdb_env_open failed";
+        CHECK_EQ(mdb_env_stat(mdb_env, &mdb_stat), MDB_SUCCESS);
+        CHECK_EQ(mdb_txn_begin(mdb_env, NULL, MDB_RDONLY, &mdb_txn),
+                MDB_SUCCESS) << "mdb_txn_begin failed";
+        CHECK_EQ(mdb_open(mdb_txn, NULL, 0, &mdb_dbi), MDB_SUCCESS)
+            << "mdb_open failed";
+        CHECK_EQ(mdb_cursor_open(mdb_txn, mdb_dbi, &mdb_cursor), MDB_SUCCESS)
+            << "mdb_cursor_open failed";
+
+        records->clear();
+        records->reserve(mdb_stat.ms_entries);
+        arena->clear();
+        Datum datum;
+        cv::Mat decode_buf;
+        int rc = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_value, MDB_FIRST);
+        while (rc == MDB_SUCCESS) {
+            datum.ParseFromArray(mdb_value.mv_data, mdb_value.mv_size);
+            CHECK(caffe::DecodeDatumInPlace(&datum, color_, &decode_buf));
+            Record record;
+            record.offset = arena->size();
+            record.channels = datum.channels();
+            record.height = datum.height();
+            record.width = datum.width();
+            record.label = datum.label();
+            const string& data = datum.data();
+            arena->insert(arena->end(), data.begin(), data.end());
+            records->push_back(record);
+            rc = mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_value, MDB_NEXT);
+        }
+        CHECK_EQ(rc, MDB_NOTFOUND) << "mdb_cursor_get failed";
+        mdb_cursor_close(mdb_cursor);
+        mdb_close(mdb_env, mdb_dbi);
+        mdb_txn_abort(mdb_txn);
+        mdb_env_close(mdb_env);
+    }
+
+    void DatasetCache::attach_shared() {
+        std::ostringstream name;
+        name << "/purine_" << std::hash<string>()(source_)
+             << (color_ ? "_c" : "_g");
+        shm_name_ = name.str();
+        // the data file of the lmdb, or the source itself
+        struct stat source_stat;
+        if (stat((source_ + "/data.mdb").c_str(), &source_stat) != 0) {
+            CHECK_EQ(stat(source_.c_str(), &source_stat), 0)
+                << "can not stat " << source_;
+        }
+        source_size_ = source_stat.st_size;
+        source_mtime_ = source_stat.st_mtime;
+        for (int attempt = 0; ; ++attempt) {
+            int fd = shm_open(shm_name_.c_str(), O_CREAT | O_EXCL | O_RDWR,
+                    0600);
+            if (fd >= 0) {
+                create_shared(fd);
+                break;
+            }
+            CHECK_EQ(errno, EEXIST) << "shm_open " << shm_name_ << " failed";
+            fd = shm_open(shm_name_.c_str(), O_RDONLY, 0600);
+            if (fd < 0) {
+                // unlinked meanwhile
+                continue;
+            }
+            if (open_shared(fd)) {
+                close(fd);
+                break;
+            }
+            CHECK_LT(attempt, 3) << "can not reclaim " << shm_name_;
+            LOG(WARNING) << "Reclaiming the stale segment " << shm_name_
+                << " of " << source_;
+            unlink_shared(fd);
+            close(fd);
+        }
+        const Header* header = static_cast<const Header*>(shm_);
+        count_ = header->count;
+        records_ = reinterpret_cast<const Record*>(
+                static_cast<const char*>(shm_) + sizeof(Header));
+        arena_ = reinterpret_cast<const uint8_t*>(records_ + count_);
+    }
+
+    void DatasetCache::create_shared(int fd) {
+        // this rank fills the segment, the header tells who is filling it
+        shm_owner_ = true;
+        struct stat st;
+        CHECK_EQ(fstat(fd, &st), 0);
+        shm_inode_ = st.st_ino;
+        CHECK_EQ(ftruncate(fd, sizeof(Header)), 0) << "ftruncate failed";
+        Header* header = static_cast<Header*>(mmap(NULL, sizeof(Header),
+                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        CHECK(header != MAP_FAILED) << "mmap " << shm_name_ << " failed";
+        header->owner = getpid();
+        header->source_size = source_size_;
+        header->source_mtime = source_mtime_;
+        munmap(header, sizeof(Header));
+
+        vector<Record> records;
+        vector<uint8_t> arena;
+        load(&records, &arena);
+        shm_size_ = sizeof(Header) + records.size() * sizeof(Record)
+            + arena.size();
+        CHECK_EQ(ftruncate(fd, shm_size_), 0) << "ftruncate failed";
+        shm_ = mmap(NULL, shm_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+        CHECK(shm_ != MAP_FAILED) << "mmap " << shm_name_ << " failed";
+        close(fd);
+        header = static_cast<Header*>(shm_);
+        header->count = records.size();
+        header->bytes = arena.size();
+        char* ptr = static_cast<char*>(shm_) + sizeof(Header);
+        memcpy(ptr, records.data(), records.size() * sizeof(Record));
+        memcpy(ptr + records.size() * sizeof(Record), arena.data(),
+                arena.size());
+        __sync_synchronize();
+        header->ready = 1;
+    }
+
+    bool DatasetCache::open_shared(int fd) {
+        auto deadline = std::chrono::steady_clock::now()
+            + std::chrono::seconds(timeout_seconds());
+        auto timed_out = [&]()->bool {
+            return std::chrono::steady_clock::now() > deadline;
+        };
+        // wait for the owner to write the header
+        struct stat st;
+        CHECK_EQ(fstat(fd, &st), 0);
+        while (st.st_size < static_cast<off_t>(sizeof(Header))) {
+            if (timed_out()) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            CHECK_EQ(fstat(fd, &st), 0);
+        }
+        const Header* header = static_cast<const Header*>(mmap(NULL,
+                    sizeof(Header), PROT_READ, MAP_SHARED, fd, 0));
+        CHECK(header != MAP_FAILED) << "mmap " << shm_name_ << " failed";
+        // then for it to fill the segment, while it is alive
+        bool stale = header->source_size != source_size_
+            || header->source_mtime != source_mtime_;
+        while (!stale && header->ready == 0) {
+            stale = timed_out() || (kill(header->owner, 0) != 0
+                    && errno == ESRCH);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        stale = stale || (kill(header->owner, 0) != 0 && errno == ESRCH);
+        munmap(const_cast<Header*>(header), sizeof(Header));
+        if (stale) {
+            return false;
+        }
+        __sync_synchronize();
+        CHECK_EQ(fstat(fd, &st), 0);
+        shm_size_ = st.st_size;
+        shm_ = mmap(NULL, shm_size_, PROT_READ, MAP_SHARED, fd, 0);
+        CHECK(shm_ != MAP_FAILED) << "mmap " << shm_name_ << " failed";
+        return true;
+    }
+
+    void DatasetCache::unlink_shared(int fd) {
+        struct stat mine;
+        CHECK_EQ(fstat(fd, &mine), 0);
+        int current = shm_open(shm_name_.c_str(), O_RDONLY, 0600);
+        if (current < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(current, &st) == 0 && st.st_ino == mine.st_ino) {
+            shm_unlink(shm_name_.c_str());
+        }
+        close(current);
+    }
+
+    DatasetCache::~DatasetCache() {
+        if (shm_ != NULL) {
+            munmap(shm_, shm_size_);
+            // ranks which already mapped the segment keep their mapping,
+            // the name may be another segment already if this one was
+            // reclaimed
+            int current = shm_owner_ ? shm_open(shm_name_.c_str(), O_RDONLY,
+                    0600) : -1;
+            if (current >= 0) {
+                struct stat st;
+                if (fstat(current, &st) == 0 && st.st_ino == shm_inode_) {
+                    shm_unlink(shm_name_.c_str());
+                }
+                close(current);
+            }
+        }
+    }
+
+}
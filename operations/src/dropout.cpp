@@ -0,0 +1,207 @@
+// Copyright Lin Min 2015
+#include "operations/include/dropout.hpp"
+#include "operations/parallel.hpp"
+#include "operations/simd.hpp"
+
+namespace purine {
+
+    // the mask bits of element index, read from the words in memory
+    static inline bool kept(const uint32_t* words, int index) {
+        return (words[index >> 5] >> (index & 31)) & 1;
+    }
+
+    /**
+     * f(index, offsets) for every element, index in the order of the mask
+     * and offsets[i] of the element in tensors[i], rows along width.
+     */
+    template <typename F>
+    static void rows(const vector<Tensor*>& tensors, const F& f) {
+        Size s = tensors[0]->size();
+        int offsets[2];
+        int index = 0;
+        for (int n = 0; n < s.num(); ++n) {
+            for (int c = 0; c < s.channels(); ++c) {
+                for (int h = 0; h < s.height(); ++h) {
+                    for (int i = 0; i < tensors.size(); ++i) {
+                        Stride st = tensors[i]->stride();
+                        offsets[i] = n * st.nstride() + c * st.cstride()
+                            + h * st.hstride();
+                    }
+                    f(index, offsets);
+                    index += s.width();
+                }
+            }
+        }
+    }
+
+    Size Dropout::mask_size(const Size& size) {
+        return Size((size.count() + 31) / 32, 1, 1, 1);
+    }
+
+    void Dropout::philox(uint32_t counter[4], uint32_t key0, uint32_t key1) {
+        for (int round = 0; round < 10; ++round) {
+            uint64_t p0 = uint64_t(0xD2511F53) * counter[0];
+            uint64_t p1 = uint64_t(0xCD9E8D57) * counter[2];
+            uint32_t c1 = counter[1];
+            uint32_t c3 = counter[3];
+            counter[0] = uint32_t(p1 >> 32) ^ c1 ^ key0;
+            counter[1] = uint32_t(p1);
+            counter[2] = uint32_t(p0 >> 32) ^ c3 ^ key1;
+            counter[3] = uint32_t(p0);
+            key0 += 0x9E3779B9;
+            key1 += 0xBB67AE85;
+        }
+    }
+
+    Dropout::Dropout(const vector<Tensor*>& inputs,
+            const vector<Tensor*>& outputs, const param_tuple& args)
+        : Operation(inputs, outputs) {
+            std::tie(ratio) = args;
+            CHECK_EQ(inputs_[0]->device(), -1) << "on the cpu only";
+            CHECK_EQ(outputs_.size(), 2);
+            CHECK_EQ(outputs_[0]->size(), inputs_[0]->size());
+            CHECK_EQ(outputs_[1]->size(), mask_size(inputs_[0]->size()));
+            CHECK(outputs_[1]->is_contiguous());
+            CHECK(ratio >= 0 && ratio < 1);
+            seed_ = cluster_seedgen();
+        }
+
+#ifdef __AVX2__
+    // the high and low halves of the 32 x 32 bit products of the lanes
+    static inline void mul(__m256i a, __m256i b, __m256i* hi, __m256i* lo) {
+        __m256i even = _mm256_mul_epu32(a, b);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+        *lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+        *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+    }
+
+    // Dropout::philox on 8 counters, c[i] holds word i of each of them
+    static inline void philox8(__m256i c[4], uint32_t key0, uint32_t key1) {
+        const __m256i m0 = _mm256_set1_epi32(0xD2511F53);
+        const __m256i m1 = _mm256_set1_epi32(0xCD9E8D57);
+        for (int round = 0; round < 10; ++round) {
+            __m256i hi0, lo0, hi1, lo1;
+            mul(c[0], m0, &hi0, &lo0);
+            mul(c[2], m1, &hi1, &lo1);
+            c[0] = _mm256_xor_si256(_mm256_xor_si256(hi1, c[1]),
+                    _mm256_set1_epi32(key0));
+            c[1] = lo1;
+            c[2] = _mm256_xor_si256(_mm256_xor_si256(hi0, c[3]),
+                    _mm256_set1_epi32(key1));
+            c[3] = lo0;
+            key0 += 0x9E3779B9;
+            key1 += 0xBB67AE85;
+        }
+    }
+
+    // bit k of the low 8 bits to bit 4k
+    static inline uint32_t spread(uint32_t m) {
+        m = (m | (m << 12)) & 0x000F000F;
+        m = (m | (m << 6)) & 0x03030303;
+        return (m | (m << 3)) & 0x11111111;
+    }
+#endif
+
+    /**
+     * Each philox call gives 4 words of random bits, each compared with
+     * ratio * 2^32 for one element, so a mask word takes 8 calls. The
+     * counter is (word, call, run), the key the seed. With AVX2 the 8
+     * calls of a word run in the lanes of a vector.
+     */
+    void Dropout::draw(uint64_t seed, uint64_t run, DTYPE ratio, int begin,
+            int end, uint32_t* words) {
+        uint32_t threshold = uint32_t(double(ratio) * 4294967296.);
+        uint32_t key0 = uint32_t(seed);
+        uint32_t key1 = uint32_t(seed >> 32);
+#ifdef __AVX2__
+        // unsigned x >= threshold as signed, with the top bits flipped
+        const __m256i flip = _mm256_set1_epi32(0x80000000);
+        const __m256i below = _mm256_xor_si256(
+                _mm256_set1_epi32(threshold), flip);
+        for (int word = begin; word < end; ++word) {
+            __m256i c[4] = { _mm256_set1_epi32(word),
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                _mm256_set1_epi32(uint32_t(run)),
+                _mm256_set1_epi32(uint32_t(run >> 32)) };
+            philox8(c, key0, key1);
+            uint32_t bits = 0;
+            for (int i = 0; i < 4; ++i) {
+                uint32_t dropped = _mm256_movemask_ps(_mm256_castsi256_ps(
+                            _mm256_cmpgt_epi32(below,
+                                _mm256_xor_si256(c[i], flip))));
+                bits |= spread(~dropped & 0xFF) << i;
+            }
+            words[word] = bits;
+        }
+#else
+        for (int word = begin; word < end; ++word) {
+            uint32_t bits = 0;
+            for (int call = 0; call < 8; ++call) {
+                uint32_t counter[4] = { uint32_t(word), uint32_t(call),
+                    uint32_t(run), uint32_t(run >> 32) };
+                philox(counter, key0, key1);
+                for (int i = 0; i < 4; ++i) {
+                    bits |= uint32_t(counter[i] >= threshold) << (call * 4 + i);
+                }
+            }
+            words[word] = bits;
+        }
+#endif
+    }
+
+    // the words of the mask are drawn in slices, one thread each
+    void Dropout::compute_cpu(const vector<bool>& add) {
+        Size s = inputs_[0]->size();
+        int count = s.count();
+        std::lock_guard<std::mutex>mask_lock(outputs_[1]->get_mutex());
+        uint32_t* words = reinterpret_cast<uint32_t*>(
+                outputs_[1]->mutable_cpu_data());
+        parallel_for((count + 31) / 32, 1024, [&](int begin, int end) {
+                draw(seed_, run_, ratio, begin, end, words);
+            });
+        ++run_;
+
+        const DTYPE* bottom = inputs_[0]->cpu_data();
+        std::lock_guard<std::mutex>top_lock(outputs_[0]->get_mutex());
+        DTYPE* top = outputs_[0]->mutable_cpu_data();
+        int bw = inputs_[0]->stride().wstride();
+        int tw = outputs_[0]->stride().wstride();
+        rows({ inputs_[0], outputs_[0] }, [&](int index, const int* off) {
+                const DTYPE* b = bottom + off[0];
+                DTYPE* t = top + off[1];
+                for (int w = 0; w < s.width(); ++w) {
+                    t[w * tw] = (add[0] ? t[w * tw] : 0)
+                        + (kept(words, index + w) ? b[w * bw] : 0);
+                }
+            });
+    }
+
+    DropoutDown::DropoutDown(const vector<Tensor*>& inputs,
+            const vector<Tensor*>& outputs, const param_tuple& args)
+        : Operation(inputs, outputs) {
+            CHECK_EQ(inputs_[0]->device(), -1) << "on the cpu only";
+            CHECK_EQ(outputs_[0]->size(), inputs_[0]->size());
+            CHECK_EQ(inputs_[1]->size(),
+                    Dropout::mask_size(inputs_[0]->size()));
+        }
+
+    void DropoutDown::compute_cpu(const vector<bool>& add) {
+        Size s = inputs_[0]->size();
+        const DTYPE* top_diff = inputs_[0]->cpu_data();
+        const uint32_t* words = reinterpret_cast<const uint32_t*>(
+                inputs_[1]->cpu_data());
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* bottom_diff = outputs_[0]->mutable_cpu_data();
+        int dw = inputs_[0]->stride().wstride();
+        int bw = outputs_[0]->stride().wstride();
+        rows({ inputs_[0], outputs_[0] }, [&](int index, const int* off) {
+                const DTYPE* d = top_diff + off[0];
+                DTYPE* b = bottom_diff + off[1];
+                for (int w = 0; w < s.width(); ++w) {
+                    b[w * bw] = (add[0] ? b[w * bw] : 0)
+                        + (kept(words, index + w) ? d[w * dw] : 0);
+                }
+            });
+    }
+
+}
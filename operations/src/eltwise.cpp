@@ -101,6 +101,58 @@ namespace purine {
         }
     }
 
+    QuorumSum::QuorumSum(const vector<Tensor*>& inputs,
+            const vector<Tensor*>& outputs, const param_tuple& args)
+        : Operation(inputs, outputs) {
+            CHECK_GE(inputs_.size(), 1);
+            for (Tensor* input : inputs_) {
+                CHECK_EQ(input->size(), outputs_[0]->size());
+            }
+            weights_ = vector<DTYPE>(inputs_.size(), 0.);
+        }
+
+    void QuorumSum::compute_cpu(const vector<bool>& add) {
+        CHECK_EQ(add[0], false);
+        CHECK_EQ(weights_.size(), inputs_.size());
+        int count = outputs_[0]->size().count();
+        bool first = true;
+        for (int i = 0; i < inputs_.size(); ++i) {
+            if (weights_[i] == 0.) {
+                continue;
+            }
+            if (first) {
+                caffe::caffe_cpu_scale(count, weights_[i], inputs_[i]->cpu_data(),
+                        outputs_[0]->mutable_cpu_data());
+                first = false;
+            } else {
+                caffe::caffe_axpy(count, weights_[i], inputs_[i]->cpu_data(),
+                        outputs_[0]->mutable_cpu_data());
+            }
+        }
+        CHECK(!first) << "no input to sum";
+    }
+
+    void QuorumSum::compute_gpu(const vector<bool>& add) {
+        CHECK_EQ(add[0], false);
+        CHECK_EQ(weights_.size(), inputs_.size());
+        int count = outputs_[0]->size().count();
+        bool first = true;
+        for (int i = 0; i < inputs_.size(); ++i) {
+            if (weights_[i] == 0.) {
+                continue;
+            }
+            if (first) {
+                caffe::caffe_gpu_scale(count, weights_[i], inputs_[i]->gpu_data(),
+                        outputs_[0]->mutable_gpu_data());
+                first = false;
+            } else {
+                caffe::caffe_gpu_axpy(count, weights_[i], inputs_[i]->gpu_data(),
+                        outputs_[0]->mutable_gpu_data());
+            }
+        }
+        CHECK(!first) << "no input to sum";
+    }
+
     Average::Average(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
             const param_tuple& args) : Operation(inputs, outputs) {
         CHECK_GE(inputs_.size(), 2);
@@ -0,0 +1,227 @@
+// Copyright Lin Min 2015
+#include "operations/include/fused.hpp"
+#include "caffeine/math_functions.hpp"
+
+namespace purine {
+
+ConvBiasAct::ConvBiasAct(const vector<Tensor*>& inputs,
+    const vector<Tensor*>& outputs, const param_tuple& args)
+    : Operation(inputs, outputs) {
+  int pad_h, pad_w, stride_h, stride_w;
+  string mode;
+  std::tie(pad_h, pad_w, stride_h, stride_w, mode) = args;
+  CHECK(inputs_.size() == 2 || inputs_.size() == 3);
+  conv_.reset(new Conv({ inputs_[0], inputs_[1] }, outputs_,
+          Conv::param_tuple(pad_h, pad_w, stride_h, stride_w)));
+  if (inputs_.size() == 3) {
+    bias_.reset(new Bias({ inputs_[2] }, outputs_, Bias::param_tuple()));
+  }
+  if (mode != "") {
+    activation_.reset(new Activation(outputs_, outputs_,
+            Activation::param_tuple(mode)));
+  }
+}
+
+void ConvBiasAct::compute_cpu(const vector<bool>& add) {
+  conv_->compute_cpu(add);
+  if (bias_) {
+    bias_->compute_cpu({ true });
+  }
+  if (activation_) {
+    activation_->compute_cpu({ false });
+  }
+}
+
+void ConvBiasAct::compute_gpu(const vector<bool>& add) {
+  conv_->compute_gpu(add);
+  if (bias_) {
+    bias_->compute_gpu({ true });
+  }
+  if (activation_) {
+    activation_->compute_gpu({ false });
+  }
+}
+
+InnerBiasAct::InnerBiasAct(const vector<Tensor*>& inputs,
+    const vector<Tensor*>& outputs, const param_tuple& args)
+    : Operation(inputs, outputs) {
+  string mode;
+  std::tie(mode) = args;
+  CHECK(inputs_.size() == 2 || inputs_.size() == 3);
+  inner_.reset(new Inner({ inputs_[0], inputs_[1] }, outputs_,
+          Inner::param_tuple()));
+  if (inputs_.size() == 3) {
+    bias_.reset(new Bias({ inputs_[2] }, outputs_, Bias::param_tuple()));
+  }
+  if (mode != "") {
+    activation_.reset(new Activation(outputs_, outputs_,
+            Activation::param_tuple(mode)));
+  }
+}
+
+void InnerBiasAct::compute_cpu(const vector<bool>& add) {
+  inner_->compute_cpu(add);
+  if (bias_) {
+    bias_->compute_cpu({ true });
+  }
+  if (activation_) {
+    activation_->compute_cpu({ false });
+  }
+}
+
+void InnerBiasAct::compute_gpu(const vector<bool>& add) {
+  inner_->compute_gpu(add);
+  if (bias_) {
+    bias_->compute_gpu({ true });
+  }
+  if (activation_) {
+    activation_->compute_gpu({ false });
+  }
+}
+
+// the parts one after the other, along num (weights) or channels (biases)
+static shared_ptr<Tensor> stacked(const vector<Tensor*>& parts,
+    bool channels) {
+  Size size = parts[0]->size();
+  int total = 0;
+  for (Tensor* part : parts) {
+    CHECK(part->is_contiguous());
+    total += channels ? part->size().channels() : part->size().num();
+  }
+  if (channels) {
+    size = { size.num(), total, size.height(), size.width() };
+  } else {
+    size = { total, size.channels(), size.height(), size.width() };
+  }
+  return shared_ptr<Tensor>(new Tensor(parts[0]->rank(), parts[0]->device(),
+          size));
+}
+
+// copy the parts which changed since the last gather into whole
+static void gather(const vector<Tensor*>& parts, Tensor* whole,
+    vector<int64_t>* versions) {
+  versions->resize(parts.size(), -1);
+  bool changed = false;
+  for (int i = 0; i < parts.size(); ++i) {
+    changed |= (*versions)[i] != parts[i]->version();
+  }
+  if (!changed) {
+    // whole keeps its version, so do the caches derived from it
+    return;
+  }
+  DTYPE* dst = whole->mutable_data();
+  for (int i = 0; i < parts.size(); ++i) {
+    int count = parts[i]->size().count();
+    if ((*versions)[i] != parts[i]->version()) {
+      (*versions)[i] = parts[i]->version();
+      if (whole->device() < 0) {
+        caffe::caffe_cpu_copy<DTYPE>(count, parts[i]->cpu_data(), dst);
+      } else {
+        CUDA_CHECK(cudaMemcpyAsync(dst, parts[i]->gpu_data(),
+                count * sizeof(DTYPE), cudaMemcpyDefault, stream()));
+      }
+    }
+    dst += count;
+  }
+}
+
+// copy (or add) whole out to the parts
+static void scatter(Tensor* whole, const vector<Tensor*>& parts,
+    const vector<bool>& add) {
+  const DTYPE* src = whole->data();
+  for (int i = 0; i < parts.size(); ++i) {
+    int count = parts[i]->size().count();
+    std::lock_guard<std::mutex>lock_guard_(parts[i]->get_mutex());
+    if (whole->device() < 0) {
+      if (add[i]) {
+        caffe::caffe_axpy<DTYPE>(count, 1., src, parts[i]->mutable_cpu_data());
+      } else {
+        caffe::caffe_cpu_copy<DTYPE>(count, src, parts[i]->mutable_cpu_data());
+      }
+    } else {
+      if (add[i]) {
+        caffe::caffe_gpu_axpy<DTYPE>(count, 1., src,
+            parts[i]->mutable_gpu_data());
+      } else {
+        CUDA_CHECK(cudaMemcpyAsync(parts[i]->mutable_gpu_data(), src,
+                count * sizeof(DTYPE), cudaMemcpyDefault, stream()));
+      }
+    }
+    src += count;
+  }
+}
+
+SiblingConv::SiblingConv(const vector<Tensor*>& inputs,
+    const vector<Tensor*>& outputs, const param_tuple& args)
+    : Operation(inputs, outputs) {
+  int pad_h, pad_w, stride_h, stride_w, n;
+  std::tie(pad_h, pad_w, stride_h, stride_w, n) = args;
+  CHECK_GT(n, 0);
+  CHECK(inputs_.size() == 1 + n || inputs_.size() == 1 + 2 * n);
+  weights_.assign(inputs_.begin() + 1, inputs_.begin() + 1 + n);
+  biases_.assign(inputs_.begin() + 1 + n, inputs_.end());
+  weight_ = stacked(weights_, false);
+  vector<Tensor*> conv_inputs = { inputs_[0], weight_.get() };
+  if (biases_.size() != 0) {
+    bias_ = stacked(biases_, true);
+    conv_inputs.push_back(bias_.get());
+  }
+  conv_.reset(new ConvBiasAct(conv_inputs, outputs_, ConvBiasAct::param_tuple(
+              pad_h, pad_w, stride_h, stride_w, "")));
+}
+
+void SiblingConv::compute_cpu(const vector<bool>& add) {
+  gather(weights_, weight_.get(), &weight_versions_);
+  if (bias_) {
+    gather(biases_, bias_.get(), &bias_versions_);
+  }
+  conv_->compute_cpu(add);
+}
+
+void SiblingConv::compute_gpu(const vector<bool>& add) {
+  gather(weights_, weight_.get(), &weight_versions_);
+  if (bias_) {
+    gather(biases_, bias_.get(), &bias_versions_);
+  }
+  conv_->compute_gpu(add);
+}
+
+SiblingConvDown::SiblingConvDown(const vector<Tensor*>& inputs,
+    const vector<Tensor*>& outputs, const param_tuple& args)
+    : Operation(inputs, outputs) {
+  CHECK_GE(inputs_.size(), 2);
+  weights_.assign(inputs_.begin() + 1, inputs_.end());
+  weight_ = stacked(weights_, false);
+  conv_down_.reset(new ConvDown({ inputs_[0], weight_.get() }, outputs_,
+          args));
+}
+
+void SiblingConvDown::compute_cpu(const vector<bool>& add) {
+  gather(weights_, weight_.get(), &weight_versions_);
+  conv_down_->compute_cpu(add);
+}
+
+void SiblingConvDown::compute_gpu(const vector<bool>& add) {
+  gather(weights_, weight_.get(), &weight_versions_);
+  conv_down_->compute_gpu(add);
+}
+
+SiblingConvWeight::SiblingConvWeight(const vector<Tensor*>& inputs,
+    const vector<Tensor*>& outputs, const param_tuple& args)
+    : Operation(inputs, outputs) {
+  CHECK_EQ(inputs_.size(), 2);
+  weight_diff_ = stacked(outputs_, false);
+  conv_weight_.reset(new ConvWeight(inputs_, { weight_diff_.get() }, args));
+}
+
+void SiblingConvWeight::compute_cpu(const vector<bool>& add) {
+  conv_weight_->compute_cpu({ false });
+  scatter(weight_diff_.get(), outputs_, add);
+}
+
+void SiblingConvWeight::compute_gpu(const vector<bool>& add) {
+  conv_weight_->compute_gpu({ false });
+  scatter(weight_diff_.get(), outputs_, add);
+}
+
+}
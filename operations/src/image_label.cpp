@@ -6,6 +6,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core_c.h>
 #include "common/common.hpp"
+#include <chrono>
 using caffe::BlobProto;
 using caffe::Datum;
 using namespace std;
@@ -22,10 +23,10 @@ namespace purine {
 
     ImageLabel::ImageLabel(const vector<Tensor*>& inputs,
             const vector<Tensor*>& outputs, const param_tuple& args)
-        : Operation(inputs, outputs) {
+        : Operation(inputs, outputs), decoded_images_(0), decoded_bytes_(0) {
             std::tie(source, mean, mirror, random, color, multi_view_id, scale, angle, 
                     offset, interval,
-                    batch_size, crop_size)
+                    batch_size, crop_size, cache)
                 = args;
 
             CHECK_EQ(batch_size, outputs_[0]->size().num());
@@ -42,6 +43,12 @@ namespace purine {
                 caffe::caffe_memset(mean_->size().count() * sizeof(DTYPE), 0,
                         mean_->mutable_cpu_data());
             }
+            if (cache != DatasetCache::NONE) {
+                cache_ = DatasetCache::get(source, color,
+                        static_cast<DatasetCache::Mode>(cache));
+                cursor_ = offset % cache_->size();
+                return;
+            }
             CHECK_EQ(mdb_env_create(&mdb_env_), MDB_SUCCESS)
                 << "mdb_env_create failed";
             CHECK_EQ(mdb_env_set_mapsize(mdb_env_, 1099511627776), MDB_SUCCESS);
@@ -64,7 +71,70 @@ namespace purine {
                                 MDB_FIRST), MDB_SUCCESS);
                 }
             }
+            datums_.resize(batch_size);
+            decode_bufs_.resize(batch_size);
+        }
+
+    void ImageLabel::start_decoders() {
+        int num = std::max(1u, std::thread::hardware_concurrency() / 2);
+        num = std::min(num, batch_size);
+        for (int i = 0; i < num; ++i) {
+            decoders_.push_back(shared_ptr<std::thread>(
+                        new std::thread(&ImageLabel::decode_worker, this, i)));
         }
+    }
+
+    void ImageLabel::decode_worker(int id) {
+        int seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(decode_mutex_);
+                decode_cv_.wait(lock, [&]() {
+                        return decode_stop_ || decode_round_ != seen; });
+                if (decode_stop_) {
+                    return;
+                }
+                seen = decode_round_;
+            }
+            for (int i = id; i < batch_size; i += decoders_.size()) {
+                if (!datums_[i].encoded()) {
+                    continue;
+                }
+                decoded_bytes_ += datums_[i].data().size();
+                CHECK(caffe::DecodeDatumInPlace(&datums_[i], color,
+                            &decode_bufs_[i])) << "failed to decode item " << i;
+                ++decoded_images_;
+            }
+            {
+                std::unique_lock<std::mutex> lock(decode_mutex_);
+                if (--decode_running_ == 0) {
+                    done_cv_.notify_one();
+                }
+            }
+        }
+    }
+
+    void ImageLabel::decode_batch() {
+        if (decoders_.size() == 0) {
+            start_decoders();
+        }
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(decode_mutex_);
+            decode_running_ = decoders_.size();
+            ++decode_round_;
+            decode_cv_.notify_all();
+            done_cv_.wait(lock, [&]() { return decode_running_ == 0; });
+        }
+        decode_seconds_ += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        if (++decode_batches_ % 100 == 0) {
+            LOG(INFO) << "ImageLabel decoded " << decoded_images_ << " images ("
+                << decoded_bytes_ / 1048576. << " MB) at "
+                << decoded_images_ / decode_seconds_ << " images/s with "
+                << decoders_.size() << " decoder threads";
+        }
+    }
 
     void rotateNScale(const cv::Mat &_from, cv::Mat &_to, double angle, double scale){
         cv::Point center = cv::Point(_from.cols / 2, _from.rows / 2);
@@ -75,15 +145,24 @@ namespace purine {
     }
 
 
-    void resize_rotate_image(Datum& datum, std::vector<DTYPE>&out, const DTYPE* mean, float scale, float angle){
-        int width = datum.width();
-        int height = datum.height();
-        int channels = datum.channels();
+    // raw pixels of one item, either in a datum or in the dataset cache
+    struct ImageView {
+        const uint8_t* data;
+        int channels;
+        int height;
+        int width;
+        int label;
+    };
+
+    void resize_rotate_image(const ImageView& image, std::vector<DTYPE>&out, const DTYPE* mean, float scale, float angle){
+        int width = image.width;
+        int height = image.height;
+        int channels = image.channels;
         int size = width * height * channels;
         if(fabs(scale - 1.0) < 0.000000001){
             out.resize(size);
             for(int index = 0; index < size; index++){
-                out[index] = static_cast<DTYPE>(static_cast<uint8_t>(datum.data()[index])) - mean[index];
+                out[index] = static_cast<DTYPE>(image.data[index]) - mean[index];
             }
             return;
         }
@@ -91,7 +170,7 @@ namespace purine {
             std::vector<DTYPE>sub_mean_data(size);
             
             for(int index = 0; index < size; index++){
-                sub_mean_data[index] = static_cast<DTYPE>(static_cast<uint8_t>(datum.data()[index])) - mean[index];
+                sub_mean_data[index] = static_cast<DTYPE>(image.data[index]) - mean[index];
             }
 
             cv::Mat src = caffe::dtype2mat(sub_mean_data.data(), channels, width, height);
@@ -106,19 +185,53 @@ namespace purine {
     }
 
     void ImageLabel::compute_cpu(const vector<bool>& add) {
-        Datum datum;
         const DTYPE* mean = mean_->data();
         DTYPE* top_data = outputs_[0]->mutable_cpu_data();
         DTYPE* top_label = outputs_[1]->mutable_cpu_data();
 
+        vector<ImageView> images(batch_size);
+        if (cache_) {
+            // serve the batch from the in-memory arena
+            for (int item_id = 0; item_id < batch_size; ++item_id) {
+                const DatasetCache::Record& record = cache_->record(cursor_);
+                images[item_id] = { cache_->data(cursor_), record.channels,
+                    record.height, record.width, record.label };
+                cursor_ = (cursor_ + 1) % cache_->size();
+            }
+        }
 
-        for (int item_id = 0; item_id < batch_size; ++item_id) {
+        // read the whole batch first, so that encoded items can be decoded
+        // in parallel.
+        bool has_encoded = false;
+        for (int item_id = 0; !cache_ && item_id < batch_size; ++item_id) {
             CHECK_EQ(mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_,
                         MDB_GET_CURRENT), MDB_SUCCESS);
-            datum.ParseFromArray(mdb_value_.mv_data, mdb_value_.mv_size);
-            CHECK(mean_->size().channels() == datum.channels()) << " mean_.channels != datum.channels";
-            CHECK(mean_->size().width() == datum.width()) << " mean_.width != datum.width";
-            CHECK(mean_->size().height() == datum.height()) << " mean_.height != datum.height";
+            datums_[item_id].ParseFromArray(mdb_value_.mv_data,
+                    mdb_value_.mv_size);
+            has_encoded |= datums_[item_id].encoded();
+            if (mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_, MDB_NEXT)
+                    != MDB_SUCCESS) {
+                // We have reached the end. Restart from the first.
+                // DLOG(INFO) << "Restarting data prefetching from start.";
+                CHECK_EQ(mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_,
+                            MDB_FIRST), MDB_SUCCESS);
+            }
+        }
+        if (has_encoded) {
+            decode_batch();
+        }
+        for (int item_id = 0; !cache_ && item_id < batch_size; ++item_id) {
+            const Datum& datum = datums_[item_id];
+            images[item_id] = {
+                reinterpret_cast<const uint8_t*>(datum.data().data()),
+                datum.channels(), datum.height(), datum.width(), datum.label() };
+        }
+
+        for (int item_id = 0; item_id < batch_size; ++item_id) {
+            const ImageView& image = images[item_id];
+            CHECK(mean_->size().channels() == image.channels) << " mean_.channels != datum.channels";
+            CHECK(mean_->size().width() == image.width) << " mean_.width != datum.width";
+            CHECK(mean_->size().height() == image.height) << " mean_.height != datum.height";
 
             std::vector<DTYPE>data;
 
@@ -156,13 +269,13 @@ namespace purine {
                 }
             }
 
-            resize_rotate_image(datum, data, mean, cur_scale, cur_angle);
+            resize_rotate_image(image, data, mean, cur_scale, cur_angle);
             
 
             //crop
-            int height = cur_scale * datum.height();
-            int width = cur_scale * datum.width();
-            int channels = cur_scale * datum.channels();
+            int height = cur_scale * image.height;
+            int width = cur_scale * image.width;
+            int channels = cur_scale * image.channels;
 
             int h_off, w_off;
             if(multi_view_id == -1){// trainning 
@@ -222,19 +335,23 @@ namespace purine {
                 }
             }
 
-            top_label[item_id] = datum.label();
-            if (mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_, MDB_NEXT)
-                    != MDB_SUCCESS) {
-                // We have reached the end. Restart from the first.
-                // DLOG(INFO) << "Restarting data prefetching from start.";
-                CHECK_EQ(mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_,
-                            MDB_FIRST), MDB_SUCCESS);
-            }
+            top_label[item_id] = image.label;
         }
 
     }
 
     ImageLabel::~ImageLabel() {
+        {
+            std::unique_lock<std::mutex> lock(decode_mutex_);
+            decode_stop_ = true;
+            decode_cv_.notify_all();
+        }
+        for (shared_ptr<std::thread>& t : decoders_) {
+            t->join();
+        }
+        if (cache_) {
+            return;
+        }
         mdb_cursor_close(mdb_cursor_);
         mdb_close(mdb_env_, mdb_dbi_);
         mdb_txn_abort(mdb_txn_);
@@ -96,6 +96,12 @@ namespace purine {
         : Operation(inputs, outputs) {
             std::tie(alpha, beta, size) = args;
             CHECK_EQ(outputs_[0]->size(), inputs_[0]->size());
+            if (outputs_.size() == 2) {
+                CHECK_EQ(inputs_[0]->device(), -1) << "top on the cpu only";
+                CHECK_EQ(outputs_[1]->size(), inputs_[0]->size());
+            } else {
+                CHECK_EQ(outputs_.size(), 1);
+            }
         }
 
     void LRNScale::compute_gpu(const vector<bool>& add) {
@@ -0,0 +1,349 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "operations/include/lrn.hpp"
+#include "operations/parallel.hpp"
+#include "operations/simd.hpp"
+
+namespace purine {
+
+    // scale^-beta, without pow for the usual beta of 0.75
+    static inline DTYPE power(DTYPE scale, DTYPE beta) {
+        if (beta == DTYPE(0.75)) {
+            return 1. / std::sqrt(scale * std::sqrt(scale));
+        }
+        return std::pow(scale, -beta);
+    }
+
+#ifdef PURINE_VECTOR
+    static inline simd::floats power(simd::floats scale, DTYPE beta) {
+        if (beta == DTYPE(0.75)) {
+            return simd::set1(1.f) / simd::sqrt(scale * simd::sqrt(scale));
+        }
+        float x[simd::floats::size];
+        simd::store(x, scale);
+        for (float& v : x) {
+            v = std::pow(v, -beta);
+        }
+        return simd::load(x);
+    }
+#endif
+
+    // the row [n, c, h, :] of a tensor
+    static inline int row(Tensor* t, int n, int c, int h) {
+        const Stride& st = t->stride();
+        return n * st.nstride() + c * st.cstride() + h * st.hstride();
+    }
+
+    // offset of w in a row, UNIT when all the rows are contiguous (NCHW) so
+    // that the loops along the rows are unit stride
+    template <bool UNIT>
+    static inline int at(int w, int wstride) {
+        return UNIT ? w : w * wstride;
+    }
+
+    static inline bool unit(const vector<Tensor*>& tensors) {
+        for (Tensor* t : tensors) {
+            if (t->stride().wstride() != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * vectors(w) for the vectors of a contiguous row of width, then
+     * scalars(w) for the rest, or for all of w when the row is strided.
+     */
+    template <bool UNIT, typename V, typename S>
+    static inline void along(int width, const V& vectors, const S& scalars) {
+        int w = 0;
+#ifdef PURINE_VECTOR
+        if (UNIT) {
+            for (; w + simd::floats::size <= width; w += simd::floats::size) {
+                vectors(w);
+            }
+        }
+#endif
+        for (; w < width; ++w) {
+            scalars(w);
+        }
+    }
+
+    // the (n, h) rows of each thread, enough for the threads to pay off
+    static inline int grain(const Size& s) {
+        return 1 + (1 << 15) / (s.channels() * s.width());
+    }
+
+    template <bool UNIT>
+    static void lrn(Tensor* bottom_t, Tensor* scale_t, Tensor* top_t,
+            DTYPE beta, bool add) {
+        Size s = bottom_t->size();
+        const DTYPE* bottom = bottom_t->cpu_data();
+        const DTYPE* scale = scale_t->cpu_data();
+        DTYPE* top = top_t->mutable_cpu_data();
+        int bw = bottom_t->stride().wstride();
+        int sw = scale_t->stride().wstride();
+        int tw = top_t->stride().wstride();
+        parallel_for(s.num() * s.height(), grain(s), [&](int begin, int end) {
+                for (int nh = begin; nh < end; ++nh) {
+                    int n = nh / s.height();
+                    int h = nh % s.height();
+                    for (int c = 0; c < s.channels(); ++c) {
+                        const DTYPE* b = bottom + row(bottom_t, n, c, h);
+                        const DTYPE* sc = scale + row(scale_t, n, c, h);
+                        DTYPE* t = top + row(top_t, n, c, h);
+                        along<UNIT>(s.width(), [&](int w) {
+#ifdef PURINE_VECTOR
+                                simd::floats v = simd::load(b + w)
+                                    * power(simd::load(sc + w), beta);
+                                simd::store(t + w, add
+                                    ? simd::load(t + w) + v : v);
+#endif
+                            }, [&](int w) {
+                                t[at<UNIT>(w, tw)] = (add ? t[at<UNIT>(w, tw)]
+                                    : 0) + b[at<UNIT>(w, bw)]
+                                    * power(sc[at<UNIT>(w, sw)], beta);
+                            });
+                    }
+                }
+            });
+    }
+
+    void LRN::compute_cpu(const vector<bool>& add) {
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        if (unit({ inputs_[0], inputs_[1], outputs_[0] })) {
+            lrn<true>(inputs_[0], inputs_[1], outputs_[0], beta, add[0]);
+        } else {
+            lrn<false>(inputs_[0], inputs_[1], outputs_[0], beta, add[0]);
+        }
+    }
+
+    /**
+     * The sums over the window of channels are kept for a whole row of
+     * width, entering channel head and leaving channel head - size. The
+     * squares of the last size channels are in a ring, so every element
+     * is squared once. With top_t, the top of the channel is written as
+     * soon as its scale is, while the row is in the cache.
+     */
+    template <bool UNIT>
+    static void lrn_scale(Tensor* bottom_t, Tensor* scale_t, Tensor* top_t,
+            int size, DTYPE alpha, DTYPE beta, const vector<bool>& add) {
+        Size s = bottom_t->size();
+        int channels = s.channels();
+        int width = s.width();
+        const DTYPE* bottom = bottom_t->cpu_data();
+        DTYPE* scale = scale_t->mutable_cpu_data();
+        DTYPE* top = top_t ? top_t->mutable_cpu_data() : NULL;
+        int bw = bottom_t->stride().wstride();
+        int sw = scale_t->stride().wstride();
+        int tw = top_t ? top_t->stride().wstride() : 1;
+        int pre_pad = (size - 1) / 2;
+        int post_pad = size - pre_pad - 1;
+        DTYPE alpha_over_size = alpha / size;
+        parallel_for(s.num() * s.height(), grain(s), [&](int begin, int end) {
+                vector<DTYPE> accum(width);
+                vector<DTYPE> squares(size * width);
+                DTYPE* a = &accum[0];
+                for (int nh = begin; nh < end; ++nh) {
+                    int n = nh / s.height();
+                    int h = nh % s.height();
+                    std::fill(accum.begin(), accum.end(), 0);
+                    for (int head = 0; head < channels + post_pad; ++head) {
+                        DTYPE* ring = &squares[(head % size) * width];
+                        if (head >= size) {
+                            along<true>(width, [&](int w) {
+#ifdef PURINE_VECTOR
+                                    simd::store(a + w, simd::load(a + w)
+                                        - simd::load(ring + w));
+#endif
+                                }, [&](int w) { a[w] -= ring[w]; });
+                        }
+                        if (head < channels) {
+                            const DTYPE* b = bottom + row(bottom_t, n, head, h);
+                            along<UNIT>(width, [&](int w) {
+#ifdef PURINE_VECTOR
+                                    simd::floats x = simd::load(b + w);
+                                    simd::floats x2 = x * x;
+                                    simd::store(ring + w, x2);
+                                    simd::store(a + w, simd::load(a + w) + x2);
+#endif
+                                }, [&](int w) {
+                                    DTYPE x = b[at<UNIT>(w, bw)];
+                                    ring[w] = x * x;
+                                    a[w] += ring[w];
+                                });
+                        }
+                        if (head < post_pad) {
+                            continue;
+                        }
+                        int c = head - post_pad;
+                        DTYPE* sc = scale + row(scale_t, n, c, h);
+                        if (top) {
+                            const DTYPE* b = bottom + row(bottom_t, n, c, h);
+                            DTYPE* t = top + row(top_t, n, c, h);
+                            along<UNIT>(width, [&](int w) {
+#ifdef PURINE_VECTOR
+                                    simd::floats v = simd::set1(1.)
+                                        + simd::load(a + w)
+                                        * simd::set1(alpha_over_size);
+                                    if (add[0]) {
+                                        v = v + simd::load(sc + w);
+                                    }
+                                    simd::store(sc + w, v);
+                                    simd::floats y = simd::load(b + w)
+                                        * power(v, beta);
+                                    simd::store(t + w, add[1]
+                                        ? simd::load(t + w) + y : y);
+#endif
+                                }, [&](int w) {
+                                    DTYPE& v = sc[at<UNIT>(w, sw)];
+                                    v = (add[0] ? v : 0) + 1.
+                                        + a[w] * alpha_over_size;
+                                    DTYPE& y = t[at<UNIT>(w, tw)];
+                                    y = (add[1] ? y : 0) + b[at<UNIT>(w, bw)]
+                                        * power(v, beta);
+                                });
+                            continue;
+                        }
+                        along<UNIT>(width, [&](int w) {
+#ifdef PURINE_VECTOR
+                                simd::floats v = simd::set1(1.)
+                                    + simd::load(a + w)
+                                    * simd::set1(alpha_over_size);
+                                simd::store(sc + w, add[0]
+                                    ? simd::load(sc + w) + v : v);
+#endif
+                            }, [&](int w) {
+                                DTYPE& v = sc[at<UNIT>(w, sw)];
+                                v = (add[0] ? v : 0) + 1.
+                                    + a[w] * alpha_over_size;
+                            });
+                    }
+                }
+            });
+    }
+
+    void LRNScale::compute_cpu(const vector<bool>& add) {
+        std::lock_guard<std::mutex>scale_lock(outputs_[0]->get_mutex());
+        if (outputs_.size() == 1) {
+            if (unit({ inputs_[0], outputs_[0] })) {
+                lrn_scale<true>(inputs_[0], outputs_[0], NULL, size, alpha,
+                        beta, add);
+            } else {
+                lrn_scale<false>(inputs_[0], outputs_[0], NULL, size, alpha,
+                        beta, add);
+            }
+            return;
+        }
+        std::lock_guard<std::mutex>top_lock(outputs_[1]->get_mutex());
+        if (unit({ inputs_[0], outputs_[0], outputs_[1] })) {
+            lrn_scale<true>(inputs_[0], outputs_[0], outputs_[1], size, alpha,
+                    beta, add);
+        } else {
+            lrn_scale<false>(inputs_[0], outputs_[0], outputs_[1], size, alpha,
+                    beta, add);
+        }
+    }
+
+    // same sliding window as LRNScale, over top_diff * top / scale
+    template <bool UNIT>
+    static void lrn_down(const vector<Tensor*>& inputs, Tensor* output,
+            int size, DTYPE alpha, DTYPE beta, bool add) {
+        Size s = inputs[0]->size();
+        int channels = s.channels();
+        int width = s.width();
+        const DTYPE* bottom = inputs[0]->cpu_data();
+        const DTYPE* top_diff = inputs[1]->cpu_data();
+        const DTYPE* scale = inputs[2]->cpu_data();
+        const DTYPE* top = inputs[3]->cpu_data();
+        DTYPE* bottom_diff = output->mutable_cpu_data();
+        int bw = inputs[0]->stride().wstride();
+        int dw = inputs[1]->stride().wstride();
+        int sw = inputs[2]->stride().wstride();
+        int tw = inputs[3]->stride().wstride();
+        int ow = output->stride().wstride();
+        int pre_pad = size - (size + 1) / 2;
+        int post_pad = size - pre_pad - 1;
+        DTYPE cache_ratio = 2. * alpha * beta / size;
+        parallel_for(s.num() * s.height(), grain(s), [&](int begin, int end) {
+                vector<DTYPE> accum(width);
+                vector<DTYPE> ratios(size * width);
+                DTYPE* a = &accum[0];
+                for (int nh = begin; nh < end; ++nh) {
+                    int n = nh / s.height();
+                    int h = nh % s.height();
+                    std::fill(accum.begin(), accum.end(), 0);
+                    for (int head = 0; head < channels + post_pad; ++head) {
+                        DTYPE* ring = &ratios[(head % size) * width];
+                        if (head >= size) {
+                            along<true>(width, [&](int w) {
+#ifdef PURINE_VECTOR
+                                    simd::store(a + w, simd::load(a + w)
+                                        - simd::load(ring + w));
+#endif
+                                }, [&](int w) { a[w] -= ring[w]; });
+                        }
+                        if (head < channels) {
+                            const DTYPE* d = top_diff
+                                + row(inputs[1], n, head, h);
+                            const DTYPE* sc = scale
+                                + row(inputs[2], n, head, h);
+                            const DTYPE* t = top + row(inputs[3], n, head, h);
+                            along<UNIT>(width, [&](int w) {
+#ifdef PURINE_VECTOR
+                                    simd::floats r = simd::load(d + w)
+                                        * simd::load(t + w)
+                                        / simd::load(sc + w);
+                                    simd::store(ring + w, r);
+                                    simd::store(a + w, simd::load(a + w) + r);
+#endif
+                                }, [&](int w) {
+                                    ring[w] = d[at<UNIT>(w, dw)]
+                                        * t[at<UNIT>(w, tw)]
+                                        / sc[at<UNIT>(w, sw)];
+                                    a[w] += ring[w];
+                                });
+                        }
+                        if (head < post_pad) {
+                            continue;
+                        }
+                        int c = head - post_pad;
+                        const DTYPE* b = bottom + row(inputs[0], n, c, h);
+                        const DTYPE* d = top_diff + row(inputs[1], n, c, h);
+                        const DTYPE* sc = scale + row(inputs[2], n, c, h);
+                        DTYPE* o = bottom_diff + row(output, n, c, h);
+                        along<UNIT>(width, [&](int w) {
+#ifdef PURINE_VECTOR
+                                simd::floats v = simd::load(d + w)
+                                    * power(simd::load(sc + w), beta)
+                                    - simd::set1(cache_ratio)
+                                    * simd::load(b + w) * simd::load(a + w);
+                                simd::store(o + w, add
+                                    ? simd::load(o + w) + v : v);
+#endif
+                            }, [&](int w) {
+                                o[at<UNIT>(w, ow)] = (add ? o[at<UNIT>(w, ow)]
+                                    : 0) + d[at<UNIT>(w, dw)]
+                                    * power(sc[at<UNIT>(w, sw)], beta)
+                                    - cache_ratio * b[at<UNIT>(w, bw)] * a[w];
+                            });
+                    }
+                }
+            });
+    }
+
+    void LRNDown::compute_cpu(const vector<bool>& add) {
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        vector<Tensor*> tensors = inputs_;
+        tensors.push_back(outputs_[0]);
+        if (unit(tensors)) {
+            lrn_down<true>(inputs_, outputs_[0], size, alpha, beta, add[0]);
+        } else {
+            lrn_down<false>(inputs_, outputs_[0], size, alpha, beta, add[0]);
+        }
+    }
+
+}
@@ -1,4 +1,5 @@
 // Copyright Lin Min 2015
+#include <algorithm>
 
 #include "operations/include/pool.hpp"
 
@@ -18,6 +19,17 @@ namespace purine {
                             bottom_size.height() + 2 * pad_h - kernel_h) / stride_h)) + 1);
         CHECK_EQ(top_size.width(), static_cast<int>(ceil(static_cast<float>(
                             bottom_size.width() + 2 * pad_w - kernel_w) / stride_w)) + 1);
+        CHECK(outputs_.size() == 1 || outputs_.size() == 2);
+        if (outputs_.size() == 2) {
+            CHECK_EQ(method, "max") << "only max pooling has a mask";
+            CHECK_LT(kernel_h * kernel_w, NO_MAX) << "too large for the mask";
+            CHECK_EQ(outputs_[1]->size(), mask_size(top_size));
+            CHECK(outputs_[1]->is_contiguous());
+        }
+        if (inputs_[0]->device() < 0) {
+            return;
+        }
+        CHECK_EQ(outputs_.size(), 1) << "the mask is kept on the cpu only";
         cudnn::createTensor4dDesc<DTYPE>(&bottom_desc_, bottom_size, bottom_stride);
         cudnn::createTensor4dDesc<DTYPE>(&top_desc_, top_size, top_stride);
         cudnnPoolingMode_t mode;
@@ -34,12 +46,99 @@ namespace purine {
                 pad_w, stride_h, stride_w);
     }
 
+    const uint8_t Pool::NO_MAX;
+
+    Size Pool::mask_size(const Size& top) {
+        return Size((top.count() + 3) / 4, 1, 1, 1);
+    }
+
     Pool::~Pool() {
+        if (pool_desc_ == NULL) {
+            return;
+        }
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(bottom_desc_));
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(top_desc_));
         CUDNN_CHECK(cudnnDestroyPoolingDescriptor(pool_desc_));
     }
 
+    /**
+     * The window of top (ph, pw) in bottom, clipped to the bottom. (h0, w0)
+     * is its corner before clipping, which the offsets in the mask are
+     * from. count is the divisor of average pooling, which includes the
+     * padding but not what is past it (as in cudnn and caffe) unless it is
+     * excluded.
+     */
+    struct Window {
+        int h0, w0, hstart, hend, wstart, wend, count;
+    };
+
+    static Window window(const Size& bottom, int ph, int pw, int kernel_h,
+            int kernel_w, int stride_h, int stride_w, int pad_h, int pad_w,
+            bool exclude_padding) {
+        Window win;
+        win.h0 = win.hstart = ph * stride_h - pad_h;
+        win.w0 = win.wstart = pw * stride_w - pad_w;
+        win.hend = std::min(win.hstart + kernel_h, bottom.height() + pad_h);
+        win.wend = std::min(win.wstart + kernel_w, bottom.width() + pad_w);
+        win.count = (win.hend - win.hstart) * (win.wend - win.wstart);
+        win.hstart = std::max(win.hstart, 0);
+        win.wstart = std::max(win.wstart, 0);
+        win.hend = std::min(win.hend, bottom.height());
+        win.wend = std::min(win.wend, bottom.width());
+        if (exclude_padding) {
+            win.count = (win.hend - win.hstart) * (win.wend - win.wstart);
+        }
+        return win;
+    }
+
+    void Pool::compute_cpu(const vector<bool>& add) {
+        Size bs = inputs_[0]->size();
+        Size ts = outputs_[0]->size();
+        Stride bst = inputs_[0]->stride();
+        Stride tst = outputs_[0]->stride();
+        bool max = method == "max";
+        bool exclude = method == "average_exclude_padding";
+        const DTYPE* bottom = inputs_[0]->cpu_data();
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* top = outputs_[0]->mutable_cpu_data();
+        uint8_t* mask = outputs_.size() == 2 ? reinterpret_cast<uint8_t*>(
+                outputs_[1]->mutable_cpu_data()) : NULL;
+        for (int n = 0; n < ts.num(); ++n) {
+            for (int c = 0; c < ts.channels(); ++c) {
+                const DTYPE* b = bottom + n * bst.nstride() + c * bst.cstride();
+                for (int ph = 0; ph < ts.height(); ++ph) {
+                    for (int pw = 0; pw < ts.width(); ++pw) {
+                        Window win = window(bs, ph, pw, kernel_h, kernel_w,
+                                stride_h, stride_w, pad_h, pad_w, exclude);
+                        DTYPE value = 0;
+                        int argmax = -1;
+                        for (int h = win.hstart; h < win.hend; ++h) {
+                            for (int w = win.wstart; w < win.wend; ++w) {
+                                DTYPE x = b[h * bst.hstride() + w * bst.wstride()];
+                                if (!max) {
+                                    value += x;
+                                } else if (argmax < 0 || x > value) {
+                                    value = x;
+                                    argmax = (h - win.h0) * kernel_w
+                                        + w - win.w0;
+                                }
+                            }
+                        }
+                        if (!max && win.count > 0) {
+                            value /= win.count;
+                        }
+                        DTYPE& t = top[n * tst.nstride() + c * tst.cstride()
+                            + ph * tst.hstride() + pw * tst.wstride()];
+                        t = (add[0] ? t : 0) + value;
+                        if (mask != NULL) {
+                            *mask++ = argmax < 0 ? NO_MAX : argmax;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
     void Pool::compute_gpu(const vector<bool>& add) {
         DTYPE alpha = 1.;
         DTYPE beta = add[0] ? 1. : 0.;
@@ -61,6 +160,17 @@ namespace purine {
                                 bottom_size.height() + 2 * pad_h - kernel_h) / stride_h)) + 1);
             CHECK_EQ(top_size.width(), static_cast<int>(ceil(static_cast<float>(
                                 bottom_size.width() + 2 * pad_w - kernel_w) / stride_w)) + 1);
+            CHECK(inputs_.size() == 3 || inputs_.size() == 4);
+            if (inputs_.size() == 4) {
+                CHECK_EQ(method, "max") << "only max pooling has a mask";
+                CHECK_LT(kernel_h * kernel_w, Pool::NO_MAX);
+                CHECK_EQ(inputs_[3]->size(), Pool::mask_size(top_size));
+                CHECK(inputs_[3]->is_contiguous());
+            }
+            if (outputs_[0]->device() < 0) {
+                return;
+            }
+            CHECK_EQ(inputs_.size(), 3) << "the mask is kept on the cpu only";
             Stride bottom_stride = outputs_[0]->stride();
             Stride top_stride = inputs_[0]->stride();
             cudnn::createTensor4dDesc<DTYPE>(&bottom_desc_, bottom_size, bottom_stride);
@@ -80,11 +190,95 @@ namespace purine {
         }
 
     PoolDown::~PoolDown() {
+        if (pool_desc_ == NULL) {
+            return;
+        }
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(bottom_desc_));
         CUDNN_CHECK(cudnnDestroyTensorDescriptor(top_desc_));
         CUDNN_CHECK(cudnnDestroyPoolingDescriptor(pool_desc_));
     }
 
+    // scatters top_diff back to the windows, to the max of each in max
+    // pooling, which is read from the mask or found again in bottom
+    void PoolDown::compute_cpu(const vector<bool>& add) {
+        Size bs = outputs_[0]->size();
+        Size ts = inputs_[0]->size();
+        Stride dst = inputs_[0]->stride();
+        Stride tst = inputs_[1]->stride();
+        Stride bst = inputs_[2]->stride();
+        Stride ost = outputs_[0]->stride();
+        bool max = method == "max";
+        bool exclude = method == "average_exclude_padding";
+        const DTYPE* top_diff = inputs_[0]->cpu_data();
+        const DTYPE* top = inputs_[1]->cpu_data();
+        const DTYPE* bottom = inputs_[2]->cpu_data();
+        const uint8_t* mask = inputs_.size() == 4
+            ? reinterpret_cast<const uint8_t*>(inputs_[3]->cpu_data()) : NULL;
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* bottom_diff = outputs_[0]->mutable_cpu_data();
+        for (int n = 0; n < bs.num(); ++n) {
+            for (int c = 0; c < bs.channels(); ++c) {
+                DTYPE* o = bottom_diff + n * ost.nstride() + c * ost.cstride();
+                if (!add[0]) {
+                    for (int h = 0; h < bs.height(); ++h) {
+                        for (int w = 0; w < bs.width(); ++w) {
+                            o[h * ost.hstride() + w * ost.wstride()] = 0;
+                        }
+                    }
+                }
+                const DTYPE* b = bottom + n * bst.nstride() + c * bst.cstride();
+                for (int ph = 0; ph < ts.height(); ++ph) {
+                    for (int pw = 0; pw < ts.width(); ++pw) {
+                        Window win = window(bs, ph, pw, kernel_h, kernel_w,
+                                stride_h, stride_w, pad_h, pad_w, exclude);
+                        DTYPE diff = top_diff[n * dst.nstride()
+                            + c * dst.cstride() + ph * dst.hstride()
+                            + pw * dst.wstride()];
+                        if (!max) {
+                            if (win.count == 0) {
+                                continue;
+                            }
+                            diff /= win.count;
+                            for (int h = win.hstart; h < win.hend; ++h) {
+                                for (int w = win.wstart; w < win.wend; ++w) {
+                                    o[h * ost.hstride() + w * ost.wstride()]
+                                        += diff;
+                                }
+                            }
+                            continue;
+                        }
+                        int argmax = -1;
+                        if (mask != NULL) {
+                            uint8_t offset = mask[((n * ts.channels() + c)
+                                    * ts.height() + ph) * ts.width() + pw];
+                            argmax = offset == Pool::NO_MAX ? -1 : offset;
+                        } else {
+                            DTYPE value = top[n * tst.nstride()
+                                + c * tst.cstride() + ph * tst.hstride()
+                                + pw * tst.wstride()];
+                            for (int h = win.hstart; h < win.hend
+                                    && argmax < 0; ++h) {
+                                for (int w = win.wstart; w < win.wend; ++w) {
+                                    if (b[h * bst.hstride() + w * bst.wstride()]
+                                            == value) {
+                                        argmax = (h - win.h0) * kernel_w
+                                            + w - win.w0;
+                                        break;
+                                    }
+                                }
+                            }
+                        }
+                        if (argmax >= 0) {
+                            int h = win.h0 + argmax / kernel_w;
+                            int w = win.w0 + argmax % kernel_w;
+                            o[h * ost.hstride() + w * ost.wstride()] += diff;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
     void PoolDown::compute_gpu(const vector<bool>& add) {
         DTYPE alpha = 1.;
         DTYPE beta = add[0] ? 1. : 0.;
@@ -0,0 +1,24 @@
+// Copyright Lin Min 2015
+#include "operations/include/release.hpp"
+
+namespace purine {
+
+Release::Release(const vector<Tensor*>& inputs,
+    const vector<Tensor*>& outputs, const param_tuple& args)
+    : Operation(inputs, outputs) {
+}
+
+void Release::compute_cpu(const vector<bool>& add) {
+  for (Tensor* input : inputs_) {
+    input->release();
+  }
+}
+
+// cudaFree waits for the kernels still reading the memory
+void Release::compute_gpu(const vector<bool>& add) {
+  for (Tensor* input : inputs_) {
+    input->release();
+  }
+}
+
+}
@@ -0,0 +1,73 @@
+// Copyright Lin Min 2015
+#include "operations/include/reorder.hpp"
+
+namespace purine {
+
+    Reorder::Reorder(const vector<Tensor*>& inputs,
+            const vector<Tensor*>& outputs, const param_tuple& args)
+        : Operation(inputs, outputs) {
+        CHECK_EQ(inputs_.size(), 1);
+        CHECK_EQ(outputs_.size(), 1);
+        CHECK_EQ(inputs_[0]->size(), outputs_[0]->size());
+        CHECK_EQ(inputs_[0]->device(), outputs_[0]->device());
+        if (inputs_[0]->device() < 0) {
+            return;
+        }
+        cudnn::createTensor4dDesc<DTYPE>(&bottom_desc_, inputs_[0]->size(),
+                inputs_[0]->stride());
+        cudnn::createTensor4dDesc<DTYPE>(&top_desc_, outputs_[0]->size(),
+                outputs_[0]->stride());
+    }
+
+    Reorder::~Reorder() {
+        if (bottom_desc_ == NULL) {
+            return;
+        }
+        CUDNN_CHECK(cudnnDestroyTensorDescriptor(bottom_desc_));
+        CUDNN_CHECK(cudnnDestroyTensorDescriptor(top_desc_));
+    }
+
+    void Reorder::compute_cpu(const vector<bool>& add) {
+        Size s = outputs_[0]->size();
+        Stride bs = inputs_[0]->stride();
+        Stride ts = outputs_[0]->stride();
+        const DTYPE* bottom = inputs_[0]->cpu_data();
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        DTYPE* top = outputs_[0]->mutable_cpu_data();
+        // the innermost loop along the innermost dimension of top
+        bool nhwc = outputs_[0]->layout() == NHWC;
+        int outer = nhwc ? s.height() : s.channels();
+        int middle = nhwc ? s.width() : s.height();
+        int inner = nhwc ? s.channels() : s.width();
+        int b_outer = nhwc ? bs.hstride() : bs.cstride();
+        int b_middle = nhwc ? bs.wstride() : bs.hstride();
+        int b_inner = nhwc ? bs.cstride() : bs.wstride();
+        int t_outer = nhwc ? ts.hstride() : ts.cstride();
+        int t_middle = nhwc ? ts.wstride() : ts.hstride();
+        int t_inner = nhwc ? ts.cstride() : ts.wstride();
+        for (int n = 0; n < s.num(); ++n) {
+            for (int i = 0; i < outer; ++i) {
+                for (int j = 0; j < middle; ++j) {
+                    const DTYPE* b = bottom + n * bs.nstride() + i * b_outer
+                        + j * b_middle;
+                    DTYPE* t = top + n * ts.nstride() + i * t_outer
+                        + j * t_middle;
+                    for (int k = 0; k < inner; ++k) {
+                        t[k * t_inner] = (add[0] ? t[k * t_inner] : 0)
+                            + b[k * b_inner];
+                    }
+                }
+            }
+        }
+    }
+
+    void Reorder::compute_gpu(const vector<bool>& add) {
+        DTYPE alpha = 1.;
+        DTYPE beta = add[0] ? 1. : 0.;
+        std::lock_guard<std::mutex>lock_guard_(outputs_[0]->get_mutex());
+        CUDNN_CHECK(cudnnTransformTensor(cudnn_handle(), &alpha, bottom_desc_,
+                    inputs_[0]->gpu_data(), &beta, top_desc_,
+                    outputs_[0]->mutable_gpu_data()));
+    }
+
+}
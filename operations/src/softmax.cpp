@@ -1,10 +1,13 @@
 // Copyright Lin Min 2015
-#include <string>
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
+#include <string>
 
 #include "operations/include/softmax.hpp"
 #include "operations/cudnn.hpp"
 #include "caffeine/math_functions.hpp"
+#include "operations/simd.hpp"
 
 using std::string;
 
@@ -141,4 +144,192 @@ namespace purine {
                 bottom_diff);
     }
 
+    SoftmaxCrossEntropy::SoftmaxCrossEntropy(const vector<Tensor*>& inputs,
+            const vector<Tensor*>& outputs, const param_tuple& args)
+        : Operation(inputs, outputs) {
+            CHECK_EQ(inputs_.size(), 3);
+            CHECK_EQ(outputs_.size(), 3);
+            CHECK_EQ(inputs_[0]->device(), -1) << "on the cpu only";
+            CHECK_EQ(outputs_[0]->size(), inputs_[0]->size());
+            CHECK_EQ(outputs_[1]->size(), Size(1, 1, 1, 1));
+            CHECK_EQ(outputs_[2]->size(), inputs_[0]->size());
+            CHECK_EQ(inputs_[1]->size().num(), inputs_[0]->size().num());
+            CHECK_EQ(inputs_[1]->size().height(), inputs_[0]->size().height());
+            CHECK_EQ(inputs_[1]->size().width(), inputs_[0]->size().width());
+        }
+
+    // the label at position index, a channel of the bottom
+    static inline int label_at(const DTYPE* label, int index, int channels) {
+        int l = static_cast<int>(label[index]);
+        CHECK_GE(l, 0) << "label " << label[index] << " at " << index;
+        CHECK_LT(l, channels) << "label " << label[index] << " at " << index;
+        return l;
+    }
+
+    /**
+     * softmax, loss and diff of the position at x, whose channels are stride
+     * apart. Returns the loss log(sum) - (x[l] - max).
+     */
+    static inline double position(const DTYPE* x, DTYPE* p, DTYPE* diff,
+            int stride, int channels, int l, DTYPE scale, bool add) {
+        DTYPE max = x[0];
+        for (int c = 1; c < channels; ++c) {
+            max = std::max(max, x[c * stride]);
+        }
+        float sum = 0;
+        for (int c = 0; c < channels; ++c) {
+            float e = simd::exp_approx(x[c * stride] - max);
+            p[c * stride] = e;
+            sum += e;
+        }
+        DTYPE inv = 1. / sum;
+        for (int c = 0; c < channels; ++c) {
+            p[c * stride] *= inv;
+            diff[c * stride] = (add ? diff[c * stride] : 0)
+                + scale * p[c * stride];
+        }
+        diff[l * stride] -= scale;
+        return std::log(sum) - (x[l * stride] - max);
+    }
+
+#ifdef __AVX2__
+    // position() of a row of contiguous channels, 8 channels at a time
+    static inline double row(const DTYPE* x, DTYPE* p, DTYPE* diff,
+            int channels, int l, DTYPE scale, bool add) {
+        int c = 0;
+        __m256 vmax = _mm256_set1_ps(x[0]);
+        for (; c + 8 <= channels; c += 8) {
+            vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(x + c));
+        }
+        DTYPE max = simd::max(vmax);
+        for (; c < channels; ++c) {
+            max = std::max(max, x[c]);
+        }
+        vmax = _mm256_set1_ps(max);
+        __m256 vsum = _mm256_setzero_ps();
+        for (c = 0; c + 8 <= channels; c += 8) {
+            __m256 e = simd::exp_approx(_mm256_sub_ps(_mm256_loadu_ps(x + c),
+                        vmax));
+            _mm256_storeu_ps(p + c, e);
+            vsum = _mm256_add_ps(vsum, e);
+        }
+        float sum = simd::sum(vsum);
+        for (; c < channels; ++c) {
+            p[c] = simd::exp_approx(x[c] - max);
+            sum += p[c];
+        }
+        DTYPE inv = 1. / sum;
+        __m256 vinv = _mm256_set1_ps(inv);
+        __m256 vscale = _mm256_set1_ps(scale);
+        for (c = 0; c + 8 <= channels; c += 8) {
+            __m256 pc = _mm256_mul_ps(_mm256_loadu_ps(p + c), vinv);
+            _mm256_storeu_ps(p + c, pc);
+            __m256 d = _mm256_mul_ps(vscale, pc);
+            if (add) {
+                d = _mm256_add_ps(d, _mm256_loadu_ps(diff + c));
+            }
+            _mm256_storeu_ps(diff + c, d);
+        }
+        for (; c < channels; ++c) {
+            p[c] *= inv;
+            diff[c] = (add ? diff[c] : 0) + scale * p[c];
+        }
+        diff[l] -= scale;
+        return std::log(sum) - (x[l] - max);
+    }
+
+    /**
+     * position() of the 8 positions from x, one in each lane: the channels
+     * are stride apart and the positions contiguous. l holds their labels.
+     */
+    static inline double positions(const DTYPE* x, DTYPE* p, DTYPE* diff,
+            int stride, int channels, const int* l, DTYPE scale, bool add) {
+        __m256 vmax = _mm256_loadu_ps(x);
+        for (int c = 1; c < channels; ++c) {
+            vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(x + c * stride));
+        }
+        __m256 vsum = _mm256_setzero_ps();
+        for (int c = 0; c < channels; ++c) {
+            __m256 e = simd::exp_approx(_mm256_sub_ps(
+                        _mm256_loadu_ps(x + c * stride), vmax));
+            _mm256_storeu_ps(p + c * stride, e);
+            vsum = _mm256_add_ps(vsum, e);
+        }
+        __m256 vinv = _mm256_div_ps(_mm256_set1_ps(1.f), vsum);
+        __m256 vscale = _mm256_set1_ps(scale);
+        for (int c = 0; c < channels; ++c) {
+            __m256 pc = _mm256_mul_ps(_mm256_loadu_ps(p + c * stride), vinv);
+            _mm256_storeu_ps(p + c * stride, pc);
+            __m256 d = _mm256_mul_ps(vscale, pc);
+            if (add) {
+                d = _mm256_add_ps(d, _mm256_loadu_ps(diff + c * stride));
+            }
+            _mm256_storeu_ps(diff + c * stride, d);
+        }
+        float max[8];
+        float sum[8];
+        _mm256_storeu_ps(max, vmax);
+        _mm256_storeu_ps(sum, vsum);
+        double loss = 0;
+        for (int k = 0; k < 8; ++k) {
+            diff[l[k] * stride + k] -= scale;
+            loss += std::log(sum[k]) - (x[l[k] * stride + k] - max[k]);
+        }
+        return loss;
+    }
+#endif
+
+    /**
+     * For each position, the exps of x - max go into softmax, whose sum
+     * gives the loss log(sum) - (x[label] - max) without the log of a
+     * probability, then the probabilities are normalized and the diff
+     * written in the same loop. softmax is always overwritten.
+     * With AVX2, the lanes run along the channels when each image has a
+     * single position, else along the positions.
+     */
+    void SoftmaxCrossEntropy::compute_cpu(const vector<bool>& add) {
+        const DTYPE* bottom = inputs_[0]->cpu_data();
+        const DTYPE* label = inputs_[1]->cpu_data();
+        Size size = inputs_[0]->size();
+        int num = size.num();
+        int channels = size.channels();
+        int spatial_dim = size.height() * size.width();
+        int dim = channels * spatial_dim;
+        DTYPE scale = inputs_[2]->cpu_data()[0] / num / spatial_dim;
+        std::lock_guard<std::mutex>softmax_lock(outputs_[0]->get_mutex());
+        std::lock_guard<std::mutex>loss_lock(outputs_[1]->get_mutex());
+        std::lock_guard<std::mutex>diff_lock(outputs_[2]->get_mutex());
+        DTYPE* softmax = outputs_[0]->mutable_cpu_data();
+        DTYPE* bottom_diff = outputs_[2]->mutable_cpu_data();
+        double loss = 0;
+        for (int i = 0; i < num; ++i) {
+            const DTYPE* x = bottom + i * dim;
+            DTYPE* p = softmax + i * dim;
+            DTYPE* diff = bottom_diff + i * dim;
+            int j = 0;
+#ifdef __AVX2__
+            if (spatial_dim == 1) {
+                loss += row(x, p, diff, channels, label_at(label, i, channels),
+                        scale, add[2]);
+                continue;
+            }
+            for (; j + 8 <= spatial_dim; j += 8) {
+                int l[8];
+                for (int k = 0; k < 8; ++k) {
+                    l[k] = label_at(label, i * spatial_dim + j + k, channels);
+                }
+                loss += positions(x + j, p + j, diff + j, spatial_dim,
+                        channels, l, scale, add[2]);
+            }
+#endif
+            for (; j < spatial_dim; ++j) {
+                loss += position(x + j, p + j, diff + j, spatial_dim, channels,
+                        label_at(label, i * spatial_dim + j, channels), scale,
+                        add[2]);
+            }
+        }
+        DTYPE* top_loss = outputs_[1]->mutable_cpu_data();
+        *top_loss = (add[1] ? *top_loss : 0) + loss / num / spatial_dim;
+    }
+
 }
@@ -0,0 +1,332 @@
+// Copyright Lin Min 2015
+#include "caffeine/math_functions.hpp"
+#include "operations/include/winograd.hpp"
+
+namespace purine {
+
+    // F(2x2, 3x3)
+    static const DTYPE BT2[] = {
+        1,  0, -1,  0,
+        0,  1,  1,  0,
+        0, -1,  1,  0,
+        0,  1,  0, -1 };
+    static const DTYPE G2[] = {
+        1,    0,   0,
+        0.5,  0.5, 0.5,
+        0.5, -0.5, 0.5,
+        0,    0,   1 };
+    static const DTYPE AT2[] = {
+        1, 1,  1,  0,
+        0, 1, -1, -1 };
+
+    // F(4x4, 3x3)
+    static const DTYPE BT4[] = {
+        4,  0, -5,  0, 1, 0,
+        0, -4, -4,  1, 1, 0,
+        0,  4, -4, -1, 1, 0,
+        0, -2, -1,  2, 1, 0,
+        0,  2, -1, -2, 1, 0,
+        0,  4,  0, -5, 0, 1 };
+    static const DTYPE G4[] = {
+        1. / 4,   0,       0,
+        -1. / 6,  -1. / 6,  -1. / 6,
+        -1. / 6,  1. / 6,   -1. / 6,
+        1. / 24,  1. / 12,  1. / 6,
+        1. / 24,  -1. / 12, 1. / 6,
+        0,        0,        1 };
+    static const DTYPE AT4[] = {
+        1, 1,  1, 1,  1, 0,
+        0, 1, -1, 2, -2, 0,
+        0, 1,  1, 4,  4, 0,
+        0, 1, -1, 8, -8, 1 };
+
+    static vector<DTYPE> transposed(const DTYPE* mat, int rows, int cols) {
+        vector<DTYPE> ret(rows * cols);
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                ret[j * rows + i] = mat[i * cols + j];
+            }
+        }
+        return ret;
+    }
+
+    // out (rows x rows) = mat (rows x cols) * in (cols x cols) * mat'
+    static void sandwich(const DTYPE* mat, int rows, int cols, const DTYPE* in,
+            DTYPE* out) {
+        DTYPE tmp[6 * 6];
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                DTYPE sum = 0;
+                for (int k = 0; k < cols; ++k) {
+                    sum += mat[i * cols + k] * in[k * cols + j];
+                }
+                tmp[i * cols + j] = sum;
+            }
+        }
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < rows; ++j) {
+                DTYPE sum = 0;
+                for (int k = 0; k < cols; ++k) {
+                    sum += tmp[i * cols + k] * mat[j * cols + k];
+                }
+                out[i * rows + j] = sum;
+            }
+        }
+    }
+
+    Winograd::Winograd(int m, const Size& bottom, const Size& top, int pad_h,
+            int pad_w) : m_(m), alpha_(m + 2), pad_h_(pad_h), pad_w_(pad_w),
+        bottom_size_(bottom), top_size_(top) {
+        CHECK(m == 2 || m == 4) << "F(" << m << "x" << m << ", 3x3) is not "
+            "implemented";
+        CHECK_EQ(bottom.height() + 2 * pad_h - 2, top.height());
+        CHECK_EQ(bottom.width() + 2 * pad_w - 2, top.width());
+        tiles_h_ = (top.height() + m - 1) / m;
+        tiles_w_ = (top.width() + m - 1) / m;
+        const DTYPE* bt = m == 2 ? BT2 : BT4;
+        const DTYPE* g = m == 2 ? G2 : G4;
+        const DTYPE* at = m == 2 ? AT2 : AT4;
+        BT_.assign(bt, bt + alpha_ * alpha_);
+        B_ = transposed(bt, alpha_, alpha_);
+        G_.assign(g, g + alpha_ * 3);
+        GT_ = transposed(g, alpha_, 3);
+        AT_.assign(at, at + m * alpha_);
+        A_ = transposed(at, m, alpha_);
+        int points = alpha_ * alpha_;
+        int tiles = tiles_h_ * tiles_w_;
+        U_.resize(points * top.channels() * bottom.channels());
+        V_.resize(points * bottom.channels() * tiles);
+        M_.resize(points * top.channels() * tiles);
+    }
+
+    bool Winograd::supported(const Size& kernel, int stride_h, int stride_w) {
+        return kernel.height() == 3 && kernel.width() == 3 && stride_h == 1
+            && stride_w == 1;
+    }
+
+    void Winograd::transform_filter(Tensor* weight) {
+        const DTYPE* data = weight->cpu_data();
+        if (data == filter_data_ && weight->version() == filter_version_) {
+            return;
+        }
+        int K = top_size_.channels();
+        int C = bottom_size_.channels();
+        Stride st = weight->stride();
+        DTYPE g[3 * 3];
+        DTYPE u[6 * 6];
+        for (int k = 0; k < K; ++k) {
+            for (int c = 0; c < C; ++c) {
+                const DTYPE* filter = data + k * st.nstride() + c * st.cstride();
+                for (int i = 0; i < 3; ++i) {
+                    for (int j = 0; j < 3; ++j) {
+                        g[i * 3 + j] = filter[i * st.hstride() + j * st.wstride()];
+                    }
+                }
+                sandwich(&G_[0], alpha_, 3, g, u);
+                for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                    U_[(xi * K + k) * C + c] = u[xi];
+                }
+            }
+        }
+        filter_data_ = data;
+        filter_version_ = weight->version();
+    }
+
+    void Winograd::transform_bottom(Tensor* bottom, int n) {
+        int C = bottom_size_.channels();
+        int H = bottom_size_.height();
+        int W = bottom_size_.width();
+        int tiles = tiles_h_ * tiles_w_;
+        Stride st = bottom->stride();
+        const DTYPE* data = bottom->cpu_data() + n * st.nstride();
+        DTYPE d[6 * 6];
+        DTYPE v[6 * 6];
+        for (int c = 0; c < C; ++c) {
+            const DTYPE* image = data + c * st.cstride();
+            for (int ty = 0; ty < tiles_h_; ++ty) {
+                for (int tx = 0; tx < tiles_w_; ++tx) {
+                    for (int i = 0; i < alpha_; ++i) {
+                        int y = ty * m_ - pad_h_ + i;
+                        for (int j = 0; j < alpha_; ++j) {
+                            int x = tx * m_ - pad_w_ + j;
+                            d[i * alpha_ + j] = y >= 0 && y < H && x >= 0 && x < W
+                                ? image[y * st.hstride() + x * st.wstride()] : 0;
+                        }
+                    }
+                    sandwich(&BT_[0], alpha_, alpha_, d, v);
+                    int t = ty * tiles_w_ + tx;
+                    for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                        V_[(xi * C + c) * tiles + t] = v[xi];
+                    }
+                }
+            }
+        }
+    }
+
+    void Winograd::transform_top_diff(Tensor* top_diff, int n) {
+        int K = top_size_.channels();
+        int H = top_size_.height();
+        int W = top_size_.width();
+        int tiles = tiles_h_ * tiles_w_;
+        Stride st = top_diff->stride();
+        const DTYPE* data = top_diff->cpu_data() + n * st.nstride();
+        DTYPE dy[4 * 4];
+        DTYPE z[6 * 6];
+        for (int k = 0; k < K; ++k) {
+            const DTYPE* image = data + k * st.cstride();
+            for (int ty = 0; ty < tiles_h_; ++ty) {
+                for (int tx = 0; tx < tiles_w_; ++tx) {
+                    for (int i = 0; i < m_; ++i) {
+                        int y = ty * m_ + i;
+                        for (int j = 0; j < m_; ++j) {
+                            int x = tx * m_ + j;
+                            dy[i * m_ + j] = y < H && x < W
+                                ? image[y * st.hstride() + x * st.wstride()] : 0;
+                        }
+                    }
+                    sandwich(&A_[0], alpha_, m_, dy, z);
+                    int t = ty * tiles_w_ + tx;
+                    for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                        M_[(xi * K + k) * tiles + t] = z[xi];
+                    }
+                }
+            }
+        }
+    }
+
+    void Winograd::forward(Tensor* bottom, Tensor* weight, Tensor* top,
+            bool add) {
+        transform_filter(weight);
+        int K = top_size_.channels();
+        int C = bottom_size_.channels();
+        int H = top_size_.height();
+        int W = top_size_.width();
+        int tiles = tiles_h_ * tiles_w_;
+        Stride st = top->stride();
+        DTYPE* top_data = top->mutable_cpu_data();
+        DTYPE mm[6 * 6];
+        DTYPE y[4 * 4];
+        for (int n = 0; n < top_size_.num(); ++n) {
+            transform_bottom(bottom, n);
+            for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                caffe::caffe_cpu_gemm<DTYPE>(CblasNoTrans, CblasNoTrans, K, tiles,
+                        C, (DTYPE)1., &U_[xi * K * C], &V_[xi * C * tiles],
+                        (DTYPE)0., &M_[xi * K * tiles]);
+            }
+            for (int k = 0; k < K; ++k) {
+                DTYPE* image = top_data + n * st.nstride() + k * st.cstride();
+                for (int t = 0; t < tiles; ++t) {
+                    for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                        mm[xi] = M_[(xi * K + k) * tiles + t];
+                    }
+                    sandwich(&AT_[0], m_, alpha_, mm, y);
+                    int ty = t / tiles_w_;
+                    int tx = t % tiles_w_;
+                    for (int i = 0; i < m_ && ty * m_ + i < H; ++i) {
+                        for (int j = 0; j < m_ && tx * m_ + j < W; ++j) {
+                            DTYPE& out = image[(ty * m_ + i) * st.hstride()
+                                + (tx * m_ + j) * st.wstride()];
+                            out = (add ? out : 0) + y[i * m_ + j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void Winograd::backward_data(Tensor* top_diff, Tensor* weight,
+            Tensor* bottom_diff, bool add) {
+        transform_filter(weight);
+        int K = top_size_.channels();
+        int C = bottom_size_.channels();
+        int H = bottom_size_.height();
+        int W = bottom_size_.width();
+        int tiles = tiles_h_ * tiles_w_;
+        Stride st = bottom_diff->stride();
+        DTYPE* bottom_data = bottom_diff->mutable_cpu_data();
+        if (!add) {
+            for (int n = 0; n < bottom_size_.num(); ++n) {
+                for (int c = 0; c < C; ++c) {
+                    for (int y = 0; y < H; ++y) {
+                        for (int x = 0; x < W; ++x) {
+                            bottom_data[n * st.nstride() + c * st.cstride()
+                                + y * st.hstride() + x * st.wstride()] = 0;
+                        }
+                    }
+                }
+            }
+        }
+        DTYPE nn[6 * 6];
+        DTYPE dd[6 * 6];
+        for (int n = 0; n < bottom_size_.num(); ++n) {
+            transform_top_diff(top_diff, n);
+            for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                caffe::caffe_cpu_gemm<DTYPE>(CblasTrans, CblasNoTrans, C, tiles,
+                        K, (DTYPE)1., &U_[xi * K * C], &M_[xi * K * tiles],
+                        (DTYPE)0., &V_[xi * C * tiles]);
+            }
+            for (int c = 0; c < C; ++c) {
+                DTYPE* image = bottom_data + n * st.nstride() + c * st.cstride();
+                for (int t = 0; t < tiles; ++t) {
+                    for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                        nn[xi] = V_[(xi * C + c) * tiles + t];
+                    }
+                    sandwich(&B_[0], alpha_, alpha_, nn, dd);
+                    int ty = t / tiles_w_;
+                    int tx = t % tiles_w_;
+                    // the tiles overlap, and cover the padding
+                    for (int i = 0; i < alpha_; ++i) {
+                        int y = ty * m_ - pad_h_ + i;
+                        if (y < 0 || y >= H) {
+                            continue;
+                        }
+                        for (int j = 0; j < alpha_; ++j) {
+                            int x = tx * m_ - pad_w_ + j;
+                            if (x >= 0 && x < W) {
+                                image[y * st.hstride() + x * st.wstride()]
+                                    += dd[i * alpha_ + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void Winograd::backward_filter(Tensor* top_diff, Tensor* bottom,
+            Tensor* weight_diff, bool add) {
+        int K = top_size_.channels();
+        int C = bottom_size_.channels();
+        int tiles = tiles_h_ * tiles_w_;
+        dU_.resize(alpha_ * alpha_ * K * C);
+        for (int n = 0; n < bottom_size_.num(); ++n) {
+            transform_bottom(bottom, n);
+            transform_top_diff(top_diff, n);
+            for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                caffe::caffe_cpu_gemm<DTYPE>(CblasNoTrans, CblasTrans, K, C,
+                        tiles, (DTYPE)1., &M_[xi * K * tiles], &V_[xi * C * tiles],
+                        (DTYPE)(n == 0 ? 0. : 1.), &dU_[xi * K * C]);
+            }
+        }
+        Stride st = weight_diff->stride();
+        DTYPE* data = weight_diff->mutable_cpu_data();
+        DTYPE mm[6 * 6];
+        DTYPE g[3 * 3];
+        for (int k = 0; k < K; ++k) {
+            for (int c = 0; c < C; ++c) {
+                for (int xi = 0; xi < alpha_ * alpha_; ++xi) {
+                    mm[xi] = dU_[(xi * K + k) * C + c];
+                }
+                sandwich(&GT_[0], 3, alpha_, mm, g);
+                DTYPE* filter = data + k * st.nstride() + c * st.cstride();
+                for (int i = 0; i < 3; ++i) {
+                    for (int j = 0; j < 3; ++j) {
+                        DTYPE& out = filter[i * st.hstride() + j * st.wstride()];
+                        out = (add ? out : 0) + g[i * 3 + j];
+                    }
+                }
+            }
+        }
+    }
+
+}
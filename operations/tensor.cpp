@@ -14,6 +14,12 @@ namespace purine {
             stride_ = Stride(size);
         }
 
+    Tensor::Tensor(int rank, int device, const Size& size, Layout layout)
+        : size_(size), rank_(rank), device_(device) {
+            offset_ = Offset(0, 0, 0, 0);
+            stride_ = Stride(size, layout);
+        }
+
     Tensor::~Tensor() {
         data_.reset();
     }
@@ -76,6 +82,8 @@ namespace purine {
         CHECK_EQ(other->stride_, stride_);
         CHECK_EQ(other->offset_, offset_);
         this->data_.swap(other->data_);
+        ++version_;
+        ++other->version_;
     }
 
     void Tensor::slice_from(Tensor* other, const Offset& off, const Size& size) {
@@ -106,6 +114,30 @@ namespace purine {
         data_.reset();
     }
 
+    bool Tensor::release() {
+        if (!data_ || data_.use_count() > 1) {
+            return false;
+        }
+        data_.reset();
+        return true;
+    }
+
+    void Tensor::alias(Tensor* other) {
+        CHECK(other->data_);
+        CHECK(is_contiguous());
+        CHECK_LE(data_.use_count(), 1) << "can not alias a slice";
+        CHECK_EQ(rank_, other->rank_);
+        CHECK_EQ(device_, other->device_);
+        CHECK_LE(size_.count(), other->size_.count());
+        data_ = other->data_;
+    }
+
+    void Tensor::set_layout(Layout layout) {
+        CHECK(!data_) << "the layout is set before the memory is allocated";
+        CHECK(is_contiguous());
+        stride_ = Stride(size_, layout);
+    }
+
     const DTYPE* Tensor::data() const {
         CHECK(data_);
         // #ifndef NDEBUG
@@ -125,6 +157,7 @@ namespace purine {
 
     DTYPE* Tensor::mutable_data() {
         CHECK_EQ(current_rank(), rank_) << "can't access data from a different rank";
+        ++version_;
         if (!data_) {
             CHECK(is_contiguous());
             DTYPE* ptr;
@@ -160,7 +193,7 @@ namespace purine {
     }
 
     bool Tensor::is_contiguous() const {
-        return Stride(size_) == stride_;
+        return Stride(size_) == stride_ || Stride(size_, NHWC) == stride_;
     }
 
 }
@@ -25,6 +25,7 @@ class Tensor {
   explicit Tensor(int rank, int device, const Size& size,
       const Offset& offset, const Stride& stride);
   explicit Tensor(int rank, int device, const Size& size);
+  explicit Tensor(int rank, int device, const Size& size, Layout layout);
   virtual ~Tensor();
 
   inline const Size& size() const { return size_; }
@@ -32,11 +33,26 @@ class Tensor {
   inline const Offset& offset() const { return offset_; }
   inline int rank() const { return rank_; }
   inline int device() const { return device_; }
+  // changes whenever the data may have changed (mutable_data, swap_memory),
+  // so that derived data (e.g. transformed filters) can be cached.
+  inline int64_t version() const { return version_; }
+  // NHWC if the channels are the innermost dimension, of slices too
+  inline Layout layout() const {
+    return stride_.cstride() < stride_.wstride() ? NHWC : NCHW;
+  }
 
   void swap_memory(Tensor* other);
   void share_from(Tensor* other);
   void slice_from(Tensor* other, const Offset& off, const Size& size);
   void delete_data();
+  // free the memory unless another tensor shares it (slices), the next
+  // mutable_data allocates it again. returns whether it was freed.
+  bool release();
+  // use the memory of other (at least as large) as own contiguous memory,
+  // so that tensors not live at the same time can share a buffer.
+  void alias(Tensor* other);
+  // change the layout of a packed tensor, before its memory is allocated
+  void set_layout(Layout layout);
   void print();
 
   inline DTYPE* mutable_gpu_data() {
@@ -58,6 +74,7 @@ class Tensor {
   DTYPE* mutable_data();
   const DTYPE* data() const;
 
+  // packed, in either layout
   bool is_contiguous() const;
 
   std::mutex& get_mutex(){
@@ -71,6 +88,7 @@ class Tensor {
   shared_ptr<DTYPE> data_;
   int rank_;
   int device_;
+  int64_t version_ = 0;
   // static
   static int offset(const Offset& off, const Stride& stride);
   static void alloc_mem(DTYPE** data, const Size& size, int rank, int device);
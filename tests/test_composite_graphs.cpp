@@ -10,6 +10,10 @@
 #include "dispatch/runnable.hpp"
 #include "dispatch/graph_template.hpp"
 #include "composite/graph/copy.hpp"
+#include "composite/graph/all_reduce.hpp"
+#include "composite/graph/data_parallel.hpp"
+#include "composite/layers/inner_prod_layer.hpp"
+#include "composite/layers/softmaxloss_layer.hpp"
 
 using namespace std;
 using namespace purine;
@@ -202,3 +206,95 @@ TEST_CASE("TestCopy", "[Copy]") {
     }
   }
 }
+
+// a softmax classifier of 6 features on the cpu, as a DataParallel replica
+class Linear : public Graph {
+ protected:
+  Blob* data_;
+  Blob* data_diff_;
+  Blob* label_;
+  vector<Blob*> weight_data_;
+  vector<Blob*> weight_diff_;
+  vector<Blob*> loss_;
+ public:
+  Linear(int rank, int device, int batch) : Graph(rank, device) {
+    data_ = create("data", { batch, 6, 1, 1 });
+    data_diff_ = create("data_diff", { batch, 6, 1, 1 });
+    label_ = create("label", { batch, 1, 1, 1 });
+    InnerProdLayer* fc = createGraph<InnerProdLayer>("fc",
+        InnerProdLayer::param_tuple(4, ""));
+    SoftmaxLossLayer* loss = createGraph<SoftmaxLossLayer>("loss",
+        SoftmaxLossLayer::param_tuple(1.));
+    B{ data_, data_diff_ } >> *fc;
+    loss->set_label(label_);
+    *fc >> *loss;
+    weight_data_ = fc->weight_data();
+    weight_diff_ = fc->weight_diff();
+    loss_ = { loss->loss()[0] };
+  }
+  inline const vector<Blob*>& weight_data() { return weight_data_; }
+  inline const vector<Blob*>& weight_diff() { return weight_diff_; }
+  inline vector<Blob*> data() { return { data_ }; }
+  inline vector<Blob*> label() { return { label_ }; }
+  inline vector<Blob*> data_diff() { return { data_diff_ }; }
+  inline vector<Blob*> loss() { return loss_; }
+};
+
+TEST_CASE("TestAccumulation", "[DataParallel]") {
+  // M micro batches of b against one batch of M * b, on rank 0
+  int M = 3;
+  int b = 4;
+  typedef DataParallel<Linear, AllReduce> Parallel;
+  shared_ptr<Parallel> whole(new Parallel({ { 0, -1, M * b } }));
+  shared_ptr<Parallel> micro(new Parallel({ { 0, -1, b } }));
+  micro->set_accumulation(M);
+  vector<AllReduce::param_tuple> param(2,
+      AllReduce::param_tuple(0.9, 0.1, 0.001));
+  whole->setup_param_server(vector<int>(2, 0), vector<int>(2, -1), param);
+  micro->setup_param_server(vector<int>(2, 0), vector<int>(2, -1), param);
+  // the same weights: micro takes those of whole, which gets them back
+  whole->init<Gaussian>({ 0, 1 }, Gaussian::param_tuple(0., 0.5));
+  micro->load_from(whole.get());
+  if (current_rank() != 0) {
+    return;
+  }
+  for (int i = 0; i < 2; ++i) {
+    shared_ptr<Tensor> from = micro->param_server(i)->weight();
+    caffe::caffe_cpu_copy(from->size().count(), from->cpu_data(),
+        whole->param_server(i)->weight()->mutable_cpu_data());
+  }
+  Runnable inputs;
+  auto batch = [&](int offset, int num)->vector<B> {
+    Blob* data = inputs.create("data", 0, -1, { num, 6, 1, 1 });
+    Blob* label = inputs.create("label", 0, -1, { num, 1, 1, 1 });
+    for (int i = 0; i < num * 6; ++i) {
+      data->tensor()->mutable_cpu_data()[i] =
+        (((offset * 6 + i) * 7919) % 1000) / 500. - 1.;
+    }
+    for (int i = 0; i < num; ++i) {
+      label->tensor()->mutable_cpu_data()[i] = (offset + i) % 4;
+    }
+    return { { data }, { label } };
+  };
+  vector<B> all = batch(0, M * b);
+  whole->feed(all[0], all[1]);
+  whole->run_async();
+  whole->sync();
+  for (int m = 0; m < M; ++m) {
+    vector<B> part = batch(m * b, b);
+    micro->feed(part[0], part[1]);
+    micro->run_async();
+    micro->sync();
+  }
+  // the diffs of micro are weighted by 1 / M when aggregated
+  for (int i = 0; i < 2; ++i) {
+    AllReduce* w = whole->param_server(i);
+    AllReduce* m = micro->param_server(i);
+    for (int j = 0; j < w->weight()->size().count(); ++j) {
+      REQUIRE(m->weight_diff()->cpu_data()[j]
+          == Approx(w->weight_diff()->cpu_data()[j]).epsilon(1e-4));
+      REQUIRE(m->weight()->cpu_data()[j]
+          == Approx(w->weight()->cpu_data()[j]).epsilon(1e-4));
+    }
+  }
+}
@@ -0,0 +1,156 @@
+// Copyright Lin Min 2015
+#include <cmath>
+#include <memory>
+
+#include "catch/catch.hpp"
+#include "operations/include/conv.hpp"
+#include "operations/include/reorder.hpp"
+
+using namespace purine;
+using std::shared_ptr;
+
+static shared_ptr<Tensor> filled(const Size& size, int seed) {
+  shared_ptr<Tensor> t(new Tensor(current_rank(), -1, size));
+  DTYPE* data = t->mutable_cpu_data();
+  for (int i = 0; i < size.count(); ++i) {
+    data[i] = ((i * 7919 + seed * 104729) % 1000) / 1000. - 0.5;
+  }
+  return t;
+}
+
+static DTYPE max_diff(Tensor* a, Tensor* b) {
+  DTYPE diff = 0;
+  for (int i = 0; i < a->size().count(); ++i) {
+    diff = std::max(diff, std::abs(a->cpu_data()[i] - b->cpu_data()[i]));
+  }
+  return diff;
+}
+
+TEST_CASE("ConvCpuAlgos", "[Conv]") {
+  Size bottom_size = { 2, 8, 9, 7 };
+  Size top_size = { 2, 16, 9, 7 };
+  Size kernel_size = { 16, 8, 3, 3 };
+  Conv::param_tuple args(1, 1, 1, 1);
+  shared_ptr<Tensor> bottom = filled(bottom_size, 1);
+  shared_ptr<Tensor> weight = filled(kernel_size, 2);
+  shared_ptr<Tensor> top_diff = filled(top_size, 3);
+  // { top, bottom_diff, weight_diff } of each algorithm
+  vector<vector<shared_ptr<Tensor> > > results;
+  for (ConvCpu::Algo algo : { ConvCpu::IM2COL, ConvCpu::WINOGRAD_2X2,
+          ConvCpu::WINOGRAD_4X4, ConvCpu::DIRECT }) {
+    ConvCpu::set_algo(algo);
+    vector<shared_ptr<Tensor> > r = { filled(top_size, 4),
+      filled(bottom_size, 5), filled(kernel_size, 6) };
+    Conv up({ bottom.get(), weight.get() }, { r[0].get() }, args);
+    ConvDown down({ top_diff.get(), weight.get() }, { r[1].get() }, args);
+    ConvWeight w({ top_diff.get(), bottom.get() }, { r[2].get() }, args);
+    up.compute_cpu({ false });
+    down.compute_cpu({ false });
+    w.compute_cpu({ false });
+    results.push_back(r);
+  }
+  ConvCpu::set_algo(ConvCpu::AUTO);
+  for (int i = 1; i < results.size(); ++i) {
+    for (int j = 0; j < 3; ++j) {
+      REQUIRE(max_diff(results[0][j].get(), results[i][j].get()) < 1e-4);
+    }
+  }
+}
+
+TEST_CASE("PointwiseConv", "[Conv]") {
+  // 1x1 kernels skip im2col, top = weight * bottom for each image
+  Size bottom_size = { 2, 6, 5, 4 };
+  Size top_size = { 2, 3, 5, 4 };
+  shared_ptr<Tensor> bottom = filled(bottom_size, 1);
+  shared_ptr<Tensor> weight = filled({ 3, 6, 1, 1 }, 2);
+  shared_ptr<Tensor> top = filled(top_size, 3);
+  Conv up({ bottom.get(), weight.get() }, { top.get() },
+      Conv::param_tuple(0, 0, 1, 1));
+  up.compute_cpu({ false });
+  const DTYPE* b = bottom->cpu_data();
+  const DTYPE* w = weight->cpu_data();
+  const DTYPE* t = top->cpu_data();
+  for (int n = 0; n < 2; ++n) {
+    for (int k = 0; k < 3; ++k) {
+      for (int i = 0; i < 20; ++i) {
+        DTYPE sum = 0;
+        for (int c = 0; c < 6; ++c) {
+          sum += w[k * 6 + c] * b[(n * 6 + c) * 20 + i];
+        }
+        REQUIRE(std::abs(t[(n * 3 + k) * 20 + i] - sum) < 1e-5);
+      }
+    }
+  }
+}
+
+TEST_CASE("ConvColumns", "[Conv]") {
+  // ConvWeight reading the columns which Conv kept
+  Size bottom_size = { 2, 4, 7, 6 };
+  Size top_size = { 2, 5, 4, 3 };
+  Size kernel_size = { 5, 4, 3, 3 };
+  Conv::param_tuple args(1, 1, 2, 2);
+  shared_ptr<Tensor> bottom = filled(bottom_size, 1);
+  shared_ptr<Tensor> weight = filled(kernel_size, 2);
+  shared_ptr<Tensor> top_diff = filled(top_size, 3);
+  shared_ptr<Tensor> top = filled(top_size, 4);
+  shared_ptr<Tensor> columns = filled({ 2, 36, 4, 3 }, 5);
+  shared_ptr<Tensor> expected = filled(kernel_size, 6);
+  shared_ptr<Tensor> weight_diff = filled(kernel_size, 7);
+  ConvWeight w({ top_diff.get(), bottom.get() }, { expected.get() }, args);
+  w.compute_cpu({ false });
+  Conv up({ bottom.get(), weight.get() }, { top.get(), columns.get() }, args);
+  ConvWeight cached({ top_diff.get(), bottom.get(), columns.get() },
+      { weight_diff.get() }, args);
+  up.compute_cpu({ false });
+  cached.compute_cpu({ false });
+  REQUIRE(max_diff(expected.get(), weight_diff.get()) < 1e-4);
+}
+
+TEST_CASE("ConvNhwc", "[Conv]") {
+  // the same convs on NHWC copies, reordered back to NCHW
+  Size bottom_size = { 2, 6, 5, 4 };
+  Size top_size = { 2, 3, 5, 4 };
+  for (int kernel : { 1, 3 }) {
+    Size kernel_size = { 3, 6, kernel, kernel };
+    Conv::param_tuple args(kernel / 2, kernel / 2, 1, 1);
+    shared_ptr<Tensor> bottom = filled(bottom_size, 1);
+    shared_ptr<Tensor> weight = filled(kernel_size, 2);
+    shared_ptr<Tensor> top_diff = filled(top_size, 3);
+    vector<shared_ptr<Tensor> > expected = { filled(top_size, 4),
+      filled(bottom_size, 5), filled(kernel_size, 6) };
+    Conv({ bottom.get(), weight.get() }, { expected[0].get() }, args)
+        .compute_cpu({ false });
+    ConvDown({ top_diff.get(), weight.get() }, { expected[1].get() }, args)
+        .compute_cpu({ false });
+    ConvWeight({ top_diff.get(), bottom.get() }, { expected[2].get() }, args)
+        .compute_cpu({ false });
+
+    auto nhwc = [](const Size& size)->shared_ptr<Tensor> {
+      return shared_ptr<Tensor>(new Tensor(current_rank(), -1, size, NHWC));
+    };
+    shared_ptr<Tensor> bottom_nhwc = nhwc(bottom_size);
+    shared_ptr<Tensor> top_diff_nhwc = nhwc(top_size);
+    Reorder({ bottom.get() }, { bottom_nhwc.get() }, Reorder::param_tuple())
+        .compute_cpu({ false });
+    Reorder({ top_diff.get() }, { top_diff_nhwc.get() },
+        Reorder::param_tuple()).compute_cpu({ false });
+    shared_ptr<Tensor> top_nhwc = nhwc(top_size);
+    shared_ptr<Tensor> bottom_diff_nhwc = nhwc(bottom_size);
+    shared_ptr<Tensor> weight_diff = filled(kernel_size, 7);
+    Conv({ bottom_nhwc.get(), weight.get() }, { top_nhwc.get() }, args)
+        .compute_cpu({ false });
+    ConvDown({ top_diff_nhwc.get(), weight.get() },
+        { bottom_diff_nhwc.get() }, args).compute_cpu({ false });
+    ConvWeight({ top_diff_nhwc.get(), bottom_nhwc.get() },
+        { weight_diff.get() }, args).compute_cpu({ false });
+    vector<shared_ptr<Tensor> > result = { filled(top_size, 8),
+      filled(bottom_size, 9), weight_diff };
+    Reorder({ top_nhwc.get() }, { result[0].get() }, Reorder::param_tuple())
+        .compute_cpu({ false });
+    Reorder({ bottom_diff_nhwc.get() }, { result[1].get() },
+        Reorder::param_tuple()).compute_cpu({ false });
+    for (int j = 0; j < 3; ++j) {
+      REQUIRE(max_diff(expected[j].get(), result[j].get()) < 1e-4);
+    }
+  }
+}
@@ -1,5 +1,7 @@
 // Copyright Lin Min 2014
 #include "catch/catch.hpp"
+#include <chrono>
+#include <thread>
 #include <vector>
 #include "operations/include/random.hpp"
 #include "operations/operation.hpp"
@@ -50,3 +52,77 @@ TEST_CASE("TestAggregate", "[Aggregate]") {
     REQUIRE(dest->tensor()->cpu_data()[i] == 3.);
   }
 }
+
+TEST_CASE("TestWeightedAggregate", "[Aggregate]") {
+  Runnable g;
+  Op<Constant>* constant1 = g.create<Constant>("constant", 0, -1, "main",
+      Constant::param_tuple(1.));
+  Op<Constant>* constant2 = g.create<Constant>("constant", 0, -1, "main",
+      Constant::param_tuple(3.));
+  Blob* dest = g.create("dest", 0, -1, {10, 10, 10, 10});
+  Blob* src1 = g.create("src1", 0, -1, {10, 10, 10, 10});
+  Blob* src2 = g.create("src2", 0, -1, {10, 10, 10, 10});
+  *constant1 >> B{ src1 };
+  *constant2 >> B{ src2 };
+  B{ src1, src2 } >> *g.createAny<Aggregate>("agg",
+      Aggregate::param_tuple(Aggregate::WEIGHTED_SUM, 0, -1),
+      vector<DTYPE>{ 0.5, 1.5 }) >> B{ dest };
+  g.run();
+  for (int i = 0; i < 10000; ++i) {
+    REQUIRE(dest->tensor()->cpu_data()[i] == 5.);
+  }
+}
+
+/**
+ * {} >> Delay >> { top, token }, fills top with a constant after sleeping,
+ * the token is left alone so that it can be a sink.
+ */
+class Delay : public Operation {
+ protected:
+  DTYPE constant;
+ public:
+  typedef tuple<DTYPE> param_tuple;
+  Delay(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
+      const param_tuple& args) : Operation(inputs, outputs) {
+    std::tie(constant) = args;
+  }
+  virtual void compute_cpu(const vector<bool>& add) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    DTYPE* top = outputs_[0]->mutable_cpu_data();
+    for (int i = 0; i < outputs_[0]->size().count(); ++i) {
+      top[i] = constant;
+    }
+  }
+};
+
+TEST_CASE("TestQuorumAggregate", "[Aggregate]") {
+  Runnable g;
+  vector<Blob*> src;
+  for (int i = 0; i < 2; ++i) {
+    Op<Constant>* constant = g.create<Constant>("constant", 0, -1, "main",
+        Constant::param_tuple(i + 1.));
+    src.push_back(g.create("src", 0, -1, {10, 10, 10, 10}));
+    *constant >> B{ src.back() };
+  }
+  // the straggler, its token keeps run() waiting until it arrived late
+  src.push_back(g.create("src", 0, -1, {10, 10, 10, 10}));
+  Blob* token = g.create("token", 0, -1, {1, 1, 1, 1});
+  *g.create<Delay>("delay", 0, -1, "straggler", Delay::param_tuple(4.))
+      >> B{ src.back(), token };
+  Blob* dest = g.create("dest", 0, -1, {10, 10, 10, 10});
+  // the two fast ones, rescaled to the sum of three
+  Aggregate* agg = g.createAny<Aggregate>("agg",
+      Aggregate::param_tuple(Aggregate::QUORUM_SUM, 0, -1),
+      QuorumSum::param_tuple(2, 0, false, {}));
+  src >> *agg >> B{ dest };
+  for (int iter = 0; iter < 5; ++iter) {
+    g.run();
+    for (int i = 0; i < 10000; ++i) {
+      REQUIRE(dest->tensor()->cpu_data()[i] == Approx(4.5));
+    }
+  }
+  REQUIRE(agg->quorum() != NULL);
+  vector<int> late = agg->quorum()->late();
+  REQUIRE(late == vector<int>({ 0, 0, 5 }));
+  REQUIRE(agg->quorum()->dropped() == 5);
+}
@@ -0,0 +1,119 @@
+// Copyright Lin Min 2015
+#include <cstdint>
+#include <memory>
+
+#include "catch/catch.hpp"
+#include "operations/include/dropout.hpp"
+
+using namespace purine;
+using std::shared_ptr;
+
+static DTYPE& at(Tensor* t, int n, int c, int h, int w) {
+  const Stride& st = t->stride();
+  return t->mutable_cpu_data()[n * st.nstride() + c * st.cstride()
+      + h * st.hstride() + w * st.wstride()];
+}
+
+static shared_ptr<Tensor> filled(const Size& size, Layout layout, int seed) {
+  shared_ptr<Tensor> t(new Tensor(current_rank(), -1, size, layout));
+  int i = 0;
+  for (int n = 0; n < size.num(); ++n) {
+    for (int c = 0; c < size.channels(); ++c) {
+      for (int h = 0; h < size.height(); ++h) {
+        for (int w = 0; w < size.width(); ++w) {
+          // nonzero, so that a dropped element shows
+          at(t.get(), n, c, h, w) =
+            ((i++ * 7919 + seed * 104729) % 1000) / 1000. + 0.5;
+        }
+      }
+    }
+  }
+  return t;
+}
+
+TEST_CASE("Philox", "[Dropout]") {
+  // the known answers of philox4x32-10 in Random123
+  uint32_t zero[4] = { 0, 0, 0, 0 };
+  Dropout::philox(zero, 0, 0);
+  REQUIRE(zero[0] == 0x6627e8d5);
+  REQUIRE(zero[1] == 0xe169c58d);
+  REQUIRE(zero[2] == 0xbc57ac4c);
+  REQUIRE(zero[3] == 0x9b00dbd8);
+  uint32_t pi[4] = { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 };
+  Dropout::philox(pi, 0xa4093822, 0x299f31d0);
+  REQUIRE(pi[0] == 0xd16cfe09);
+  REQUIRE(pi[1] == 0x94fdcceb);
+  REQUIRE(pi[2] == 0x5001e420);
+  REQUIRE(pi[3] == 0x24126ea1);
+}
+
+TEST_CASE("DropoutDraw", "[Dropout]") {
+  // the words against philox one call at a time, drawn whole and in
+  // slices as the threads do
+  uint64_t seed = 0x123456789abcdefULL;
+  uint64_t run = 0x100000003ULL;
+  DTYPE ratio = 0.3;
+  uint32_t threshold = uint32_t(double(ratio) * 4294967296.);
+  int count = 100;
+  vector<uint32_t> whole(count);
+  vector<uint32_t> sliced(count);
+  Dropout::draw(seed, run, ratio, 0, count, &whole[0]);
+  int cuts[] = { 0, 7, 61, count };
+  for (int i = 0; i < 3; ++i) {
+    Dropout::draw(seed, run, ratio, cuts[i], cuts[i + 1], &sliced[0]);
+  }
+  for (int word = 0; word < count; ++word) {
+    uint32_t bits = 0;
+    for (int call = 0; call < 8; ++call) {
+      uint32_t counter[4] = { uint32_t(word), uint32_t(call), uint32_t(run),
+        uint32_t(run >> 32) };
+      Dropout::philox(counter, uint32_t(seed), uint32_t(seed >> 32));
+      for (int i = 0; i < 4; ++i) {
+        bits |= uint32_t(counter[i] >= threshold) << (call * 4 + i);
+      }
+    }
+    REQUIRE(whole[word] == bits);
+    REQUIRE(sliced[word] == bits);
+  }
+}
+
+TEST_CASE("DropoutCpu", "[Dropout]") {
+  // 945 elements, the last mask word is partly used
+  Size s = { 3, 5, 7, 9 };
+  DTYPE ratio = 0.3;
+  for (Layout layout : { NCHW, NHWC }) {
+    shared_ptr<Tensor> bottom = filled(s, layout, 1);
+    shared_ptr<Tensor> top = filled(s, layout, 2);
+    shared_ptr<Tensor> top_diff = filled(s, layout, 3);
+    shared_ptr<Tensor> bottom_diff = filled(s, layout, 4);
+    shared_ptr<Tensor> mask(new Tensor(current_rank(), -1,
+          Dropout::mask_size(s)));
+    Dropout({ bottom.get() }, { top.get(), mask.get() },
+        Dropout::param_tuple(ratio)).compute_cpu({ false, false });
+    DropoutDown({ top_diff.get(), mask.get() }, { bottom_diff.get() },
+        DropoutDown::param_tuple()).compute_cpu({ false });
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(
+        mask->cpu_data());
+    int index = 0;
+    int kept = 0;
+    for (int n = 0; n < s.num(); ++n) {
+      for (int c = 0; c < s.channels(); ++c) {
+        for (int h = 0; h < s.height(); ++h) {
+          for (int w = 0; w < s.width(); ++w) {
+            // the bits are in the order of n, c, h, w whatever the layout
+            bool bit = (words[index >> 5] >> (index & 31)) & 1;
+            ++index;
+            kept += bit;
+            REQUIRE(at(top.get(), n, c, h, w)
+                == (bit ? at(bottom.get(), n, c, h, w) : 0));
+            REQUIRE(at(bottom_diff.get(), n, c, h, w)
+                == (bit ? at(top_diff.get(), n, c, h, w) : 0));
+          }
+        }
+      }
+    }
+    // binomial with a standard deviation of about 0.015
+    DTYPE rate = DTYPE(kept) / s.count();
+    REQUIRE(rate == Approx(1 - ratio).epsilon(0.1));
+  }
+}
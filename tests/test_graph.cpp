@@ -1,14 +1,25 @@
 // Copyright Lin Min 2015
 
+#include <chrono>
+#include <thread>
 #include "catch/catch.hpp"
 #include "operations/operation.hpp"
+#include "operations/include/activation.hpp"
+#include "operations/include/bias.hpp"
 #include "operations/include/conv.hpp"
+#include "operations/include/inner.hpp"
 #include "operations/include/random.hpp"
 #include "operations/include/eltwise.hpp"
 #include "operations/include/mem_copy.hpp"
+#include "operations/include/softmax.hpp"
 #include "dispatch/graph_template.hpp"
 #include "dispatch/op_template.hpp"
+#include "dispatch/inference.hpp"
+#include "dispatch/recompute.hpp"
+#include "dispatch/relayout.hpp"
 #include "dispatch/runnable.hpp"
+#include "dispatch/trace.hpp"
+#include "composite/graph/split.hpp"
 #include "composite/layers/conv_layer.hpp"
 
 using namespace purine;
@@ -162,3 +173,272 @@ TEST_CASE("Operator", "[Layer][Graph]") {
   conv_layer2->top();
   print_graph(g.print());
 }
+
+/**
+ * {} >> Count >> { top }, writes 1, 2, 3, ... one value per generation.
+ */
+class Count : public Operation {
+ public:
+  typedef tuple<> param_tuple;
+  static int count;
+  static vector<int64_t> begin;
+  Count(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
+      const param_tuple& args) : Operation(inputs, outputs) {}
+  virtual void compute_cpu(const vector<bool>& add) {
+    begin.push_back(Tracer::now());
+    ++count;
+    DTYPE* top = outputs_[0]->mutable_cpu_data();
+    for (int i = 0; i < outputs_[0]->size().count(); ++i) {
+      top[i] = count;
+    }
+  }
+};
+int Count::count = 0;
+vector<int64_t> Count::begin;
+
+/**
+ * { bottom } >> Record >> {}, slow sink keeping the first value it reads.
+ */
+class Record : public Operation {
+ public:
+  typedef tuple<> param_tuple;
+  static vector<DTYPE> values;
+  static vector<int64_t> end;
+  Record(const vector<Tensor*>& inputs, const vector<Tensor*>& outputs,
+      const param_tuple& args) : Operation(inputs, outputs) {}
+  virtual void compute_cpu(const vector<bool>& add) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    values.push_back(inputs_[0]->cpu_data()[0]);
+    end.push_back(Tracer::now());
+  }
+};
+vector<DTYPE> Record::values;
+vector<int64_t> Record::end;
+
+TEST_CASE("InFlight", "[Graph][Thread]") {
+  Runnable g(0, -1);
+  Blob* a = g.create("a", {1, 3, 10, 10});
+  Blob* b = g.create("b", {1, 3, 10, 10});
+  Blob* c = g.create("c", {1, 3, 10, 10});
+  *g.create<Count>("count", "count", Count::param_tuple()) >> B{ a };
+  B{ a } >> *g.create<Scale>("scale2", "scale2", Scale::param_tuple(2.))
+      >> B{ b };
+  B{ b } >> *g.create<Scale>("scale3", "scale3", Scale::param_tuple(3.))
+      >> B{ c };
+  B{ c } >> *g.create<Record>("record", "record", Record::param_tuple());
+  g.set_max_in_flight(3);
+  vector<Runnable::Iteration> iterations;
+  for (int i = 0; i < 10; ++i) {
+    iterations.push_back(g.run_async());
+  }
+  iterations[9].wait();
+  for (int i = 0; i < 10; ++i) {
+    REQUIRE(iterations[i].generation() == i);
+    REQUIRE(iterations[i].ready());
+  }
+  g.sync();
+  REQUIRE(Count::begin.size() == 10);
+  REQUIRE(Record::values.size() == 10);
+  for (int i = 0; i < 10; ++i) {
+    // each generation reads its own count, not a later one.
+    REQUIRE(Record::values[i] == 6. * (i + 1));
+  }
+  for (int i = 0; i + 1 < 10; ++i) {
+    // generation i + 1 starts while the slow sink still works on i.
+    REQUIRE(Count::begin[i + 1] < Record::end[i]);
+  }
+  Tensor* t = c->tensor();
+  for (int i = 0; i < t->size().count(); ++i) {
+    REQUIRE(t->cpu_data()[i] == 60.);
+  }
+}
+
+TEST_CASE("Recompute", "[Graph][Thread]") {
+  /**
+   * segment: data >> a >> b1 >> c >> top, { diff, b1 } >> e >> out
+   * outside: top >> d >> diff
+   */
+  Runnable g(0, -1);
+  Graph* seg = g.createAny<Graph>("seg", 0, -1);
+  Blob* data = g.create("data", {1, 3, 10, 10});
+  Blob* b1 = seg->create("b1", {1, 3, 10, 10});
+  Blob* top = seg->create("top", {1, 3, 10, 10});
+  Blob* diff = g.create("diff", {1, 3, 10, 10});
+  Blob* out = seg->create("out", {1, 3, 10, 10});
+  *g.create<Constant>("constant", "main", Constant::param_tuple(1.))
+      >> B{ data };
+  B{ data } >> *seg->create<Scale>("a", "main", Scale::param_tuple(2.))
+      >> B{ b1 };
+  B{ b1 } >> *seg->create<Scale>("c", "main", Scale::param_tuple(3.))
+      >> B{ top };
+  B{ top } >> *g.create<Scale>("d", "main", Scale::param_tuple(1.))
+      >> B{ diff };
+  B{ diff, b1 } >> *seg->create<Mul>("e", "main", Mul::param_tuple())
+      >> B{ out };
+  Recompute recompute(&g, { { "seg" } });
+  REQUIRE(recompute.released() == 300 * sizeof(DTYPE));
+  for (int iter = 0; iter < 2; ++iter) {
+    g.run();
+    Tensor* t = out->tensor();
+    for (int i = 0; i < t->size().count(); ++i) {
+      REQUIRE(t->cpu_data()[i] == 12.);
+    }
+  }
+}
+
+TEST_CASE("Inference", "[Graph][Thread]") {
+  /**
+   * data >> dropout >> inner1 (+ bias) >> top1 >> inner2 >> top2 >> x2
+   * >> top3 >> copy >> out, top1 >> backward >> diff
+   */
+  Runnable g(0, -1);
+  Blob* data = g.create("data", {2, 3, 1, 1});
+  Blob* dropped = g.create("dropped", {2, 3, 1, 1});
+  Blob* w1 = g.create("w1", {4, 3, 1, 1});
+  Blob* bias = g.create("bias", {1, 4, 1, 1});
+  Blob* top1 = g.create("top1", {2, 4, 1, 1});
+  Blob* w2 = g.create("w2", {2, 4, 1, 1});
+  Blob* top2 = g.create("top2", {2, 2, 1, 1});
+  Blob* top3 = g.create("top3", {2, 2, 1, 1});
+  Blob* out = g.create("out", {2, 2, 1, 1});
+  Blob* diff = g.create("diff", {2, 4, 1, 1});
+  B{ data } >> *g.create<Scale>("dropout", "main", Scale::param_tuple(0.5))
+      >> B{ dropped };
+  B{ dropped, w1 } >> *g.create<Inner>("inner1", "main", Inner::param_tuple())
+      >> B{ top1 };
+  B{ bias } >> *g.create<Bias>("bias1", "main", Bias::param_tuple())
+      >> B{ top1 };
+  B{ top1, w2 } >> *g.create<Inner>("inner2", "main", Inner::param_tuple())
+      >> B{ top2 };
+  B{ top2 } >> *g.create<Scale>("x2", "main", Scale::param_tuple(2.))
+      >> B{ top3 };
+  B{ top3 } >> *g.create<Scale>("copy", "main", Scale::param_tuple(1.))
+      >> B{ out };
+  B{ top1 } >> *g.create<Scale>("backward", "main", Scale::param_tuple(1.))
+      >> B{ diff };
+  Inference inference(&g, { data }, { out });
+  REQUIRE(inference.report().find("in 2 buffers") != string::npos);
+  // the weights and the data are filled after the rewrite, like load
+  Runnable filler(0, -1);
+  B to_fill;
+  for (Blob* b : { data, w1, bias, w2 }) {
+    to_fill.push_back(filler.create("fill", b->shared_tensor()));
+  }
+  *filler.create<Constant>("constant", "main", Constant::param_tuple(1.))
+      >> to_fill;
+  filler.run();
+  inference.fold();
+  for (int iter = 0; iter < 2; ++iter) {
+    g.run();
+    Tensor* t = out->tensor();
+    for (int i = 0; i < t->size().count(); ++i) {
+      REQUIRE(t->cpu_data()[i] == 20.);
+    }
+  }
+}
+
+TEST_CASE("InferenceMultiOutput", "[Graph][Thread]") {
+  /**
+   * { data, label, lambda } >> softmax_loss >> { probs, loss, bottom_diff },
+   * bottom_diff >> backward >> diff. only loss is read.
+   */
+  Runnable g(0, -1);
+  Blob* data = g.create("data", {2, 3, 1, 1});
+  Blob* label = g.create("label", {2, 1, 1, 1});
+  Blob* lambda = g.create("lambda", {1, 1, 1, 1});
+  Blob* probs = g.create("probs", {2, 3, 1, 1});
+  Blob* loss = g.create("loss", {1, 1, 1, 1});
+  Blob* bottom_diff = g.create("bottom_diff", {2, 3, 1, 1});
+  Blob* diff = g.create("diff", {2, 3, 1, 1});
+  B{ data, label, lambda } >> *g.create<SoftmaxCrossEntropy>("softmax_loss",
+      "main", SoftmaxCrossEntropy::param_tuple())
+      >> B{ probs, loss, bottom_diff };
+  B{ bottom_diff } >> *g.create<Scale>("backward", "main",
+      Scale::param_tuple(1.)) >> B{ diff };
+  Inference inference(&g, { data, label }, { loss });
+  // the backward op and its top go, the unread outputs of softmax_loss stay
+  REQUIRE(inference.report().find("removed 2 nodes") != string::npos);
+  Runnable filler(0, -1);
+  B ones = { filler.create("fill", data->shared_tensor()),
+    filler.create("fill", lambda->shared_tensor()) };
+  *filler.create<Constant>("one", "main", Constant::param_tuple(1.)) >> ones;
+  *filler.create<Constant>("zero", "main", Constant::param_tuple(0.))
+      >> B{ filler.create("fill", label->shared_tensor()) };
+  filler.run();
+  inference.fold();
+  g.run();
+  REQUIRE(loss->tensor()->cpu_data()[0] == Approx(log(3.)));
+  for (int i = 0; i < 6; ++i) {
+    REQUIRE(probs->tensor()->cpu_data()[i] == Approx(1. / 3));
+  }
+}
+
+TEST_CASE("Relayout", "[Graph][Thread]") {
+  /**
+   * { data, weight } >> conv (+ bias) >> top >> relu >> act >> split,
+   * top_diff >> conv_down, conv_weight, bias_down, each result read by a
+   * Scale, which is not layout agnostic.
+   */
+  vector<vector<DTYPE> > results[2];
+  for (int relayout = 0; relayout < 2; ++relayout) {
+    Runnable g(0, -1);
+    Blob* data = g.create("data", {2, 4, 6, 5});
+    Blob* weight = g.create("weight", {6, 4, 3, 3});
+    Blob* bias = g.create("bias", {1, 6, 1, 1});
+    Blob* top_diff = g.create("top_diff", {2, 6, 6, 5});
+    int seed = 0;
+    for (Blob* b : { data, weight, bias, top_diff }) {
+      DTYPE* d = b->tensor()->mutable_cpu_data();
+      for (int i = 0; i < b->tensor()->size().count(); ++i) {
+        d[i] = ((i * 7919 + ++seed * 104729) % 1000) / 1000. - 0.5;
+      }
+    }
+    Blob* top = g.create("top", {2, 6, 6, 5});
+    Blob* act = g.create("act", {2, 6, 6, 5});
+    Blob* data_diff = g.create("data_diff", {2, 4, 6, 5});
+    Blob* weight_diff = g.create("weight_diff", {6, 4, 3, 3});
+    Blob* bias_diff = g.create("bias_diff", {1, 6, 1, 1});
+    B{ data, weight } >> *g.create<Conv>("conv", "main",
+        Conv::param_tuple(1, 1, 1, 1)) >> B{ top };
+    B{ bias } >> *g.create<Bias>("bias", "main", Bias::param_tuple())
+        >> B{ top };
+    B{ top } >> *g.create<Activation>("relu", "main",
+        Activation::param_tuple("relu")) >> B{ act };
+    Split* split = g.createGraph<Split>("split", 0, -1,
+        Split::param_tuple(Split::CHANNELS), vector<int>{ 2, 4 });
+    B{ act } >> *split;
+    B{ top_diff, weight } >> *g.create<ConvDown>("conv_down", "main",
+        Conv::param_tuple(1, 1, 1, 1)) >> B{ data_diff };
+    B{ top_diff, data } >> *g.create<ConvWeight>("conv_weight", "main",
+        Conv::param_tuple(1, 1, 1, 1)) >> B{ weight_diff };
+    B{ top_diff } >> *g.create<BiasDown>("bias_down", "main",
+        BiasDown::param_tuple()) >> B{ bias_diff };
+    B outputs;
+    for (Blob* b : { split->top()[0], split->top()[1], data_diff,
+            weight_diff, bias_diff }) {
+      outputs.push_back(g.create("result", b->tensor()->size()));
+      B{ b } >> *g.create<Scale>("read", "main", Scale::param_tuple(1.))
+          >> B{ outputs.back() };
+    }
+    if (relayout) {
+      // top and data_diff, the diffs and the split act keep NCHW
+      Relayout pass(&g);
+      REQUIRE(pass.changed() == 2);
+      REQUIRE(pass.reordered() == 1);
+      REQUIRE(top->tensor()->layout() == NHWC);
+      REQUIRE(act->tensor()->layout() == NCHW);
+      REQUIRE(weight_diff->tensor()->layout() == NCHW);
+    }
+    g.run();
+    for (Blob* b : outputs) {
+      const DTYPE* d = b->tensor()->cpu_data();
+      results[relayout].push_back(vector<DTYPE>(d,
+            d + b->tensor()->size().count()));
+    }
+  }
+  for (int j = 0; j < results[0].size(); ++j) {
+    for (int i = 0; i < results[0][j].size(); ++i) {
+      REQUIRE(std::abs(results[0][j][i] - results[1][j][i]) < 1e-4);
+    }
+  }
+}
@@ -8,6 +8,7 @@
 #include "operations/include/random.hpp"
 #include "caffeine/math_functions.hpp"
 #include "composite/graph/copy.hpp"
+#include "dispatch/sibling_fusion.hpp"
 
 TEST_CASE("TestInception", "[Inception]") {
   Runnable run(0, 0);
@@ -87,3 +88,61 @@ TEST_CASE("TestInception", "[Inception]") {
     REQUIRE(dt3[k] == expected3[k]);
   }
 }
+
+TEST_CASE("TestSiblingFusion", "[Inception]") {
+  // the same inception with and without its 1x1 reductions merged, the
+  // top, the data diff and every weight diff, copied to the cpu
+  vector<vector<DTYPE> > outputs[2];
+  for (int fused = 0; fused < 2; ++fused) {
+    Runnable run(0, 0);
+    Blob* data = run.create("data", {5, 5, 5, 5});
+    Blob* data_diff = run.create("data_diff", {5, 5, 5, 5});
+    InceptionLayer* inception = run.createGraph<InceptionLayer>("inception",
+        InceptionLayer::param_tuple(5, 5, 5, 5, 5, 5));
+    vector<Blob*>{ data, data_diff } >> *inception;
+    // a different value in each weight, so that mixing them up shows
+    vector<Blob*> weight = inception->weight_data();
+    *run.create<Constant>("data", "main", Constant::param_tuple(1.))
+      >> vector<Blob*>{ data };
+    for (int i = 0; i < weight.size(); ++i) {
+      *run.create<Constant>("weight", "main",
+          Constant::param_tuple(0.01 * (i + 1))) >> vector<Blob*>{ weight[i] };
+    }
+    // and a top diff which differs along the channels
+    Blob* top_diff = run.create("top_diff", 0, -1, {5, 20, 5, 5});
+    DTYPE* diff = top_diff->tensor()->mutable_cpu_data();
+    for (int i = 0; i < 2500; ++i) {
+      diff[i] = 0.01 * (i % 13) - 0.05;
+    }
+    vector<Blob*>{ top_diff } >> *run.createAny<Copy>("copy_diff",
+        Copy::param_tuple(0, 0)) >> vector<Blob*>{ inception->top()[1] };
+    vector<Blob*> results = { inception->top()[0], data_diff };
+    vector<Blob*> weight_diff = inception->weight_diff();
+    results.insert(results.end(), weight_diff.begin(), weight_diff.end());
+    vector<Blob*> copied;
+    for (Blob* result : results) {
+      Copy* cp = run.createAny<Copy>("copy", Copy::param_tuple(0, -1));
+      vector<Blob*>{ result } >> *cp;
+      copied.push_back(cp->top()[0]);
+    }
+    if (fused) {
+      SiblingFusion fusion(&run);
+      REQUIRE(fusion.groups() == 1);
+      REQUIRE(fusion.merged() == 2);
+    }
+    run.run();
+    for (Blob* blob : copied) {
+      const DTYPE* dt = blob->tensor()->cpu_data();
+      outputs[fused].push_back(vector<DTYPE>(dt,
+            dt + blob->tensor()->size().count()));
+    }
+  }
+  REQUIRE(outputs[0].size() == 14);
+  for (int j = 0; j < outputs[0].size(); ++j) {
+    REQUIRE(outputs[0][j].size() == outputs[1][j].size());
+    for (int i = 0; i < outputs[0][j].size(); ++i) {
+      DTYPE scale = std::max(DTYPE(1.), std::abs(outputs[0][j][i]));
+      REQUIRE(std::abs(outputs[0][j][i] - outputs[1][j][i]) < 1e-4 * scale);
+    }
+  }
+}
@@ -0,0 +1,101 @@
+// Copyright Lin Min 2015
+#include <cmath>
+#include <memory>
+
+#include "catch/catch.hpp"
+#include "operations/include/lrn.hpp"
+
+using namespace purine;
+using std::shared_ptr;
+
+static DTYPE& at(Tensor* t, int n, int c, int h, int w) {
+  const Stride& st = t->stride();
+  return t->mutable_cpu_data()[n * st.nstride() + c * st.cstride()
+      + h * st.hstride() + w * st.wstride()];
+}
+
+static shared_ptr<Tensor> filled(const Size& size, Layout layout, int seed) {
+  shared_ptr<Tensor> t(new Tensor(current_rank(), -1, size, layout));
+  int i = 0;
+  for (int n = 0; n < size.num(); ++n) {
+    for (int c = 0; c < size.channels(); ++c) {
+      for (int h = 0; h < size.height(); ++h) {
+        for (int w = 0; w < size.width(); ++w) {
+          at(t.get(), n, c, h, w) =
+            ((i++ * 7919 + seed * 104729) % 1000) / 1000. - 0.5;
+        }
+      }
+    }
+  }
+  return t;
+}
+
+TEST_CASE("LRNCpu", "[LRN]") {
+  // against the naive sums over the window of channels, rows of 21 have
+  // whole vectors and a tail
+  Size s = { 2, 7, 3, 21 };
+  DTYPE alpha = 0.1;
+  for (int size : { 3, 4, 5 }) {
+    for (DTYPE beta : { DTYPE(0.75), DTYPE(0.6) }) {
+      for (Layout layout : { NCHW, NHWC }) {
+        LRN::param_tuple args(alpha, beta, size);
+        shared_ptr<Tensor> bottom = filled(s, layout, 1);
+        shared_ptr<Tensor> top_diff = filled(s, layout, 2);
+        shared_ptr<Tensor> scale = filled(s, layout, 3);
+        shared_ptr<Tensor> top = filled(s, layout, 4);
+        shared_ptr<Tensor> bottom_diff = filled(s, layout, 5);
+        LRNScale({ bottom.get() }, { scale.get() }, args)
+          .compute_cpu({ false });
+        LRN({ bottom.get(), scale.get() }, { top.get() }, args)
+          .compute_cpu({ false });
+        LRNDown({ bottom.get(), top_diff.get(), scale.get(), top.get() },
+            { bottom_diff.get() }, args).compute_cpu({ false });
+        // the scale and the top in one pass
+        shared_ptr<Tensor> fused_scale = filled(s, layout, 6);
+        shared_ptr<Tensor> fused_top = filled(s, layout, 7);
+        LRNScale({ bottom.get() }, { fused_scale.get(), fused_top.get() },
+            args).compute_cpu({ false, false });
+        // channel c sums the squares of [c - pre, c + post]
+        int pre = (size - 1) / 2;
+        int post = size - pre - 1;
+        for (int n = 0; n < s.num(); ++n) {
+          for (int h = 0; h < s.height(); ++h) {
+            for (int w = 0; w < s.width(); ++w) {
+              vector<double> sc(s.channels());
+              for (int c = 0; c < s.channels(); ++c) {
+                double sum = 0;
+                for (int k = std::max(c - pre, 0);
+                     k <= std::min(c + post, s.channels() - 1); ++k) {
+                  double x = at(bottom.get(), n, k, h, w);
+                  sum += x * x;
+                }
+                sc[c] = 1. + alpha / size * sum;
+                REQUIRE(at(scale.get(), n, c, h, w) == Approx(sc[c]));
+                REQUIRE(at(top.get(), n, c, h, w) == Approx(
+                        at(bottom.get(), n, c, h, w) * std::pow(sc[c], -beta)));
+                REQUIRE(at(fused_scale.get(), n, c, h, w)
+                    == at(scale.get(), n, c, h, w));
+                REQUIRE(at(fused_top.get(), n, c, h, w)
+                    == at(top.get(), n, c, h, w));
+              }
+              for (int c = 0; c < s.channels(); ++c) {
+                // the channels whose window holds c
+                double sum = 0;
+                for (int k = std::max(c - post, 0);
+                     k <= std::min(c + pre, s.channels() - 1); ++k) {
+                  sum += at(top_diff.get(), n, k, h, w) * at(top.get(), n, k,
+                      h, w) / sc[k];
+                }
+                double expected = at(top_diff.get(), n, c, h, w)
+                  * std::pow(sc[c], -beta) - 2. * alpha * beta / size
+                  * at(bottom.get(), n, c, h, w) * sum;
+                REQUIRE(at(bottom_diff.get(), n, c, h, w)
+                    == Approx(expected).epsilon(1e-4));
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,159 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "catch/catch.hpp"
+#include "operations/include/pool.hpp"
+
+using namespace purine;
+using std::shared_ptr;
+using std::string;
+
+static DTYPE& at(Tensor* t, int n, int c, int h, int w) {
+  const Stride& st = t->stride();
+  return t->mutable_cpu_data()[n * st.nstride() + c * st.cstride()
+      + h * st.hstride() + w * st.wstride()];
+}
+
+static shared_ptr<Tensor> filled(const Size& size, Layout layout, int seed) {
+  shared_ptr<Tensor> t(new Tensor(current_rank(), -1, size, layout));
+  int i = 0;
+  for (int n = 0; n < size.num(); ++n) {
+    for (int c = 0; c < size.channels(); ++c) {
+      for (int h = 0; h < size.height(); ++h) {
+        for (int w = 0; w < size.width(); ++w) {
+          at(t.get(), n, c, h, w) =
+            ((i++ * 7919 + seed * 104729) % 1000) / 1000. - 0.5;
+        }
+      }
+    }
+  }
+  return t;
+}
+
+TEST_CASE("PoolCpu", "[Pool]") {
+  struct Case {
+    string method;
+    int kernel_h, kernel_w, stride_h, stride_w, pad_h, pad_w;
+  };
+  // the last window of the 3x3 stride 2 ones is clipped at the right edge
+  vector<Case> cases = {
+    { "max", 3, 3, 2, 2, 0, 0 },
+    { "max", 3, 3, 2, 2, 1, 1 },
+    { "max", 2, 3, 1, 2, 1, 0 },
+    { "average", 3, 3, 2, 2, 0, 0 },
+    { "average", 3, 3, 2, 2, 1, 1 },
+    { "average_exclude_padding", 3, 3, 2, 2, 1, 1 },
+    { "average_exclude_padding", 2, 3, 1, 2, 1, 0 }
+  };
+  Size bs = { 2, 3, 7, 6 };
+  for (const Case& p : cases) {
+    for (Layout layout : { NCHW, NHWC }) {
+      int height = static_cast<int>(std::ceil(static_cast<float>(
+              bs.height() + 2 * p.pad_h - p.kernel_h) / p.stride_h)) + 1;
+      int width = static_cast<int>(std::ceil(static_cast<float>(
+              bs.width() + 2 * p.pad_w - p.kernel_w) / p.stride_w)) + 1;
+      Size ts = { bs.num(), bs.channels(), height, width };
+      Pool::param_tuple args(p.method, p.kernel_h, p.kernel_w, p.stride_h,
+          p.stride_w, p.pad_h, p.pad_w);
+      bool max = p.method == "max";
+      shared_ptr<Tensor> bottom = filled(bs, layout, 1);
+      shared_ptr<Tensor> top = filled(ts, layout, 2);
+      shared_ptr<Tensor> mask(new Tensor(current_rank(), -1,
+            Pool::mask_size(ts)));
+      shared_ptr<Tensor> top_diff = filled(ts, layout, 4);
+      shared_ptr<Tensor> bottom_diff = filled(bs, layout, 5);
+      shared_ptr<Tensor> masked_diff = filled(bs, layout, 6);
+      if (max) {
+        Pool({ bottom.get() }, { top.get(), mask.get() }, args)
+          .compute_cpu({ false, false });
+        PoolDown({ top_diff.get(), top.get(), bottom.get(), mask.get() },
+            { masked_diff.get() }, args).compute_cpu({ false });
+      } else {
+        Pool({ bottom.get() }, { top.get() }, args).compute_cpu({ false });
+      }
+      PoolDown({ top_diff.get(), top.get(), bottom.get() },
+          { bottom_diff.get() }, args).compute_cpu({ false });
+
+      shared_ptr<Tensor> expected_diff(new Tensor(current_rank(), -1, bs));
+      DTYPE* e = expected_diff->mutable_cpu_data();
+      std::fill(e, e + bs.count(), 0);
+      for (int n = 0; n < ts.num(); ++n) {
+        for (int c = 0; c < ts.channels(); ++c) {
+          for (int ph = 0; ph < ts.height(); ++ph) {
+            for (int pw = 0; pw < ts.width(); ++pw) {
+              int h0 = ph * p.stride_h - p.pad_h;
+              int w0 = pw * p.stride_w - p.pad_w;
+              // the taps in the padded bottom, and those in the bottom
+              int padded = 0;
+              int inside = 0;
+              DTYPE sum = 0;
+              int hmax = -1;
+              int wmax = -1;
+              for (int h = h0; h < h0 + p.kernel_h; ++h) {
+                for (int w = w0; w < w0 + p.kernel_w; ++w) {
+                  padded += h < bs.height() + p.pad_h
+                    && w < bs.width() + p.pad_w;
+                  if (h < 0 || w < 0 || h >= bs.height()
+                      || w >= bs.width()) {
+                    continue;
+                  }
+                  ++inside;
+                  DTYPE x = at(bottom.get(), n, c, h, w);
+                  sum += x;
+                  if (hmax < 0 || x > at(bottom.get(), n, c, hmax, wmax)) {
+                    hmax = h;
+                    wmax = w;
+                  }
+                }
+              }
+              REQUIRE(inside > 0);
+              DTYPE diff = at(top_diff.get(), n, c, ph, pw);
+              DTYPE value = at(top.get(), n, c, ph, pw);
+              if (max) {
+                REQUIRE(value == at(bottom.get(), n, c, hmax, wmax));
+                // a byte per window, in the order of n, c, h, w
+                const uint8_t* offsets = reinterpret_cast<const uint8_t*>(
+                    mask->cpu_data());
+                REQUIRE(offsets[((n * ts.channels() + c) * ts.height() + ph)
+                    * ts.width() + pw] == (hmax - h0) * p.kernel_w + wmax - w0);
+                e[((n * bs.channels() + c) * bs.height() + hmax)
+                  * bs.width() + wmax] += diff;
+                continue;
+              }
+              int count = p.method == "average" ? padded : inside;
+              REQUIRE(value == Approx(sum / count));
+              for (int h = std::max(h0, 0);
+                   h < std::min(h0 + p.kernel_h, bs.height()); ++h) {
+                for (int w = std::max(w0, 0);
+                     w < std::min(w0 + p.kernel_w, bs.width()); ++w) {
+                  e[((n * bs.channels() + c) * bs.height() + h)
+                    * bs.width() + w] += diff / count;
+                }
+              }
+            }
+          }
+        }
+      }
+      for (int n = 0; n < bs.num(); ++n) {
+        for (int c = 0; c < bs.channels(); ++c) {
+          for (int h = 0; h < bs.height(); ++h) {
+            for (int w = 0; w < bs.width(); ++w) {
+              DTYPE expected = e[((n * bs.channels() + c) * bs.height() + h)
+                * bs.width() + w];
+              REQUIRE(at(bottom_diff.get(), n, c, h, w) == Approx(expected));
+              if (max) {
+                // the mask routes the diff as the search does
+                REQUIRE(at(masked_diff.get(), n, c, h, w)
+                    == at(bottom_diff.get(), n, c, h, w));
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,123 @@
+// Copyright Lin Min 2015
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "catch/catch.hpp"
+#include "operations/include/accuracy.hpp"
+#include "operations/include/softmax.hpp"
+
+using namespace purine;
+using std::shared_ptr;
+
+static shared_ptr<Tensor> filled(const Size& size, int seed) {
+  shared_ptr<Tensor> t(new Tensor(current_rank(), -1, size));
+  DTYPE* data = t->mutable_cpu_data();
+  for (int i = 0; i < size.count(); ++i) {
+    data[i] = ((i * 7919 + seed * 104729) % 1000) / 100. - 5.;
+  }
+  return t;
+}
+
+TEST_CASE("SoftmaxCrossEntropy", "[Softmax]") {
+  // against a plain softmax fed to SoftmaxLoss and SoftmaxLossDown. The
+  // shapes cover the vector paths along the channels and along the
+  // positions, with their scalar tails.
+  for (Size size : { Size(4, 11, 1, 1), Size(3, 5, 2, 3), Size(2, 5, 3, 4) }) {
+    int num = size.num();
+    int channels = size.channels();
+    int spatial_dim = size.height() * size.width();
+    shared_ptr<Tensor> bottom = filled(size, 1);
+    shared_ptr<Tensor> label(new Tensor(current_rank(), -1,
+          { num, 1, size.height(), size.width() }));
+    for (int i = 0; i < num * spatial_dim; ++i) {
+      label->mutable_cpu_data()[i] = (i * 3) % channels;
+    }
+    shared_ptr<Tensor> lambda(new Tensor(current_rank(), -1, { 1, 1, 1, 1 }));
+    lambda->mutable_cpu_data()[0] = 0.7;
+
+    shared_ptr<Tensor> probs(new Tensor(current_rank(), -1, size));
+    const DTYPE* x = bottom->cpu_data();
+    DTYPE* p = probs->mutable_cpu_data();
+    for (int i = 0; i < num; ++i) {
+      for (int j = 0; j < spatial_dim; ++j) {
+        int offset = i * channels * spatial_dim + j;
+        double sum = 0;
+        for (int c = 0; c < channels; ++c) {
+          sum += std::exp(x[offset + c * spatial_dim]);
+        }
+        for (int c = 0; c < channels; ++c) {
+          p[offset + c * spatial_dim] = std::exp(x[offset + c * spatial_dim])
+            / sum;
+        }
+      }
+    }
+    shared_ptr<Tensor> loss(new Tensor(current_rank(), -1, { 1, 1, 1, 1 }));
+    shared_ptr<Tensor> diff(new Tensor(current_rank(), -1, size));
+    SoftmaxLoss({ probs.get(), label.get() }, { loss.get() },
+        SoftmaxLoss::param_tuple()).compute_cpu({ false });
+    SoftmaxLossDown({ probs.get(), label.get(), lambda.get() }, { diff.get() },
+        SoftmaxLossDown::param_tuple()).compute_cpu({ false });
+
+    for (bool add : { false, true }) {
+      // softmax is overwritten, the loss and the diff added to with add
+      shared_ptr<Tensor> softmax = filled(size, 3);
+      shared_ptr<Tensor> fused_loss = filled({ 1, 1, 1, 1 }, 4);
+      shared_ptr<Tensor> fused_diff = filled(size, 5);
+      DTYPE loss_before = fused_loss->cpu_data()[0];
+      vector<DTYPE> diff_before(fused_diff->cpu_data(),
+          fused_diff->cpu_data() + size.count());
+      SoftmaxCrossEntropy({ bottom.get(), label.get(), lambda.get() },
+          { softmax.get(), fused_loss.get(), fused_diff.get() },
+          SoftmaxCrossEntropy::param_tuple()).compute_cpu({ add, add, add });
+      REQUIRE(fused_loss->cpu_data()[0] == Approx((add ? loss_before : 0)
+            + loss->cpu_data()[0]).epsilon(1e-5));
+      for (int i = 0; i < size.count(); ++i) {
+        REQUIRE(std::abs(softmax->cpu_data()[i] - probs->cpu_data()[i])
+            < 1e-6);
+        REQUIRE(std::abs(fused_diff->cpu_data()[i] - (add ? diff_before[i] : 0)
+              - diff->cpu_data()[i]) < 1e-6);
+      }
+    }
+  }
+}
+
+TEST_CASE("AccuracyTies", "[Accuracy]") {
+  // against partial_sort of (score, class) pairs, on rows full of ties
+  Size size = { 6, 7, 1, 1 };
+  int dim = size.channels();
+  shared_ptr<Tensor> bottom(new Tensor(current_rank(), -1, size));
+  shared_ptr<Tensor> label(new Tensor(current_rank(), -1,
+        { size.num(), 1, 1, 1 }));
+  DTYPE* data = bottom->mutable_cpu_data();
+  for (int i = 0; i < size.count(); ++i) {
+    data[i] = (i * 5 + i / dim) % 3;
+  }
+  for (int i = 0; i < size.num(); ++i) {
+    label->mutable_cpu_data()[i] = (i * 4) % dim;
+  }
+  for (int top_n = 1; top_n <= dim; ++top_n) {
+    int hits = 0;
+    for (int i = 0; i < size.num(); ++i) {
+      vector<std::pair<DTYPE, int> > row;
+      for (int j = 0; j < dim; ++j) {
+        row.push_back(std::make_pair(data[i * dim + j], j));
+      }
+      std::partial_sort(row.begin(), row.begin() + top_n, row.end(),
+          std::greater<std::pair<DTYPE, int> >());
+      for (int k = 0; k < top_n; ++k) {
+        if (row[k].second == static_cast<int>(label->cpu_data()[i])) {
+          ++hits;
+          break;
+        }
+      }
+    }
+    shared_ptr<Tensor> accuracy(new Tensor(current_rank(), -1,
+          { 1, 1, 1, 1 }));
+    Accuracy({ bottom.get(), label.get() }, { accuracy.get() },
+        Accuracy::param_tuple(top_n)).compute_cpu({ false });
+    REQUIRE(accuracy->cpu_data()[0] == Approx(DTYPE(hits) / size.num()));
+  }
+}
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdlib.h>
 #include <algorithm>
 #include <string>
 #include <utility>
@@ -20,9 +21,21 @@ using boost::scoped_ptr;
 string data_path = "data/cifar-10/";
 string db_path = data_path + "cifar-10-train-lmdb";
 string save_path = data_path + "mean.binaryproto";
+// decode encoded datums in color, same as the color param of the reader
+bool color = true;
 
+// compute_image_mean [db_path [save_path [color]]], color 0 for grayscale
 int main(int argc, char** argv) {
     ::google::InitGoogleLogging(argv[0]);
+    if (argc > 1) {
+        db_path = argv[1];
+    }
+    if (argc > 2) {
+        save_path = argv[2];
+    }
+    if (argc > 3) {
+        color = atoi(argv[3]) != 0;
+    }
 
     // lmdb
     MDB_env *mdb_env;
@@ -54,11 +67,13 @@ int main(int argc, char** argv) {
 
     BlobProto sum_blob;
     Datum datum;
+    cv::Mat decode_buf;
     
     for(int item = 0; item < db_size; item++){
         CHECK_EQ(mdb_cursor_get(mdb_cursor, &mdb_key, &mdb_value, MDB_GET_CURRENT), MDB_SUCCESS) 
             << "mdb_cursor_get failed";
         datum.ParseFromArray(mdb_value.mv_data, mdb_value.mv_size);
+        CHECK(caffe::DecodeDatumInPlace(&datum, color, &decode_buf));
         const string& data = datum.data();
 
         const int data_size = datum.channels() * datum.height() * datum.width();
@@ -0,0 +1,68 @@
+// Copyright Lin Min 2015
+// predict the iteration time of data parallel GoogLeNet for candidate
+// parallel_config files, without the cluster.
+//   PURINE_TRACE=prof mpirun -np 4 googlenet_timing  (writes prof_*.profile)
+//   plan_parallel prof_128.rank0.profile config_a config_b ...
+// a config has one "rank device batch_size" line per replica, like
+// parallel_config. the profile of one rank covers the ops of all replicas
+// since the costs are keyed without the replica name.
+
+#include <mpi.h>
+#include <cstdio>
+#include <glog/logging.h>
+#include "examples/googlenet.hpp"
+#include "composite/graph/all_reduce.hpp"
+#include "dispatch/simulator.hpp"
+
+int batch_size = 128;
+string source = "";
+string mean_file = "";
+
+using namespace purine;
+
+vector<vector<int> > read_config(const string& filename) {
+    FILE* file = fopen(filename.c_str(), "r");
+    CHECK(file) << "can not open " << filename;
+    vector<vector<int> > parallels;
+    int rank, device, batch;
+    while (fscanf(file, "%d %d %d", &rank, &device, &batch) == 3) {
+        parallels.push_back({ rank, device, batch });
+    }
+    fclose(file);
+    return parallels;
+}
+
+int main(int argc, char** argv) {
+    google::InitGoogleLogging(argv[0]);
+    int ret;
+    MPI_CHECK(MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &ret));
+    CHECK_GE(argc, 3) << "usage: plan_parallel profile config [config ...]";
+    Simulator::Profile profile;
+    profile.load(argv[1]);
+    string best;
+    double best_throughput = 0;
+    for (int i = 2; i < argc; ++i) {
+        vector<vector<int> > parallels = read_config(argv[i]);
+        int samples = 0;
+        for (const vector<int>& p : parallels) {
+            samples += p[2];
+        }
+        DataParallel<GoogLeNet<false>, AllReduce> net(parallels);
+        vector<AllReduce::param_tuple> param(116,
+                AllReduce::param_tuple(0.9, 0.01, 0.));
+        net.setup_param_server(vector<int>(116, 0), vector<int>(116, -1),
+                param);
+        Simulator::Result result = Simulator(&net, profile).run();
+        double throughput = samples * 1e6 / result.iteration;
+        LOG(INFO) << argv[i] << ": " << parallels.size() << " replicas, "
+            << samples << " images, " << throughput << " images/s\n"
+            << Simulator::report(result);
+        if (throughput > best_throughput) {
+            best_throughput = throughput;
+            best = argv[i];
+        }
+    }
+    LOG(INFO) << "best: " << best << " " << best_throughput << " images/s";
+    MPI_CHECK(MPI_Finalize());
+    return 0;
+}